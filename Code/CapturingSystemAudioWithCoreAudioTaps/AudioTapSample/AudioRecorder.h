@@ -12,14 +12,115 @@ A class that provides functions for running IO on an audio device, recording aud
 #include <CoreAudio/CoreAudio.h>
 #include <AudioToolbox/ExtendedAudioFile.h>
 
+// How a captured stream's ring is keeping up with the writer thread.
+@interface CaptureStreamStatistics : NSObject
+
+// The frames waiting in the ring, and the most it holds.
+@property (nonatomic) NSUInteger fillFrames;
+@property (nonatomic) NSUInteger capacityFrames;
+@property (nonatomic) uint64_t capturedFrames;
+// Frames the I/O thread couldn't fit in the ring because the writer thread fell behind.
+@property (nonatomic) uint64_t droppedFrames;
+@property (nonatomic) uint64_t writtenFrames;
+
+@end
+
+// How well a compressed recording is shrinking its streams, and what it costs.
+@interface CaptureCompressionStatistics : NSObject
+
+@property (nonatomic) uint64_t rawBytes;
+@property (nonatomic) uint64_t encodedBytes;
+// Raw bytes per encoded byte.
+@property (nonatomic) double compressionRatio;
+// The CPU time the encoder workers have spent, summed across workers.
+@property (nonatomic) double encoderSeconds;
+
+@end
+
+// The newest meter readings of an input stream.
+@interface CaptureStreamAnalysis : NSObject
+
+// The peak and RMS level of each channel over the last analysis interval, in dBFS.
+@property (copy, nonatomic) NSArray<NSNumber*>* peakLevels;
+@property (copy, nonatomic) NSArray<NSNumber*>* rmsLevels;
+// EBU R128 loudness in LUFS, or negative infinity until there's enough audio to measure.
+@property (nonatomic) double momentaryLoudness;
+@property (nonatomic) double shortTermLoudness;
+@property (nonatomic) double integratedLoudness;
+// The strongest level in each spectrum band, in dBFS, and the lowest frequency of each band, in Hz.
+@property (copy, nonatomic) NSArray<NSNumber*>* spectrum;
+@property (copy, nonatomic) NSArray<NSNumber*>* bandFrequencies;
+// Frames the meters missed because their worker fell behind.
+@property (nonatomic) uint64_t droppedFrames;
+
+@end
+
+// How a stream of an aligned recording is following the reference device's clock.
+@interface CaptureClockStatistics : NSObject
+
+// The stream's sample rate as measured against the host clock.
+@property (nonatomic) double sampleRate;
+// How far the aligner has moved the stream's resampling ratio from the ratio of the measured rates, in parts per million.
+@property (nonatomic) double correction;
+// How far the stream trails the reference, in frames of the stream.
+@property (nonatomic) double alignmentError;
+@property (nonatomic) bool aligned;
+@property (nonatomic) uint64_t droppedFrames;
+// The times the stream lost its place, as after dropping frames, and joined the recording again.
+@property (nonatomic) uint64_t realignmentCount;
+
+@end
+
 // You implement the `AudioRecorder` class in Objective-C++ because Swift doesn't have the real-time safety required to run an audio IO proc.
 @interface AudioRecorder : NSObject
 
 @property (readwrite, nonatomic) AudioObjectID deviceID;
 @property (readwrite, atomic) bool recordingEnabled;
 @property (readwrite, atomic) bool loopbackEnabled;
+// For each output channel, counted across all output streams, the input channel that loopback plays on it, or -1 for silence.
+// Leave it empty to send each input stream to the output stream with the same index.
+@property (copy, readwrite, nonatomic) NSArray<NSNumber*>* loopbackChannelMap;
+// Records every input stream into one chunked container file instead of a file per stream. Takes effect at the next recording.
+@property (readwrite, atomic) bool containerEnabled;
+// Records each input stream losslessly compressed, into a `.tapz` file, instead of an uncompressed CAF file.
+// Takes effect at the next recording, unless `containerEnabled` is on.
+@property (readwrite, atomic) bool compressionEnabled;
+// Records each input stream into a series of preallocated CAF files, starting a new one after `segmentSeconds` of audio
+// or `segmentBytes` of file, whichever comes first, and lists them in a JSON manifest. A limit of 0 doesn't apply;
+// with both at 0, recordings aren't segmented. Takes effect at the next recording, unless `containerEnabled` or
+// `compressionEnabled` is on.
+@property (readwrite, atomic) double segmentSeconds;
+@property (readwrite, atomic) uint64_t segmentBytes;
+// Keeps the last `preRollSeconds` of every input stream while I/O runs, so `commitPreRoll:` can record
+// from a moment that has passed. Runs I/O on its own when it's above 0. Changing it restarts I/O.
+@property (readwrite, atomic) double preRollSeconds;
+// Meters each input stream's levels, loudness, and spectrum on a worker thread while I/O runs.
+@property (readwrite, atomic) bool meteringEnabled;
 @property (strong, readonly, nonatomic) NSURL* recordingURL;
 
+// Starts recording with up to `seconds` of the pre-roll history, without restarting I/O, and sets `recordingEnabled`.
+// Returns false if `preRollSeconds` is 0 or the recording files can't be made.
+-(bool) commitPreRoll: (double)seconds;
+
+// A snapshot of each input stream's capture statistics. Safe to call while recording.
+-(NSArray<CaptureStreamStatistics*>*) streamStatistics;
+
+// The newest meter readings of each input stream, or an empty array if metering is off. Call from the main thread.
+-(NSArray<CaptureStreamAnalysis*>*) streamAnalysis;
+
+// The compression statistics of the current or last compressed recording, or `nil` if there hasn't been one.
+-(CaptureCompressionStatistics*) compressionStatistics;
+
+// Records every input stream of each device in `deviceIDs`, each device running on its own clock, into one container
+// file whose streams line up frame for frame. The first device's clock is the reference, and the other devices' streams
+// are resampled to follow it. Runs alongside `deviceID` and its recording. Returns false if an aligned recording is
+// already running, or a device can't start.
+-(bool) startAlignedRecordingWithDevices: (NSArray<NSNumber*>*)deviceIDs;
+-(void) stopAlignedRecording;
+
+// How each stream of the aligned recording is following the reference clock, or an empty array if none is running.
+-(NSArray<CaptureClockStatistics*>*) clockStatistics;
+
 @end
 
 #endif /* AudioRecorder_h */
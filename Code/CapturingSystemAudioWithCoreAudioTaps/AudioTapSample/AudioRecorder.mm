@@ -6,14 +6,111 @@ A class that provides functions for running IO on an audio device, recording aud
 */
 
 #include "AudioRecorder.h"
+#include "CaptureAnalyzer.hpp"
+#include "CaptureContainer.hpp"
+#include "CaptureEngine.hpp"
+#include "ClockAligner.hpp"
+#include "CompressedRecording.hpp"
+#include "SegmentedRecording.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
 #include <vector>
 
+// The I/O proc hands the device's buffers to the capture engine as they are.
+static_assert(sizeof(CaptureBuffer) == sizeof(AudioBuffer) &&
+              offsetof(CaptureBuffer, byteSize) == offsetof(AudioBuffer, mDataByteSize) &&
+              offsetof(CaptureBuffer, data) == offsetof(AudioBuffer, mData),
+              "CaptureBuffer must match the layout of AudioBuffer");
+
+// How much audio each stream's ring holds, which is how long the writer thread can stall before frames drop.
+constexpr double kCaptureRingSeconds = 2.0;
+
+// The loopback converter's buffer size when the device doesn't report its largest I/O cycle.
+constexpr UInt32 kDefaultMaxFramesPerCycle = 4096;
+
 constexpr AudioObjectPropertyAddress PropertyAddress(AudioObjectPropertySelector selector,
                                                      AudioObjectPropertyScope scope = kAudioObjectPropertyScopeGlobal,
                                                      AudioObjectPropertyElement element = kAudioObjectPropertyElementMain) noexcept {
     return {selector, scope, element};
 }
 
+// Describes a device stream for the portable capture classes, including the sample formats the loopback converter handles.
+static CaptureStreamFormat MakeCaptureStreamFormat(const AudioStreamBasicDescription& format) noexcept {
+    CaptureStreamFormat captureFormat{format.mSampleRate, format.mChannelsPerFrame, format.mBytesPerFrame};
+    const auto bytesPerSample = (format.mChannelsPerFrame != 0) ? format.mBytesPerFrame / format.mChannelsPerFrame : 0;
+    if (format.mFormatID != kAudioFormatLinearPCM || (format.mFormatFlags & kAudioFormatFlagIsBigEndian) != 0) {
+        return captureFormat;
+    }
+    if ((format.mFormatFlags & kAudioFormatFlagIsFloat) != 0) {
+        if (format.mBitsPerChannel == 32 && bytesPerSample == 4) {
+            captureFormat.sampleFormat = CaptureSampleFormat::float32;
+        }
+        else if (format.mBitsPerChannel == 64 && bytesPerSample == 8) {
+            captureFormat.sampleFormat = CaptureSampleFormat::float64;
+        }
+    }
+    else if ((format.mFormatFlags & kAudioFormatFlagIsSignedInteger) != 0) {
+        const bool alignedHigh = (format.mFormatFlags & kAudioFormatFlagIsAlignedHigh) != 0 || format.mBitsPerChannel == bytesPerSample * 8;
+        if (format.mBitsPerChannel == 16 && bytesPerSample == 2) {
+            captureFormat.sampleFormat = CaptureSampleFormat::int16;
+        }
+        else if (format.mBitsPerChannel == 24 && bytesPerSample == 3) {
+            captureFormat.sampleFormat = CaptureSampleFormat::int24;
+        }
+        else if (format.mBitsPerChannel <= 32 && bytesPerSample == 4 && alignedHigh) {
+            captureFormat.sampleFormat = CaptureSampleFormat::int32;
+        }
+    }
+    return captureFormat;
+}
+
+// Returns the path for a recording file named `name` in the app's folder in `Music`.
+static NSString* RecordingPath(NSURL* musicURL, NSString* name) {
+    auto* path = [NSString stringWithFormat: @"%s/AudioTapSample/%@", musicURL.fileSystemRepresentation, name];
+    if (access([path UTF8String], R_OK | W_OK) != 0) {
+        // If unable to access the `Music` directory, use `TMPDIR` instead.
+        auto tmp = getenv("TMPDIR");
+        path = [NSString stringWithFormat: @"%s%@", tmp, name];
+    }
+    return path;
+}
+
+// Returns the current date and time in a form that suits a file name.
+static NSString* RecordingDateString() {
+    auto dateString = NSDate.now.description;
+    dateString = [dateString stringByReplacingOccurrencesOfString:@" " withString:@"_"];
+    dateString = [dateString stringByReplacingOccurrencesOfString:@":" withString:@"-"];
+    dateString = [dateString stringByReplacingOccurrencesOfString:@"+" withString:@""];
+    return dateString;
+}
+
+// Gets the formats of a device's input streams, in the order the I/O proc receives their buffers.
+static std::vector<AudioStreamBasicDescription> InputStreamFormats(AudioObjectID deviceID) {
+    std::vector<AudioStreamBasicDescription> formats;
+    UInt32 size = 0;
+    auto address = PropertyAddress(kAudioDevicePropertyStreams, kAudioObjectPropertyScopeInput);
+    if (AudioObjectGetPropertyDataSize(deviceID, &address, 0, nullptr, &size) != kAudioHardwareNoError) {
+        return formats;
+    }
+    std::vector<AudioObjectID> streamList(size / sizeof(AudioObjectID));
+    if (streamList.empty() || AudioObjectGetPropertyData(deviceID, &address, 0, nullptr, &size, streamList.data()) != kAudioHardwareNoError) {
+        return formats;
+    }
+    streamList.resize(size / sizeof(AudioObjectID));
+    for (auto streamID : streamList) {
+        auto formatAddress = PropertyAddress(kAudioStreamPropertyVirtualFormat);
+        AudioStreamBasicDescription format;
+        size = sizeof(AudioStreamBasicDescription);
+        memset(&format, 0, size);
+        AudioObjectGetPropertyData(streamID, &formatAddress, 0, nullptr, &size, &format);
+        // Keep a stream without a format, so the others keep their places; the aligner rejects it.
+        formats.push_back(format);
+    }
+    return formats;
+}
+
 enum class StreamDirection : UInt32 {
     output,
     input
@@ -29,12 +126,79 @@ static OSStatus ioproc(AudioObjectID,
                        const AudioTimeStamp*,
                        void* inClientData) noexcept;
 
+static OSStatus alignedIOProc(AudioObjectID,
+                              const AudioTimeStamp*,
+                              const AudioBufferList* inInputData,
+                              const AudioTimeStamp* inInputTime,
+                              AudioBufferList*,
+                              const AudioTimeStamp*,
+                              void* inClientData) noexcept;
+
+// A device of an aligned recording, and where its input streams fall among the aligner's streams.
+struct AlignedDevice {
+    AudioObjectID deviceID = kAudioObjectUnknown;
+    AudioDeviceIOProcID IOProcID = nullptr;
+    ClockAligner* aligner = nullptr;
+    uint32_t firstStream = 0;
+    uint32_t streamCount = 0;
+};
+
+// Writes each captured stream to its own file on the capture engine's writer thread.
+class ExtAudioFileSink final : public CaptureSink {
+public:
+    ExtAudioFileSink(std::vector<ExtAudioFileRef> files, std::vector<AudioStreamBasicDescription> formats)
+        : mFiles(std::move(files)), mFormats(std::move(formats)) {}
+
+    ~ExtAudioFileSink() override {
+        for (auto file : mFiles) {
+            ExtAudioFileDispose(file);
+        }
+    }
+
+    bool write(uint32_t stream, const void* data, uint32_t frameCount) override {
+        if (stream >= mFiles.size()) {
+            return false;
+        }
+        const auto& format = mFormats[stream];
+        AudioBufferList writeData;
+        writeData.mNumberBuffers = 1;
+        writeData.mBuffers[0].mNumberChannels = format.mChannelsPerFrame;
+        writeData.mBuffers[0].mDataByteSize = frameCount * format.mBytesPerFrame;
+        writeData.mBuffers[0].mData = const_cast<void*>(data);
+        return ExtAudioFileWrite(mFiles[stream], frameCount, &writeData) == noErr;
+    }
+
+private:
+    std::vector<ExtAudioFileRef> mFiles;
+    std::vector<AudioStreamBasicDescription> mFormats;
+};
+
+@implementation CaptureStreamStatistics
+@end
+
+@implementation CaptureCompressionStatistics
+@end
+
+@implementation CaptureStreamAnalysis
+@end
+
+@implementation CaptureClockStatistics
+@end
+
 @interface AudioRecorder ()
 
 @property (readwrite, nonatomic) std::shared_ptr<std::vector<AudioStreamBasicDescription>> inputStreamList;
 @property (readwrite, nonatomic) std::shared_ptr<std::vector<AudioStreamBasicDescription>> outputStreamList;
+// The stream object of each entry in the stream lists, so a catalog only asks new streams for their formats.
+@property (readwrite, nonatomic) std::shared_ptr<std::vector<AudioObjectID>> inputStreamIDs;
+@property (readwrite, nonatomic) std::shared_ptr<std::vector<AudioObjectID>> outputStreamIDs;
 @property (strong, readwrite, nonatomic) NSURL* recordingURL;
-@property (readwrite, nonatomic) std::shared_ptr<std::vector<ExtAudioFileRef>> fileList;
+@property (readwrite, nonatomic) std::shared_ptr<CaptureEngine> captureEngine;
+@property (readwrite, nonatomic) std::shared_ptr<CompressedRecording::Statistics> compressionCounters;
+@property (readwrite, nonatomic) std::shared_ptr<SegmentedRecording::Statistics> segmentCounters;
+@property (readwrite, nonatomic) std::shared_ptr<CaptureAnalyzer> analyzer;
+@property (readwrite, nonatomic) std::shared_ptr<ClockAligner> clockAligner;
+@property (readwrite, nonatomic) std::shared_ptr<std::vector<AlignedDevice>> alignedDevices;
 @property (readwrite, nonatomic) AudioDeviceIOProcID IOProcID;
 
 @end
@@ -44,10 +208,24 @@ static OSStatus ioproc(AudioObjectID,
 @synthesize deviceID = _deviceID;
 @synthesize inputStreamList = _inputStreamList;
 @synthesize outputStreamList = _outputStreamList;
+@synthesize inputStreamIDs = _inputStreamIDs;
+@synthesize outputStreamIDs = _outputStreamIDs;
 @synthesize recordingEnabled = _recordingEnabled;
 @synthesize loopbackEnabled = _loopbackEnabled;
+@synthesize loopbackChannelMap = _loopbackChannelMap;
+@synthesize containerEnabled = _containerEnabled;
+@synthesize compressionEnabled = _compressionEnabled;
+@synthesize segmentSeconds = _segmentSeconds;
+@synthesize segmentBytes = _segmentBytes;
+@synthesize preRollSeconds = _preRollSeconds;
+@synthesize meteringEnabled = _meteringEnabled;
 @synthesize recordingURL = _recordingURL;
-@synthesize fileList = _fileList;
+@synthesize captureEngine = _captureEngine;
+@synthesize compressionCounters = _compressionCounters;
+@synthesize segmentCounters = _segmentCounters;
+@synthesize analyzer = _analyzer;
+@synthesize clockAligner = _clockAligner;
+@synthesize alignedDevices = _alignedDevices;
 @synthesize IOProcID = _IOProcID;
 
 -(id) init {
@@ -59,7 +237,9 @@ static OSStatus ioproc(AudioObjectID,
     _deviceID = kAudioObjectUnknown;
     _inputStreamList = std::make_shared<std::vector<AudioStreamBasicDescription>>();
     _outputStreamList = std::make_shared<std::vector<AudioStreamBasicDescription>>();
-    _fileList = std::make_shared<std::vector<ExtAudioFileRef>>();
+    _inputStreamIDs = std::make_shared<std::vector<AudioObjectID>>();
+    _outputStreamIDs = std::make_shared<std::vector<AudioObjectID>>();
+    _captureEngine = std::make_shared<CaptureEngine>();
     _recordingEnabled = false;
     
     return self;
@@ -82,15 +262,14 @@ static OSStatus ioproc(AudioObjectID,
     }
     _recordingEnabled = enabled;
     if (enabled) {
-        if (_loopbackEnabled) {
-            [self stopIO];
-        }
-        if (![self startRecording]) {
+        // If loopback or the pre-roll already runs I/O, start writing without restarting it.
+        const bool started = (self.IOProcID != nullptr) ? [self makeRecordingFiles] : [self startRecording];
+        if (!started) {
             _recordingEnabled = false;
         }
     }
     else {
-        if (_loopbackEnabled) {
+        if (_loopbackEnabled || _preRollSeconds > 0) {
             [self cleanUpRecordingFiles];
         }
         else {
@@ -108,12 +287,14 @@ static OSStatus ioproc(AudioObjectID,
         return;
     }
     _loopbackEnabled = enabled;
-    if (_recordingEnabled) {
+    self.captureEngine->setLoopbackEnabled(enabled);
+    if (_recordingEnabled || _preRollSeconds > 0) {
         return;
     }
     if (enabled) {
         if (![self startIO]) {
             _loopbackEnabled = false;
+            self.captureEngine->setLoopbackEnabled(false);
         }
     }
     else {
@@ -121,6 +302,56 @@ static OSStatus ioproc(AudioObjectID,
     }
 }
 
+-(double) preRollSeconds {
+    return _preRollSeconds;
+}
+
+-(void) setPreRollSeconds: (double)seconds {
+    seconds = std::max(seconds, 0.0);
+    if (_preRollSeconds == seconds) {
+        return;
+    }
+    _preRollSeconds = seconds;
+    // Rebuild the rings with room for the history, and start or stop I/O to match.
+    [self adaptToDevice: self.deviceID];
+}
+
+-(bool) commitPreRoll: (double)seconds {
+    if (_recordingEnabled) {
+        return true;
+    }
+    if (self.IOProcID == nullptr || !self.captureEngine->isHistoryEnabled()) {
+        return false;
+    }
+    if (![self makeRecordingFilesWithPreRoll: seconds]) {
+        return false;
+    }
+    _recordingEnabled = true;
+    return true;
+}
+
+-(bool) meteringEnabled {
+    return _meteringEnabled;
+}
+
+-(void) setMeteringEnabled: (bool)enabled {
+    if (_meteringEnabled == enabled) {
+        return;
+    }
+    _meteringEnabled = enabled;
+    [self configureMetering];
+}
+
+-(NSArray<NSNumber*>*) loopbackChannelMap {
+    return _loopbackChannelMap;
+}
+
+-(void) setLoopbackChannelMap: (NSArray<NSNumber*>*)channelMap {
+    _loopbackChannelMap = [channelMap copy];
+    // The capture engine takes up the new plan at the next I/O cycle, so I/O and any recording carry on.
+    [self configureLoopback];
+}
+
 -(BOOL) adaptToDevice: (AudioObjectID)deviceID {
     [self stopIO];
     [self unregisterListeners];
@@ -130,6 +361,12 @@ static OSStatus ioproc(AudioObjectID,
     _deviceID = deviceID;
 #pragma clang diagnostic pop
     
+    // A different device shares no streams with the last one, so start the catalog over.
+    self.inputStreamList = std::make_shared<std::vector<AudioStreamBasicDescription>>();
+    self.outputStreamList = std::make_shared<std::vector<AudioStreamBasicDescription>>();
+    self.inputStreamIDs = std::make_shared<std::vector<AudioObjectID>>();
+    self.outputStreamIDs = std::make_shared<std::vector<AudioObjectID>>();
+    self.captureEngine->configure({}, kCaptureRingSeconds, self.preRollSeconds);
     [self catalogDeviceStreams];
     [self registerListeners];
     
@@ -138,56 +375,147 @@ static OSStatus ioproc(AudioObjectID,
         if (self.recordingEnabled) {
             answer = [self startRecording];
         }
-        else if (self.loopbackEnabled) {
+        else if (self.loopbackEnabled || self.preRollSeconds > 0) {
             answer = [self startIO];
         }
     }
     return answer;
 }
 
+// Brings the stream lists up to date with the device, and changes only the capture streams that
+// came, went, or changed format, so I/O and any recording carry on in the streams the device still has.
 -(void) catalogDeviceStreams {
-    self.inputStreamList->clear();
-    self.outputStreamList->clear();
-
-    if (self.deviceID == kAudioObjectUnknown) {
-        return;
-    }
-
     // Get the stream list from the device.
-    UInt32 size = 0;
-    AudioObjectPropertyAddress address = PropertyAddress(kAudioDevicePropertyStreams);
-    OSStatus error = AudioObjectGetPropertyDataSize(self.deviceID, &address, 0, nullptr, &size);
-    auto streamCount = size / sizeof(AudioObjectID);
-    if (error != kAudioHardwareNoError || streamCount == 0) {
-        return;
-    }
-    std::vector<AudioObjectID> streamList(streamCount);
-    error = AudioObjectGetPropertyData(self.deviceID, &address, 0, nullptr, &size, streamList.data());
-    if (error != kAudioHardwareNoError) {
-        return;
+    std::vector<AudioObjectID> streamList;
+    if (self.deviceID != kAudioObjectUnknown) {
+        UInt32 size = 0;
+        auto address = PropertyAddress(kAudioDevicePropertyStreams);
+        OSStatus error = AudioObjectGetPropertyDataSize(self.deviceID, &address, 0, nullptr, &size);
+        streamList.resize(size / sizeof(AudioObjectID));
+        if (error == kAudioHardwareNoError && !streamList.empty()) {
+            error = AudioObjectGetPropertyData(self.deviceID, &address, 0, nullptr, &size, streamList.data());
+        }
+        streamList.resize((error == kAudioHardwareNoError) ? size / sizeof(AudioObjectID) : 0);
     }
     
-    streamList.resize(size / sizeof(AudioObjectID));
+    auto inputStreamList = std::make_shared<std::vector<AudioStreamBasicDescription>>();
+    auto outputStreamList = std::make_shared<std::vector<AudioStreamBasicDescription>>();
+    auto inputStreamIDs = std::make_shared<std::vector<AudioObjectID>>();
+    auto outputStreamIDs = std::make_shared<std::vector<AudioObjectID>>();
+    // For each input stream, the index of the capture stream it continues, or -1 if it's new.
+    std::vector<int32_t> previousStreams;
+    bool formatsChanged = false;
     for (auto streamID : streamList) {
-        // Get the format of each stream.
-        address = PropertyAddress(kAudioStreamPropertyVirtualFormat);
+        // Read every stream's format each time, since a stream the last catalog found may have
+        // changed its rate or layout along with the device.
+        auto address = PropertyAddress(kAudioStreamPropertyVirtualFormat);
         AudioStreamBasicDescription format;
-        size = sizeof(AudioStreamBasicDescription);
+        UInt32 size = sizeof(AudioStreamBasicDescription);
         memset(&format, 0, size);
-        error = AudioObjectGetPropertyData(streamID, &address, 0, nullptr, &size, &format);
-        if (error == kAudioHardwareNoError) {
-            address = PropertyAddress(kAudioStreamPropertyDirection);
-            StreamDirection direction = StreamDirection::output;
-            size = sizeof(UInt32);
-            AudioObjectGetPropertyData(streamID, &address, 0, nullptr, &size, &direction);
-            if (direction == StreamDirection::output) {
-                self.outputStreamList->push_back(format);
-            }
-            else {
-                self.inputStreamList->push_back(format);
-            }
+        if (AudioObjectGetPropertyData(streamID, &address, 0, nullptr, &size, &format) != kAudioHardwareNoError) {
+            continue;
+        }
+        
+        // A stream the last catalog found keeps its direction, and its capture stream if its format held.
+        auto knownInput = std::find(self.inputStreamIDs->begin(), self.inputStreamIDs->end(), streamID);
+        if (knownInput != self.inputStreamIDs->end()) {
+            const auto index = knownInput - self.inputStreamIDs->begin();
+            const bool sameFormat = memcmp(&self.inputStreamList->at(size_t(index)), &format, sizeof(format)) == 0;
+            formatsChanged = formatsChanged || !sameFormat;
+            inputStreamList->push_back(format);
+            inputStreamIDs->push_back(streamID);
+            previousStreams.push_back(sameFormat ? int32_t(index) : -1);
+            continue;
+        }
+        auto knownOutput = std::find(self.outputStreamIDs->begin(), self.outputStreamIDs->end(), streamID);
+        if (knownOutput != self.outputStreamIDs->end()) {
+            outputStreamList->push_back(format);
+            outputStreamIDs->push_back(streamID);
+            continue;
         }
+        
+        // Get the direction of each new stream.
+        address = PropertyAddress(kAudioStreamPropertyDirection);
+        StreamDirection direction = StreamDirection::output;
+        size = sizeof(UInt32);
+        AudioObjectGetPropertyData(streamID, &address, 0, nullptr, &size, &direction);
+        if (direction == StreamDirection::output) {
+            outputStreamList->push_back(format);
+            outputStreamIDs->push_back(streamID);
+        }
+        else {
+            inputStreamList->push_back(format);
+            inputStreamIDs->push_back(streamID);
+            previousStreams.push_back(-1);
+        }
+    }
+    
+    const bool inputsChanged = formatsChanged || (*inputStreamIDs != *self.inputStreamIDs);
+    const auto keptStreams = std::count_if(previousStreams.begin(), previousStreams.end(), [](int32_t previous) { return previous >= 0; });
+    const auto newStreams = long(previousStreams.size()) - long(keptStreams);
+    if (inputsChanged) {
+        NSLog(@"Input streams changed: %ld kept, %ld added or changed format, %ld removed",
+              long(keptStreams), newStreams, long(self.inputStreamIDs->size()) - long(keptStreams));
+    }
+    if (inputsChanged && newStreams > 0 && self.captureEngine->isRecording()) {
+        // The recording's files were made for the streams it started with, so a new stream has nowhere to go until the next recording.
+        NSLog(@"Not recording %ld new input streams until the next recording", newStreams);
     }
+    self.inputStreamList = inputStreamList;
+    self.outputStreamList = outputStreamList;
+    self.inputStreamIDs = inputStreamIDs;
+    self.outputStreamIDs = outputStreamIDs;
+    
+    // Preallocate a ring for each new input stream, so the I/O proc only ever copies into memory it already has.
+    if (inputsChanged) {
+        std::vector<CaptureStreamFormat> captureFormats;
+        for (const auto& format : *inputStreamList) {
+            captureFormats.push_back(MakeCaptureStreamFormat(format));
+        }
+        self.captureEngine->reconfigure(captureFormats, previousStreams);
+        if (self.meteringEnabled) {
+            [self configureMetering];
+        }
+    }
+    [self configureLoopback];
+}
+
+-(void) configureMetering {
+    // Start a new analyzer for the current streams before the I/O thread can see it.
+    std::shared_ptr<CaptureAnalyzer> analyzer;
+    if (self.meteringEnabled) {
+        std::vector<CaptureStreamFormat> captureFormats;
+        for (const auto& format : *self.inputStreamList) {
+            captureFormats.push_back(MakeCaptureStreamFormat(format));
+        }
+        analyzer = std::make_shared<CaptureAnalyzer>();
+        analyzer->start(captureFormats);
+    }
+    self.captureEngine->setAnalyzer(analyzer);
+    self.analyzer = analyzer;
+}
+
+-(void) configureLoopback {
+    std::vector<CaptureStreamFormat> outputFormats;
+    for (const auto& format : *self.outputStreamList) {
+        outputFormats.push_back(MakeCaptureStreamFormat(format));
+    }
+    LoopbackConverter::ChannelMap channelMap;
+    for (NSNumber* channel in self.loopbackChannelMap) {
+        channelMap.push_back(channel.intValue);
+    }
+    
+    // Size the converter's buffers for the largest I/O cycle the device allows.
+    AudioValueRange bufferFrameSizeRange{0, 0};
+    UInt32 size = sizeof(AudioValueRange);
+    auto address = PropertyAddress(kAudioDevicePropertyBufferFrameSizeRange);
+    UInt32 maxFramesPerCycle = kDefaultMaxFramesPerCycle;
+    if (self.deviceID != kAudioObjectUnknown &&
+        AudioObjectGetPropertyData(self.deviceID, &address, 0, nullptr, &size, &bufferFrameSizeRange) == kAudioHardwareNoError &&
+        bufferFrameSizeRange.mMaximum >= 1) {
+        maxFramesPerCycle = UInt32(bufferFrameSizeRange.mMaximum);
+    }
+    self.captureEngine->configureLoopback(outputFormats, channelMap, maxFramesPerCycle);
 }
 
 -(bool) startRecording {
@@ -204,14 +532,18 @@ static OSStatus ioproc(AudioObjectID,
 -(bool) startIO {
     NSLog(@"Starting IO");
     AudioDeviceIOProcID ioProcID = nullptr;
-    auto error = AudioDeviceCreateIOProcID(self.deviceID, ioproc, (__bridge void*)self, &ioProcID);
+    // Pass the capture engine rather than `self`, so the I/O proc never sends an Objective-C message.
+    auto error = AudioDeviceCreateIOProcID(self.deviceID, ioproc, self.captureEngine.get(), &ioProcID);
     if (error != kAudioHardwareNoError) {
         return false;
     }
     self.IOProcID = ioProcID;
+    // Keep the pre-roll history from the first I/O cycle.
+    self.captureEngine->setHistoryEnabled(self.preRollSeconds > 0);
     
     error = AudioDeviceStart(self.deviceID, self.IOProcID);
     if (error != kAudioHardwareNoError) {
+        self.captureEngine->setHistoryEnabled(false);
         AudioDeviceDestroyIOProcID(self.deviceID, self.IOProcID);
         self.IOProcID = nullptr;
         return false;
@@ -225,6 +557,7 @@ static OSStatus ioproc(AudioObjectID,
     AudioDeviceDestroyIOProcID(self.deviceID, self.IOProcID);
     self.IOProcID = nullptr;
     [self cleanUpRecordingFiles];
+    self.captureEngine->setHistoryEnabled(false);
 }
 
 -(void) registerListeners {
@@ -235,6 +568,10 @@ static OSStatus ioproc(AudioObjectID,
         AudioObjectAddPropertyListener(self.deviceID, &address, deviceChangedListener, (__bridge void*)self);
         address = PropertyAddress(kAudioAggregateDevicePropertyTapList);
         AudioObjectAddPropertyListener(self.deviceID, &address, deviceChangedListener, (__bridge void*)self);
+        address = PropertyAddress(kAudioDevicePropertyStreamConfiguration, kAudioObjectPropertyScopeWildcard);
+        AudioObjectAddPropertyListener(self.deviceID, &address, deviceChangedListener, (__bridge void*)self);
+        address = PropertyAddress(kAudioDevicePropertyNominalSampleRate);
+        AudioObjectAddPropertyListener(self.deviceID, &address, deviceChangedListener, (__bridge void*)self);
     }
 }
 
@@ -246,10 +583,18 @@ static OSStatus ioproc(AudioObjectID,
         AudioObjectRemovePropertyListener(self.deviceID, &address, deviceChangedListener, (__bridge void*)self);
         address = PropertyAddress(kAudioAggregateDevicePropertyTapList);
         AudioObjectRemovePropertyListener(self.deviceID, &address, deviceChangedListener, (__bridge void*)self);
+        address = PropertyAddress(kAudioDevicePropertyStreamConfiguration, kAudioObjectPropertyScopeWildcard);
+        AudioObjectRemovePropertyListener(self.deviceID, &address, deviceChangedListener, (__bridge void*)self);
+        address = PropertyAddress(kAudioDevicePropertyNominalSampleRate);
+        AudioObjectRemovePropertyListener(self.deviceID, &address, deviceChangedListener, (__bridge void*)self);
     }
 }
 
 -(bool) makeRecordingFiles {
+    return [self makeRecordingFilesWithPreRoll: 0];
+}
+
+-(bool) makeRecordingFilesWithPreRoll: (double)preRollSeconds {
     // Return if there are no input streams to record from.
     if (self.inputStreamList->size() == 0) {
         return false;
@@ -261,23 +606,73 @@ static OSStatus ioproc(AudioObjectID,
                                                  appropriateForURL: nullptr
                                                             create: YES 
                                                              error: nullptr];
-    auto* dateFormatter = [[NSDateFormatter alloc] init];
-    dateFormatter.dateStyle = NSDateFormatterMediumStyle;
-    dateFormatter.timeStyle = NSDateFormatterShortStyle;
-    auto dateString = NSDate.now.description;
-    dateString = [dateString stringByReplacingOccurrencesOfString:@" " withString:@"_"];
-    dateString = [dateString stringByReplacingOccurrencesOfString:@":" withString:@"-"];
-    dateString = [dateString stringByReplacingOccurrencesOfString:@"+" withString:@""];
+    auto* dateString = RecordingDateString();
     
     auto streamFormats = self.inputStreamList;
-    auto files = self.fileList;
-    for (unsigned index = 0; index < streamFormats->size(); ++index) {
-        auto* path = [NSString stringWithFormat: @"%s/AudioTapSample/Rec-%@-Stream_%d.caf", musicURL.fileSystemRepresentation, dateString, index];
-        if (access([path UTF8String], R_OK | W_OK) != 0) {
-            // If unable to access the `Music` directory, use `TMPDIR` instead.
-            auto tmp = getenv("TMPDIR");
-            path = [NSString stringWithFormat: @"%sRec-%@-Stream_%d.caf", tmp, dateString, index];
+    if (self.containerEnabled) {
+        auto* path = RecordingPath(musicURL, [NSString stringWithFormat: @"Rec-%@.tapc", dateString]);
+        std::vector<CaptureStreamFormat> captureFormats;
+        for (const auto& format : *streamFormats) {
+            captureFormats.push_back(MakeCaptureStreamFormat(format));
         }
+        auto writer = std::make_unique<CaptureContainerWriter>();
+        if (!writer->open(path.UTF8String, captureFormats)) {
+            return false;
+        }
+        self.recordingURL = [NSURL fileURLWithPath: path];
+        
+        // The writer thread fills the container's chunks, and the writer finishes the file when recording stops.
+        self.captureEngine->startRecording(std::move(writer), preRollSeconds);
+        return true;
+    }
+    
+    if (self.compressionEnabled) {
+        std::vector<std::string> paths;
+        std::vector<CaptureStreamFormat> captureFormats;
+        for (unsigned index = 0; index < streamFormats->size(); ++index) {
+            auto* path = RecordingPath(musicURL, [NSString stringWithFormat: @"Rec-%@-Stream_%d.tapz", dateString, index]);
+            self.recordingURL = [NSURL fileURLWithPath: path];
+            paths.push_back(path.UTF8String);
+            captureFormats.push_back(MakeCaptureStreamFormat(streamFormats->at(index)));
+        }
+        auto counters = std::make_shared<CompressedRecording::Statistics>();
+        auto sink = std::make_unique<CompressingSink>();
+        if (!sink->open(paths, captureFormats, counters)) {
+            return false;
+        }
+        self.compressionCounters = counters;
+        
+        // The writer thread cuts the streams into blocks, and the sink's workers encode and write them.
+        self.captureEngine->startRecording(std::move(sink), preRollSeconds);
+        return true;
+    }
+    
+    if (self.segmentSeconds > 0 || self.segmentBytes > 0) {
+        std::vector<CaptureStreamFormat> captureFormats;
+        for (const auto& format : *streamFormats) {
+            captureFormats.push_back(MakeCaptureStreamFormat(format));
+        }
+        if (std::all_of(captureFormats.begin(), captureFormats.end(), IsSupportedFormat)) {
+            auto* path = RecordingPath(musicURL, [NSString stringWithFormat: @"Rec-%@", dateString]);
+            auto counters = std::make_shared<SegmentedRecording::Statistics>();
+            auto sink = std::make_unique<SegmentingSink>();
+            if (!sink->open(path.UTF8String, captureFormats, self.segmentSeconds, self.segmentBytes, counters)) {
+                return false;
+            }
+            self.recordingURL = [NSURL fileURLWithPath: @(sink->manifestPath().c_str())];
+            self.segmentCounters = counters;
+            
+            // The writer thread rolls the streams over to new segments, so the I/O thread never waits on a file.
+            self.captureEngine->startRecording(std::move(sink), preRollSeconds);
+            return true;
+        }
+        // The segments hold the captured samples as they are, so a format they can't describe records unsegmented.
+        NSLog(@"Recording without segments: an input stream's format can't be written to a segment");
+    }
+    
+    std::vector<ExtAudioFileRef> files;
+    for (unsigned index = 0; index < streamFormats->size(); ++index) {
+        auto* path = RecordingPath(musicURL, [NSString stringWithFormat: @"Rec-%@-Stream_%d.caf", dateString, index]);
 
         auto* url = [NSURL fileURLWithPath: path];
         self.recordingURL = url;
@@ -285,20 +680,205 @@ static OSStatus ioproc(AudioObjectID,
         ExtAudioFileRef file = nullptr;
         auto error = ExtAudioFileCreateWithURL((__bridge CFURLRef)url, kAudioFileCAFType, &format, nullptr, kAudioFileFlags_EraseFile, &file);
         if (error != 0) {
-            [self cleanUpRecordingFiles];
+            for (auto createdFile : files) {
+                ExtAudioFileDispose(createdFile);
+            }
             return false;
         }
-        files->push_back(file);
+        files.push_back(file);
     }
+    
+    // The writer thread owns the files from here, and disposes of them when recording stops.
+    self.captureEngine->startRecording(std::make_unique<ExtAudioFileSink>(std::move(files), *streamFormats), preRollSeconds);
     return true;
 }
 
 -(void) cleanUpRecordingFiles {
-    auto list = self.fileList;
-    for (auto file : *list) {
-        ExtAudioFileDispose(file);
+    const bool wasRecording = self.captureEngine->isRecording();
+    self.captureEngine->stopRecording();
+    
+    auto counters = self.compressionCounters;
+    if (wasRecording && counters != nullptr && counters->encodedBytes.load() > 0) {
+        NSLog(@"Compressed recording: %.3f:1, %.2f s of encoder CPU time",
+              double(counters->rawBytes.load()) / double(counters->encodedBytes.load()),
+              double(counters->encoderNanoseconds.load()) / 1e9);
+    }
+    auto segmentCounters = self.segmentCounters;
+    if (wasRecording && segmentCounters != nullptr) {
+        NSLog(@"Segmented recording: %llu segments, %.1f MB, longest write %.2f ms, %llu file errors",
+              segmentCounters->segmentCount.load(),
+              double(segmentCounters->bytesWritten.load()) / 1e6,
+              double(segmentCounters->longestWriteNanoseconds.load()) / 1e6,
+              segmentCounters->fileErrorCount.load());
+        self.segmentCounters = nullptr;
+    }
+}
+
+-(NSArray<CaptureStreamAnalysis*>*) streamAnalysis {
+    auto analyzer = self.analyzer;
+    if (analyzer == nullptr) {
+        return @[];
+    }
+    auto decibels = [](float level) {
+        return @((level > 0) ? 20 * std::log10(level) : -INFINITY);
+    };
+    const auto& snapshot = analyzer->latest();
+    auto streamFormats = self.inputStreamList;
+    auto* analysis = [NSMutableArray arrayWithCapacity: snapshot.streams.size()];
+    for (size_t stream = 0; stream < std::min(snapshot.streams.size(), streamFormats->size()); ++stream) {
+        const auto& streamAnalysis = snapshot.streams[stream];
+        auto* entry = [[CaptureStreamAnalysis alloc] init];
+        auto* peakLevels = [NSMutableArray arrayWithCapacity: streamAnalysis.peak.size()];
+        auto* rmsLevels = [NSMutableArray arrayWithCapacity: streamAnalysis.rms.size()];
+        for (size_t channel = 0; channel < streamAnalysis.peak.size(); ++channel) {
+            [peakLevels addObject: decibels(streamAnalysis.peak[channel])];
+            [rmsLevels addObject: decibels(streamAnalysis.rms[channel])];
+        }
+        auto* spectrum = [NSMutableArray arrayWithCapacity: streamAnalysis.spectrum.size()];
+        auto* bandFrequencies = [NSMutableArray arrayWithCapacity: streamAnalysis.spectrum.size()];
+        for (uint32_t band = 0; band < streamAnalysis.spectrum.size(); ++band) {
+            [spectrum addObject: @(streamAnalysis.spectrum[band])];
+            [bandFrequencies addObject: @(CaptureAnalyzer::bandFrequency(streamFormats->at(stream).mSampleRate, band))];
+        }
+        entry.peakLevels = peakLevels;
+        entry.rmsLevels = rmsLevels;
+        entry.momentaryLoudness = streamAnalysis.momentaryLoudness;
+        entry.shortTermLoudness = streamAnalysis.shortTermLoudness;
+        entry.integratedLoudness = streamAnalysis.integratedLoudness;
+        entry.spectrum = spectrum;
+        entry.bandFrequencies = bandFrequencies;
+        entry.droppedFrames = streamAnalysis.droppedFrames;
+        [analysis addObject: entry];
+    }
+    return analysis;
+}
+
+-(CaptureCompressionStatistics*) compressionStatistics {
+    auto counters = self.compressionCounters;
+    if (counters == nullptr) {
+        return nil;
+    }
+    auto* statistics = [[CaptureCompressionStatistics alloc] init];
+    statistics.rawBytes = counters->rawBytes.load(std::memory_order_relaxed);
+    statistics.encodedBytes = counters->encodedBytes.load(std::memory_order_relaxed);
+    statistics.compressionRatio = (statistics.encodedBytes > 0) ? double(statistics.rawBytes) / double(statistics.encodedBytes) : 0;
+    statistics.encoderSeconds = double(counters->encoderNanoseconds.load(std::memory_order_relaxed)) / 1e9;
+    return statistics;
+}
+
+-(NSArray<CaptureStreamStatistics*>*) streamStatistics {
+    auto engine = self.captureEngine;
+    auto* statistics = [NSMutableArray arrayWithCapacity: engine->streamCount()];
+    for (uint32_t stream = 0; stream < engine->streamCount(); ++stream) {
+        auto streamStatistics = engine->statistics(stream);
+        auto* entry = [[CaptureStreamStatistics alloc] init];
+        entry.fillFrames = streamStatistics.fillFrames;
+        entry.capacityFrames = streamStatistics.capacityFrames;
+        entry.capturedFrames = streamStatistics.capturedFrames;
+        entry.droppedFrames = streamStatistics.droppedFrames;
+        entry.writtenFrames = streamStatistics.writtenFrames;
+        [statistics addObject: entry];
     }
-    list->clear();
+    return statistics;
+}
+
+// MARK: - Aligned recording
+
+-(bool) startAlignedRecordingWithDevices: (NSArray<NSNumber*>*)deviceIDs {
+    if (self.clockAligner != nullptr || deviceIDs.count == 0) {
+        return false;
+    }
+    
+    auto devices = std::make_shared<std::vector<AlignedDevice>>();
+    std::vector<CaptureStreamFormat> captureFormats;
+    for (NSNumber* deviceID in deviceIDs) {
+        AlignedDevice device;
+        device.deviceID = deviceID.unsignedIntValue;
+        device.firstStream = uint32_t(captureFormats.size());
+        for (const auto& format : InputStreamFormats(device.deviceID)) {
+            captureFormats.push_back(MakeCaptureStreamFormat(format));
+        }
+        device.streamCount = uint32_t(captureFormats.size()) - device.firstStream;
+        devices->push_back(device);
+    }
+    if (captureFormats.empty()) {
+        return false;
+    }
+    
+    auto* musicURL = [NSFileManager.defaultManager URLForDirectory: NSMusicDirectory
+                                                          inDomain: NSUserDomainMask
+                                                 appropriateForURL: nullptr
+                                                            create: YES
+                                                             error: nullptr];
+    auto* path = RecordingPath(musicURL, [NSString stringWithFormat: @"Rec-%@-Aligned.tapc", RecordingDateString()]);
+    auto writer = std::make_unique<CaptureContainerWriter>();
+    if (!writer->open(path.UTF8String, ClockAligner::outputFormats(captureFormats))) {
+        return false;
+    }
+    auto aligner = std::make_shared<ClockAligner>();
+    if (!aligner->start(captureFormats, std::move(writer))) {
+        NSLog(@"Can't align the recording: an input stream's format isn't supported");
+        return false;
+    }
+    self.recordingURL = [NSURL fileURLWithPath: path];
+    self.clockAligner = aligner;
+    self.alignedDevices = devices;
+    
+    for (auto& device : *devices) {
+        device.aligner = aligner.get();
+        // Pass the device's entry rather than `self`, so the I/O proc never sends an Objective-C message.
+        if (AudioDeviceCreateIOProcID(device.deviceID, alignedIOProc, &device, &device.IOProcID) != kAudioHardwareNoError ||
+            AudioDeviceStart(device.deviceID, device.IOProcID) != kAudioHardwareNoError) {
+            [self stopAlignedRecording];
+            return false;
+        }
+    }
+    return true;
+}
+
+-(void) stopAlignedRecording {
+    auto devices = self.alignedDevices;
+    if (devices != nullptr) {
+        for (auto& device : *devices) {
+            if (device.IOProcID != nullptr) {
+                AudioDeviceStop(device.deviceID, device.IOProcID);
+                AudioDeviceDestroyIOProcID(device.deviceID, device.IOProcID);
+                device.IOProcID = nullptr;
+            }
+        }
+    }
+    auto aligner = self.clockAligner;
+    if (aligner != nullptr) {
+        // The I/O procs have stopped, so the aligner writes what its rings still hold and finishes the file.
+        aligner->stop();
+        for (uint32_t stream = 0; stream < aligner->streamCount(); ++stream) {
+            const auto statistics = aligner->statistics(stream);
+            NSLog(@"Aligned stream %u: %.3f Hz, %llu realignments, %llu dropped frames",
+                  stream, statistics.sampleRate, statistics.realignmentCount, statistics.droppedFrames);
+        }
+    }
+    self.alignedDevices = nullptr;
+    self.clockAligner = nullptr;
+}
+
+-(NSArray<CaptureClockStatistics*>*) clockStatistics {
+    auto aligner = self.clockAligner;
+    if (aligner == nullptr) {
+        return @[];
+    }
+    auto* statistics = [NSMutableArray arrayWithCapacity: aligner->streamCount()];
+    for (uint32_t stream = 0; stream < aligner->streamCount(); ++stream) {
+        const auto streamStatistics = aligner->statistics(stream);
+        auto* entry = [[CaptureClockStatistics alloc] init];
+        entry.sampleRate = streamStatistics.sampleRate;
+        entry.correction = streamStatistics.correction;
+        entry.alignmentError = streamStatistics.alignmentError;
+        entry.aligned = streamStatistics.aligned;
+        entry.droppedFrames = streamStatistics.droppedFrames;
+        entry.realignmentCount = streamStatistics.realignmentCount;
+        [statistics addObject: entry];
+    }
+    return statistics;
 }
 
 @end
@@ -306,16 +886,32 @@ static OSStatus ioproc(AudioObjectID,
 static OSStatus deviceChangedListener(AudioObjectID, UInt32 inNumberAddresses, const AudioObjectPropertyAddress* inAddresses, void* inClientData) noexcept {
     auto* engine = (__bridge AudioRecorder*)inClientData;
     if (engine != nullptr) {
+        bool deviceDied = false;
+        bool streamsChanged = false;
         for (unsigned index = 0; index < inNumberAddresses; ++index) {
             auto address = inAddresses[index];
             switch (address.mSelector) {
                 case kAudioDevicePropertyDeviceIsAlive:
-                    [engine adaptToDevice: kAudioObjectUnknown];
+                    deviceDied = true;
+                    break;
                 case kAudioAggregateDevicePropertyFullSubDeviceList:
                 case kAudioAggregateDevicePropertyTapList:
-                    [engine adaptToDevice: engine.deviceID];
+                // A new layout or rate changes the formats of streams the catalog already has.
+                case kAudioDevicePropertyStreamConfiguration:
+                case kAudioDevicePropertyNominalSampleRate:
+                    streamsChanged = true;
+                    break;
             }
         }
+        // Handle the whole batch of changes once, on the main thread, which configures the recorder everywhere else.
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (deviceDied) {
+                [engine adaptToDevice: kAudioObjectUnknown];
+            }
+            else if (streamsChanged) {
+                [engine catalogDeviceStreams];
+            }
+        });
     }
     return kAudioHardwareNoError;
 }
@@ -327,37 +923,45 @@ static OSStatus ioproc(AudioObjectID,
                        AudioBufferList* outOutputData,
                        const AudioTimeStamp*,
                        void* inClientData) noexcept {
-    // Get the `AudioRecorder` object from `inClientData`.
-    auto* recorder = (__bridge AudioRecorder*)inClientData;
-    auto fileList = recorder.fileList;
+    // Get the `CaptureEngine` object from `inClientData`.
+    auto* engine = static_cast<CaptureEngine*>(inClientData);
     
     UInt32 numberInputBuffers = 0;
-    UInt32 numberFramesToRecord = 0;
-    if (inInputData != nullptr && inInputData->mNumberBuffers > 0) {
+    const CaptureBuffer* inputBuffers = nullptr;
+    if (inInputData != nullptr) {
         numberInputBuffers = inInputData->mNumberBuffers;
-        numberFramesToRecord = inInputData->mBuffers[0].mDataByteSize / (inInputData->mBuffers[0].mNumberChannels * sizeof(Float32));
+        inputBuffers = reinterpret_cast<const CaptureBuffer*>(inInputData->mBuffers);
     }
     UInt32 numberOutputBuffers = 0;
-    UInt32 numberFramesToOutput = 0;
-    if (outOutputData != nullptr && outOutputData->mNumberBuffers > 0) {
+    CaptureBuffer* outputBuffers = nullptr;
+    if (outOutputData != nullptr) {
         numberOutputBuffers = outOutputData->mNumberBuffers;
-        numberFramesToOutput = outOutputData->mBuffers[0].mDataByteSize / (outOutputData->mBuffers[0].mNumberChannels * sizeof(Float32));
+        outputBuffers = reinterpret_cast<CaptureBuffer*>(outOutputData->mBuffers);
     }
     
-    for (size_t index = 0; index < numberInputBuffers; ++index) {
-        AudioBuffer buffer = inInputData->mBuffers[index];
-        if (recorder.recordingEnabled == true && index < fileList->size()) {
-            // Write the input buffer data to the recording file.
-            AudioBufferList writeData;
-            writeData.mNumberBuffers = 1;
-            writeData.mBuffers[0] = buffer;
-            ExtAudioFileWriteAsync(fileList->at(index), numberFramesToRecord, &writeData);
-        }
-        if (recorder.loopbackEnabled == true && index < numberOutputBuffers) {
-            // Write the input buffer data to the output buffer.
-            // This will only work correctly if the formats of the output streams in the device match the formats of the input streams.
-            memcpy(outOutputData->mBuffers[index].mData, buffer.mData, buffer.mDataByteSize);
-        }
+    // Copy each input stream into its ring, and convert it to the output streams if loopback is on.
+    engine->process(inputBuffers, numberInputBuffers, outputBuffers, numberOutputBuffers);
+    
+    return kAudioHardwareNoError;
+}
+
+static OSStatus alignedIOProc(AudioObjectID,
+                              const AudioTimeStamp*,
+                              const AudioBufferList* inInputData,
+                              const AudioTimeStamp* inInputTime,
+                              AudioBufferList*,
+                              const AudioTimeStamp*,
+                              void* inClientData) noexcept {
+    auto* device = static_cast<const AlignedDevice*>(inClientData);
+    if (inInputData == nullptr || inInputTime == nullptr || (inInputTime->mFlags & kAudioTimeStampHostTimeValid) == 0) {
+        return kAudioHardwareNoError;
+    }
+    
+    // The aligner follows the device's clock from the host time of each cycle's first input frame.
+    const double hostSeconds = double(AudioConvertHostTimeToNanos(inInputTime->mHostTime)) * 1e-9;
+    const auto* inputBuffers = reinterpret_cast<const CaptureBuffer*>(inInputData->mBuffers);
+    for (UInt32 index = 0; index < std::min(inInputData->mNumberBuffers, device->streamCount); ++index) {
+        device->aligner->capture(device->firstStream + index, hostSeconds, inputBuffers[index]);
     }
     
     return kAudioHardwareNoError;
@@ -0,0 +1,539 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements an analyzer that meters captured streams and measures their loudness and spectra off the I/O thread.
+*/
+
+#include "CaptureAnalyzer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <time.h>
+
+// How much each stream's ring holds, at least, and in intervals of the worker.
+constexpr double kMinimumRingSeconds = 0.5;
+constexpr double kRingIntervals = 4;
+
+// The frames the worker converts and measures at a time.
+constexpr uint32_t kChunkFrames = 1024;
+
+// BS.1770 measures loudness in 400 ms blocks that overlap by 75%, so the worker keeps the energy of
+// each 100 ms and averages 4 of them for momentary loudness, or 30 for short-term loudness.
+constexpr double kBlockSeconds = 0.1;
+constexpr uint32_t kMomentaryBlocks = 4;
+constexpr uint32_t kShortTermBlocks = 30;
+
+// Integrated loudness leaves out blocks quieter than -70 LUFS, then blocks more than 10 LU quieter
+// than the rest. The histogram of blocks starts at the absolute gate, in steps of 0.1 LU, so the
+// relative gate is exact to a step.
+constexpr double kAbsoluteGate = -70;
+constexpr double kRelativeGate = -10;
+constexpr double kGateBinsPerLU = 10;
+constexpr uint32_t kGateBins = 1000;
+
+constexpr double kPi = 3.14159265358979323846;
+
+// MARK: - Vector kernels
+
+// Four-lane vectors that compile to NEON on Apple silicon and SSE on Intel.
+typedef float Float4 __attribute__((vector_size(16)));
+typedef int32_t Int4 __attribute__((vector_size(16)));
+
+template <typename Vector>
+static inline Vector Load(const void* source) noexcept {
+    Vector value;
+    memcpy(&value, source, sizeof(value));
+    return value;
+}
+
+template <typename Vector>
+static inline void Store(void* destination, Vector value) noexcept {
+    memcpy(destination, &value, sizeof(value));
+}
+
+static inline Float4 Select(Int4 mask, Float4 whenTrue, Float4 whenFalse) noexcept {
+    return (Float4)((mask & (Int4)whenTrue) | (~mask & (Int4)whenFalse));
+}
+
+// Raises `peak` to the largest magnitude in `samples`, and adds their sum of squares to `sumOfSquares`. NaNs don't count.
+static void MeasureLevels(const float* samples, size_t count, float& peak, double& sumOfSquares) noexcept {
+    Float4 peaks = {};
+    Float4 sums = {};
+    size_t index = 0;
+    for (; index + 4 <= count; index += 4) {
+        const auto value = Load<Float4>(samples + index);
+        const auto magnitude = (Float4)((Int4)value & 0x7fffffff);
+        peaks = Select(magnitude > peaks, magnitude, peaks);
+        sums += value * value;
+    }
+    float largest = peak;
+    double sum = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+        largest = std::max(largest, peaks[lane]);
+        sum += double(sums[lane]);
+    }
+    for (; index < count; ++index) {
+        const auto magnitude = std::fabs(samples[index]);
+        largest = (magnitude > largest) ? magnitude : largest;
+        sum += double(samples[index]) * double(samples[index]);
+    }
+    peak = largest;
+    sumOfSquares += sum;
+}
+
+static double SumOfSquares(const float* samples, size_t count) noexcept {
+    Float4 sums = {};
+    size_t index = 0;
+    for (; index + 4 <= count; index += 4) {
+        const auto value = Load<Float4>(samples + index);
+        sums += value * value;
+    }
+    double sum = double(sums[0]) + double(sums[1]) + double(sums[2]) + double(sums[3]);
+    for (; index < count; ++index) {
+        sum += double(samples[index]) * double(samples[index]);
+    }
+    return sum;
+}
+
+// Adds `scale` times `source` to `destination`.
+static void AddScaled(float* destination, const float* source, float scale, size_t count) noexcept {
+    size_t index = 0;
+    for (; index + 4 <= count; index += 4) {
+        Store(destination + index, Load<Float4>(destination + index) + Load<Float4>(source + index) * scale);
+    }
+    for (; index < count; ++index) {
+        destination[index] += source[index] * scale;
+    }
+}
+
+// MARK: - Loudness
+
+static double Loudness(double energy) noexcept {
+    return (energy > 0) ? -0.691 + 10 * std::log10(energy) : -std::numeric_limits<double>::infinity();
+}
+
+// The two stages of BS.1770's K-weighting, a high shelf for the head and a high-pass, at any
+// sample rate. The standard gives coefficients for 48 kHz; these come from the analog prototypes
+// that those coefficients match.
+template <typename Biquad>
+static std::array<Biquad, 2> KWeighting(double sampleRate) noexcept {
+    std::array<Biquad, 2> stages{};
+
+    auto K = std::tan(kPi * 1681.974450955533 / sampleRate);
+    auto Q = 0.7071752369554196;
+    const auto Vh = std::pow(10.0, 3.999843853973347 / 20);
+    const auto Vb = std::pow(Vh, 0.4996667741545416);
+    auto a0 = 1 + K / Q + K * K;
+    stages[0] = {(Vh + Vb * K / Q + K * K) / a0, 2 * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0,
+                 2 * (K * K - 1) / a0, (1 - K / Q + K * K) / a0};
+
+    K = std::tan(kPi * 38.13547087602444 / sampleRate);
+    Q = 0.5003270373238773;
+    a0 = 1 + K / Q + K * K;
+    stages[1] = {1, -2, 1, 2 * (K * K - 1) / a0, (1 - K / Q + K * K) / a0};
+    return stages;
+}
+
+// Runs both stages over `count` samples, in transposed direct form II, keeping the state in doubles
+// so the 38 Hz high-pass stays accurate. Each stage's feedback is a chain of dependent multiplies,
+// so running the stages in one loop lets the processor work on both chains at once.
+template <typename Biquad>
+static void Filter(const std::array<Biquad, 2>& stages, const float* source, float* destination, size_t count, double* state) noexcept {
+    const auto& shelf = stages[0];
+    const auto& highPass = stages[1];
+    auto s1 = state[0];
+    auto s2 = state[1];
+    auto h1 = state[2];
+    auto h2 = state[3];
+    for (size_t index = 0; index < count; ++index) {
+        const double input = source[index];
+        const auto shelved = shelf.b0 * input + s1;
+        s1 = shelf.b1 * input - shelf.a1 * shelved + s2;
+        s2 = shelf.b2 * input - shelf.a2 * shelved;
+        const auto output = highPass.b0 * shelved + h1;
+        h1 = highPass.b1 * shelved - highPass.a1 * output + h2;
+        h2 = highPass.b2 * shelved - highPass.a2 * output;
+        destination[index] = float(output);
+    }
+    // Flush the tail of silence to zero, before it turns into slow denormals.
+    const double values[] = {s1, s2, h1, h2};
+    for (int slot = 0; slot < 4; ++slot) {
+        state[slot] = (std::fabs(values[slot]) < 1e-30) ? 0 : values[slot];
+    }
+}
+
+static double MeanOfLastBlocks(const std::vector<double>& blocks, uint64_t blockCount, uint32_t count) noexcept {
+    double energy = 0;
+    for (uint32_t block = 0; block < count; ++block) {
+        energy += blocks[size_t((blockCount - 1 - block) % blocks.size())];
+    }
+    return energy / count;
+}
+
+static uint64_t ThreadCPUNanoseconds() noexcept {
+    timespec time{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return uint64_t(time.tv_sec) * 1000000000 + uint64_t(time.tv_nsec);
+}
+
+// MARK: - Analyzer
+
+CaptureAnalyzer::~CaptureAnalyzer() {
+    stop();
+}
+
+double CaptureAnalyzer::bandFrequency(double sampleRate, uint32_t band) noexcept {
+    const auto nyquist = std::max(sampleRate / 2, kLowestFrequency);
+    return kLowestFrequency * std::pow(nyquist / kLowestFrequency, double(band) / kSpectrumBands);
+}
+
+void CaptureAnalyzer::start(const std::vector<CaptureStreamFormat>& streams, double interval) {
+    stop();
+
+    constexpr uint32_t halfSize = kFFTSize / 2;
+    mWindow.resize(kFFTSize);
+    for (uint32_t index = 0; index < kFFTSize; ++index) {
+        mWindow[index] = float(0.5 - 0.5 * std::cos(2 * kPi * index / kFFTSize));
+    }
+    uint32_t bits = 0;
+    while ((1u << bits) < halfSize) {
+        ++bits;
+    }
+    mBitReversal.resize(halfSize);
+    for (uint32_t index = 0; index < halfSize; ++index) {
+        uint32_t reversed = 0;
+        for (uint32_t bit = 0; bit < bits; ++bit) {
+            reversed |= ((index >> bit) & 1) << (bits - 1 - bit);
+        }
+        mBitReversal[index] = reversed;
+    }
+    // Each stage's twiddles in a row, so the butterflies load them four at a time.
+    for (int part = 0; part < 2; ++part) {
+        mStageTwiddles[part].clear();
+        mUnpackTwiddles[part].resize(halfSize);
+        mFFTBuffer[part].resize(halfSize);
+    }
+    for (uint32_t half = 1; half < halfSize; half *= 2) {
+        for (uint32_t index = 0; index < half; ++index) {
+            mStageTwiddles[0].push_back(float(std::cos(-kPi * index / half)));
+            mStageTwiddles[1].push_back(float(std::sin(-kPi * index / half)));
+        }
+    }
+    for (uint32_t index = 0; index < halfSize; ++index) {
+        mUnpackTwiddles[0][index] = float(std::cos(-2 * kPi * index / kFFTSize));
+        mUnpackTwiddles[1][index] = float(std::sin(-2 * kPi * index / kFFTSize));
+    }
+    mPower.resize(halfSize + 1);
+
+    mStreams.clear();
+    for (const auto& format : streams) {
+        auto stream = std::make_unique<Stream>();
+        stream->format = format;
+        stream->supported = IsSupportedFormat(format);
+        if (stream->supported) {
+            const auto channels = format.channelCount;
+            const auto ringSeconds = std::max(kMinimumRingSeconds, interval * kRingIntervals);
+            stream->ring = std::make_unique<CaptureRing>(format.bytesPerFrame, uint32_t(std::ceil(format.sampleRate * ringSeconds)));
+            stream->samples.resize(size_t(kChunkFrames) * channels);
+            stream->channel.resize(kChunkFrames);
+            stream->weighted.resize(size_t(kChunkFrames) * channels);
+            stream->mix.resize(kChunkFrames);
+            stream->kWeighting = KWeighting<Biquad>(format.sampleRate);
+            stream->filterState.assign(size_t(channels) * 4, 0);
+            stream->peak.assign(channels, 0);
+            stream->sumOfSquares.assign(channels, 0);
+            stream->framesPerBlock = std::max(uint32_t(std::lround(format.sampleRate * kBlockSeconds)), 1u);
+            stream->blocks.assign(kShortTermBlocks, 0);
+            stream->gateCounts.assign(kGateBins, 0);
+            stream->gateEnergy.assign(kGateBins, 0);
+            stream->spectrumHistory.assign(kFFTSize, 0);
+            for (uint32_t band = 0; band < kSpectrumBands; ++band) {
+                const auto binsPerHertz = kFFTSize / format.sampleRate;
+                auto first = std::max(uint32_t(std::floor(bandFrequency(format.sampleRate, band) * binsPerHertz)), 1u);
+                auto end = uint32_t(std::ceil(bandFrequency(format.sampleRate, band + 1) * binsPerHertz));
+                first = std::min(first, kFFTSize / 2);
+                end = std::min(std::max(end, first + 1), kFFTSize / 2 + 1);
+                stream->bands.emplace_back(first, end);
+            }
+        }
+        mStreams.push_back(std::move(stream));
+    }
+
+    // Size every snapshot up front, so publishing never allocates.
+    for (auto& snapshot : mSnapshots) {
+        snapshot.sequence = 0;
+        snapshot.streams.assign(streams.size(), StreamAnalysis{});
+        for (size_t index = 0; index < streams.size(); ++index) {
+            auto& analysis = snapshot.streams[index];
+            const auto channels = mStreams[index]->supported ? streams[index].channelCount : 0;
+            analysis.peak.assign(channels, 0);
+            analysis.rms.assign(channels, 0);
+            analysis.momentaryLoudness = -std::numeric_limits<double>::infinity();
+            analysis.shortTermLoudness = -std::numeric_limits<double>::infinity();
+            analysis.integratedLoudness = -std::numeric_limits<double>::infinity();
+            analysis.spectrum.assign(mStreams[index]->supported ? kSpectrumBands : 0, -200);
+        }
+    }
+    mLatest.store(1);
+    mBack = 0;
+    mFront = 2;
+    mSequence = 0;
+
+    if (interval > 0) {
+        mWorkerRunning.store(true);
+        mWorker = std::thread([this, interval] { runWorker(interval); });
+    }
+}
+
+void CaptureAnalyzer::stop() {
+    mWorkerRunning.store(false);
+    if (mWorker.joinable()) {
+        mWorker.join();
+    }
+}
+
+// MARK: - I/O cycle
+
+void CaptureAnalyzer::capture(uint32_t stream, const CaptureBuffer& buffer) noexcept {
+    if (stream >= mStreams.size() || !mStreams[stream]->supported) {
+        return;
+    }
+    auto& state = *mStreams[stream];
+    const auto frames = buffer.byteSize / state.ring->bytesPerFrame();
+    const auto written = state.ring->write(buffer.data, frames);
+    if (written < frames) {
+        state.droppedFrames.store(state.droppedFrames.load(std::memory_order_relaxed) + (frames - written), std::memory_order_relaxed);
+    }
+}
+
+// MARK: - Worker
+
+void CaptureAnalyzer::runWorker(double interval) {
+    while (mWorkerRunning.load()) {
+        analyze();
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    }
+}
+
+void CaptureAnalyzer::analyze() noexcept {
+    const auto started = ThreadCPUNanoseconds();
+    auto& snapshot = mSnapshots[mBack];
+    for (size_t index = 0; index < mStreams.size(); ++index) {
+        auto& stream = *mStreams[index];
+        if (stream.supported) {
+            const uint8_t* first = nullptr;
+            const uint8_t* second = nullptr;
+            uint32_t firstFrames = 0;
+            uint32_t secondFrames = 0;
+            const auto available = stream.ring->peek(first, firstFrames, second, secondFrames);
+            const auto bytesPerFrame = stream.format.bytesPerFrame;
+            for (uint32_t offset = 0; offset < firstFrames; offset += kChunkFrames) {
+                measure(stream, first + size_t(offset) * bytesPerFrame, std::min(kChunkFrames, firstFrames - offset));
+            }
+            for (uint32_t offset = 0; offset < secondFrames; offset += kChunkFrames) {
+                measure(stream, second + size_t(offset) * bytesPerFrame, std::min(kChunkFrames, secondFrames - offset));
+            }
+            stream.ring->consume(available);
+        }
+        report(stream, snapshot.streams[index]);
+    }
+
+    // Publish the snapshot, and take the one the reader isn't holding to fill next time.
+    snapshot.sequence = ++mSequence;
+    mBack = mLatest.exchange(mBack | kFresh, std::memory_order_acq_rel) & ~kFresh;
+    mAnalysisNanoseconds.fetch_add(ThreadCPUNanoseconds() - started, std::memory_order_relaxed);
+}
+
+const CaptureAnalyzer::Snapshot& CaptureAnalyzer::latest() noexcept {
+    if ((mLatest.load(std::memory_order_relaxed) & kFresh) != 0) {
+        mFront = mLatest.exchange(mFront, std::memory_order_acq_rel) & ~kFresh;
+    }
+    return mSnapshots[mFront];
+}
+
+void CaptureAnalyzer::measure(Stream& stream, const uint8_t* data, uint32_t frameCount) noexcept {
+    const auto channels = stream.format.channelCount;
+    ConvertToFloat(stream.format.sampleFormat, data, stream.samples.data(), size_t(frameCount) * channels);
+    std::fill_n(stream.mix.begin(), frameCount, 0.0f);
+
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+        const float* samples = stream.samples.data();
+        if (channels > 1) {
+            for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                stream.channel[frame] = stream.samples[size_t(frame) * channels + channel];
+            }
+            samples = stream.channel.data();
+        }
+        MeasureLevels(samples, frameCount, stream.peak[channel], stream.sumOfSquares[channel]);
+        AddScaled(stream.mix.data(), samples, 1.0f / float(channels), frameCount);
+
+        auto* weighted = stream.weighted.data() + size_t(channel) * kChunkFrames;
+        auto* state = stream.filterState.data() + size_t(channel) * 4;
+        Filter(stream.kWeighting, samples, weighted, frameCount, state);
+    }
+
+    // Split the chunk where loudness blocks end.
+    for (uint32_t offset = 0; offset < frameCount;) {
+        const auto frames = std::min(frameCount - offset, stream.framesPerBlock - stream.blockFrames);
+        addToBlocks(stream, offset, frames);
+        offset += frames;
+    }
+
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        stream.spectrumHistory[stream.spectrumPosition] = stream.mix[frame];
+        stream.spectrumPosition = (stream.spectrumPosition + 1) % kFFTSize;
+    }
+    stream.intervalFrames += frameCount;
+    stream.analyzedFrames += frameCount;
+}
+
+void CaptureAnalyzer::addToBlocks(Stream& stream, uint32_t offset, uint32_t frameCount) noexcept {
+    for (uint32_t channel = 0; channel < stream.format.channelCount; ++channel) {
+        stream.blockEnergy += SumOfSquares(stream.weighted.data() + size_t(channel) * kChunkFrames + offset, frameCount);
+    }
+    stream.blockFrames += frameCount;
+    if (stream.blockFrames == stream.framesPerBlock) {
+        finishBlock(stream);
+    }
+}
+
+void CaptureAnalyzer::finishBlock(Stream& stream) noexcept {
+    stream.blocks[size_t(stream.blockCount % kShortTermBlocks)] = stream.blockEnergy / stream.framesPerBlock;
+    ++stream.blockCount;
+    stream.blockEnergy = 0;
+    stream.blockFrames = 0;
+
+    if (stream.blockCount >= kMomentaryBlocks) {
+        const auto energy = MeanOfLastBlocks(stream.blocks, stream.blockCount, kMomentaryBlocks);
+        const auto loudness = Loudness(energy);
+        if (loudness > kAbsoluteGate) {
+            const auto bin = std::min(size_t((loudness - kAbsoluteGate) * kGateBinsPerLU), size_t(kGateBins - 1));
+            ++stream.gateCounts[bin];
+            stream.gateEnergy[bin] += energy;
+        }
+    }
+}
+
+double CaptureAnalyzer::integratedLoudness(const Stream& stream) const noexcept {
+    double energy = 0;
+    uint64_t count = 0;
+    for (uint32_t bin = 0; bin < kGateBins; ++bin) {
+        energy += stream.gateEnergy[bin];
+        count += stream.gateCounts[bin];
+    }
+    if (count == 0) {
+        return -std::numeric_limits<double>::infinity();
+    }
+    const auto relativeGate = Loudness(energy / double(count)) + kRelativeGate;
+    const auto firstBin = uint32_t(std::clamp((relativeGate - kAbsoluteGate) * kGateBinsPerLU, 0.0, double(kGateBins - 1)));
+    energy = 0;
+    count = 0;
+    for (uint32_t bin = firstBin; bin < kGateBins; ++bin) {
+        energy += stream.gateEnergy[bin];
+        count += stream.gateCounts[bin];
+    }
+    return Loudness(energy / double(count));
+}
+
+void CaptureAnalyzer::report(Stream& stream, StreamAnalysis& analysis) noexcept {
+    analysis.droppedFrames = stream.droppedFrames.load(std::memory_order_relaxed);
+    analysis.analyzedFrames = stream.analyzedFrames;
+    if (!stream.supported) {
+        return;
+    }
+
+    for (uint32_t channel = 0; channel < stream.format.channelCount; ++channel) {
+        analysis.peak[channel] = stream.peak[channel];
+        analysis.rms[channel] = (stream.intervalFrames > 0) ? float(std::sqrt(stream.sumOfSquares[channel] / double(stream.intervalFrames))) : 0;
+        stream.peak[channel] = 0;
+        stream.sumOfSquares[channel] = 0;
+    }
+    stream.intervalFrames = 0;
+
+    constexpr auto silence = -std::numeric_limits<double>::infinity();
+    analysis.momentaryLoudness = (stream.blockCount >= kMomentaryBlocks) ? Loudness(MeanOfLastBlocks(stream.blocks, stream.blockCount, kMomentaryBlocks)) : silence;
+    analysis.shortTermLoudness = (stream.blockCount >= kShortTermBlocks) ? Loudness(MeanOfLastBlocks(stream.blocks, stream.blockCount, kShortTermBlocks)) : silence;
+    analysis.integratedLoudness = integratedLoudness(stream);
+
+    // Window the mix from its oldest frame, transform it, and keep the strongest bin of each band.
+    for (uint32_t index = 0; index < kFFTSize / 2; ++index) {
+        const auto even = 2 * index;
+        const auto destination = mBitReversal[index];
+        mFFTBuffer[0][destination] = stream.spectrumHistory[(stream.spectrumPosition + even) % kFFTSize] * mWindow[even];
+        mFFTBuffer[1][destination] = stream.spectrumHistory[(stream.spectrumPosition + even + 1) % kFFTSize] * mWindow[even + 1];
+    }
+    transform();
+    // A full-scale sine peaks at half the window's sum, which is a quarter of the FFT size for a Hann window.
+    constexpr float scale = 4.0f / kFFTSize;
+    for (uint32_t band = 0; band < kSpectrumBands; ++band) {
+        float strongest = 0;
+        for (uint32_t bin = stream.bands[band].first; bin < stream.bands[band].second; ++bin) {
+            strongest = std::max(strongest, mPower[bin]);
+        }
+        analysis.spectrum[band] = 10 * std::log10(strongest * scale * scale + 1e-20f);
+    }
+}
+
+// Transforms `mFFTBuffer`, whose input is already in bit-reversed order, with a radix-2 FFT, and
+// unpacks it into the power of each bin of the real FFT of twice the length.
+void CaptureAnalyzer::transform() noexcept {
+    constexpr uint32_t halfSize = kFFTSize / 2;
+    auto* real = mFFTBuffer[0].data();
+    auto* imaginary = mFFTBuffer[1].data();
+    const float* twiddleReal = mStageTwiddles[0].data();
+    const float* twiddleImaginary = mStageTwiddles[1].data();
+    for (uint32_t half = 1; half < halfSize; half *= 2) {
+        for (uint32_t start = 0; start < halfSize; start += 2 * half) {
+            uint32_t index = 0;
+            for (; index + 4 <= half; index += 4) {
+                const auto wr = Load<Float4>(twiddleReal + index);
+                const auto wi = Load<Float4>(twiddleImaginary + index);
+                const auto top = start + index;
+                const auto bottom = top + half;
+                const auto oddReal = Load<Float4>(real + bottom);
+                const auto oddImaginary = Load<Float4>(imaginary + bottom);
+                const auto productReal = wr * oddReal - wi * oddImaginary;
+                const auto productImaginary = wr * oddImaginary + wi * oddReal;
+                const auto evenReal = Load<Float4>(real + top);
+                const auto evenImaginary = Load<Float4>(imaginary + top);
+                Store(real + bottom, evenReal - productReal);
+                Store(imaginary + bottom, evenImaginary - productImaginary);
+                Store(real + top, evenReal + productReal);
+                Store(imaginary + top, evenImaginary + productImaginary);
+            }
+            for (; index < half; ++index) {
+                const auto top = start + index;
+                const auto bottom = top + half;
+                const auto productReal = twiddleReal[index] * real[bottom] - twiddleImaginary[index] * imaginary[bottom];
+                const auto productImaginary = twiddleReal[index] * imaginary[bottom] + twiddleImaginary[index] * real[bottom];
+                real[bottom] = real[top] - productReal;
+                imaginary[bottom] = imaginary[top] - productImaginary;
+                real[top] += productReal;
+                imaginary[top] += productImaginary;
+            }
+        }
+        twiddleReal += half;
+        twiddleImaginary += half;
+    }
+
+    // Separate the transforms of the even and odd samples, and combine them.
+    for (uint32_t bin = 0; bin <= halfSize; ++bin) {
+        const auto index = bin % halfSize;
+        const auto mirror = (halfSize - bin) % halfSize;
+        const auto evenReal = 0.5f * (real[index] + real[mirror]);
+        const auto evenImaginary = 0.5f * (imaginary[index] - imaginary[mirror]);
+        const auto oddReal = 0.5f * (imaginary[index] + imaginary[mirror]);
+        const auto oddImaginary = -0.5f * (real[index] - real[mirror]);
+        const auto wr = mUnpackTwiddles[0][index];
+        const auto wi = mUnpackTwiddles[1][index];
+        // The twiddle for the Nyquist bin is -1, which is the negated twiddle for bin 0.
+        const auto sign = (bin == halfSize) ? -1.0f : 1.0f;
+        const auto binReal = evenReal + sign * (wr * oddReal - wi * oddImaginary);
+        const auto binImaginary = evenImaginary + sign * (wr * oddImaginary + wi * oddReal);
+        mPower[bin] = binReal * binReal + binImaginary * binImaginary;
+    }
+}
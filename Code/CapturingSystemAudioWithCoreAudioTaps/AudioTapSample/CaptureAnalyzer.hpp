@@ -0,0 +1,163 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+An analyzer that meters captured streams and measures their loudness and spectra off the I/O thread.
+*/
+
+#ifndef CaptureAnalyzer_hpp
+#define CaptureAnalyzer_hpp
+
+#include "CaptureFormat.hpp"
+#include "CaptureRing.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Meters captured streams on a worker thread. The I/O thread copies each cycle into a ring per
+// stream and moves on. Every interval, the worker converts what the rings hold to float and measures
+// each stream's:
+//
+//   levels     The peak and RMS of each channel over the interval.
+//   loudness   Momentary (400 ms), short-term (3 s), and integrated loudness in LUFS, K-weighted and
+//              gated as ITU-R BS.1770 and EBU R128 describe. Every channel has a weight of 1, since
+//              the streams don't say which channels are surrounds.
+//   spectrum   A Hann-windowed FFT of the mix of the stream's channels, reduced to log-spaced bands.
+//
+// Each pass publishes a snapshot through a triple buffer, so a reader takes the newest results
+// without locking, and the worker never waits for the reader.
+class CaptureAnalyzer {
+public:
+    // The samples each spectrum covers, and the bands it's reduced to, from `kLowestFrequency` to half the sample rate.
+    static constexpr uint32_t kFFTSize = 2048;
+    static constexpr uint32_t kSpectrumBands = 64;
+    static constexpr double kLowestFrequency = 20;
+
+    struct StreamAnalysis {
+        // Per channel, where 1 is full scale.
+        std::vector<float> peak;
+        std::vector<float> rms;
+        // In LUFS. Negative infinity until the stream has played for the measure's window, and
+        // for integrated loudness, until a block is louder than the absolute gate.
+        double momentaryLoudness = 0;
+        double shortTermLoudness = 0;
+        double integratedLoudness = 0;
+        // The level of the strongest bin in each band, in dBFS, where a full-scale sine reads 0.
+        std::vector<float> spectrum;
+        uint64_t analyzedFrames = 0;
+        // Frames the I/O thread couldn't fit in the stream's ring because the worker fell behind.
+        uint64_t droppedFrames = 0;
+    };
+
+    struct Snapshot {
+        // Counts the passes that published results; 0 before the first.
+        uint64_t sequence = 0;
+        std::vector<StreamAnalysis> streams;
+    };
+
+    CaptureAnalyzer() = default;
+    CaptureAnalyzer(const CaptureAnalyzer&) = delete;
+    CaptureAnalyzer& operator=(const CaptureAnalyzer&) = delete;
+    ~CaptureAnalyzer();
+
+    // Allocates the rings and the analysis state for `streams`, and starts a worker that analyzes
+    // every `interval` seconds. With an interval of 0, no worker starts, and the caller runs `analyze`.
+    // Streams in formats the converters don't support read as silence.
+    void start(const std::vector<CaptureStreamFormat>& streams, double interval = 0.05);
+
+    // Stops the worker. The last snapshot stays available.
+    void stop();
+
+    // Copies a cycle of `stream` into its ring. Real-time safe.
+    void capture(uint32_t stream, const CaptureBuffer& buffer) noexcept;
+
+    // Measures what the rings hold and publishes a snapshot. The worker runs this; don't call it while the worker runs.
+    void analyze() noexcept;
+
+    // The newest snapshot. Call from one thread only. The snapshot doesn't change until the next call.
+    const Snapshot& latest() noexcept;
+
+    // The CPU time the analysis has taken so far. Safe to call from any thread.
+    uint64_t analysisNanoseconds() const { return mAnalysisNanoseconds.load(std::memory_order_relaxed); }
+
+    // The lowest frequency of a spectrum band, in Hz.
+    static double bandFrequency(double sampleRate, uint32_t band) noexcept;
+
+private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+
+    struct Stream {
+        CaptureStreamFormat format;
+        bool supported = false;
+        std::unique_ptr<CaptureRing> ring;
+        std::atomic<uint64_t> droppedFrames{0};
+
+        // From here on, the worker's alone.
+        std::vector<float> samples;
+        std::vector<float> channel;
+        std::vector<float> weighted;
+        std::vector<float> mix;
+        std::array<Biquad, 2> kWeighting{};
+        std::vector<double> filterState;
+
+        std::vector<float> peak;
+        std::vector<double> sumOfSquares;
+        uint64_t intervalFrames = 0;
+
+        // The K-weighted energy of the 100 ms block in progress, and of the last 3 s of blocks.
+        double blockEnergy = 0;
+        uint32_t blockFrames = 0;
+        uint32_t framesPerBlock = 0;
+        std::vector<double> blocks;
+        uint64_t blockCount = 0;
+        // For integrated loudness, the 400 ms blocks above the absolute gate, by loudness in steps of 0.1 LU.
+        std::vector<uint64_t> gateCounts;
+        std::vector<double> gateEnergy;
+
+        // The last `kFFTSize` frames of the mix, oldest at `spectrumPosition`, and each band's bins.
+        std::vector<float> spectrumHistory;
+        uint32_t spectrumPosition = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> bands;
+        uint64_t analyzedFrames = 0;
+    };
+
+    void measure(Stream& stream, const uint8_t* data, uint32_t frameCount) noexcept;
+    void addToBlocks(Stream& stream, uint32_t offset, uint32_t frameCount) noexcept;
+    void finishBlock(Stream& stream) noexcept;
+    double integratedLoudness(const Stream& stream) const noexcept;
+    void report(Stream& stream, StreamAnalysis& analysis) noexcept;
+    void transform() noexcept;
+    void runWorker(double interval);
+
+    std::vector<std::unique_ptr<Stream>> mStreams;
+
+    // The spectrum transforms the real mix as a complex signal of half the length, with even
+    // samples as the real parts and odd samples as the imaginary parts, and unpacks the result.
+    std::vector<float> mWindow;
+    std::vector<uint32_t> mBitReversal;
+    std::vector<float> mStageTwiddles[2];
+    std::vector<float> mUnpackTwiddles[2];
+    std::vector<float> mFFTBuffer[2];
+    std::vector<float> mPower;
+
+    // The triple buffer. The worker fills `mBack`, the reader holds `mFront`, and `mLatest` holds the
+    // third, flagged with `kFresh` when the worker has published it since the reader last took it.
+    static constexpr uint32_t kFresh = 4;
+    std::array<Snapshot, 3> mSnapshots;
+    std::atomic<uint32_t> mLatest{1};
+    uint32_t mBack = 0;
+    uint32_t mFront = 2;
+    uint64_t mSequence = 0;
+
+    std::thread mWorker;
+    std::atomic<bool> mWorkerRunning{false};
+    std::atomic<uint64_t> mAnalysisNanoseconds{0};
+};
+
+#endif /* CaptureAnalyzer_hpp */
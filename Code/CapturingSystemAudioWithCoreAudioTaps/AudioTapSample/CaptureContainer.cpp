@@ -0,0 +1,354 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a single-file container that stores every captured stream in fixed-size, aligned chunks with a seek index.
+*/
+
+#include "CaptureContainer.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace CaptureContainer;
+
+// How many chunks can be waiting for a slow stream before the oldest goes out short.
+constexpr uint32_t kMaxPendingChunks = 4;
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static size_t chunkHeaderBytes(uint32_t streamCount) {
+    return sizeof(ContainerChunkHeader) + sizeof(ContainerChunkStream) * streamCount;
+}
+
+// Writes all of `size` bytes, retrying short writes.
+static bool writeAll(int file, const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        const auto written = ::write(file, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= size_t(written);
+    }
+    return true;
+}
+
+// MARK: - Writer
+
+CaptureContainerWriter::~CaptureContainerWriter() {
+    close();
+}
+
+bool CaptureContainerWriter::open(const std::string& path, const std::vector<CaptureStreamFormat>& streams, double chunkDuration) {
+    close();
+
+    // Lay out each stream's block in the chunk after the chunk header.
+    mStreams.clear();
+    uint64_t offset = alignUp(chunkHeaderBytes(uint32_t(streams.size())), kBlockAlignment);
+    for (const auto& format : streams) {
+        ContainerStream stream{};
+        stream.sampleRate = format.sampleRate;
+        stream.channelCount = format.channelCount;
+        stream.bytesPerFrame = std::max(format.bytesPerFrame, 1u);
+        stream.sampleFormat = format.sampleFormat;
+        stream.framesPerChunk = std::max(uint32_t(std::ceil(format.sampleRate * chunkDuration)), 1u);
+        stream.offsetInChunk = offset;
+        offset = alignUp(offset + uint64_t(stream.framesPerChunk) * stream.bytesPerFrame, kBlockAlignment);
+        mStreams.push_back(stream);
+    }
+
+    memset(&mHeader, 0, sizeof(mHeader));
+    memcpy(mHeader.magic, kMagic, sizeof(kMagic));
+    mHeader.version = kVersion;
+    mHeader.streamCount = uint32_t(streams.size());
+    mHeader.chunkBytes = alignUp(offset, kAlignment);
+    mHeader.dataOffset = alignUp(sizeof(ContainerHeader) + sizeof(ContainerStream) * streams.size(), kAlignment);
+    mHeader.chunkDuration = chunkDuration;
+
+    mChunkStorage.assign(size_t(mHeader.chunkBytes) * kMaxPendingChunks, 0);
+    mPending.assign(kMaxPendingChunks, PendingChunk());
+    for (uint32_t index = 0; index < kMaxPendingChunks; ++index) {
+        mPending[index].buffer = mChunkStorage.data() + size_t(mHeader.chunkBytes) * index;
+        mPending[index].streams.assign(streams.size(), ContainerChunkStream{});
+    }
+    mOldestPending = 0;
+    mPendingCount = 0;
+    mCursors.assign(streams.size(), 0);
+    mReceivedFrames.assign(streams.size(), 0);
+    mIndex.clear();
+    mChunkCount = 0;
+    mFailed = false;
+
+    mFile = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (mFile < 0) {
+        return false;
+    }
+
+    // Write a provisional header; `close` rewrites it with the chunk count and the index's location.
+    std::vector<uint8_t> header(mHeader.dataOffset, 0);
+    memcpy(header.data(), &mHeader, sizeof(mHeader));
+    memcpy(header.data() + sizeof(mHeader), mStreams.data(), sizeof(ContainerStream) * mStreams.size());
+    if (!writeAll(mFile, header.data(), header.size())) {
+        ::close(mFile);
+        mFile = -1;
+        return false;
+    }
+    mFileOffset = mHeader.dataOffset;
+    return true;
+}
+
+bool CaptureContainerWriter::write(uint32_t stream, const void* data, uint32_t frameCount) {
+    if (mFile < 0 || stream >= mStreams.size()) {
+        return false;
+    }
+    const auto& layout = mStreams[stream];
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (frameCount > 0) {
+        if (mCursors[stream] == mPendingCount) {
+            if (mPendingCount == kMaxPendingChunks) {
+                emitOldestChunk();
+            }
+            openChunk();
+        }
+
+        auto& chunk = pendingChunk(mCursors[stream]);
+        auto& chunkStream = chunk.streams[stream];
+        if (chunkStream.frameCount == 0) {
+            chunkStream.firstFrame = mReceivedFrames[stream];
+        }
+        const auto frames = std::min(frameCount, layout.framesPerChunk - chunkStream.frameCount);
+        memcpy(chunk.buffer + layout.offsetInChunk + size_t(chunkStream.frameCount) * layout.bytesPerFrame, bytes, size_t(frames) * layout.bytesPerFrame);
+        chunkStream.frameCount += frames;
+        mReceivedFrames[stream] += frames;
+        bytes += size_t(frames) * layout.bytesPerFrame;
+        frameCount -= frames;
+
+        if (chunkStream.frameCount == layout.framesPerChunk) {
+            mCursors[stream]++;
+        }
+        // Write out every chunk that all the streams have filled.
+        while (mPendingCount > 0 && std::all_of(mCursors.begin(), mCursors.end(), [](uint32_t cursor) { return cursor > 0; })) {
+            emitOldestChunk();
+        }
+    }
+    return !mFailed;
+}
+
+void CaptureContainerWriter::openChunk() {
+    auto& chunk = pendingChunk(mPendingCount);
+    for (auto& chunkStream : chunk.streams) {
+        chunkStream = ContainerChunkStream{};
+    }
+    mPendingCount++;
+}
+
+bool CaptureContainerWriter::emitOldestChunk() {
+    auto& chunk = pendingChunk(0);
+
+    // A stream that wrote nothing to the chunk continues from where it is in a later chunk.
+    for (uint32_t stream = 0; stream < mStreams.size(); ++stream) {
+        auto& chunkStream = chunk.streams[stream];
+        if (chunkStream.frameCount == 0) {
+            chunkStream.firstFrame = mReceivedFrames[stream];
+        }
+        // Clear what's left of a short block, so the file never holds stale audio.
+        const auto& layout = mStreams[stream];
+        const auto unused = layout.framesPerChunk - chunkStream.frameCount;
+        memset(chunk.buffer + layout.offsetInChunk + size_t(chunkStream.frameCount) * layout.bytesPerFrame, 0, size_t(unused) * layout.bytesPerFrame);
+    }
+
+    ContainerChunkHeader header{mChunkCount, uint32_t(mStreams.size()), 0};
+    memcpy(chunk.buffer, &header, sizeof(header));
+    memcpy(chunk.buffer + sizeof(header), chunk.streams.data(), sizeof(ContainerChunkStream) * mStreams.size());
+
+    if (!mFailed && !writeAll(mFile, chunk.buffer, mHeader.chunkBytes)) {
+        mFailed = true;
+    }
+
+    ContainerIndexEntry entry{mFileOffset};
+    const auto entryStart = mIndex.size();
+    mIndex.resize(entryStart + sizeof(entry) + sizeof(ContainerChunkStream) * mStreams.size());
+    memcpy(mIndex.data() + entryStart, &entry, sizeof(entry));
+    memcpy(mIndex.data() + entryStart + sizeof(entry), chunk.streams.data(), sizeof(ContainerChunkStream) * mStreams.size());
+    mFileOffset += mHeader.chunkBytes;
+    mChunkCount++;
+
+    mOldestPending = (mOldestPending + 1) % kMaxPendingChunks;
+    mPendingCount--;
+    for (auto& cursor : mCursors) {
+        if (cursor > 0) {
+            cursor--;
+        }
+    }
+    return !mFailed;
+}
+
+bool CaptureContainerWriter::close() {
+    if (mFile < 0) {
+        return false;
+    }
+    while (mPendingCount > 0) {
+        emitOldestChunk();
+    }
+
+    // The index goes after the last chunk, and the header points to it.
+    mHeader.chunkCount = mChunkCount;
+    mHeader.indexOffset = mFileOffset;
+    bool succeeded = !mFailed && writeAll(mFile, mIndex.data(), mIndex.size());
+    succeeded = succeeded && ::pwrite(mFile, &mHeader, sizeof(mHeader), 0) == ssize_t(sizeof(mHeader));
+
+    ::close(mFile);
+    mFile = -1;
+    return succeeded;
+}
+
+// MARK: - Reader
+
+CaptureContainerReader::~CaptureContainerReader() {
+    close();
+}
+
+bool CaptureContainerReader::open(const std::string& path) {
+    close();
+
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat status {};
+    if (fstat(file, &status) != 0 || size_t(status.st_size) < sizeof(ContainerHeader)) {
+        ::close(file);
+        return false;
+    }
+    void* mapping = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+    ::close(file);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    mMapping = static_cast<const uint8_t*>(mapping);
+    mMappingSize = size_t(status.st_size);
+
+    // Check that the header is complete and that everything it points to is inside the file.
+    ContainerHeader header;
+    memcpy(&header, mMapping, sizeof(header));
+    const auto streamsEnd = sizeof(ContainerHeader) + sizeof(ContainerStream) * uint64_t(header.streamCount);
+    mIndexEntryBytes = sizeof(ContainerIndexEntry) + sizeof(ContainerChunkStream) * size_t(header.streamCount);
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        streamsEnd > mMappingSize || header.indexOffset > mMappingSize ||
+        header.chunkCount > (mMappingSize - header.indexOffset) / mIndexEntryBytes) {
+        close();
+        return false;
+    }
+    mStreams.resize(header.streamCount);
+    memcpy(mStreams.data(), mMapping + sizeof(ContainerHeader), sizeof(ContainerStream) * header.streamCount);
+    for (const auto& stream : mStreams) {
+        if (stream.offsetInChunk + uint64_t(stream.framesPerChunk) * stream.bytesPerFrame > header.chunkBytes) {
+            close();
+            return false;
+        }
+    }
+    mChunkCount = header.chunkCount;
+    mIndex = mMapping + header.indexOffset;
+    for (uint64_t chunk = 0; chunk < mChunkCount; ++chunk) {
+        if (chunkOffset(chunk) + header.chunkBytes > header.indexOffset) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void CaptureContainerReader::close() {
+    if (mMapping != nullptr) {
+        munmap(const_cast<uint8_t*>(mMapping), mMappingSize);
+    }
+    mMapping = nullptr;
+    mMappingSize = 0;
+    mStreams.clear();
+    mChunkCount = 0;
+    mIndex = nullptr;
+}
+
+CaptureStreamFormat CaptureContainerReader::format(uint32_t stream) const {
+    const auto& layout = mStreams.at(stream);
+    return {layout.sampleRate, layout.channelCount, layout.bytesPerFrame, layout.sampleFormat};
+}
+
+uint64_t CaptureContainerReader::chunkOffset(uint64_t chunk) const {
+    ContainerIndexEntry entry;
+    memcpy(&entry, mIndex + chunk * mIndexEntryBytes, sizeof(entry));
+    return entry.fileOffset;
+}
+
+const ContainerChunkStream& CaptureContainerReader::chunkStream(uint64_t chunk, uint32_t stream) const {
+    return *reinterpret_cast<const ContainerChunkStream*>(mIndex + chunk * mIndexEntryBytes + sizeof(ContainerIndexEntry) + sizeof(ContainerChunkStream) * stream);
+}
+
+uint64_t CaptureContainerReader::frameCount(uint32_t stream) const {
+    if (stream >= mStreams.size() || mChunkCount == 0) {
+        return 0;
+    }
+    const auto& last = chunkStream(mChunkCount - 1, stream);
+    return last.firstFrame + last.frameCount;
+}
+
+const uint8_t* CaptureContainerReader::frames(uint32_t stream, uint64_t frame, uint32_t& contiguousFrames) const {
+    contiguousFrames = 0;
+    if (stream >= mStreams.size() || mChunkCount == 0) {
+        return nullptr;
+    }
+
+    // A stream's first frames only increase from chunk to chunk, so find the last chunk that starts at or before `frame`.
+    uint64_t low = 0;
+    uint64_t high = mChunkCount;
+    while (high - low > 1) {
+        const auto middle = low + (high - low) / 2;
+        if (chunkStream(middle, stream).firstFrame <= frame) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+    // Step past chunks that hold none of the stream's frames.
+    for (auto chunk = low; chunk < mChunkCount; ++chunk) {
+        const auto& entry = chunkStream(chunk, stream);
+        if (entry.firstFrame > frame) {
+            break;
+        }
+        if (frame < entry.firstFrame + entry.frameCount) {
+            const auto& layout = mStreams[stream];
+            const auto frameInChunk = frame - entry.firstFrame;
+            contiguousFrames = uint32_t(entry.frameCount - frameInChunk);
+            return mMapping + chunkOffset(chunk) + layout.offsetInChunk + frameInChunk * layout.bytesPerFrame;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t CaptureContainerReader::read(uint32_t stream, uint64_t firstFrame, uint64_t frameCount, void* destination) const {
+    auto output = static_cast<uint8_t*>(destination);
+    uint64_t copied = 0;
+    while (copied < frameCount) {
+        uint32_t contiguous = 0;
+        const auto source = frames(stream, firstFrame + copied, contiguous);
+        if (source == nullptr) {
+            break;
+        }
+        const auto count = std::min<uint64_t>(contiguous, frameCount - copied);
+        const auto bytesPerFrame = mStreams[stream].bytesPerFrame;
+        memcpy(output + copied * bytesPerFrame, source, size_t(count) * bytesPerFrame);
+        copied += count;
+    }
+    return copied;
+}
@@ -0,0 +1,163 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A single-file container that stores every captured stream in fixed-size, aligned chunks with a seek index.
+*/
+
+#ifndef CaptureContainer_hpp
+#define CaptureContainer_hpp
+
+#include "CaptureEngine.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The container's layout, in native byte order:
+//
+//   header     `ContainerHeader`, then a `ContainerStream` per stream, padded to `kAlignment`
+//   chunks     `chunkBytes` each. A chunk starts with a `ContainerChunkHeader` and a
+//              `ContainerChunkStream` per stream, then holds each stream's frames, interleaved
+//              as captured, at that stream's `offsetInChunk`.
+//   index      A `ContainerIndexEntry` and a `ContainerChunkStream` per stream for every chunk.
+//
+// Every chunk covers about `chunkDuration` seconds of each stream. A stream's frames run on
+// from one chunk to the next, and each chunk records the first frame and frame count of every
+// stream, so the index finds any frame of any stream with a binary search and one read.
+namespace CaptureContainer {
+
+constexpr char kMagic[8] = {'T', 'A', 'P', 'C', 'A', 'P', '0', '1'};
+constexpr uint32_t kVersion = 1;
+
+// Chunks and the header are multiples of the page size, so chunks map and read without straddling pages.
+constexpr uint32_t kAlignment = 4096;
+
+// Each stream's block within a chunk starts on a cache line.
+constexpr uint32_t kBlockAlignment = 64;
+
+struct ContainerHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t streamCount;
+    uint64_t chunkBytes;
+    uint64_t dataOffset;
+    uint64_t chunkCount;
+    uint64_t indexOffset;
+    double chunkDuration;
+};
+
+struct ContainerStream {
+    double sampleRate;
+    uint32_t channelCount;
+    uint32_t bytesPerFrame;
+    uint32_t framesPerChunk;
+    CaptureSampleFormat sampleFormat;
+    uint64_t offsetInChunk;
+};
+
+struct ContainerChunkHeader {
+    uint64_t chunkIndex;
+    uint32_t streamCount;
+    uint32_t reserved;
+};
+
+struct ContainerChunkStream {
+    uint64_t firstFrame;
+    uint32_t frameCount;
+    uint32_t reserved;
+};
+
+struct ContainerIndexEntry {
+    uint64_t fileOffset;
+};
+
+} // namespace CaptureContainer
+
+// Writes captured streams to a container as the capture engine's writer thread drains them.
+// A stream's frames collect in a chunk buffer until every stream has filled its part of the
+// chunk, and the whole chunk goes to the file in one sequential, aligned write. If a stream
+// falls several chunks behind the others, the oldest chunk goes out with that stream's part short.
+class CaptureContainerWriter final : public CaptureSink {
+public:
+    CaptureContainerWriter() = default;
+    CaptureContainerWriter(const CaptureContainerWriter&) = delete;
+    CaptureContainerWriter& operator=(const CaptureContainerWriter&) = delete;
+    ~CaptureContainerWriter() override;
+
+    // Creates the file, replacing any file at `path`, and preallocates the chunk buffers.
+    bool open(const std::string& path, const std::vector<CaptureStreamFormat>& streams, double chunkDuration = 0.25);
+
+    bool write(uint32_t stream, const void* data, uint32_t frameCount) override;
+
+    // Writes the partly filled chunks, the index, and the final header, and closes the file.
+    bool close();
+
+    uint64_t chunkCount() const { return mChunkCount; }
+
+private:
+    struct PendingChunk {
+        uint8_t* buffer = nullptr;
+        std::vector<CaptureContainer::ContainerChunkStream> streams;
+    };
+
+    void openChunk();
+    bool emitOldestChunk();
+    PendingChunk& pendingChunk(uint32_t position) { return mPending[(mOldestPending + position) % mPending.size()]; }
+
+    int mFile = -1;
+    bool mFailed = false;
+    CaptureContainer::ContainerHeader mHeader{};
+    std::vector<CaptureContainer::ContainerStream> mStreams;
+    uint64_t mFileOffset = 0;
+
+    std::vector<uint8_t> mChunkStorage;
+    std::vector<PendingChunk> mPending;
+    uint32_t mOldestPending = 0;
+    uint32_t mPendingCount = 0;
+
+    // For each stream, the pending chunk it's filling, counted from the oldest, and the frames it has written.
+    std::vector<uint32_t> mCursors;
+    std::vector<uint64_t> mReceivedFrames;
+
+    std::vector<uint8_t> mIndex;
+    uint64_t mChunkCount = 0;
+};
+
+// Maps a container into memory, and reads any frame range of any stream without copying.
+class CaptureContainerReader {
+public:
+    CaptureContainerReader() = default;
+    CaptureContainerReader(const CaptureContainerReader&) = delete;
+    CaptureContainerReader& operator=(const CaptureContainerReader&) = delete;
+    ~CaptureContainerReader();
+
+    bool open(const std::string& path);
+    void close();
+
+    uint32_t streamCount() const { return uint32_t(mStreams.size()); }
+    CaptureStreamFormat format(uint32_t stream) const;
+    uint64_t chunkCount() const { return mChunkCount; }
+    uint64_t frameCount(uint32_t stream) const;
+
+    // Returns a pointer into the mapping at a stream's frame, and the number of frames
+    // that follow it contiguously in the same chunk, or null if the stream doesn't have the frame.
+    const uint8_t* frames(uint32_t stream, uint64_t frame, uint32_t& contiguousFrames) const;
+
+    // Copies a frame range into `destination`, across chunks, and returns the frames copied.
+    uint64_t read(uint32_t stream, uint64_t firstFrame, uint64_t frameCount, void* destination) const;
+
+private:
+    const CaptureContainer::ContainerChunkStream& chunkStream(uint64_t chunk, uint32_t stream) const;
+    uint64_t chunkOffset(uint64_t chunk) const;
+
+    const uint8_t* mMapping = nullptr;
+    size_t mMappingSize = 0;
+    std::vector<CaptureContainer::ContainerStream> mStreams;
+    uint64_t mChunkCount = 0;
+    const uint8_t* mIndex = nullptr;
+    size_t mIndexEntryBytes = 0;
+};
+
+#endif /* CaptureContainer_hpp */
@@ -0,0 +1,317 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a portable capture core that moves audio from the I/O cycle to a writer thread through lock-free rings.
+*/
+
+#include "CaptureEngine.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// How often the writer thread wakes to drain the rings. Each wake writes everything the
+// rings hold, so at 48 kHz a stream goes to its sink in writes of about 2,400 frames.
+constexpr auto kWriterInterval = std::chrono::milliseconds(50);
+
+// How often `publish` checks whether the I/O thread has let go of the old table.
+constexpr auto kTableRetryInterval = std::chrono::microseconds(500);
+
+static bool SameFormat(const CaptureStreamFormat& a, const CaptureStreamFormat& b) noexcept {
+    return a.sampleRate == b.sampleRate && a.channelCount == b.channelCount &&
+           a.bytesPerFrame == b.bytesPerFrame && a.sampleFormat == b.sampleFormat;
+}
+
+CaptureEngine::~CaptureEngine() {
+    setHistoryEnabled(false);
+    stopRecording();
+}
+
+void CaptureEngine::configure(const std::vector<CaptureStreamFormat>& inputStreams, double ringSeconds, double historySeconds) {
+    setHistoryEnabled(false);
+    stopRecording();
+
+    mRingSeconds = ringSeconds;
+    mHistorySeconds = std::max(historySeconds, 0.0);
+    std::vector<std::shared_ptr<Stream>> streams;
+    for (const auto& format : inputStreams) {
+        streams.push_back(makeStream(format));
+    }
+    publish(makeTable(std::move(streams)));
+}
+
+void CaptureEngine::reconfigure(const std::vector<CaptureStreamFormat>& inputStreams, const std::vector<int32_t>& previousStreams) {
+    const auto& configuredStreams = mTable->streams;
+    std::vector<bool> kept(configuredStreams.size(), false);
+    std::vector<std::shared_ptr<Stream>> streams;
+    for (size_t index = 0; index < inputStreams.size(); ++index) {
+        const auto& format = inputStreams[index];
+        const auto previous = (index < previousStreams.size()) ? previousStreams[index] : -1;
+        if (previous >= 0 && size_t(previous) < configuredStreams.size() && !kept[size_t(previous)] &&
+            SameFormat(configuredStreams[size_t(previous)]->format, format)) {
+            kept[size_t(previous)] = true;
+            streams.push_back(configuredStreams[size_t(previous)]);
+        }
+        else {
+            streams.push_back(makeStream(format));
+        }
+    }
+
+    auto previousTable = publish(makeTable(std::move(streams)));
+
+    // The I/O thread no longer writes into the streams that went, so write what they still hold.
+    std::lock_guard<std::mutex> lock(mSinkMutex);
+    for (size_t index = 0; index < kept.size(); ++index) {
+        if (!kept[index] && mSink) {
+            drain(*previousTable->streams[index]);
+        }
+    }
+}
+
+void CaptureEngine::configureLoopback(const std::vector<CaptureStreamFormat>& outputStreams,
+                                      const LoopbackConverter::ChannelMap& channelMap,
+                                      uint32_t maxFramesPerCycle) {
+    publish(makeTable(mTable->streams, outputStreams, channelMap, maxFramesPerCycle));
+}
+
+void CaptureEngine::setAnalyzer(std::shared_ptr<CaptureAnalyzer> analyzer) {
+    mAnalyzer = std::move(analyzer);
+    // Keep the streams and the loopback plan as they are.
+    auto table = std::make_unique<StreamTable>(*mTable);
+    table->analyzer = mAnalyzer;
+    publish(std::move(table));
+}
+
+std::shared_ptr<CaptureEngine::Stream> CaptureEngine::makeStream(const CaptureStreamFormat& format) const {
+    auto stream = std::make_shared<Stream>();
+    stream->format = format;
+    const auto frames = uint32_t(std::ceil(std::max(format.sampleRate, 1.0) * (mRingSeconds + mHistorySeconds)));
+    stream->ring = std::make_unique<CaptureRing>(std::max(format.bytesPerFrame, 1u), frames);
+    return stream;
+}
+
+std::unique_ptr<CaptureEngine::StreamTable> CaptureEngine::makeTable(std::vector<std::shared_ptr<Stream>> streams,
+                                                                     const std::vector<CaptureStreamFormat>& outputStreams,
+                                                                     const LoopbackConverter::ChannelMap& channelMap,
+                                                                     uint32_t maxFramesPerCycle) const {
+    std::vector<CaptureStreamFormat> inputStreams;
+    for (const auto& stream : streams) {
+        inputStreams.push_back(stream->format);
+    }
+    auto table = std::make_unique<StreamTable>();
+    table->streams = std::move(streams);
+    // Without output streams, loopback plays silence.
+    table->loopbackConverter = std::make_shared<LoopbackConverter>();
+    table->loopbackConverter->configure(inputStreams, outputStreams, channelMap, maxFramesPerCycle);
+    table->analyzer = mAnalyzer;
+    return table;
+}
+
+std::unique_ptr<CaptureEngine::StreamTable> CaptureEngine::publish(std::unique_ptr<StreamTable> table) {
+    {
+        std::lock_guard<std::mutex> lock(mSinkMutex);
+        std::swap(mTable, table);
+        mPublishedTable.store(mTable.get());
+    }
+    // Wait out an I/O cycle still running on the old table. The I/O thread never waits on this
+    // thread, so this takes at most one cycle.
+    while (mTableInUse.load() == table.get()) {
+        std::this_thread::sleep_for(kTableRetryInterval);
+    }
+    return table;
+}
+
+void CaptureEngine::setHistoryEnabled(bool enabled) {
+    if (enabled == mHistory.load() || (enabled && mHistorySeconds <= 0)) {
+        return;
+    }
+    if (enabled) {
+        if (!mRecording.load()) {
+            // Nothing writes into the rings yet, so start them empty.
+            for (auto& stream : mTable->streams) {
+                stream->ring->discardAll();
+            }
+            startWriter();
+        }
+        mHistory.store(true, std::memory_order_release);
+    }
+    else {
+        mHistory.store(false, std::memory_order_release);
+        if (!mRecording.load()) {
+            stopWriter();
+        }
+    }
+}
+
+void CaptureEngine::startRecording(std::unique_ptr<CaptureSink> sink, double preRollSeconds) {
+    stopRecording();
+
+    if (mHistory.load()) {
+        // Take over the rings from the writer thread, and drop the history older than the pre-roll.
+        std::lock_guard<std::mutex> lock(mSinkMutex);
+        for (uint32_t index = 0; index < mTable->streams.size(); ++index) {
+            auto& stream = *mTable->streams[index];
+            const auto available = stream.ring->availableFrames();
+            const auto preRollFrames = uint32_t(std::ceil(std::max(preRollSeconds, 0.0) * stream.format.sampleRate));
+            stream.ring->consume(available - std::min(available, preRollFrames));
+            stream.sinkStream = int32_t(index);
+        }
+        mSink = std::move(sink);
+        mRecording.store(true, std::memory_order_release);
+        return;
+    }
+
+    // Start from an empty ring, and let the I/O thread fill it only once the writer is running.
+    for (uint32_t index = 0; index < mTable->streams.size(); ++index) {
+        auto& stream = *mTable->streams[index];
+        stream.ring->discardAll();
+        stream.sinkStream = int32_t(index);
+    }
+    mSink = std::move(sink);
+    startWriter();
+    mRecording.store(true, std::memory_order_release);
+}
+
+void CaptureEngine::stopRecording() {
+    if (mHistory.load()) {
+        // Write what the recording captured up to now, and leave the writer thread keeping history.
+        std::lock_guard<std::mutex> lock(mSinkMutex);
+        mRecording.store(false, std::memory_order_release);
+        if (mSink) {
+            drain();
+            mSink.reset();
+        }
+        return;
+    }
+
+    mRecording.store(false, std::memory_order_release);
+    stopWriter();
+    mSink.reset();
+}
+
+// MARK: - I/O cycle
+
+void CaptureEngine::process(const CaptureBuffer* inputs, uint32_t inputCount, CaptureBuffer* outputs, uint32_t outputCount) noexcept {
+    const bool capturing = mRecording.load(std::memory_order_acquire) || mHistory.load(std::memory_order_acquire);
+    const bool loopback = mLoopback.load(std::memory_order_relaxed);
+
+    // Hold the published table for the cycle. Checking that it's still the published one after
+    // holding it means `publish` can't free it under this thread.
+    auto* table = mPublishedTable.load();
+    mTableInUse.store(table);
+    for (auto* published = mPublishedTable.load(); published != table; published = mPublishedTable.load()) {
+        table = published;
+        mTableInUse.store(table);
+    }
+
+    for (uint32_t index = 0; index < inputCount; ++index) {
+        const auto& buffer = inputs[index];
+        if (table->analyzer != nullptr) {
+            table->analyzer->capture(index, buffer);
+        }
+        if (capturing && index < table->streams.size()) {
+            auto& stream = *table->streams[index];
+            const auto frames = buffer.byteSize / stream.ring->bytesPerFrame();
+            const auto written = stream.ring->write(buffer.data, frames);
+            stream.capturedFrames.store(stream.capturedFrames.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+            if (written < frames) {
+                stream.droppedFrames.store(stream.droppedFrames.load(std::memory_order_relaxed) + (frames - written), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    if (loopback) {
+        table->loopbackConverter->process(inputs, inputCount, outputs, outputCount);
+    }
+    mTableInUse.store(nullptr);
+}
+
+// MARK: - Writer thread
+
+void CaptureEngine::startWriter() {
+    mWriterRunning.store(true);
+    mWriter = std::thread([this] { runWriter(); });
+}
+
+void CaptureEngine::stopWriter() {
+    mWriterRunning.store(false);
+    if (mWriter.joinable()) {
+        mWriter.join();
+    }
+}
+
+void CaptureEngine::runWriter() {
+    bool running = true;
+    while (running) {
+        running = mWriterRunning.load();
+        {
+            // On the last pass, write whatever the I/O thread captured before recording stopped.
+            std::lock_guard<std::mutex> lock(mSinkMutex);
+            if (mSink) {
+                drain();
+            }
+            else {
+                trimHistory();
+            }
+        }
+        if (running) {
+            std::this_thread::sleep_for(kWriterInterval);
+        }
+    }
+}
+
+void CaptureEngine::trimHistory() {
+    for (auto& stream : mTable->streams) {
+        const auto available = stream->ring->availableFrames();
+        const auto historyFrames = uint32_t(std::ceil(mHistorySeconds * stream->format.sampleRate));
+        if (available > historyFrames) {
+            stream->ring->consume(available - historyFrames);
+        }
+    }
+}
+
+void CaptureEngine::drain() {
+    for (auto& stream : mTable->streams) {
+        drain(*stream);
+    }
+}
+
+void CaptureEngine::drain(Stream& stream) {
+    const uint8_t* first = nullptr;
+    const uint8_t* second = nullptr;
+    uint32_t firstFrames = 0;
+    uint32_t secondFrames = 0;
+    const auto available = stream.ring->peek(first, firstFrames, second, secondFrames);
+    if (available == 0) {
+        return;
+    }
+    // A stream that joined during the recording has no place in the sink.
+    if (stream.sinkStream >= 0) {
+        const auto sinkStream = uint32_t(stream.sinkStream);
+        bool succeeded = mSink->write(sinkStream, first, firstFrames);
+        if (secondFrames > 0) {
+            succeeded = mSink->write(sinkStream, second, secondFrames) && succeeded;
+        }
+        if (!succeeded) {
+            mSinkErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+        stream.writtenFrames.fetch_add(available, std::memory_order_relaxed);
+    }
+    stream.ring->consume(available);
+}
+
+// MARK: - Statistics
+
+CaptureEngine::StreamStatistics CaptureEngine::statistics(uint32_t stream) const {
+    StreamStatistics statistics;
+    if (stream < mTable->streams.size()) {
+        const auto& state = *mTable->streams[stream];
+        statistics.fillFrames = state.ring->availableFrames();
+        statistics.capacityFrames = state.ring->frameCapacity();
+        statistics.capturedFrames = state.capturedFrames.load(std::memory_order_relaxed);
+        statistics.droppedFrames = state.droppedFrames.load(std::memory_order_relaxed);
+        statistics.writtenFrames = state.writtenFrames.load(std::memory_order_relaxed);
+    }
+    return statistics;
+}
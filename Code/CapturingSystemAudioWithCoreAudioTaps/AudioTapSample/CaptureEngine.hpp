@@ -0,0 +1,165 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable capture core that moves audio from the I/O cycle to a writer thread through lock-free rings.
+*/
+
+#ifndef CaptureEngine_hpp
+#define CaptureEngine_hpp
+
+#include "CaptureAnalyzer.hpp"
+#include "CaptureFormat.hpp"
+#include "CaptureRing.hpp"
+#include "LoopbackConverter.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Where the writer thread puts captured audio, such as a set of files.
+class CaptureSink {
+public:
+    virtual ~CaptureSink() = default;
+
+    // Writes frames of a stream in its captured format. Runs on the writer thread only.
+    virtual bool write(uint32_t stream, const void* data, uint32_t frameCount) = 0;
+};
+
+// Captures each input stream into its own ring on the I/O thread, and drains the rings into a
+// sink on a writer thread. The I/O thread only copies into the rings and reads atomics; it never
+// blocks, allocates, or calls into the file system. When a ring is full, the cycle's remaining
+// frames are dropped and counted.
+//
+// With history on, the engine captures even while it isn't recording, and the writer thread trims
+// each ring to the last few seconds instead of writing it. A recording can then start from a
+// moment that has already passed, without restarting I/O.
+//
+// The streams and the loopback converter live in a table that the I/O thread picks up at the
+// start of each cycle. Reconfiguring publishes a new table and frees the old one once the I/O
+// thread has let go of it, so streams can come and go while the others keep capturing.
+class CaptureEngine {
+public:
+    struct StreamStatistics {
+        uint32_t fillFrames = 0;
+        uint32_t capacityFrames = 0;
+        uint64_t capturedFrames = 0;
+        uint64_t droppedFrames = 0;
+        uint64_t writtenFrames = 0;
+    };
+
+    CaptureEngine() = default;
+    CaptureEngine(const CaptureEngine&) = delete;
+    CaptureEngine& operator=(const CaptureEngine&) = delete;
+    ~CaptureEngine();
+
+    // Builds a ring for each input stream holding `ringSeconds` of audio, plus `historySeconds` of
+    // history. Turns history off and stops recording.
+    void configure(const std::vector<CaptureStreamFormat>& inputStreams, double ringSeconds, double historySeconds = 0);
+
+    // Changes the input streams while I/O, recording, and history carry on. For each new stream,
+    // `previousStreams` holds the index of the configured stream it continues, whose ring and place
+    // in the recording it keeps, or -1 for a new stream. A new stream starts recording at the next
+    // recording. The rest of the configured streams go, after the writer thread writes what they hold.
+    // Loopback plays silence until `configureLoopback` plans it again.
+    void reconfigure(const std::vector<CaptureStreamFormat>& inputStreams, const std::vector<int32_t>& previousStreams);
+
+    // The configured streams. Call from the thread that configures the engine.
+    uint32_t streamCount() const { return uint32_t(mTable->streams.size()); }
+    const CaptureStreamFormat& streamFormat(uint32_t stream) const { return mTable->streams[stream]->format; }
+
+    // Keeps the configured seconds of history while not recording. Does nothing if `configure` asked for none.
+    void setHistoryEnabled(bool enabled);
+    bool isHistoryEnabled() const { return mHistory.load(std::memory_order_relaxed); }
+
+    // Starts recording into `sink`. With history on, the recording begins with up to `preRollSeconds`
+    // of audio already captured, and capture carries on uninterrupted. Otherwise it starts at the next I/O cycle.
+    void startRecording(std::unique_ptr<CaptureSink> sink, double preRollSeconds = 0);
+
+    // Stops recording, writes what the rings hold, and releases the sink. With history on, capture carries on.
+    void stopRecording();
+
+    bool isRecording() const { return mRecording.load(std::memory_order_relaxed); }
+
+    void setLoopbackEnabled(bool enabled) { mLoopback.store(enabled, std::memory_order_relaxed); }
+    bool isLoopbackEnabled() const { return mLoopback.load(std::memory_order_relaxed); }
+
+    // Plans how loopback fills `outputStreams` from the configured input streams. Call after
+    // `configure` or `reconfigure`. Safe while I/O runs; the new plan takes over at the next cycle.
+    // An empty map uses `LoopbackConverter::defaultChannelMap`.
+    void configureLoopback(const std::vector<CaptureStreamFormat>& outputStreams,
+                           const LoopbackConverter::ChannelMap& channelMap,
+                           uint32_t maxFramesPerCycle);
+
+    // Hands every cycle of the input streams to `analyzer`, from the next cycle on, or stops with null.
+    // The analyzer should be started for the configured streams. Safe while I/O runs.
+    void setAnalyzer(std::shared_ptr<CaptureAnalyzer> analyzer);
+
+    // Runs one I/O cycle. Real-time safe.
+    void process(const CaptureBuffer* inputs, uint32_t inputCount, CaptureBuffer* outputs, uint32_t outputCount) noexcept;
+
+    // Call from the thread that configures the engine.
+    StreamStatistics statistics(uint32_t stream) const;
+    uint64_t loopbackDiscontinuityCount() const { return mTable->loopbackConverter->discontinuityCount(); }
+
+    // Safe to call from any thread.
+    uint64_t sinkErrorCount() const { return mSinkErrors.load(std::memory_order_relaxed); }
+
+private:
+    struct Stream {
+        CaptureStreamFormat format;
+        std::unique_ptr<CaptureRing> ring;
+        std::atomic<uint64_t> capturedFrames{0};
+        std::atomic<uint64_t> droppedFrames{0};
+        std::atomic<uint64_t> writtenFrames{0};
+        // The stream's index in the sink, or -1 if the stream joined after recording started.
+        int32_t sinkStream = -1;
+    };
+
+    // Tables share streams and converters; only the I/O thread holding a table uses them.
+    struct StreamTable {
+        std::vector<std::shared_ptr<Stream>> streams;
+        std::shared_ptr<LoopbackConverter> loopbackConverter;
+        std::shared_ptr<CaptureAnalyzer> analyzer;
+    };
+
+    std::shared_ptr<Stream> makeStream(const CaptureStreamFormat& format) const;
+    std::unique_ptr<StreamTable> makeTable(std::vector<std::shared_ptr<Stream>> streams,
+                                           const std::vector<CaptureStreamFormat>& outputStreams = {},
+                                           const LoopbackConverter::ChannelMap& channelMap = {},
+                                           uint32_t maxFramesPerCycle = 0) const;
+    std::unique_ptr<StreamTable> publish(std::unique_ptr<StreamTable> table);
+    void startWriter();
+    void stopWriter();
+    void runWriter();
+    void drain();
+    void drain(Stream& stream);
+    void trimHistory();
+
+    // Declared before `mTable`, whose first table copies it.
+    std::shared_ptr<CaptureAnalyzer> mAnalyzer;
+
+    // `mTable` belongs to the configuring thread, and to the writer thread under `mSinkMutex`.
+    // The I/O thread reads `mPublishedTable`, and holds it in `mTableInUse` for the length of a cycle.
+    std::unique_ptr<StreamTable> mTable = makeTable({});
+    std::atomic<StreamTable*> mPublishedTable{mTable.get()};
+    std::atomic<StreamTable*> mTableInUse{nullptr};
+    double mRingSeconds = 0;
+    std::atomic<bool> mRecording{false};
+    std::atomic<bool> mHistory{false};
+    double mHistorySeconds = 0;
+    std::atomic<bool> mLoopback{false};
+
+    // Guards the sink and the consumer side of the rings, which pass between the writer thread and
+    // the thread that starts and stops recordings.
+    std::mutex mSinkMutex;
+    std::unique_ptr<CaptureSink> mSink;
+    std::thread mWriter;
+    std::atomic<bool> mWriterRunning{false};
+    std::atomic<uint64_t> mSinkErrors{0};
+};
+
+#endif /* CaptureEngine_hpp */
@@ -0,0 +1,86 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Functions that implement the sample format conversions the portable capture classes share.
+*/
+
+#include "CaptureFormat.hpp"
+
+#include <cstring>
+
+// Four-lane vectors that compile to NEON on Apple silicon and SSE on Intel.
+typedef float Float4 __attribute__((vector_size(16)));
+typedef int32_t Int4 __attribute__((vector_size(16)));
+typedef int16_t Short4 __attribute__((vector_size(8)));
+
+template <typename Vector>
+static inline Vector Load(const void* source) noexcept {
+    Vector value;
+    memcpy(&value, source, sizeof(value));
+    return value;
+}
+
+template <typename Vector>
+static inline void Store(void* destination, Vector value) noexcept {
+    memcpy(destination, &value, sizeof(value));
+}
+
+uint32_t BytesPerSample(CaptureSampleFormat format) noexcept {
+    switch (format) {
+        case CaptureSampleFormat::float32: return 4;
+        case CaptureSampleFormat::float64: return 8;
+        case CaptureSampleFormat::int16: return 2;
+        case CaptureSampleFormat::int24: return 3;
+        case CaptureSampleFormat::int32: return 4;
+        case CaptureSampleFormat::unsupported: return 0;
+    }
+    return 0;
+}
+
+bool IsSupportedFormat(const CaptureStreamFormat& format) noexcept {
+    const auto bytesPerSample = BytesPerSample(format.sampleFormat);
+    return bytesPerSample != 0 && format.channelCount != 0 && format.sampleRate > 0 &&
+           format.bytesPerFrame == bytesPerSample * format.channelCount;
+}
+
+void ConvertToFloat(CaptureSampleFormat format, const void* source, float* destination, size_t count) noexcept {
+    const auto* bytes = static_cast<const uint8_t*>(source);
+    size_t index = 0;
+    switch (format) {
+        case CaptureSampleFormat::float32:
+            memcpy(destination, source, count * sizeof(float));
+            return;
+        case CaptureSampleFormat::float64:
+            for (; index < count; ++index) {
+                destination[index] = float(reinterpret_cast<const double*>(source)[index]);
+            }
+            return;
+        case CaptureSampleFormat::int16:
+            for (; index + 4 <= count; index += 4) {
+                Store(destination + index, __builtin_convertvector(Load<Short4>(bytes + index * 2), Float4) * (1.0f / 32768.0f));
+            }
+            for (; index < count; ++index) {
+                destination[index] = float(reinterpret_cast<const int16_t*>(source)[index]) * (1.0f / 32768.0f);
+            }
+            return;
+        case CaptureSampleFormat::int24:
+            // Packed 24-bit samples don't line up with vector lanes, so this one is a scalar loop.
+            for (; index < count; ++index) {
+                const uint8_t* sample = bytes + index * 3;
+                const auto value = int32_t(uint32_t(sample[0]) << 8 | uint32_t(sample[1]) << 16 | uint32_t(sample[2]) << 24) >> 8;
+                destination[index] = float(value) * (1.0f / 8388608.0f);
+            }
+            return;
+        case CaptureSampleFormat::int32:
+            for (; index + 4 <= count; index += 4) {
+                Store(destination + index, __builtin_convertvector(Load<Int4>(bytes + index * 4), Float4) * (1.0f / 2147483648.0f));
+            }
+            for (; index < count; ++index) {
+                destination[index] = float(reinterpret_cast<const int32_t*>(source)[index]) * (1.0f / 2147483648.0f);
+            }
+            return;
+        case CaptureSampleFormat::unsupported:
+            return;
+    }
+}
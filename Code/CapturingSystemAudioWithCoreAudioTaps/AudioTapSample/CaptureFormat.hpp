@@ -0,0 +1,50 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+The stream formats, buffers, and sample conversions that the portable capture classes share.
+*/
+
+#ifndef CaptureFormat_hpp
+#define CaptureFormat_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+// The sample formats the loopback converter reads and writes, in native byte order.
+// `int32` also covers 24-bit samples aligned high in 32 bits.
+enum class CaptureSampleFormat : uint32_t {
+    unsupported,
+    float32,
+    float64,
+    int16,
+    int24,
+    int32
+};
+
+// The format of one interleaved stream, as the device delivers it.
+struct CaptureStreamFormat {
+    double sampleRate = 0;
+    uint32_t channelCount = 0;
+    uint32_t bytesPerFrame = 0;
+    CaptureSampleFormat sampleFormat = CaptureSampleFormat::unsupported;
+};
+
+// One stream's buffer for one I/O cycle. It has the same layout as Core Audio's `AudioBuffer`,
+// so the I/O proc passes the device's buffer lists through without copying them.
+struct CaptureBuffer {
+    uint32_t channelCount;
+    uint32_t byteSize;
+    void* data;
+};
+
+// The bytes in one sample of `format`, or 0 if it's `unsupported`.
+uint32_t BytesPerSample(CaptureSampleFormat format) noexcept;
+
+// Whether the converters can read and write `format`: a known sample format whose frame is exactly one sample per channel.
+bool IsSupportedFormat(const CaptureStreamFormat& format) noexcept;
+
+// Converts `count` interleaved samples to float in [-1, 1), four lanes at a time.
+void ConvertToFloat(CaptureSampleFormat format, const void* source, float* destination, size_t count) noexcept;
+
+#endif /* CaptureFormat_hpp */
@@ -0,0 +1,96 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A lock-free single-producer, single-consumer ring of audio frames in a stream's captured format.
+*/
+
+#ifndef CaptureRing_hpp
+#define CaptureRing_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// The I/O thread writes each cycle's frames into the ring, and a writer thread reads them back in
+// large batches. The ring stores frames as opaque bytes, so it works for any interleaved format.
+// Neither side locks or allocates after construction.
+class CaptureRing {
+public:
+    CaptureRing(uint32_t bytesPerFrame, uint32_t minimumFrameCapacity)
+        : mBytesPerFrame(bytesPerFrame) {
+        // Round up to a power of two so positions wrap with a mask.
+        mFrameCapacity = 1;
+        while (mFrameCapacity < minimumFrameCapacity) {
+            mFrameCapacity <<= 1;
+        }
+        mMask = mFrameCapacity - 1;
+        mStorage = std::make_unique<uint8_t[]>(size_t(mFrameCapacity) * mBytesPerFrame);
+    }
+
+    CaptureRing(const CaptureRing&) = delete;
+    CaptureRing& operator=(const CaptureRing&) = delete;
+
+    uint32_t bytesPerFrame() const { return mBytesPerFrame; }
+    uint32_t frameCapacity() const { return mFrameCapacity; }
+
+    // MARK: - Producer
+
+    // Copies up to `frameCount` frames in and returns how many fit.
+    uint32_t write(const void* data, uint32_t frameCount) noexcept {
+        const auto writePosition = mWritePosition.load(std::memory_order_relaxed);
+        const auto readPosition = mReadPosition.load(std::memory_order_acquire);
+        const auto frames = std::min<uint64_t>(frameCount, mFrameCapacity - (writePosition - readPosition));
+
+        const auto start = uint32_t(writePosition & mMask);
+        const auto firstPart = std::min<uint64_t>(frames, mFrameCapacity - start);
+        memcpy(mStorage.get() + size_t(start) * mBytesPerFrame, data, size_t(firstPart) * mBytesPerFrame);
+        memcpy(mStorage.get(), static_cast<const uint8_t*>(data) + size_t(firstPart) * mBytesPerFrame, size_t(frames - firstPart) * mBytesPerFrame);
+
+        mWritePosition.store(writePosition + frames, std::memory_order_release);
+        return uint32_t(frames);
+    }
+
+    // MARK: - Consumer
+
+    // The readable frames as up to two contiguous regions, oldest first. `consume` releases them.
+    uint32_t peek(const uint8_t*& first, uint32_t& firstFrames, const uint8_t*& second, uint32_t& secondFrames) const noexcept {
+        const auto readPosition = mReadPosition.load(std::memory_order_relaxed);
+        const auto available = uint32_t(mWritePosition.load(std::memory_order_acquire) - readPosition);
+        const auto start = uint32_t(readPosition & mMask);
+        firstFrames = std::min(available, mFrameCapacity - start);
+        secondFrames = available - firstFrames;
+        first = mStorage.get() + size_t(start) * mBytesPerFrame;
+        second = mStorage.get();
+        return available;
+    }
+
+    void consume(uint32_t frameCount) noexcept {
+        mReadPosition.fetch_add(frameCount, std::memory_order_release);
+    }
+
+    // Drops everything written so far, such as audio captured before a recording began.
+    void discardAll() noexcept {
+        mReadPosition.store(mWritePosition.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // MARK: - Either thread
+
+    uint32_t availableFrames() const noexcept {
+        return uint32_t(mWritePosition.load(std::memory_order_acquire) - mReadPosition.load(std::memory_order_acquire));
+    }
+
+private:
+    const uint32_t mBytesPerFrame;
+    uint32_t mFrameCapacity = 0;
+    uint32_t mMask = 0;
+    std::unique_ptr<uint8_t[]> mStorage;
+
+    // Each side writes its own position on its own cache line.
+    alignas(64) std::atomic<uint64_t> mWritePosition{0};
+    alignas(64) std::atomic<uint64_t> mReadPosition{0};
+};
+
+#endif /* CaptureRing_hpp */
@@ -0,0 +1,424 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a clock estimator and an aligner that resample streams from independent devices onto one device's clock.
+*/
+
+#include "ClockAligner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+constexpr double kPi = 3.14159265358979323846;
+
+// A cycle this far from where the estimator expects it restarts the estimator.
+constexpr double kRestartSeconds = 0.05;
+
+// The clock estimator's bandwidth starts at 1 over this, in Hz, and narrows as 1 over the seconds it has run, plus this.
+constexpr double kNarrowingSeconds = 0.5;
+
+// How much each stream's ring holds, at least, and in intervals of the worker.
+constexpr double kMinimumRingSeconds = 0.5;
+constexpr double kRingIntervals = 8;
+
+// The input a resampler needs beyond the frames it reads: the filter's reach after the read position, and one more.
+constexpr uint32_t kReachFrames = VariableRateResampler::kTaps / 2 + 1;
+
+// The alignment loop pulls a stream's error back to 0 in about `kCorrectionSeconds`, critically damped,
+// and moves the ratio at most `kMaxCorrection` from the ratio of the estimated rates. That's a pitch
+// change of under 2 cents, and several times the drift between two ordinary crystal clocks.
+constexpr double kCorrectionSeconds = 1.0;
+constexpr double kMaxCorrection = 1e-3;
+
+// How far the estimated rates may stray from the nominal ones before the aligner stops believing them.
+constexpr double kMaxDrift = 1e-2;
+
+// A stream further than this out of alignment, as after it drops frames, joins again.
+constexpr double kRealignSeconds = 0.002;
+
+// When the reference has this much audio waiting, the streams that still can't keep up go silent
+// until they can, so a device that stops doesn't stop the recording.
+constexpr double kStallSeconds = 0.2;
+
+// MARK: - Clock estimator
+
+void ClockEstimator::reset(double nominalSampleRate, double bandwidth) noexcept {
+    mNominalSampleRate = nominalSampleRate;
+    mBandwidth = bandwidth;
+    mStarted = false;
+    mFrame = 0;
+    mTime = 0;
+    mPeriod = 1 / nominalSampleRate;
+    mNextFrame = 0;
+    mNextTime = 0;
+    mRestartCount = 0;
+}
+
+void ClockEstimator::update(double hostSeconds, uint32_t frameCount) noexcept {
+    const double error = hostSeconds - mNextTime;
+    if (!mStarted || std::abs(error) > kRestartSeconds) {
+        // Start the loop at this cycle, keeping the frame count and the frame length it had.
+        mRestartCount += mStarted ? 1 : 0;
+        mStarted = true;
+        mFrame = mNextFrame;
+        mTime = hostSeconds;
+    }
+    else {
+        // Set the gains for the length of the cycle that just ended, with the damping of a Butterworth filter.
+        // The loop starts wide, to settle quickly, and narrows as it runs, to average over more cycles.
+        const double elapsedFrames = mNextFrame - mFrame;
+        const double bandwidth = std::max(mBandwidth, 1 / (kNarrowingSeconds + mNextFrame / mNominalSampleRate));
+        const double omega = 2 * kPi * bandwidth * elapsedFrames / mNominalSampleRate;
+        mFrame = mNextFrame;
+        mTime = mNextTime + std::sqrt(2.0) * omega * error;
+        mPeriod += omega * omega * error / elapsedFrames;
+    }
+    mNextFrame = mFrame + frameCount;
+    mNextTime = mTime + frameCount * mPeriod;
+}
+
+// MARK: - Aligner
+
+ClockAligner::~ClockAligner() {
+    stop();
+}
+
+std::vector<CaptureStreamFormat> ClockAligner::outputFormats(const std::vector<CaptureStreamFormat>& streams) {
+    std::vector<CaptureStreamFormat> formats;
+    for (const auto& stream : streams) {
+        formats.push_back({streams.front().sampleRate, stream.channelCount, uint32_t(sizeof(float)) * stream.channelCount, CaptureSampleFormat::float32});
+    }
+    return formats;
+}
+
+bool ClockAligner::start(const std::vector<CaptureStreamFormat>& streams, std::unique_ptr<CaptureSink> sink, double interval) {
+    stop();
+    mStreams.clear();
+    if (streams.empty() || !std::all_of(streams.begin(), streams.end(), IsSupportedFormat) || sink == nullptr) {
+        return false;
+    }
+
+    const double outputSampleRate = streams.front().sampleRate;
+    const double ringSeconds = std::max(kMinimumRingSeconds, interval * kRingIntervals);
+    uint32_t maxChannelCount = 0;
+    for (size_t index = 0; index < streams.size(); ++index) {
+        const auto& format = streams[index];
+        auto stream = std::make_unique<Stream>();
+        stream->format = format;
+        stream->ring = std::make_unique<CaptureRing>(format.bytesPerFrame, uint32_t(std::ceil(format.sampleRate * ringSeconds)));
+        stream->clock.reset(format.sampleRate);
+        stream->nominalRatio = format.sampleRate / outputSampleRate;
+        stream->ratio = stream->nominalRatio;
+        // The reference goes to the sink as it is. Every other stream needs a block's input at the highest
+        // ratio the aligner allows, and the filter's reach.
+        stream->resampled = (index > 0);
+        stream->maxInputFrames = uint32_t(std::ceil(kBlockFrames * stream->nominalRatio * (1 + kMaxDrift) * (1 + kMaxCorrection))) + kReachFrames + 1;
+        if (stream->resampled) {
+            for (uint32_t channel = 0; channel < format.channelCount; ++channel) {
+                stream->resamplers.push_back(std::make_unique<VariableRateResampler>(format.sampleRate, outputSampleRate, stream->maxInputFrames));
+            }
+        }
+        stream->input.resize(size_t(stream->maxInputFrames) * format.channelCount);
+        stream->output.resize(size_t(kBlockFrames) * format.channelCount);
+        maxChannelCount = std::max(maxChannelCount, format.channelCount);
+        mStreams.push_back(std::move(stream));
+    }
+    // Enough silence for a block of any stream, or for the input a resampler joins with.
+    uint32_t maxInputFrames = 0;
+    for (const auto& stream : mStreams) {
+        maxInputFrames = std::max(maxInputFrames, stream->maxInputFrames);
+    }
+    mSilence.assign(size_t(std::max(kBlockFrames, maxInputFrames)) * maxChannelCount, 0.0f);
+    mSink = std::move(sink);
+
+    if (interval > 0) {
+        mWorkerRunning.store(true);
+        mWorker = std::thread([this, interval] { runWorker(interval); });
+    }
+    return true;
+}
+
+void ClockAligner::stop() {
+    mWorkerRunning.store(false);
+    if (mWorker.joinable()) {
+        mWorker.join();
+    }
+    if (mSink != nullptr) {
+        align();
+        mSink.reset();
+    }
+}
+
+// MARK: - I/O cycle
+
+void ClockAligner::capture(uint32_t stream, double hostSeconds, const CaptureBuffer& buffer) noexcept {
+    if (stream >= mStreams.size()) {
+        return;
+    }
+    auto& state = *mStreams[stream];
+    const auto frames = buffer.byteSize / state.format.bytesPerFrame;
+    if (frames == 0) {
+        return;
+    }
+    state.clock.update(hostSeconds, frames);
+    const auto written = state.ring->write(buffer.data, frames);
+    state.ringPosition += written;
+    if (written < frames) {
+        state.droppedFrames.store(state.droppedFrames.load(std::memory_order_relaxed) + (frames - written), std::memory_order_relaxed);
+    }
+
+    // Publish the frame after the cycle, so that the frames the ring just dropped show in the offset at once.
+    const auto sequence = state.clockSequence.load(std::memory_order_relaxed);
+    state.clockSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    state.clockFrame.store(state.clock.frame() + frames, std::memory_order_relaxed);
+    state.clockTime.store(state.clock.time() + frames * state.clock.period(), std::memory_order_relaxed);
+    state.clockPeriod.store(state.clock.period(), std::memory_order_relaxed);
+    state.clockRingPosition.store(state.ringPosition, std::memory_order_relaxed);
+    state.clockSequence.store(sequence + 2, std::memory_order_release);
+}
+
+// MARK: - Worker
+
+void ClockAligner::runWorker(double interval) {
+    while (mWorkerRunning.load()) {
+        align();
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    }
+}
+
+bool ClockAligner::readClock(Stream& stream) const noexcept {
+    while (true) {
+        const auto sequence = stream.clockSequence.load(std::memory_order_acquire);
+        if (sequence == 0) {
+            return false;
+        }
+        if ((sequence & 1) != 0) {
+            continue;
+        }
+        ClockState clock;
+        clock.frame = stream.clockFrame.load(std::memory_order_relaxed);
+        clock.time = stream.clockTime.load(std::memory_order_relaxed);
+        clock.period = stream.clockPeriod.load(std::memory_order_relaxed);
+        clock.ringPosition = stream.clockRingPosition.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (stream.clockSequence.load(std::memory_order_relaxed) == sequence) {
+            stream.published = clock;
+            return true;
+        }
+    }
+}
+
+double ClockAligner::readFrame(const Stream& stream) const noexcept {
+    return stream.resampled ? stream.inputEnd - stream.resamplers.front()->bufferedFrames() :
+                              double(stream.readPosition) + double(stream.frameOffset);
+}
+
+uint32_t ClockAligner::producibleFrames(const Stream& stream) const noexcept {
+    const auto available = double(stream.ring->availableFrames());
+    if (!stream.resampled) {
+        return uint32_t(available);
+    }
+    const auto frames = std::floor((stream.resamplers.front()->bufferedFrames() + available - kReachFrames) / stream.ratio);
+    return uint32_t(std::max(frames, 0.0));
+}
+
+bool ClockAligner::join(Stream& stream, double frame) {
+    const auto& clock = stream.published;
+    stream.frameOffset = int64_t(std::llround(clock.frame)) - int64_t(clock.ringPosition);
+    stream.aligned = false;
+    if (!stream.resampled) {
+        // The reference joins wherever its ring is, as it sets the output's frames.
+        stream.aligned = true;
+        stream.realignmentCount.store(stream.alignmentCount, std::memory_order_relaxed);
+        ++stream.alignmentCount;
+        return true;
+    }
+
+    // Start the resamplers so that they read `frame` next: skip the frames before it, or lead in with silence.
+    for (auto& resampler : stream.resamplers) {
+        resampler->reset();
+    }
+    const auto target = int64_t(std::llround(frame + stream.resamplers.front()->bufferedFrames()));
+    const auto head = int64_t(stream.readPosition) + stream.frameOffset;
+    const auto available = stream.ring->availableFrames();
+    if (head < target) {
+        const auto skipped = uint32_t(std::min<int64_t>(target - head, available));
+        stream.ring->consume(skipped);
+        stream.readPosition += skipped;
+        if (head + skipped < target) {
+            return false;
+        }
+    }
+    else if (head - target > int64_t(stream.maxInputFrames)) {
+        // The stream starts after this block.
+        return false;
+    }
+    else {
+        const auto silence = uint32_t(head - target);
+        for (auto& resampler : stream.resamplers) {
+            resampler->push(mSilence.data(), 1, silence);
+        }
+    }
+    stream.inputEnd = double(head > target ? head : target);
+    stream.integral = 0;
+    stream.error = 0;
+    stream.aligned = true;
+    stream.realignmentCount.store(stream.alignmentCount, std::memory_order_relaxed);
+    ++stream.alignmentCount;
+    return true;
+}
+
+void ClockAligner::feed(Stream& stream, uint32_t frameCount) {
+    const auto channelCount = stream.format.channelCount;
+    const auto available = stream.ring->availableFrames();
+    uint32_t inputFrames = std::min(frameCount, available);
+    if (stream.resampled) {
+        const auto needed = std::ceil(frameCount * stream.ratio + kReachFrames - stream.resamplers.front()->bufferedFrames());
+        inputFrames = uint32_t(std::clamp(needed, 0.0, double(std::min(available, stream.maxInputFrames))));
+    }
+
+    // Convert the input to float, in place of the output for the reference.
+    float* converted = stream.resampled ? stream.input.data() : stream.output.data();
+    const uint8_t* first = nullptr;
+    const uint8_t* second = nullptr;
+    uint32_t firstFrames = 0;
+    uint32_t secondFrames = 0;
+    stream.ring->peek(first, firstFrames, second, secondFrames);
+    firstFrames = std::min(firstFrames, inputFrames);
+    secondFrames = inputFrames - firstFrames;
+    ConvertToFloat(stream.format.sampleFormat, first, converted, size_t(firstFrames) * channelCount);
+    ConvertToFloat(stream.format.sampleFormat, second, converted + size_t(firstFrames) * channelCount, size_t(secondFrames) * channelCount);
+    stream.ring->consume(inputFrames);
+    stream.readPosition += inputFrames;
+
+    if (!stream.resampled) {
+        std::fill(stream.output.begin() + ptrdiff_t(inputFrames) * channelCount, stream.output.begin() + ptrdiff_t(frameCount) * channelCount, 0.0f);
+        return;
+    }
+    stream.inputEnd += inputFrames;
+    for (uint32_t channel = 0; channel < channelCount; ++channel) {
+        auto& resampler = *stream.resamplers[channel];
+        resampler.setStep(stream.ratio);
+        resampler.push(stream.input.data() + channel, channelCount, inputFrames);
+        // The resampler runs short only if the ring did, so fill the rest with silence.
+        for (auto frame = resampler.pull(stream.output.data() + channel, channelCount, frameCount); frame < frameCount; ++frame) {
+            stream.output[size_t(frame) * channelCount + channel] = 0;
+        }
+    }
+}
+
+uint32_t ClockAligner::align() {
+    if (mSink == nullptr) {
+        return 0;
+    }
+    auto& reference = *mStreams.front();
+    for (auto& stream : mStreams) {
+        stream->hasClock = readClock(*stream);
+        // A stream that dropped frames has lost its place in the ring, so it joins again past the drop.
+        const auto offset = int64_t(std::llround(stream->published.frame)) - int64_t(stream->published.ringPosition);
+        if (stream->hasClock && stream->aligned && offset != stream->frameOffset) {
+            const auto available = stream->ring->availableFrames();
+            stream->ring->consume(available);
+            stream->readPosition += available;
+            stream->aligned = false;
+        }
+    }
+    if (!reference.hasClock) {
+        return 0;
+    }
+    if (!reference.aligned) {
+        join(reference, 0);
+    }
+
+    uint32_t alignedFrames = 0;
+    while (true) {
+        // Every stream reads the audio of the host time of the reference's next frame.
+        const auto& referenceClock = reference.published;
+        const auto time = referenceClock.time + (readFrame(reference) - referenceClock.frame) * referenceClock.period;
+        uint32_t frameCount = std::min(kBlockFrames, producibleFrames(reference));
+        if (frameCount == 0) {
+            break;
+        }
+        const bool stalled = double(reference.ring->availableFrames()) > kStallSeconds * reference.format.sampleRate;
+
+        for (size_t index = 1; index < mStreams.size(); ++index) {
+            auto& stream = *mStreams[index];
+            if (!stream.hasClock) {
+                continue;
+            }
+            const auto& clock = stream.published;
+            const auto frame = clock.frame + (time - clock.time) / clock.period;
+            const auto rateRatio = std::clamp(referenceClock.period / clock.period,
+                                              stream.nominalRatio * (1 - kMaxDrift), stream.nominalRatio * (1 + kMaxDrift));
+            if (stream.aligned) {
+                stream.error = readFrame(stream) - frame;
+                if (std::abs(stream.error) > kRealignSeconds * stream.format.sampleRate) {
+                    stream.aligned = false;
+                }
+            }
+            if (!stream.aligned && !join(stream, frame)) {
+                continue;
+            }
+
+            // Reading ahead of the reference calls for a lower ratio, and reading behind for a higher one.
+            const double proportionalGain = 1 / (kCorrectionSeconds * reference.format.sampleRate);
+            const double integralGain = proportionalGain * proportionalGain / 4;
+            const double maxCorrection = kMaxCorrection * rateRatio;
+            stream.integral = std::clamp(stream.integral, -maxCorrection / integralGain, maxCorrection / integralGain);
+            const double correction = std::clamp(proportionalGain * stream.error + integralGain * stream.integral, -maxCorrection, maxCorrection);
+            stream.ratio = rateRatio - correction;
+            stream.rateRatio = rateRatio;
+
+            const auto producible = producibleFrames(stream);
+            if (producible < frameCount && stalled) {
+                stream.aligned = false;
+                continue;
+            }
+            frameCount = std::min(frameCount, producible);
+        }
+        if (frameCount == 0) {
+            break;
+        }
+
+        for (uint32_t index = 0; index < mStreams.size(); ++index) {
+            auto& stream = *mStreams[index];
+            const float* output = mSilence.data();
+            if (stream.aligned) {
+                feed(stream, frameCount);
+                stream.integral += stream.error * frameCount;
+                output = stream.output.data();
+            }
+            if (!mSink->write(index, output, frameCount)) {
+                mSinkErrors.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        alignedFrames += frameCount;
+    }
+
+    for (auto& stream : mStreams) {
+        stream->sampleRate.store(stream->hasClock ? 1 / stream->published.period : 0, std::memory_order_relaxed);
+        stream->correction.store(stream->resampled && stream->aligned ? (stream->ratio / stream->rateRatio - 1) * 1e6 : 0, std::memory_order_relaxed);
+        stream->alignmentError.store(stream->aligned ? stream->error : 0, std::memory_order_relaxed);
+        stream->publishedAligned.store(stream->aligned, std::memory_order_relaxed);
+    }
+    return alignedFrames;
+}
+
+// MARK: - Statistics
+
+ClockAligner::StreamStatistics ClockAligner::statistics(uint32_t stream) const {
+    StreamStatistics statistics;
+    if (stream < mStreams.size()) {
+        const auto& state = *mStreams[stream];
+        statistics.sampleRate = state.sampleRate.load(std::memory_order_relaxed);
+        statistics.correction = state.correction.load(std::memory_order_relaxed);
+        statistics.alignmentError = state.alignmentError.load(std::memory_order_relaxed);
+        statistics.aligned = state.publishedAligned.load(std::memory_order_relaxed);
+        statistics.droppedFrames = state.droppedFrames.load(std::memory_order_relaxed);
+        statistics.realignmentCount = state.realignmentCount.load(std::memory_order_relaxed);
+    }
+    return statistics;
+}
@@ -0,0 +1,193 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A clock estimator and an aligner that resample streams from independent devices onto one device's clock.
+*/
+
+#ifndef ClockAligner_hpp
+#define ClockAligner_hpp
+
+#include "CaptureEngine.hpp"
+#include "CaptureRing.hpp"
+#include "VariableRateResampler.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Follows a device's sample clock from the host times of its I/O cycles with a delay-locked loop: a
+// second-order loop whose proportional term corrects the time of each cycle and whose integral term
+// corrects the length of a frame. The loop smooths out the jitter in the times, and the frame length
+// it settles on gives the device's actual sample rate against the host clock.
+class ClockEstimator {
+public:
+    // How quickly the loop follows the clock once it has settled, in Hz. A lower bandwidth smooths more
+    // jitter but follows changes in the clock's rate more slowly. The loop starts wider, and narrows to this.
+    static constexpr double kDefaultBandwidth = 0.02;
+
+    // Starts over, assuming the clock runs at `nominalSampleRate`.
+    void reset(double nominalSampleRate, double bandwidth = kDefaultBandwidth) noexcept;
+
+    // Takes the host time of a cycle's first frame, in seconds, and the cycle's frame count. Cycles
+    // follow each other without a gap, so frames count up from the first cycle's first frame, which is 0.
+    // A cycle far from where the loop expects it, as after an overload, restarts the loop there.
+    void update(double hostSeconds, uint32_t frameCount) noexcept;
+
+    bool hasStarted() const { return mStarted; }
+
+    // The frame the last cycle started on, and the loop's estimate of its host time.
+    double frame() const { return mFrame; }
+    double time() const { return mTime; }
+
+    // The loop's estimate of the length of a frame, in seconds of host time.
+    double period() const { return mPeriod; }
+    double sampleRate() const { return 1 / mPeriod; }
+
+    uint64_t restartCount() const { return mRestartCount; }
+
+private:
+    double mNominalSampleRate = 0;
+    double mBandwidth = kDefaultBandwidth;
+    bool mStarted = false;
+    double mFrame = 0;
+    double mTime = 0;
+    double mPeriod = 0;
+    double mNextFrame = 0;
+    double mNextTime = 0;
+    uint64_t mRestartCount = 0;
+};
+
+// Records streams from devices that run on their own clocks as one recording whose streams line up
+// frame for frame. Each device's I/O thread copies its streams into rings, along with the host time
+// of the cycle, and a clock estimator per stream follows the device's clock. The first stream is the
+// reference: a worker thread writes it to the sink as it is, and resamples every other stream to the
+// reference's rate, so that each output frame of every stream is the audio of the same host time.
+//
+// A stream's resampling ratio is the ratio of the estimated rates, corrected by a proportional-integral
+// loop on the difference between the host time the stream's resampler is reading and the host time
+// of the reference's frame. The loop keeps the streams aligned to a fraction of a frame over hours of
+// drift. A stream joins the recording, with silence before it, at the frame that matches its first
+// cycle, and joins again in the same way after it drops frames.
+class ClockAligner {
+public:
+    // The output frames the worker makes at a time, between updates of the ratios.
+    static constexpr uint32_t kBlockFrames = 256;
+
+    struct StreamStatistics {
+        // The stream's estimated sample rate against the host clock.
+        double sampleRate = 0;
+        // How far the loop has moved the resampling ratio from the ratio of the estimated rates, in parts per million.
+        double correction = 0;
+        // How far the stream's output trails the reference's, in frames of the stream.
+        double alignmentError = 0;
+        bool aligned = false;
+        uint64_t droppedFrames = 0;
+        // The times the stream joined the recording after its first.
+        uint64_t realignmentCount = 0;
+    };
+
+    ClockAligner() = default;
+    ClockAligner(const ClockAligner&) = delete;
+    ClockAligner& operator=(const ClockAligner&) = delete;
+    ~ClockAligner();
+
+    // The formats the aligner writes to its sink for `streams`: 32-bit float at the rate of the first stream.
+    static std::vector<CaptureStreamFormat> outputFormats(const std::vector<CaptureStreamFormat>& streams);
+
+    // Allocates the rings, clock estimators, and resamplers for `streams`, and starts a worker that aligns
+    // what the rings hold into `sink` every `interval` seconds. With an interval of 0, no worker starts, and the
+    // caller runs `align`. Returns false, and starts nothing, if a stream's format isn't supported.
+    bool start(const std::vector<CaptureStreamFormat>& streams, std::unique_ptr<CaptureSink> sink, double interval = 0.05);
+
+    // Stops the worker, aligns what the rings still hold, and releases the sink.
+    void stop();
+
+    // Copies a cycle of `stream` into its ring, with the host time of the cycle's first frame in seconds.
+    // Real-time safe. Call from one I/O thread per stream.
+    void capture(uint32_t stream, double hostSeconds, const CaptureBuffer& buffer) noexcept;
+
+    // Writes as many aligned frames of every stream as the rings allow, and returns the frame count. The
+    // worker runs this; don't call it while the worker runs.
+    uint32_t align();
+
+    // Safe to call from any thread.
+    StreamStatistics statistics(uint32_t stream) const;
+    uint64_t sinkErrorCount() const { return mSinkErrors.load(std::memory_order_relaxed); }
+    uint32_t streamCount() const { return uint32_t(mStreams.size()); }
+
+private:
+    // The clock as the I/O thread last published it: the frame after its last cycle, that frame's host
+    // time, and where it goes in the ring. The frame and the ring position differ by the frames the ring has dropped.
+    struct ClockState {
+        double frame = 0;
+        double time = 0;
+        double period = 0;
+        uint64_t ringPosition = 0;
+    };
+
+    struct Stream {
+        CaptureStreamFormat format;
+        std::unique_ptr<CaptureRing> ring;
+
+        // The I/O thread's alone.
+        ClockEstimator clock;
+        uint64_t ringPosition = 0;
+
+        // The I/O thread publishes its clock at the end of each cycle, and the worker retries a read that
+        // a publish overlapped.
+        std::atomic<uint32_t> clockSequence{0};
+        std::atomic<double> clockFrame{0};
+        std::atomic<double> clockTime{0};
+        std::atomic<double> clockPeriod{0};
+        std::atomic<uint64_t> clockRingPosition{0};
+        std::atomic<uint64_t> droppedFrames{0};
+
+        // From here on, the worker's alone. Frames are numbered as the stream's clock numbers them,
+        // which is their position in the ring plus `frameOffset`. For a resampled stream, `inputEnd`
+        // is the number of the frame after the resamplers' input.
+        ClockState published;
+        bool hasClock = false;
+        bool resampled = false;
+        bool aligned = false;
+        uint64_t readPosition = 0;
+        int64_t frameOffset = 0;
+        double inputEnd = 0;
+        // Input frames per output frame: nominally, as the clocks run, and as the alignment loop corrects it.
+        double nominalRatio = 1;
+        double rateRatio = 1;
+        double ratio = 1;
+        double error = 0;
+        double integral = 0;
+        uint32_t maxInputFrames = 0;
+        uint64_t alignmentCount = 0;
+        std::vector<std::unique_ptr<VariableRateResampler>> resamplers;
+        std::vector<float> input;
+        std::vector<float> output;
+
+        std::atomic<double> sampleRate{0};
+        std::atomic<double> correction{0};
+        std::atomic<double> alignmentError{0};
+        std::atomic<bool> publishedAligned{false};
+        std::atomic<uint64_t> realignmentCount{0};
+    };
+
+    bool readClock(Stream& stream) const noexcept;
+    double readFrame(const Stream& stream) const noexcept;
+    uint32_t producibleFrames(const Stream& stream) const noexcept;
+    bool join(Stream& stream, double frame);
+    void feed(Stream& stream, uint32_t frameCount);
+    void runWorker(double interval);
+
+    std::vector<std::unique_ptr<Stream>> mStreams;
+    std::unique_ptr<CaptureSink> mSink;
+    std::atomic<uint64_t> mSinkErrors{0};
+    std::vector<float> mSilence;
+
+    std::thread mWorker;
+    std::atomic<bool> mWorkerRunning{false};
+};
+
+#endif /* ClockAligner_hpp */
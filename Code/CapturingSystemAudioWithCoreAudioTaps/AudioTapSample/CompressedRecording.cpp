@@ -0,0 +1,310 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a recording sink that compresses each stream losslessly on a pool of worker threads.
+*/
+
+#include "CompressedRecording.hpp"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace CompressedRecording;
+
+// The largest block a reader accepts, so a damaged header can't ask for gigabytes.
+constexpr uint32_t kMaxBlockFrames = 1 << 20;
+
+// Writes all of `size` bytes, retrying short writes.
+static bool writeAll(int file, const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        const auto written = ::write(file, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= size_t(written);
+    }
+    return true;
+}
+
+// Reads up to `size` bytes, retrying short reads, and returns how many it read.
+static size_t readAll(int file, void* data, size_t size) {
+    auto bytes = static_cast<uint8_t*>(data);
+    size_t total = 0;
+    while (total < size) {
+        const auto count = ::read(file, bytes + total, size - total);
+        if (count <= 0) {
+            break;
+        }
+        total += size_t(count);
+    }
+    return total;
+}
+
+static uint64_t threadCPUNanoseconds() {
+    timespec time{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return uint64_t(time.tv_sec) * 1000000000 + uint64_t(time.tv_nsec);
+}
+
+// MARK: - Sink
+
+CompressingSink::~CompressingSink() {
+    close();
+}
+
+bool CompressingSink::open(const std::vector<std::string>& paths,
+                           const std::vector<CaptureStreamFormat>& streams,
+                           std::shared_ptr<Statistics> statistics,
+                           uint32_t workerCount,
+                           uint32_t blockFrames) {
+    close();
+    if (paths.size() != streams.size() || streams.empty()) {
+        return false;
+    }
+    mStatistics = statistics ? std::move(statistics) : std::make_shared<Statistics>();
+    mBlockFrames = std::clamp(blockFrames, 1u, kMaxBlockFrames);
+
+    size_t maxFrameBytes = 0;
+    size_t maxEncodedBytes = 0;
+    for (size_t index = 0; index < streams.size(); ++index) {
+        auto stream = std::make_unique<Stream>();
+        stream->format = streams[index];
+        stream->format.bytesPerFrame = std::max(stream->format.bytesPerFrame, 1u);
+        stream->file = ::open(paths[index].c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        CompressedStreamHeader header{};
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.blockFrames = mBlockFrames;
+        header.sampleRate = stream->format.sampleRate;
+        header.channelCount = stream->format.channelCount;
+        header.bytesPerFrame = stream->format.bytesPerFrame;
+        header.sampleFormat = stream->format.sampleFormat;
+        const bool created = stream->file >= 0 && writeAll(stream->file, &header, sizeof(header));
+        maxFrameBytes = std::max(maxFrameBytes, size_t(mBlockFrames) * stream->format.bytesPerFrame);
+        maxEncodedBytes = std::max(maxEncodedBytes, LosslessCodec::maxEncodedBytes(stream->format, mBlockFrames));
+        mStreams.push_back(std::move(stream));
+        if (!created) {
+            for (auto& openStream : mStreams) {
+                if (openStream->file >= 0) {
+                    ::close(openStream->file);
+                }
+            }
+            mStreams.clear();
+            return false;
+        }
+    }
+
+    if (workerCount == 0) {
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Give every stream a block to fill, and every worker two to encode, so the writer thread rarely waits.
+    const size_t blockCount = mStreams.size() + 2 * size_t(workerCount);
+    for (size_t index = 0; index < blockCount; ++index) {
+        auto block = std::make_unique<Block>();
+        block->frames.resize(maxFrameBytes);
+        block->encoded.resize(sizeof(CompressedBlockHeader) + maxEncodedBytes);
+        mFreeBlocks.push_back(block.get());
+        mBlocks.push_back(std::move(block));
+    }
+
+    mStopping = false;
+    for (uint32_t index = 0; index < workerCount; ++index) {
+        mWorkers.emplace_back([this] { runWorker(); });
+    }
+    mOpen = true;
+    return true;
+}
+
+bool CompressingSink::write(uint32_t stream, const void* data, uint32_t frameCount) {
+    if (!mOpen || stream >= mStreams.size()) {
+        return false;
+    }
+    auto& state = *mStreams[stream];
+    const auto bytesPerFrame = state.format.bytesPerFrame;
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (frameCount > 0) {
+        if (state.filling == nullptr) {
+            state.filling = takeFreeBlock();
+            state.filling->stream = stream;
+            state.filling->frameCount = 0;
+        }
+        auto& block = *state.filling;
+        const auto frames = std::min(frameCount, mBlockFrames - block.frameCount);
+        memcpy(block.frames.data() + size_t(block.frameCount) * bytesPerFrame, bytes, size_t(frames) * bytesPerFrame);
+        block.frameCount += frames;
+        bytes += size_t(frames) * bytesPerFrame;
+        frameCount -= frames;
+        if (block.frameCount == mBlockFrames) {
+            submit(state);
+        }
+    }
+    return true;
+}
+
+bool CompressingSink::close() {
+    if (!mOpen) {
+        return true;
+    }
+
+    // Send the partly filled blocks, then let the workers empty the queue and exit.
+    for (auto& stream : mStreams) {
+        if (stream->filling != nullptr && stream->filling->frameCount > 0) {
+            submit(*stream);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        mStopping = true;
+    }
+    mQueueChanged.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+    mWorkers.clear();
+
+    bool succeeded = mStatistics->fileErrorCount.load() == 0;
+    for (auto& stream : mStreams) {
+        succeeded = (::close(stream->file) == 0) && succeeded;
+    }
+    mStreams.clear();
+    mFreeBlocks.clear();
+    mBlocks.clear();
+    mOpen = false;
+    return succeeded;
+}
+
+CompressingSink::Block* CompressingSink::takeFreeBlock() {
+    std::unique_lock<std::mutex> lock(mFreeMutex);
+    mBlockFreed.wait(lock, [this] { return !mFreeBlocks.empty(); });
+    auto* block = mFreeBlocks.back();
+    mFreeBlocks.pop_back();
+    return block;
+}
+
+void CompressingSink::submit(Stream& stream) {
+    auto* block = stream.filling;
+    stream.filling = nullptr;
+    block->sequence = stream.nextSequence++;
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        mQueue.push_back(block);
+    }
+    mQueueChanged.notify_one();
+}
+
+// MARK: - Workers
+
+void CompressingSink::runWorker() {
+    // Each worker keeps its own encoder for each stream, made the first time it sees the stream.
+    std::vector<std::unique_ptr<LosslessEncoder>> encoders(mStreams.size());
+    while (true) {
+        Block* block = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mQueueMutex);
+            mQueueChanged.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+            if (mQueue.empty()) {
+                return;
+            }
+            block = mQueue.front();
+            mQueue.pop_front();
+        }
+
+        const auto& stream = *mStreams[block->stream];
+        auto& encoder = encoders[block->stream];
+        if (!encoder) {
+            encoder = std::make_unique<LosslessEncoder>(stream.format, mBlockFrames);
+        }
+        const auto start = threadCPUNanoseconds();
+        const auto size = encoder->encode(block->frames.data(), block->frameCount, block->encoded.data() + sizeof(CompressedBlockHeader));
+        const auto elapsed = threadCPUNanoseconds() - start;
+
+        const CompressedBlockHeader header{uint32_t(size), block->frameCount};
+        memcpy(block->encoded.data(), &header, sizeof(header));
+        block->encodedBytes = sizeof(header) + size;
+
+        mStatistics->rawBytes.fetch_add(uint64_t(block->frameCount) * stream.format.bytesPerFrame, std::memory_order_relaxed);
+        mStatistics->encodedBytes.fetch_add(block->encodedBytes, std::memory_order_relaxed);
+        mStatistics->encoderNanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+        mStatistics->blockCount.fetch_add(1, std::memory_order_relaxed);
+        finishBlock(block);
+    }
+}
+
+void CompressingSink::finishBlock(Block* block) {
+    auto& stream = *mStreams[block->stream];
+    std::lock_guard<std::mutex> lock(stream.mutex);
+    stream.finished.emplace(block->sequence, block);
+
+    // Append this block and any later ones that were waiting on it.
+    while (!stream.finished.empty() && stream.finished.begin()->first == stream.nextToWrite) {
+        auto* next = stream.finished.begin()->second;
+        stream.finished.erase(stream.finished.begin());
+        if (!writeAll(stream.file, next->encoded.data(), next->encodedBytes)) {
+            mStatistics->fileErrorCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        ++stream.nextToWrite;
+        {
+            std::lock_guard<std::mutex> freeLock(mFreeMutex);
+            mFreeBlocks.push_back(next);
+        }
+        mBlockFreed.notify_one();
+    }
+}
+
+// MARK: - Reader
+
+CompressedStreamReader::~CompressedStreamReader() {
+    close();
+}
+
+bool CompressedStreamReader::open(const std::string& path) {
+    close();
+    mFile = ::open(path.c_str(), O_RDONLY);
+    if (mFile < 0) {
+        return false;
+    }
+    CompressedStreamHeader header{};
+    if (readAll(mFile, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion ||
+        header.blockFrames == 0 || header.blockFrames > kMaxBlockFrames ||
+        header.channelCount == 0 || header.bytesPerFrame == 0) {
+        close();
+        return false;
+    }
+    mFormat = {header.sampleRate, header.channelCount, header.bytesPerFrame, header.sampleFormat};
+    mBlockFrames = header.blockFrames;
+    mDecoder = std::make_unique<LosslessDecoder>(mFormat, mBlockFrames);
+    mEncoded.resize(LosslessCodec::maxEncodedBytes(mFormat, mBlockFrames));
+    return true;
+}
+
+void CompressedStreamReader::close() {
+    if (mFile >= 0) {
+        ::close(mFile);
+    }
+    mFile = -1;
+    mDecoder.reset();
+    mEncoded.clear();
+}
+
+bool CompressedStreamReader::readBlock(std::vector<uint8_t>& frames, uint32_t& frameCount) {
+    CompressedBlockHeader header{};
+    if (mFile < 0 || readAll(mFile, &header, sizeof(header)) != sizeof(header) ||
+        header.encodedBytes > mEncoded.size() || header.frameCount > mBlockFrames ||
+        readAll(mFile, mEncoded.data(), header.encodedBytes) != header.encodedBytes) {
+        return false;
+    }
+    frames.resize(size_t(header.frameCount) * mFormat.bytesPerFrame);
+    frameCount = header.frameCount;
+    return mDecoder->decode(mEncoded.data(), header.encodedBytes, header.frameCount, frames.data());
+}
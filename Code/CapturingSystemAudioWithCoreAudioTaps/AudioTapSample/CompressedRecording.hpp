@@ -0,0 +1,153 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A recording sink that compresses each stream losslessly on a pool of worker threads.
+*/
+
+#ifndef CompressedRecording_hpp
+#define CompressedRecording_hpp
+
+#include "CaptureEngine.hpp"
+#include "LosslessCodec.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Each stream's file holds a `CompressedStreamHeader`, then a `CompressedBlockHeader` and its
+// encoded bytes for every block, in order, in native byte order.
+namespace CompressedRecording {
+
+constexpr char kMagic[8] = {'T', 'A', 'P', 'Z', '0', '0', '0', '1'};
+// Version 2 codes a constant channel in the width of its samples rather than in 32 bits.
+constexpr uint32_t kVersion = 2;
+
+struct CompressedStreamHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockFrames;
+    double sampleRate;
+    uint32_t channelCount;
+    uint32_t bytesPerFrame;
+    CaptureSampleFormat sampleFormat;
+    uint32_t reserved;
+};
+
+struct CompressedBlockHeader {
+    uint32_t encodedBytes;
+    uint32_t frameCount;
+};
+
+// Running totals for a compressed recording. The sink updates them, and any thread can read them.
+struct Statistics {
+    std::atomic<uint64_t> rawBytes{0};
+    std::atomic<uint64_t> encodedBytes{0};
+    std::atomic<uint64_t> encoderNanoseconds{0};
+    std::atomic<uint64_t> blockCount{0};
+    std::atomic<uint64_t> fileErrorCount{0};
+};
+
+} // namespace CompressedRecording
+
+// Cuts each stream into blocks on the capture engine's writer thread, and hands the blocks to a
+// pool of workers that encode them with `LosslessEncoder`. Blocks of one stream can encode on
+// several workers at once; whichever worker finishes the next block in order appends it, and any
+// that follow it, to the stream's file. The writer thread only copies; when every block buffer is
+// busy it waits, and the capture rings absorb the delay.
+class CompressingSink final : public CaptureSink {
+public:
+    CompressingSink() = default;
+    CompressingSink(const CompressingSink&) = delete;
+    CompressingSink& operator=(const CompressingSink&) = delete;
+    ~CompressingSink() override;
+
+    // Creates a file for each stream, replacing any at its path, and starts `workerCount` workers,
+    // or one per processor core if it's 0.
+    bool open(const std::vector<std::string>& paths,
+              const std::vector<CaptureStreamFormat>& streams,
+              std::shared_ptr<CompressedRecording::Statistics> statistics,
+              uint32_t workerCount = 0,
+              uint32_t blockFrames = 4096);
+
+    bool write(uint32_t stream, const void* data, uint32_t frameCount) override;
+
+    // Encodes the partly filled blocks, waits for the workers to write everything, and closes the files.
+    bool close();
+
+private:
+    struct Block {
+        uint32_t stream = 0;
+        uint64_t sequence = 0;
+        uint32_t frameCount = 0;
+        std::vector<uint8_t> frames;
+        std::vector<uint8_t> encoded;
+        size_t encodedBytes = 0;
+    };
+
+    struct Stream {
+        CaptureStreamFormat format;
+        int file = -1;
+        Block* filling = nullptr;
+        uint64_t nextSequence = 0;
+
+        // Guards the file and the blocks that finished out of order.
+        std::mutex mutex;
+        uint64_t nextToWrite = 0;
+        std::map<uint64_t, Block*> finished;
+    };
+
+    Block* takeFreeBlock();
+    void submit(Stream& stream);
+    void runWorker();
+    void finishBlock(Block* block);
+
+    std::vector<std::unique_ptr<Stream>> mStreams;
+    std::shared_ptr<CompressedRecording::Statistics> mStatistics;
+    uint32_t mBlockFrames = 0;
+    bool mOpen = false;
+
+    std::vector<std::unique_ptr<Block>> mBlocks;
+    std::vector<Block*> mFreeBlocks;
+    std::mutex mFreeMutex;
+    std::condition_variable mBlockFreed;
+
+    std::deque<Block*> mQueue;
+    std::mutex mQueueMutex;
+    std::condition_variable mQueueChanged;
+    bool mStopping = false;
+    std::vector<std::thread> mWorkers;
+};
+
+// Reads back a compressed stream file one block at a time.
+class CompressedStreamReader {
+public:
+    CompressedStreamReader() = default;
+    CompressedStreamReader(const CompressedStreamReader&) = delete;
+    CompressedStreamReader& operator=(const CompressedStreamReader&) = delete;
+    ~CompressedStreamReader();
+
+    bool open(const std::string& path);
+    void close();
+
+    CaptureStreamFormat format() const { return mFormat; }
+
+    // Decodes the next block into `frames`, which the reader resizes. Returns false at the end of the file or on a malformed block.
+    bool readBlock(std::vector<uint8_t>& frames, uint32_t& frameCount);
+
+private:
+    int mFile = -1;
+    CaptureStreamFormat mFormat;
+    uint32_t mBlockFrames = 0;
+    std::unique_ptr<LosslessDecoder> mDecoder;
+    std::vector<uint8_t> mEncoded;
+};
+
+#endif /* CompressedRecording_hpp */
@@ -0,0 +1,313 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a converter that loops a device's input streams back to its output streams across formats, channel layouts, and sample rates.
+*/
+
+#include "LoopbackConverter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// MARK: - Sample format kernels
+
+// Four-lane vectors that compile to NEON on Apple silicon and SSE on Intel.
+typedef float Float4 __attribute__((vector_size(16)));
+typedef int32_t Int4 __attribute__((vector_size(16)));
+typedef int16_t Short4 __attribute__((vector_size(8)));
+
+template <typename Vector>
+static inline Vector Load(const void* source) noexcept {
+    Vector value;
+    memcpy(&value, source, sizeof(value));
+    return value;
+}
+
+template <typename Vector>
+static inline void Store(void* destination, Vector value) noexcept {
+    memcpy(destination, &value, sizeof(value));
+}
+
+static inline Float4 Select(Int4 mask, Float4 whenTrue, Float4 whenFalse) noexcept {
+    return (Float4)((mask & (Int4)whenTrue) | (~mask & (Int4)whenFalse));
+}
+
+// Scales to an integer range, clamps, and rounds to the nearest integer. NaN becomes zero.
+static inline Int4 FloatToInt(Float4 value, float scale, float maximum) noexcept {
+    const Float4 zero = {};
+    const Float4 low = zero - scale;
+    const Float4 high = zero + maximum;
+    value = Select(value == value, value * scale, zero);
+    value = Select(value > low, value, low);
+    value = Select(value < high, value, high);
+    value += Select(value < zero, zero - 0.5f, zero + 0.5f);
+    return __builtin_convertvector(value, Int4);
+}
+
+// Converts `count` interleaved float samples to `format`, clamping integers to full scale.
+static void ConvertFromFloat(CaptureSampleFormat format, const float* source, void* destination, size_t count) noexcept {
+    auto* bytes = static_cast<uint8_t*>(destination);
+    if (format == CaptureSampleFormat::float32) {
+        memmove(destination, source, count * sizeof(float));
+        return;
+    }
+    if (format == CaptureSampleFormat::float64) {
+        for (size_t index = 0; index < count; ++index) {
+            reinterpret_cast<double*>(destination)[index] = double(source[index]);
+        }
+        return;
+    }
+
+    // Convert whole vectors, then pad the last few samples out to one more and store only the ones that exist.
+    const size_t vectorCount = count & ~size_t(3);
+    Float4 tail = {};
+    memcpy(&tail, source + vectorCount, (count - vectorCount) * sizeof(float));
+    const size_t tailCount = count - vectorCount;
+    switch (format) {
+        case CaptureSampleFormat::int16: {
+            for (size_t index = 0; index < vectorCount; index += 4) {
+                Store(bytes + index * 2, __builtin_convertvector(FloatToInt(Load<Float4>(source + index), 32768.0f, 32767.0f), Short4));
+            }
+            const auto samples = __builtin_convertvector(FloatToInt(tail, 32768.0f, 32767.0f), Short4);
+            memcpy(bytes + vectorCount * 2, &samples, tailCount * 2);
+            return;
+        }
+        case CaptureSampleFormat::int24: {
+            // Packed 24-bit samples don't line up with vector lanes, so only the conversion is vectorized.
+            for (size_t index = 0; index < count; index += 4) {
+                const auto samples = FloatToInt((index < vectorCount) ? Load<Float4>(source + index) : tail, 8388608.0f, 8388607.0f);
+                const size_t lanes = std::min<size_t>(4, count - index);
+                for (size_t lane = 0; lane < lanes; ++lane) {
+                    const auto sample = uint32_t(samples[lane]);
+                    bytes[(index + lane) * 3] = uint8_t(sample);
+                    bytes[(index + lane) * 3 + 1] = uint8_t(sample >> 8);
+                    bytes[(index + lane) * 3 + 2] = uint8_t(sample >> 16);
+                }
+            }
+            return;
+        }
+        case CaptureSampleFormat::int32: {
+            // The largest float below 2^31.
+            constexpr float kMaximum = 2147483520.0f;
+            for (size_t index = 0; index < vectorCount; index += 4) {
+                Store(bytes + index * 4, FloatToInt(Load<Float4>(source + index), 2147483648.0f, kMaximum));
+            }
+            const auto samples = FloatToInt(tail, 2147483648.0f, kMaximum);
+            memcpy(bytes + vectorCount * 4, &samples, tailCount * 4);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+static void CopyChannel(const float* source, size_t sourceStride, float* destination, size_t destinationStride, uint32_t frameCount) noexcept {
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        destination[frame * destinationStride] = source[frame * sourceStride];
+    }
+}
+
+static void ClearChannel(float* destination, size_t stride, uint32_t frameCount) noexcept {
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        destination[frame * stride] = 0;
+    }
+}
+
+// MARK: - Configuration
+
+LoopbackConverter::ChannelMap LoopbackConverter::defaultChannelMap(const std::vector<CaptureStreamFormat>& inputs, const std::vector<CaptureStreamFormat>& outputs) {
+    ChannelMap map;
+    int32_t firstInputChannel = 0;
+    for (size_t stream = 0; stream < outputs.size(); ++stream) {
+        const auto inputChannels = (stream < inputs.size()) ? int32_t(inputs[stream].channelCount) : 0;
+        for (uint32_t channel = 0; channel < outputs[stream].channelCount; ++channel) {
+            if (int32_t(channel) < inputChannels) {
+                map.push_back(firstInputChannel + int32_t(channel));
+            }
+            else if (inputChannels == 1) {
+                map.push_back(firstInputChannel);
+            }
+            else {
+                map.push_back(-1);
+            }
+        }
+        firstInputChannel += inputChannels;
+    }
+    return map;
+}
+
+void LoopbackConverter::configure(const std::vector<CaptureStreamFormat>& inputs,
+                                  const std::vector<CaptureStreamFormat>& outputs,
+                                  const ChannelMap& channelMap,
+                                  uint32_t maxFramesPerCycle) {
+    mMaxFrames = maxFramesPerCycle;
+    mInputs.clear();
+    mOutputs.clear();
+    mResamplers.clear();
+    mOutputScratch.clear();
+
+    // Find where each input channel lives.
+    std::vector<std::pair<int32_t, uint32_t>> inputChannels;
+    mInputs.resize(inputs.size());
+    for (size_t stream = 0; stream < inputs.size(); ++stream) {
+        mInputs[stream].format = inputs[stream];
+        for (uint32_t channel = 0; channel < inputs[stream].channelCount; ++channel) {
+            inputChannels.emplace_back(IsSupportedFormat(inputs[stream]) ? int32_t(stream) : -1, channel);
+        }
+    }
+
+    const auto& map = channelMap.empty() ? defaultChannelMap(inputs, outputs) : channelMap;
+    size_t outputChannel = 0;
+    uint32_t maxOutputSamples = 0;
+    mOutputs.resize(outputs.size());
+    for (size_t stream = 0; stream < outputs.size(); ++stream) {
+        auto& output = mOutputs[stream];
+        output.format = outputs[stream];
+        const bool supported = IsSupportedFormat(output.format);
+        if (supported && output.format.sampleFormat != CaptureSampleFormat::float32) {
+            maxOutputSamples = std::max(maxOutputSamples, output.format.channelCount * mMaxFrames);
+        }
+
+        output.routes.resize(output.format.channelCount);
+        for (uint32_t channel = 0; channel < output.format.channelCount; ++channel, ++outputChannel) {
+            const auto source = (outputChannel < map.size()) ? map[outputChannel] : -1;
+            if (!supported || source < 0 || size_t(source) >= inputChannels.size() || inputChannels[size_t(source)].first < 0) {
+                continue;
+            }
+            auto& route = output.routes[channel];
+            route.inputStream = inputChannels[size_t(source)].first;
+            route.inputChannel = inputChannels[size_t(source)].second;
+            auto& input = mInputs[size_t(route.inputStream)];
+            if (input.format.sampleRate != output.format.sampleRate) {
+                mResamplers.push_back(std::make_unique<VariableRateResampler>(input.format.sampleRate, output.format.sampleRate, mMaxFrames));
+                route.resampler = mResamplers.back().get();
+            }
+        }
+
+        // Look for an output that takes one input whole.
+        const auto& first = output.routes.empty() ? Route{} : output.routes.front();
+        bool whole = first.inputStream >= 0 && first.resampler == nullptr &&
+                     mInputs[size_t(first.inputStream)].format.channelCount == output.format.channelCount;
+        for (uint32_t channel = 0; whole && channel < output.routes.size(); ++channel) {
+            whole = output.routes[channel].inputStream == first.inputStream && output.routes[channel].inputChannel == channel;
+        }
+        if (whole) {
+            output.wholeInput = first.inputStream;
+            output.passthrough = mInputs[size_t(first.inputStream)].format.sampleFormat == output.format.sampleFormat;
+        }
+
+        // Everything but a passthrough reads its input as float.
+        if (!output.passthrough) {
+            for (const auto& route : output.routes) {
+                if (route.inputStream >= 0) {
+                    mInputs[size_t(route.inputStream)].needsFloat = true;
+                }
+            }
+        }
+    }
+
+    for (auto& input : mInputs) {
+        if (input.needsFloat && input.format.sampleFormat != CaptureSampleFormat::float32) {
+            input.scratch.resize(size_t(input.format.channelCount) * mMaxFrames);
+        }
+    }
+    mOutputScratch.resize(maxOutputSamples);
+}
+
+// MARK: - I/O cycle
+
+void LoopbackConverter::process(const CaptureBuffer* inputs, uint32_t inputCount, CaptureBuffer* outputs, uint32_t outputCount) noexcept {
+    convertInputs(inputs, inputCount);
+    for (uint32_t stream = 0; stream < outputCount; ++stream) {
+        if (stream < mOutputs.size()) {
+            fillOutput(mOutputs[stream], outputs[stream]);
+        }
+        else {
+            memset(outputs[stream].data, 0, outputs[stream].byteSize);
+        }
+    }
+}
+
+void LoopbackConverter::convertInputs(const CaptureBuffer* inputs, uint32_t inputCount) noexcept {
+    for (uint32_t stream = 0; stream < mInputs.size(); ++stream) {
+        auto& input = mInputs[stream];
+        input.data = nullptr;
+        input.samples = nullptr;
+        input.frameCount = 0;
+        if (stream >= inputCount || input.format.bytesPerFrame == 0) {
+            continue;
+        }
+        input.data = inputs[stream].data;
+        input.frameCount = std::min(inputs[stream].byteSize / input.format.bytesPerFrame, mMaxFrames);
+        if (!input.needsFloat) {
+            continue;
+        }
+        if (input.format.sampleFormat == CaptureSampleFormat::float32) {
+            input.samples = static_cast<const float*>(inputs[stream].data);
+        }
+        else {
+            ConvertToFloat(input.format.sampleFormat, inputs[stream].data, input.scratch.data(), size_t(input.frameCount) * input.format.channelCount);
+            input.samples = input.scratch.data();
+        }
+    }
+}
+
+void LoopbackConverter::fillOutput(Output& output, CaptureBuffer& buffer) noexcept {
+    const auto& format = output.format;
+    if (!IsSupportedFormat(format)) {
+        memset(buffer.data, 0, buffer.byteSize);
+        return;
+    }
+    const size_t channels = format.channelCount;
+    const auto frameCount = std::min(buffer.byteSize / format.bytesPerFrame, mMaxFrames);
+    uint32_t filledFrames = frameCount;
+
+    if (output.wholeInput >= 0) {
+        // The output plays one input as it is, apart from maybe its sample format.
+        const auto& input = mInputs[size_t(output.wholeInput)];
+        filledFrames = std::min(input.frameCount, frameCount);
+        if (output.passthrough && input.data != nullptr) {
+            // Nothing to convert, so the samples go through bit for bit.
+            memcpy(buffer.data, input.data, size_t(filledFrames) * format.bytesPerFrame);
+        }
+        else if (!output.passthrough && input.samples != nullptr) {
+            ConvertFromFloat(format.sampleFormat, input.samples, buffer.data, filledFrames * channels);
+        }
+        else {
+            filledFrames = 0;
+        }
+    }
+    else {
+        float* destination = (format.sampleFormat == CaptureSampleFormat::float32) ? static_cast<float*>(buffer.data) : mOutputScratch.data();
+        for (size_t channel = 0; channel < channels; ++channel) {
+            const auto& route = output.routes[channel];
+            const Input* input = (route.inputStream >= 0) ? &mInputs[size_t(route.inputStream)] : nullptr;
+            uint32_t routedFrames = 0;
+            if (input != nullptr && input->samples != nullptr) {
+                const float* source = input->samples + route.inputChannel;
+                if (route.resampler != nullptr) {
+                    countDiscontinuity(route.resampler->push(source, input->format.channelCount, input->frameCount));
+                    routedFrames = route.resampler->pull(destination + channel, channels, frameCount);
+                    countDiscontinuity(frameCount - routedFrames);
+                }
+                else {
+                    routedFrames = std::min(input->frameCount, frameCount);
+                    CopyChannel(source, input->format.channelCount, destination + channel, channels, routedFrames);
+                }
+            }
+            ClearChannel(destination + routedFrames * channels + channel, channels, frameCount - routedFrames);
+        }
+        ConvertFromFloat(format.sampleFormat, destination, buffer.data, size_t(frameCount) * channels);
+    }
+
+    // Silence whatever the inputs didn't cover.
+    const auto filledBytes = filledFrames * format.bytesPerFrame;
+    memset(static_cast<uint8_t*>(buffer.data) + filledBytes, 0, buffer.byteSize - filledBytes);
+}
+
+void LoopbackConverter::countDiscontinuity(uint64_t frames) noexcept {
+    if (frames > 0) {
+        mDiscontinuities.store(mDiscontinuities.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,90 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A converter that loops a device's input streams back to its output streams across formats, channel layouts, and sample rates.
+*/
+
+#ifndef LoopbackConverter_hpp
+#define LoopbackConverter_hpp
+
+#include "CaptureFormat.hpp"
+#include "VariableRateResampler.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Fills each output stream from any channels of the input streams. Channels are numbered across
+// all of a direction's streams in order, so a channel map entry of 3 for output channel 1 plays
+// the fourth input channel, wherever it lives, on the second output channel.
+//
+// Each cycle converts the inputs it needs to float, routes the channels into each output stream,
+// resampling any route between streams of different rates, and converts to the output format.
+// An output stream whose input has the same format and layout is copied through unchanged.
+// `configure` plans the routes and allocates everything, so `process` never allocates or locks.
+class LoopbackConverter {
+public:
+    // For each output channel, the input channel it plays, or -1 for silence.
+    using ChannelMap = std::vector<int32_t>;
+
+    LoopbackConverter() = default;
+    LoopbackConverter(const LoopbackConverter&) = delete;
+    LoopbackConverter& operator=(const LoopbackConverter&) = delete;
+
+    // Sends each input stream to the output stream with the same index, channel for channel,
+    // and a mono input to every channel of its output.
+    static ChannelMap defaultChannelMap(const std::vector<CaptureStreamFormat>& inputs, const std::vector<CaptureStreamFormat>& outputs);
+
+    // Plans the routes for `channelMap`, or the default map if it's empty, and preallocates for
+    // cycles of up to `maxFramesPerCycle`. Call while I/O is stopped.
+    void configure(const std::vector<CaptureStreamFormat>& inputs,
+                   const std::vector<CaptureStreamFormat>& outputs,
+                   const ChannelMap& channelMap,
+                   uint32_t maxFramesPerCycle);
+
+    // Fills every output buffer from the input buffers. Real-time safe.
+    void process(const CaptureBuffer* inputs, uint32_t inputCount, CaptureBuffer* outputs, uint32_t outputCount) noexcept;
+
+    // The frames resampled routes filled with silence or dropped because input and output fell out of step. Safe to call from any thread.
+    uint64_t discontinuityCount() const { return mDiscontinuities.load(std::memory_order_relaxed); }
+
+private:
+    struct Input {
+        CaptureStreamFormat format;
+        bool needsFloat = false;
+        std::vector<float> scratch;
+        const void* data = nullptr;
+        const float* samples = nullptr;
+        uint32_t frameCount = 0;
+    };
+
+    struct Route {
+        int32_t inputStream = -1;
+        uint32_t inputChannel = 0;
+        VariableRateResampler* resampler = nullptr;
+    };
+
+    struct Output {
+        CaptureStreamFormat format;
+        std::vector<Route> routes;
+        // When every channel comes from the same channel of one input of the same rate and layout,
+        // that input, and whether its sample format matches too.
+        int32_t wholeInput = -1;
+        bool passthrough = false;
+    };
+
+    void convertInputs(const CaptureBuffer* inputs, uint32_t inputCount) noexcept;
+    void fillOutput(Output& output, CaptureBuffer& buffer) noexcept;
+    void countDiscontinuity(uint64_t frames) noexcept;
+
+    uint32_t mMaxFrames = 0;
+    std::vector<Input> mInputs;
+    std::vector<Output> mOutputs;
+    std::vector<std::unique_ptr<VariableRateResampler>> mResamplers;
+    std::vector<float> mOutputScratch;
+    std::atomic<uint64_t> mDiscontinuities{0};
+};
+
+#endif /* LoopbackConverter_hpp */
@@ -0,0 +1,719 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a lossless block codec for captured audio that uses linear prediction and Rice coding.
+*/
+
+#include "LosslessCodec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace LosslessCodec;
+
+// A Rice code whose quotient reaches this many zeros stores the value raw instead, so a stray
+// large residual costs 96 bits rather than billions.
+constexpr uint32_t kEscapeQuotient = 32;
+
+constexpr uint32_t kMaxFixedOrder = 4;
+constexpr uint32_t kMaxPartitionOrder = 7;
+constexpr uint32_t kCoefficientPrecision = 15;
+constexpr uint32_t kMaxCoefficientShift = 15;
+
+// Blocks shorter than this skip LPC, because the coefficients would cost more than they save.
+constexpr uint32_t kMinLPCFrames = 64;
+
+enum class BlockType : uint8_t {
+    raw,
+    coded
+};
+
+enum class ChannelTransform : uint32_t {
+    integer,
+    scaledFloat,
+    orderedFloat
+};
+
+enum class ChannelMode : uint32_t {
+    constant,
+    verbatim,
+    fixed,
+    lpc
+};
+
+// MARK: - Bit streams
+
+// Writes bits most significant first.
+class BitWriter {
+public:
+    explicit BitWriter(uint8_t* destination) : mDestination(destination) {}
+
+    void write(uint64_t value, uint32_t bitCount) noexcept {
+        if (bitCount > 32) {
+            write(value >> 32, bitCount - 32);
+            bitCount = 32;
+        }
+        mCache = (mCache << bitCount) | (value & ((uint64_t(1) << bitCount) - 1));
+        mBitCount += bitCount;
+        while (mBitCount >= 8) {
+            mBitCount -= 8;
+            mDestination[mSize++] = uint8_t(mCache >> mBitCount);
+        }
+    }
+
+    void writeRice(uint64_t value, uint32_t parameter) noexcept {
+        const auto quotient = value >> parameter;
+        if (quotient < kEscapeQuotient) {
+            write(1, uint32_t(quotient) + 1);
+            write(value, parameter);
+        }
+        else {
+            write(0, kEscapeQuotient);
+            write(value, 64);
+        }
+    }
+
+    // Pads the last byte with zeros, and returns the bytes written.
+    size_t finish() noexcept {
+        if (mBitCount > 0) {
+            mDestination[mSize++] = uint8_t(mCache << (8 - mBitCount));
+            mBitCount = 0;
+        }
+        return mSize;
+    }
+
+private:
+    uint8_t* mDestination;
+    size_t mSize = 0;
+    uint64_t mCache = 0;
+    uint32_t mBitCount = 0;
+};
+
+// Reads bits most significant first. Reading past the end returns zeros and marks the reader failed.
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    bool failed() const { return mFailed; }
+
+    uint64_t read(uint32_t bitCount) noexcept {
+        if (bitCount > 32) {
+            const auto high = read(bitCount - 32);
+            return (high << 32) | read(32);
+        }
+        if (bitCount == 0) {
+            return 0;
+        }
+        refill();
+        if (mBitCount < bitCount) {
+            mFailed = true;
+            mBitCount = 0;
+            return 0;
+        }
+        const auto value = mCache >> (64 - bitCount);
+        mCache <<= bitCount;
+        mBitCount -= bitCount;
+        return value;
+    }
+
+    int64_t readSigned(uint32_t bitCount) noexcept {
+        const auto value = read(bitCount);
+        return int64_t(value << (64 - bitCount)) >> (64 - bitCount);
+    }
+
+    uint64_t readRice(uint32_t parameter) noexcept {
+        refill();
+        const uint32_t zeros = (mCache == 0) ? 64 : uint32_t(__builtin_clzll(mCache));
+        if (zeros >= kEscapeQuotient && mBitCount >= kEscapeQuotient) {
+            mCache <<= kEscapeQuotient;
+            mBitCount -= kEscapeQuotient;
+            return read(64);
+        }
+        if (zeros >= mBitCount) {
+            mFailed = true;
+            mBitCount = 0;
+            return 0;
+        }
+        mCache <<= zeros + 1;
+        mBitCount -= zeros + 1;
+        return (uint64_t(zeros) << parameter) | read(parameter);
+    }
+
+private:
+    void refill() noexcept {
+        while (mBitCount <= 56 && mOffset < mSize) {
+            mCache |= uint64_t(mData[mOffset++]) << (56 - mBitCount);
+            mBitCount += 8;
+        }
+    }
+
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+    uint64_t mCache = 0;
+    uint32_t mBitCount = 0;
+    bool mFailed = false;
+};
+
+// MARK: - Helpers
+
+static inline uint64_t ZigZag(int64_t value) noexcept {
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+static inline int64_t UnZigZag(uint64_t value) noexcept {
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+// Wrapping arithmetic, so a malformed block can't overflow a signed integer.
+static inline int64_t WrappingAdd(int64_t a, int64_t b) noexcept {
+    return int64_t(uint64_t(a) + uint64_t(b));
+}
+
+static inline int64_t WrappingSubtract(int64_t a, int64_t b) noexcept {
+    return int64_t(uint64_t(a) - uint64_t(b));
+}
+
+static inline int64_t FixedPrediction(const int32_t* samples, uint32_t index, uint32_t order) noexcept {
+    switch (order) {
+        case 1: return int64_t(samples[index - 1]);
+        case 2: return 2 * int64_t(samples[index - 1]) - samples[index - 2];
+        case 3: return 3 * (int64_t(samples[index - 1]) - samples[index - 2]) + samples[index - 3];
+        case 4: return 4 * (int64_t(samples[index - 1]) + samples[index - 3]) - 6 * int64_t(samples[index - 2]) - samples[index - 4];
+        default: return 0;
+    }
+}
+
+static inline int64_t LPCPrediction(const int32_t* samples, uint32_t index, const int32_t* coefficients, uint32_t order, uint32_t shift) noexcept {
+    int64_t sum = 0;
+    for (uint32_t tap = 0; tap < order; ++tap) {
+        sum += int64_t(coefficients[tap]) * samples[index - 1 - tap];
+    }
+    return sum >> shift;
+}
+
+static uint32_t ValueBits(const CaptureStreamFormat& format) noexcept {
+    switch (format.sampleFormat) {
+        case CaptureSampleFormat::int16: return 16;
+        case CaptureSampleFormat::int24: return 24;
+        default: return 32;
+    }
+}
+
+// How a channel's residual splits into partitions, and each partition's Rice parameter.
+struct RicePlan {
+    uint32_t partitionOrder = 0;
+    uint8_t parameters[1u << kMaxPartitionOrder] = {};
+};
+
+static uint32_t EstimateRiceParameter(uint64_t sum, uint32_t count) noexcept {
+    if (count == 0 || sum <= count) {
+        return 0;
+    }
+    const auto mean = sum / count;
+    return std::min(uint32_t(63 - __builtin_clzll(mean)), 31u);
+}
+
+// Picks the partition order and parameters for a residual, and returns its exact size in bits.
+static uint64_t PlanResidual(const int64_t* residuals, uint32_t frameCount, uint32_t order, RicePlan& plan) noexcept {
+    uint32_t maxPartitionOrder = 0;
+    while (maxPartitionOrder < kMaxPartitionOrder &&
+           (frameCount % (2u << maxPartitionOrder)) == 0 &&
+           (frameCount >> (maxPartitionOrder + 1)) > order) {
+        ++maxPartitionOrder;
+    }
+
+    // Sum each of the finest partitions, clamping outliers so the sums can't overflow.
+    uint64_t sums[1u << kMaxPartitionOrder];
+    const uint32_t finestCount = 1u << maxPartitionOrder;
+    const uint32_t finestSize = frameCount >> maxPartitionOrder;
+    for (uint32_t partition = 0; partition < finestCount; ++partition) {
+        uint64_t sum = 0;
+        const uint32_t start = std::max(partition * finestSize, order);
+        for (uint32_t index = start; index < (partition + 1) * finestSize; ++index) {
+            sum += std::min(ZigZag(residuals[index]), uint64_t(1) << 40);
+        }
+        sums[partition] = sum;
+    }
+
+    // Estimate each partition order from coarser sums, merging pairs as it goes.
+    uint64_t bestEstimate = UINT64_MAX;
+    for (uint32_t partitionOrder = maxPartitionOrder + 1; partitionOrder-- > 0;) {
+        const uint32_t partitionCount = 1u << partitionOrder;
+        const uint32_t partitionSize = frameCount >> partitionOrder;
+        uint64_t estimate = 3;
+        for (uint32_t partition = 0; partition < partitionCount; ++partition) {
+            const uint32_t count = partitionSize - ((partition == 0) ? order : 0);
+            const auto parameter = EstimateRiceParameter(sums[partition], count);
+            estimate += 5 + uint64_t(count) * (parameter + 1) + (sums[partition] >> parameter);
+        }
+        if (estimate < bestEstimate) {
+            bestEstimate = estimate;
+            plan.partitionOrder = partitionOrder;
+            for (uint32_t partition = 0; partition < partitionCount; ++partition) {
+                plan.parameters[partition] = uint8_t(EstimateRiceParameter(sums[partition], partitionSize - ((partition == 0) ? order : 0)));
+            }
+        }
+        for (uint32_t partition = 0; partition < partitionCount / 2; ++partition) {
+            sums[partition] = sums[2 * partition] + sums[2 * partition + 1];
+        }
+    }
+
+    // Count the plan's exact size, escapes included.
+    uint64_t bits = 3;
+    const uint32_t partitionSize = frameCount >> plan.partitionOrder;
+    for (uint32_t partition = 0; partition < (1u << plan.partitionOrder); ++partition) {
+        const uint32_t parameter = plan.parameters[partition];
+        bits += 5;
+        const uint32_t start = std::max(partition * partitionSize, order);
+        for (uint32_t index = start; index < (partition + 1) * partitionSize; ++index) {
+            const auto quotient = ZigZag(residuals[index]) >> parameter;
+            bits += (quotient < kEscapeQuotient) ? quotient + 1 + parameter : kEscapeQuotient + 64;
+        }
+    }
+    return bits;
+}
+
+static void WriteResidual(BitWriter& writer, const int64_t* residuals, uint32_t frameCount, uint32_t order, const RicePlan& plan) noexcept {
+    writer.write(plan.partitionOrder, 3);
+    const uint32_t partitionSize = frameCount >> plan.partitionOrder;
+    for (uint32_t partition = 0; partition < (1u << plan.partitionOrder); ++partition) {
+        const uint32_t parameter = plan.parameters[partition];
+        writer.write(parameter, 5);
+        const uint32_t start = std::max(partition * partitionSize, order);
+        for (uint32_t index = start; index < (partition + 1) * partitionSize; ++index) {
+            writer.writeRice(ZigZag(residuals[index]), parameter);
+        }
+    }
+}
+
+static bool ReadResidual(BitReader& reader, int64_t* residuals, uint32_t frameCount, uint32_t order) noexcept {
+    const auto partitionOrder = uint32_t(reader.read(3));
+    const uint32_t partitionSize = frameCount >> partitionOrder;
+    if ((partitionSize << partitionOrder) != frameCount || (partitionOrder > 0 && partitionSize < order)) {
+        return false;
+    }
+    for (uint32_t partition = 0; partition < (1u << partitionOrder); ++partition) {
+        const auto parameter = uint32_t(reader.read(5));
+        const uint32_t start = std::max(partition * partitionSize, order);
+        for (uint32_t index = start; index < (partition + 1) * partitionSize; ++index) {
+            residuals[index] = UnZigZag(reader.readRice(parameter));
+        }
+        if (reader.failed()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Finds LPC coefficients for orders 1 through `maxOrder` from a Welch-windowed autocorrelation with
+// the Levinson-Durbin recursion, and returns the order with the smallest estimated size, or 0.
+static uint32_t ComputeLPC(const int32_t* samples, uint32_t frameCount, uint32_t maxOrder, double* windowed,
+                           double (&coefficients)[kMaxLPCOrder][kMaxLPCOrder]) noexcept {
+    const double half = 0.5 * (frameCount - 1);
+    for (uint32_t index = 0; index < frameCount; ++index) {
+        const double distance = (index - half) / (half + 1);
+        windowed[index] = samples[index] * (1.0 - distance * distance);
+    }
+
+    double autocorrelation[kMaxLPCOrder + 1];
+    for (uint32_t lag = 0; lag <= maxOrder; ++lag) {
+        double sum = 0;
+        for (uint32_t index = lag; index < frameCount; ++index) {
+            sum += windowed[index] * windowed[index - lag];
+        }
+        autocorrelation[lag] = sum;
+    }
+    if (autocorrelation[0] <= 0) {
+        return 0;
+    }
+
+    double lpc[kMaxLPCOrder] = {};
+    double error = autocorrelation[0];
+    double bestBits = HUGE_VAL;
+    uint32_t bestOrder = 0;
+    for (uint32_t order = 0; order < maxOrder; ++order) {
+        double reflection = -autocorrelation[order + 1];
+        for (uint32_t tap = 0; tap < order; ++tap) {
+            reflection -= lpc[tap] * autocorrelation[order - tap];
+        }
+        reflection /= error;
+
+        lpc[order] = reflection;
+        for (uint32_t tap = 0; tap < order / 2; ++tap) {
+            const double previous = lpc[tap];
+            lpc[tap] += reflection * lpc[order - 1 - tap];
+            lpc[order - 1 - tap] += reflection * previous;
+        }
+        if (order & 1) {
+            lpc[order / 2] += lpc[order / 2] * reflection;
+        }
+        error *= 1.0 - reflection * reflection;
+
+        for (uint32_t tap = 0; tap <= order; ++tap) {
+            coefficients[order][tap] = -lpc[tap];
+        }
+
+        // Estimate the residual's bits per sample from the prediction error, plus the cost of the coefficients and warm-up.
+        const double bitsPerResidual = (error > 0) ? std::max(0.0, 0.5 * std::log2(0.5 * error / frameCount)) : 0.0;
+        const double bits = bitsPerResidual * (frameCount - order - 1) + (order + 1) * (kCoefficientPrecision + bitsPerResidual);
+        if (bits < bestBits) {
+            bestBits = bits;
+            bestOrder = order + 1;
+        }
+        if (error <= 0) {
+            break;
+        }
+    }
+    return bestOrder;
+}
+
+// Quantizes coefficients to `kCoefficientPrecision` signed bits with error feedback, and returns false if they don't fit.
+static bool QuantizeCoefficients(const double* coefficients, uint32_t order, int32_t* quantized, uint32_t& shift) noexcept {
+    double maximum = 0;
+    for (uint32_t tap = 0; tap < order; ++tap) {
+        maximum = std::max(maximum, std::abs(coefficients[tap]));
+    }
+    if (!(maximum > 0)) {
+        return false;
+    }
+    int exponent = 0;
+    std::frexp(maximum, &exponent);
+    const int wantedShift = int(kCoefficientPrecision) - 1 - exponent;
+    if (wantedShift < 0) {
+        return false;
+    }
+    shift = uint32_t(std::min(wantedShift, int(kMaxCoefficientShift)));
+
+    const int32_t largest = (1 << (kCoefficientPrecision - 1)) - 1;
+    double error = 0;
+    for (uint32_t tap = 0; tap < order; ++tap) {
+        error += coefficients[tap] * double(1u << shift);
+        const auto value = std::clamp(int32_t(std::lround(error)), -largest - 1, largest);
+        quantized[tap] = value;
+        error -= value;
+    }
+    return true;
+}
+
+// MARK: - Float transforms
+
+// Finds the power of two that turns every float in the channel into an int32 exactly, or returns false.
+static bool FindFloatScale(const int32_t* bits, uint32_t frameCount, uint32_t& scale) noexcept {
+    int32_t fractionalBits = 0;
+    int32_t magnitudeBits = 0;
+    for (uint32_t index = 0; index < frameCount; ++index) {
+        const auto value = uint32_t(bits[index]);
+        if ((value & 0x7FFFFFFF) == 0) {
+            // Negative zero has no integer to stand for it.
+            if (value != 0) {
+                return false;
+            }
+            continue;
+        }
+        int32_t exponent = int32_t((value >> 23) & 0xFF);
+        uint32_t mantissa = value & 0x7FFFFF;
+        if (exponent == 0xFF) {
+            return false;
+        }
+        if (exponent == 0) {
+            exponent = 1;
+        }
+        else {
+            mantissa |= 0x800000;
+        }
+        // The value is mantissa * 2^(exponent - 150).
+        fractionalBits = std::max(fractionalBits, 150 - exponent - __builtin_ctz(mantissa));
+        magnitudeBits = std::max(magnitudeBits, 32 - __builtin_clz(mantissa) + exponent - 150);
+    }
+    if (fractionalBits + magnitudeBits > 31) {
+        return false;
+    }
+    scale = uint32_t(std::max(fractionalBits, 0));
+    return scale <= 31;
+}
+
+static inline int32_t OrderFloatBits(int32_t bits) noexcept {
+    return bits ^ ((bits >> 31) & 0x7FFFFFFF);
+}
+
+// MARK: - LosslessCodec
+
+bool LosslessCodec::isCompressible(const CaptureStreamFormat& format) {
+    const uint32_t bytesPerSample = (format.sampleFormat == CaptureSampleFormat::int16) ? 2 :
+                                    (format.sampleFormat == CaptureSampleFormat::int24) ? 3 :
+                                    (format.sampleFormat == CaptureSampleFormat::int32 || format.sampleFormat == CaptureSampleFormat::float32) ? 4 : 0;
+    return bytesPerSample != 0 && format.channelCount != 0 && format.bytesPerFrame == bytesPerSample * format.channelCount;
+}
+
+size_t LosslessCodec::maxEncodedBytes(const CaptureStreamFormat& format, uint32_t frameCount) {
+    if (!isCompressible(format)) {
+        return 1 + size_t(frameCount) * format.bytesPerFrame;
+    }
+    // A verbatim channel, its header, and a partial byte. Every other mode codes smaller than
+    // verbatim, except a constant channel, which still takes one value when the block is empty.
+    const size_t valueCount = std::max(frameCount, 1u);
+    return 1 + size_t(format.channelCount) * ((valueCount * ValueBits(format) + 7) / 8 + 2) + 1;
+}
+
+// MARK: - LosslessEncoder
+
+LosslessEncoder::LosslessEncoder(const CaptureStreamFormat& format, uint32_t maxFrameCount)
+    : mFormat(format), mSamples(maxFrameCount), mResiduals(maxFrameCount), mCandidateResiduals(maxFrameCount), mWindowed(maxFrameCount) {}
+
+size_t LosslessEncoder::encode(const void* frames, uint32_t frameCount, uint8_t* destination) {
+    frameCount = std::min(frameCount, uint32_t(mSamples.size()));
+    if (!isCompressible(mFormat)) {
+        destination[0] = uint8_t(BlockType::raw);
+        memcpy(destination + 1, frames, size_t(frameCount) * mFormat.bytesPerFrame);
+        return 1 + size_t(frameCount) * mFormat.bytesPerFrame;
+    }
+
+    destination[0] = uint8_t(BlockType::coded);
+    BitWriter writer(destination + 1);
+    const auto* bytes = static_cast<const uint8_t*>(frames);
+    const uint32_t channels = mFormat.channelCount;
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+        // Pull the channel out of the interleaved frames.
+        int32_t* samples = mSamples.data();
+        switch (mFormat.sampleFormat) {
+            case CaptureSampleFormat::int16:
+                for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                    int16_t sample;
+                    memcpy(&sample, bytes + (size_t(frame) * channels + channel) * 2, sizeof(sample));
+                    samples[frame] = sample;
+                }
+                break;
+            case CaptureSampleFormat::int24:
+                for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                    const uint8_t* sample = bytes + (size_t(frame) * channels + channel) * 3;
+                    samples[frame] = int32_t(uint32_t(sample[0]) << 8 | uint32_t(sample[1]) << 16 | uint32_t(sample[2]) << 24) >> 8;
+                }
+                break;
+            default:
+                for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                    memcpy(samples + frame, bytes + (size_t(frame) * channels + channel) * 4, sizeof(int32_t));
+                }
+                break;
+        }
+        encodeChannel(frameCount, writer);
+    }
+    return 1 + writer.finish();
+}
+
+void LosslessEncoder::encodeChannel(uint32_t frameCount, BitWriter& writer) {
+    int32_t* samples = mSamples.data();
+
+    // Turn float bit patterns into integers that predict well.
+    if (mFormat.sampleFormat == CaptureSampleFormat::float32) {
+        uint32_t scale = 0;
+        if (FindFloatScale(samples, frameCount, scale)) {
+            for (uint32_t index = 0; index < frameCount; ++index) {
+                float value;
+                memcpy(&value, samples + index, sizeof(value));
+                samples[index] = int32_t(std::ldexp(value, int(scale)));
+            }
+            writer.write(uint32_t(ChannelTransform::scaledFloat), 2);
+            writer.write(scale, 5);
+        }
+        else {
+            for (uint32_t index = 0; index < frameCount; ++index) {
+                samples[index] = OrderFloatBits(samples[index]);
+            }
+            writer.write(uint32_t(ChannelTransform::orderedFloat), 2);
+        }
+    }
+    else {
+        writer.write(uint32_t(ChannelTransform::integer), 2);
+    }
+    const uint32_t valueBits = ValueBits(mFormat);
+
+    if (std::all_of(samples, samples + frameCount, [&](int32_t sample) { return sample == samples[0]; })) {
+        writer.write(uint32_t(ChannelMode::constant), 2);
+        writer.write(uint32_t(frameCount > 0 ? samples[0] : 0), valueBits);
+        return;
+    }
+
+    // Start from the fixed polynomial with the smallest total error.
+    uint64_t fixedErrors[kMaxFixedOrder + 1] = {};
+    const uint32_t maxFixedOrder = std::min(kMaxFixedOrder, frameCount - 1);
+    for (uint32_t index = maxFixedOrder; index < frameCount; ++index) {
+        for (uint32_t order = 0; order <= maxFixedOrder; ++order) {
+            const auto residual = int64_t(samples[index]) - FixedPrediction(samples, index, order);
+            fixedErrors[order] += uint64_t(std::min<int64_t>(std::abs(residual), int64_t(1) << 40));
+        }
+    }
+    const auto fixedOrder = uint32_t(std::min_element(fixedErrors, fixedErrors + maxFixedOrder + 1) - fixedErrors);
+    for (uint32_t index = fixedOrder; index < frameCount; ++index) {
+        mResiduals[index] = WrappingSubtract(samples[index], FixedPrediction(samples, index, fixedOrder));
+    }
+    RicePlan plan;
+    auto mode = ChannelMode::fixed;
+    uint32_t order = fixedOrder;
+    uint64_t bits = 3 + uint64_t(order) * valueBits + PlanResidual(mResiduals.data(), frameCount, order, plan);
+
+    // Try LPC, and keep it if it codes smaller.
+    int32_t coefficients[kMaxLPCOrder] = {};
+    uint32_t shift = 0;
+    if (frameCount >= kMinLPCFrames) {
+        double candidates[kMaxLPCOrder][kMaxLPCOrder];
+        const auto lpcOrder = ComputeLPC(samples, frameCount, kMaxLPCOrder, mWindowed.data(), candidates);
+        int32_t quantized[kMaxLPCOrder] = {};
+        uint32_t quantizedShift = 0;
+        if (lpcOrder > 0 && QuantizeCoefficients(candidates[lpcOrder - 1], lpcOrder, quantized, quantizedShift)) {
+            for (uint32_t index = lpcOrder; index < frameCount; ++index) {
+                mCandidateResiduals[index] = WrappingSubtract(samples[index], LPCPrediction(samples, index, quantized, lpcOrder, quantizedShift));
+            }
+            RicePlan lpcPlan;
+            const uint64_t lpcBits = 12 + uint64_t(lpcOrder) * (kCoefficientPrecision + valueBits) +
+                                     PlanResidual(mCandidateResiduals.data(), frameCount, lpcOrder, lpcPlan);
+            if (lpcBits < bits) {
+                mode = ChannelMode::lpc;
+                order = lpcOrder;
+                bits = lpcBits;
+                plan = lpcPlan;
+                shift = quantizedShift;
+                std::copy(quantized, quantized + lpcOrder, coefficients);
+                mResiduals.swap(mCandidateResiduals);
+            }
+        }
+    }
+
+    if (bits >= uint64_t(frameCount) * valueBits) {
+        writer.write(uint32_t(ChannelMode::verbatim), 2);
+        for (uint32_t index = 0; index < frameCount; ++index) {
+            writer.write(uint32_t(samples[index]), valueBits);
+        }
+        return;
+    }
+
+    writer.write(uint32_t(mode), 2);
+    if (mode == ChannelMode::fixed) {
+        writer.write(order, 3);
+    }
+    else {
+        writer.write(order - 1, 4);
+        writer.write(shift, 4);
+        writer.write(kCoefficientPrecision - 1, 4);
+        for (uint32_t tap = 0; tap < order; ++tap) {
+            writer.write(uint32_t(coefficients[tap]), kCoefficientPrecision);
+        }
+    }
+    for (uint32_t index = 0; index < order; ++index) {
+        writer.write(uint32_t(samples[index]), valueBits);
+    }
+    WriteResidual(writer, mResiduals.data(), frameCount, order, plan);
+}
+
+// MARK: - LosslessDecoder
+
+LosslessDecoder::LosslessDecoder(const CaptureStreamFormat& format, uint32_t maxFrameCount)
+    : mFormat(format), mSamples(maxFrameCount), mResiduals(maxFrameCount) {}
+
+bool LosslessDecoder::decode(const uint8_t* data, size_t size, uint32_t frameCount, void* frames) {
+    if (size < 1 || frameCount > mSamples.size()) {
+        return false;
+    }
+    if (data[0] == uint8_t(BlockType::raw)) {
+        const size_t bytes = size_t(frameCount) * mFormat.bytesPerFrame;
+        if (size - 1 < bytes) {
+            return false;
+        }
+        memcpy(frames, data + 1, bytes);
+        return true;
+    }
+    if (data[0] != uint8_t(BlockType::coded) || !isCompressible(mFormat)) {
+        return false;
+    }
+
+    BitReader reader(data + 1, size - 1);
+    auto* bytes = static_cast<uint8_t*>(frames);
+    const uint32_t channels = mFormat.channelCount;
+    const uint32_t valueBits = ValueBits(mFormat);
+    int32_t* samples = mSamples.data();
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+        const auto transform = ChannelTransform(reader.read(2));
+        const auto scale = (transform == ChannelTransform::scaledFloat) ? uint32_t(reader.read(5)) : 0u;
+        const auto mode = ChannelMode(reader.read(2));
+        switch (mode) {
+            case ChannelMode::constant:
+                std::fill(samples, samples + frameCount, int32_t(reader.readSigned(valueBits)));
+                break;
+            case ChannelMode::verbatim:
+                for (uint32_t index = 0; index < frameCount; ++index) {
+                    samples[index] = int32_t(reader.readSigned(valueBits));
+                }
+                break;
+            case ChannelMode::fixed:
+            case ChannelMode::lpc: {
+                uint32_t order = 0;
+                uint32_t shift = 0;
+                int32_t coefficients[16] = {};
+                if (mode == ChannelMode::fixed) {
+                    order = uint32_t(reader.read(3));
+                    if (order > kMaxFixedOrder) {
+                        return false;
+                    }
+                }
+                else {
+                    order = uint32_t(reader.read(4)) + 1;
+                    shift = uint32_t(reader.read(4));
+                    const auto precision = uint32_t(reader.read(4)) + 1;
+                    for (uint32_t tap = 0; tap < order; ++tap) {
+                        coefficients[tap] = int32_t(reader.readSigned(precision));
+                    }
+                }
+                if (order > frameCount) {
+                    return false;
+                }
+                for (uint32_t index = 0; index < order; ++index) {
+                    samples[index] = int32_t(reader.readSigned(valueBits));
+                }
+                if (!ReadResidual(reader, mResiduals.data(), frameCount, order)) {
+                    return false;
+                }
+                for (uint32_t index = order; index < frameCount; ++index) {
+                    const auto prediction = (mode == ChannelMode::fixed) ? FixedPrediction(samples, index, order)
+                                                                         : LPCPrediction(samples, index, coefficients, order, shift);
+                    samples[index] = int32_t(uint32_t(uint64_t(WrappingAdd(mResiduals[index], prediction))));
+                }
+                break;
+            }
+        }
+        if (reader.failed()) {
+            return false;
+        }
+
+        // Undo the float transform, and interleave the channel back into the frames.
+        for (uint32_t frame = 0; frame < frameCount; ++frame) {
+            int32_t value = samples[frame];
+            if (transform == ChannelTransform::scaledFloat) {
+                const float sample = std::ldexp(float(value), -int(scale));
+                memcpy(&value, &sample, sizeof(value));
+            }
+            else if (transform == ChannelTransform::orderedFloat) {
+                value = OrderFloatBits(value);
+            }
+            switch (mFormat.sampleFormat) {
+                case CaptureSampleFormat::int16: {
+                    const auto sample = int16_t(value);
+                    memcpy(bytes + (size_t(frame) * channels + channel) * 2, &sample, sizeof(sample));
+                    break;
+                }
+                case CaptureSampleFormat::int24: {
+                    uint8_t* sample = bytes + (size_t(frame) * channels + channel) * 3;
+                    sample[0] = uint8_t(value);
+                    sample[1] = uint8_t(value >> 8);
+                    sample[2] = uint8_t(value >> 16);
+                    break;
+                }
+                default:
+                    memcpy(bytes + (size_t(frame) * channels + channel) * 4, &value, sizeof(value));
+                    break;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A lossless block codec for captured audio that uses linear prediction and Rice coding.
+*/
+
+#ifndef LosslessCodec_hpp
+#define LosslessCodec_hpp
+
+#include "CaptureFormat.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Codes each channel of a block on its own, in the style of FLAC. The encoder predicts each
+// sample from the ones before it, with a fixed polynomial or a quantized LPC filter of up to
+// `kMaxLPCOrder` taps, and Rice-codes the prediction error in partitions that each pick their own
+// parameter. A channel that doesn't shrink is stored verbatim, and a constant channel as one value.
+//
+// Integer samples are predicted as they are. Float samples that are all integers in disguise,
+// such as 16- or 24-bit audio converted to float, are predicted as those integers. Any other
+// float samples are predicted from their bit patterns, remapped so they order like the values.
+// Every path reproduces the input bit for bit, including NaNs and negative zeros.
+namespace LosslessCodec {
+
+constexpr uint32_t kMaxLPCOrder = 12;
+
+// Whether the codec can compress the format. Other formats are stored verbatim.
+bool isCompressible(const CaptureStreamFormat& format);
+
+// The most bytes a block of `frameCount` frames encodes to.
+size_t maxEncodedBytes(const CaptureStreamFormat& format, uint32_t frameCount);
+
+} // namespace LosslessCodec
+
+class BitWriter;
+
+// Encodes blocks of one format. Holds scratch space for one block, so use one per thread.
+class LosslessEncoder {
+public:
+    LosslessEncoder(const CaptureStreamFormat& format, uint32_t maxFrameCount);
+
+    // Encodes interleaved frames into `destination`, which holds at least
+    // `maxEncodedBytes(format, frameCount)` bytes, and returns the encoded size.
+    size_t encode(const void* frames, uint32_t frameCount, uint8_t* destination);
+
+private:
+    void encodeChannel(uint32_t frameCount, BitWriter& writer);
+
+    CaptureStreamFormat mFormat;
+    std::vector<int32_t> mSamples;
+    std::vector<int64_t> mResiduals;
+    std::vector<int64_t> mCandidateResiduals;
+    std::vector<double> mWindowed;
+};
+
+// Decodes blocks that `LosslessEncoder` wrote for the same format.
+class LosslessDecoder {
+public:
+    LosslessDecoder(const CaptureStreamFormat& format, uint32_t maxFrameCount);
+
+    // Decodes `frameCount` interleaved frames into `frames`, and returns false if the block is malformed.
+    bool decode(const uint8_t* data, size_t size, uint32_t frameCount, void* frames);
+
+private:
+    CaptureStreamFormat mFormat;
+    std::vector<int32_t> mSamples;
+    std::vector<int64_t> mResiduals;
+};
+
+#endif /* LosslessCodec_hpp */
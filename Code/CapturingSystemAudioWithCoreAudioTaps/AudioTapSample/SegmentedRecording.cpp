@@ -0,0 +1,321 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a recording sink that rolls each stream over to a new, preallocated CAF file at a fixed length, and keeps a manifest of the segments.
+*/
+
+#include "SegmentedRecording.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace SegmentedRecording;
+
+// Where the `data` chunk's size sits in a segment: after the file header, the `desc` chunk, and the `data` chunk's type.
+constexpr off_t kDataSizeOffset = 56;
+
+// The CAF format flags for linear PCM. Integer samples are always signed.
+constexpr uint32_t kCAFLinearPCMFormatFlagIsFloat = 1 << 0;
+constexpr uint32_t kCAFLinearPCMFormatFlagIsLittleEndian = 1 << 1;
+
+// Writes all of `size` bytes, retrying short writes.
+static bool writeAll(int file, const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        const auto written = ::write(file, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= size_t(written);
+    }
+    return true;
+}
+
+// CAF stores its headers big-endian.
+static uint8_t* putBigEndian(uint8_t* destination, uint64_t value, int byteCount) {
+    for (int index = 0; index < byteCount; ++index) {
+        destination[index] = uint8_t(value >> (8 * (byteCount - 1 - index)));
+    }
+    return destination + byteCount;
+}
+
+static uint8_t* putType(uint8_t* destination, const char (&type)[5]) {
+    memcpy(destination, type, 4);
+    return destination + 4;
+}
+
+static uint32_t bitsPerChannel(CaptureSampleFormat format) {
+    return BytesPerSample(format) * 8;
+}
+
+// Reserves `size` bytes for `file` without changing its length, so later writes don't wait for the
+// file system to find space. A file system that can't reserve the space just allocates as usual.
+static void preallocate(int file, uint64_t size) {
+#if defined(__APPLE__)
+    fstore_t store{F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, off_t(size), 0};
+    if (fcntl(file, F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(file, F_PREALLOCATE, &store);
+    }
+#else
+    // `posix_fallocate` extends the file too, so `finishSegment` truncates it to what was written.
+    posix_fallocate(file, 0, off_t(size));
+#endif
+}
+
+// The path of a stream's segment, from the recording's base path.
+static std::string segmentPath(const std::string& basePath, uint32_t stream, uint32_t segmentIndex) {
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), "-Stream_%u-Segment_%04u.caf", stream, segmentIndex);
+    return basePath + suffix;
+}
+
+// The part of a path after its last slash.
+static std::string fileName(const std::string& path) {
+    const auto slash = path.rfind('/');
+    return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+// MARK: - Sink
+
+SegmentingSink::~SegmentingSink() {
+    close();
+}
+
+bool SegmentingSink::open(const std::string& basePath,
+                          const std::vector<CaptureStreamFormat>& streams,
+                          double segmentSeconds,
+                          uint64_t segmentBytes,
+                          std::shared_ptr<Statistics> statistics) {
+    close();
+
+    mBasePath = basePath;
+    mManifestPath = basePath + "-Manifest.json";
+    mStatistics = statistics ? std::move(statistics) : std::make_shared<Statistics>();
+    mStreams.assign(streams.size(), Stream());
+    for (uint32_t index = 0; index < streams.size(); ++index) {
+        auto& stream = mStreams[index];
+        stream.format = streams[index];
+        if (!IsSupportedFormat(stream.format)) {
+            mStreams.clear();
+            return false;
+        }
+        // Both limits round down to whole frames, and a segment holds at least one.
+        uint64_t framesPerSegment = UINT64_MAX;
+        if (segmentSeconds > 0) {
+            framesPerSegment = std::min(framesPerSegment, uint64_t(std::floor(segmentSeconds * stream.format.sampleRate)));
+        }
+        if (segmentBytes > 0) {
+            framesPerSegment = std::min(framesPerSegment, (segmentBytes - std::min<uint64_t>(segmentBytes, kHeaderBytes)) / stream.format.bytesPerFrame);
+        }
+        stream.framesPerSegment = std::max<uint64_t>(framesPerSegment, 1);
+    }
+
+    mOpen = true;
+    for (uint32_t index = 0; index < mStreams.size(); ++index) {
+        if (!createSegment(index, 0, mStreams[index].current)) {
+            close();
+            return false;
+        }
+    }
+    writeManifest();
+    return true;
+}
+
+bool SegmentingSink::write(uint32_t stream, const void* data, uint32_t frameCount) {
+    if (stream >= mStreams.size()) {
+        return false;
+    }
+    auto& state = mStreams[stream];
+    const auto bytesPerFrame = state.format.bytesPerFrame;
+    auto bytes = static_cast<const uint8_t*>(data);
+    bool succeeded = true;
+    while (frameCount > 0) {
+        // Roll over only when there are frames for the next segment, so a recording doesn't end on an empty one.
+        if (state.current.frameCount == state.framesPerSegment && !rollOver(stream)) {
+            return false;
+        }
+        const auto frames = uint32_t(std::min<uint64_t>(frameCount, state.framesPerSegment - state.current.frameCount));
+
+        const auto started = std::chrono::steady_clock::now();
+        if (!writeAll(state.current.file, bytes, size_t(frames) * bytesPerFrame)) {
+            countError();
+            succeeded = false;
+        }
+        const auto elapsed = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+        auto longest = mStatistics->longestWriteNanoseconds.load(std::memory_order_relaxed);
+        while (elapsed > longest && !mStatistics->longestWriteNanoseconds.compare_exchange_weak(longest, elapsed, std::memory_order_relaxed)) {
+        }
+        mStatistics->bytesWritten.fetch_add(uint64_t(frames) * bytesPerFrame, std::memory_order_relaxed);
+
+        state.current.frameCount += frames;
+        state.frameCount += frames;
+        bytes += size_t(frames) * bytesPerFrame;
+        frameCount -= frames;
+
+        // Create the next segment well before it's needed, so the switch doesn't wait for it.
+        if (state.next.file < 0 && state.current.frameCount >= state.framesPerSegment / 2 && state.framesPerSegment > 1) {
+            createSegment(stream, state.segmentIndex + 1, state.next);
+        }
+    }
+    return succeeded;
+}
+
+bool SegmentingSink::close() {
+    if (!mOpen) {
+        return true;
+    }
+    bool succeeded = true;
+    for (uint32_t index = 0; index < mStreams.size(); ++index) {
+        auto& stream = mStreams[index];
+        if (stream.current.file >= 0) {
+            succeeded = finishSegment(stream, stream.current) && succeeded;
+            stream.finished.push_back(stream.current);
+        }
+        // Remove a segment made in advance that the recording didn't reach.
+        if (stream.next.file >= 0) {
+            ::close(stream.next.file);
+            unlink(segmentPath(mBasePath, index, stream.segmentIndex + 1).c_str());
+        }
+        stream.current = Segment();
+        stream.next = Segment();
+    }
+    succeeded = writeManifest() && succeeded;
+    mOpen = false;
+    mStreams.clear();
+    return succeeded;
+}
+
+// MARK: - Segments
+
+bool SegmentingSink::createSegment(uint32_t stream, uint32_t segmentIndex, Segment& segment) {
+    const auto& format = mStreams[stream].format;
+    const auto path = segmentPath(mBasePath, stream, segmentIndex);
+    segment = Segment();
+    segment.name = fileName(path);
+    segment.file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (segment.file < 0) {
+        countError();
+        return false;
+    }
+
+    uint8_t header[kHeaderBytes];
+    auto* cursor = putType(header, "caff");
+    cursor = putBigEndian(cursor, 1, 2);
+    cursor = putBigEndian(cursor, 0, 2);
+
+    cursor = putType(cursor, "desc");
+    cursor = putBigEndian(cursor, 32, 8);
+    uint64_t sampleRate = 0;
+    memcpy(&sampleRate, &format.sampleRate, sizeof(sampleRate));
+    cursor = putBigEndian(cursor, sampleRate, 8);
+    cursor = putType(cursor, "lpcm");
+    const bool isFloat = format.sampleFormat == CaptureSampleFormat::float32 || format.sampleFormat == CaptureSampleFormat::float64;
+    const bool isLittleEndian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+    cursor = putBigEndian(cursor, (isFloat ? kCAFLinearPCMFormatFlagIsFloat : 0) | (isLittleEndian ? kCAFLinearPCMFormatFlagIsLittleEndian : 0), 4);
+    cursor = putBigEndian(cursor, format.bytesPerFrame, 4);
+    cursor = putBigEndian(cursor, 1, 4);
+    cursor = putBigEndian(cursor, format.channelCount, 4);
+    cursor = putBigEndian(cursor, bitsPerChannel(format.sampleFormat), 4);
+
+    // A size of -1 marks the `data` chunk as running to the end of the file until `finishSegment` sets it.
+    cursor = putType(cursor, "data");
+    cursor = putBigEndian(cursor, UINT64_MAX, 8);
+    putBigEndian(cursor, 0, 4);
+
+    preallocate(segment.file, kHeaderBytes + mStreams[stream].framesPerSegment * format.bytesPerFrame);
+    if (!writeAll(segment.file, header, sizeof(header))) {
+        countError();
+        ::close(segment.file);
+        segment.file = -1;
+        return false;
+    }
+    return true;
+}
+
+bool SegmentingSink::finishSegment(const Stream& stream, Segment& segment) {
+    const auto audioBytes = segment.frameCount * stream.format.bytesPerFrame;
+    uint8_t dataSize[8];
+    // The `data` chunk's size counts its edit count too.
+    putBigEndian(dataSize, audioBytes + 4, 8);
+    bool succeeded = pwrite(segment.file, dataSize, sizeof(dataSize), kDataSizeOffset) == ssize_t(sizeof(dataSize));
+#if !defined(__APPLE__)
+    succeeded = ftruncate(segment.file, off_t(kHeaderBytes + audioBytes)) == 0 && succeeded;
+#endif
+    succeeded = ::close(segment.file) == 0 && succeeded;
+    segment.file = -1;
+    if (!succeeded) {
+        countError();
+    }
+    mStatistics->segmentCount.fetch_add(1, std::memory_order_relaxed);
+    return succeeded;
+}
+
+bool SegmentingSink::rollOver(uint32_t stream) {
+    auto& state = mStreams[stream];
+    if (state.next.file < 0 && !createSegment(stream, state.segmentIndex + 1, state.next)) {
+        return false;
+    }
+    finishSegment(state, state.current);
+    state.finished.push_back(state.current);
+    state.current = state.next;
+    state.current.firstFrame = state.frameCount;
+    state.next = Segment();
+    ++state.segmentIndex;
+    return writeManifest();
+}
+
+// MARK: - Manifest
+
+// Writes the manifest beside the segments, replacing the last one in a single rename, so a
+// reader never sees half a manifest.
+bool SegmentingSink::writeManifest() {
+    std::string manifest = "{\n  \"streams\": [";
+    char line[512];
+    for (size_t index = 0; index < mStreams.size(); ++index) {
+        const auto& stream = mStreams[index];
+        snprintf(line, sizeof(line), "%s\n    {\n      \"sampleRate\": %.17g,\n      \"channelCount\": %u,\n      \"bitsPerChannel\": %u,\n      \"segments\": [",
+                 (index > 0) ? "," : "", stream.format.sampleRate, stream.format.channelCount, bitsPerChannel(stream.format.sampleFormat));
+        manifest += line;
+        auto segments = stream.finished;
+        if (stream.current.file >= 0) {
+            segments.push_back(stream.current);
+        }
+        for (size_t segment = 0; segment < segments.size(); ++segment) {
+            const auto& entry = segments[segment];
+            snprintf(line, sizeof(line), "%s\n        {\"file\": \"%s\", \"firstFrame\": %llu, \"frameCount\": %llu, \"startSeconds\": %.9f}",
+                     (segment > 0) ? "," : "", entry.name.c_str(), (unsigned long long)entry.firstFrame,
+                     (unsigned long long)entry.frameCount, double(entry.firstFrame) / stream.format.sampleRate);
+            manifest += line;
+        }
+        manifest += "\n      ]\n    }";
+    }
+    manifest += "\n  ]\n}\n";
+
+    const auto temporaryPath = mManifestPath + ".tmp";
+    const int file = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        countError();
+        return false;
+    }
+    bool succeeded = writeAll(file, manifest.data(), manifest.size());
+    succeeded = ::close(file) == 0 && succeeded;
+    succeeded = succeeded && rename(temporaryPath.c_str(), mManifestPath.c_str()) == 0;
+    if (!succeeded) {
+        countError();
+    }
+    return succeeded;
+}
+
+void SegmentingSink::countError() {
+    mStatistics->fileErrorCount.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,104 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A recording sink that rolls each stream over to a new, preallocated CAF file at a fixed length, and keeps a manifest of the segments.
+*/
+
+#ifndef SegmentedRecording_hpp
+#define SegmentedRecording_hpp
+
+#include "CaptureEngine.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Each segment is a CAF file of linear PCM in the stream's captured format. Its `data` chunk
+// holds the segment's size once the segment is finished, so an interrupted recording leaves
+// every segment but the last complete.
+//
+// The manifest is a JSON file that lists, for each stream, its format and its segments in order,
+// with each segment's file name, first frame, frame count, and start time in seconds from the
+// beginning of the recording. Frames run on from one segment to the next without a gap, so the
+// first frames place every segment exactly.
+namespace SegmentedRecording {
+
+// The bytes before a segment's audio: the file header, and the `desc` and `data` chunk headers.
+constexpr uint32_t kHeaderBytes = 68;
+
+// Running totals for a segmented recording. The sink updates them, and any thread can read them.
+struct Statistics {
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> segmentCount{0};
+    // The longest a single write to a segment took, which is how long the writer thread stalled.
+    std::atomic<uint64_t> longestWriteNanoseconds{0};
+    std::atomic<uint64_t> fileErrorCount{0};
+};
+
+} // namespace SegmentedRecording
+
+// Writes each stream to a series of CAF files on the capture engine's writer thread. A segment
+// ends after `segmentSeconds` of audio or `segmentBytes` of file, whichever comes first, and the
+// stream goes on in the next segment, so the I/O thread never sees a switch.
+//
+// Each segment's space is allocated when the segment is created, so writes fill space the file
+// system has already found. The next segment is created once the current one is half full, so
+// the switch itself only finishes one file and starts writing to another.
+class SegmentingSink final : public CaptureSink {
+public:
+    SegmentingSink() = default;
+    SegmentingSink(const SegmentingSink&) = delete;
+    SegmentingSink& operator=(const SegmentingSink&) = delete;
+    ~SegmentingSink() override;
+
+    // Creates the first segment of each stream, named `<basePath>-Stream_<stream>-Segment_<segment>.caf`.
+    // A limit of 0 doesn't apply; with both at 0, each stream has one segment. Every stream needs a supported format.
+    bool open(const std::string& basePath,
+              const std::vector<CaptureStreamFormat>& streams,
+              double segmentSeconds,
+              uint64_t segmentBytes,
+              std::shared_ptr<SegmentedRecording::Statistics> statistics);
+
+    bool write(uint32_t stream, const void* data, uint32_t frameCount) override;
+
+    // Finishes the last segments, removes any created in advance, and writes the final manifest.
+    bool close();
+
+    // `<basePath>-Manifest.json`
+    const std::string& manifestPath() const { return mManifestPath; }
+
+private:
+    struct Segment {
+        int file = -1;
+        std::string name;
+        uint64_t firstFrame = 0;
+        uint64_t frameCount = 0;
+    };
+
+    struct Stream {
+        CaptureStreamFormat format;
+        uint64_t framesPerSegment = 0;
+        uint64_t frameCount = 0;
+        uint32_t segmentIndex = 0;
+        Segment current;
+        Segment next;
+        std::vector<Segment> finished;
+    };
+
+    bool createSegment(uint32_t stream, uint32_t segmentIndex, Segment& segment);
+    bool finishSegment(const Stream& stream, Segment& segment);
+    bool rollOver(uint32_t stream);
+    bool writeManifest();
+    void countError();
+
+    std::string mBasePath;
+    std::string mManifestPath;
+    std::vector<Stream> mStreams;
+    std::shared_ptr<SegmentedRecording::Statistics> mStatistics;
+    bool mOpen = false;
+};
+
+#endif /* SegmentedRecording_hpp */
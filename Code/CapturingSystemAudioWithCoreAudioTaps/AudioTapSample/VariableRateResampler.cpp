@@ -0,0 +1,135 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a streaming windowed-sinc resampler for one channel of audio.
+*/
+
+#include "VariableRateResampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+typedef float Float4 __attribute__((vector_size(16)));
+
+// The filter's history before the read position, and its reach after it.
+constexpr uint32_t kHistoryFrames = VariableRateResampler::kTaps / 2 - 1;
+constexpr uint32_t kLookaheadFrames = VariableRateResampler::kTaps / 2;
+
+// Zeros ahead of the first input frame beyond the filter's reach, so a cycle that brings one frame
+// fewer than the ratio suggests doesn't run short.
+constexpr uint32_t kCushionFrames = 2;
+
+static inline Float4 LoadFloat4(const float* source) noexcept {
+    Float4 value;
+    memcpy(&value, source, sizeof(value));
+    return value;
+}
+
+VariableRateResampler::VariableRateResampler(double inputSampleRate, double outputSampleRate, uint32_t maxInputFrames)
+    : mStep(inputSampleRate / outputSampleRate) {
+    // Pass up to 92% of the lower of the two Nyquist frequencies, so downsampling doesn't alias.
+    const double cutoff = std::min(1.0, outputSampleRate / inputSampleRate) * 0.92;
+
+    // Store each phase's taps followed by their difference from the next phase's,
+    // so a fractional phase costs one multiply-add per tap.
+    std::vector<double> phases(size_t(kPhases + 1) * kTaps);
+    for (uint32_t phase = 0; phase <= kPhases; ++phase) {
+        const double fraction = double(phase) / kPhases;
+        double sum = 0;
+        for (uint32_t tap = 0; tap < kTaps; ++tap) {
+            const double x = double(tap) - kHistoryFrames - fraction;
+            const double sinc = (x == 0) ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            const double window = (std::abs(x) >= kTaps / 2) ? 0.0 :
+                0.42 + 0.5 * std::cos(2 * M_PI * x / kTaps) + 0.08 * std::cos(4 * M_PI * x / kTaps);
+            phases[size_t(phase) * kTaps + tap] = sinc * window;
+            sum += sinc * window;
+        }
+        // Normalize each phase to unity gain at DC.
+        for (uint32_t tap = 0; tap < kTaps; ++tap) {
+            phases[size_t(phase) * kTaps + tap] /= sum;
+        }
+    }
+    mCoefficients.resize(size_t(kPhases) * kTaps * 2);
+    for (uint32_t phase = 0; phase < kPhases; ++phase) {
+        float* coefficients = mCoefficients.data() + size_t(phase) * kTaps * 2;
+        for (uint32_t tap = 0; tap < kTaps; ++tap) {
+            const double current = phases[size_t(phase) * kTaps + tap];
+            coefficients[tap] = float(current);
+            coefficients[kTaps + tap] = float(phases[size_t(phase + 1) * kTaps + tap] - current);
+        }
+    }
+
+    mHistory.resize(kTaps + kCushionFrames + size_t(maxInputFrames) * 2);
+    reset();
+}
+
+void VariableRateResampler::reset() {
+    std::fill(mHistory.begin(), mHistory.end(), 0.0f);
+    mCount = kHistoryFrames + kLookaheadFrames + kCushionFrames;
+    mPosition = kHistoryFrames;
+}
+
+uint32_t VariableRateResampler::push(const float* source, size_t stride, uint32_t frameCount) noexcept {
+    const size_t capacity = mHistory.size();
+    uint32_t dropped = 0;
+    if (frameCount > capacity) {
+        // Keep only the newest input that fits.
+        dropped += uint32_t(frameCount - capacity);
+        source += (frameCount - capacity) * stride;
+        frameCount = uint32_t(capacity);
+    }
+
+    if (mCount + frameCount > capacity) {
+        // Discard the input the filter has moved past.
+        auto consumed = std::min(size_t(mPosition) - kHistoryFrames, mCount);
+        if (mCount + frameCount - consumed > capacity) {
+            // Still too full, because the output side has stopped pulling. Drop the oldest input too.
+            const auto excess = mCount + frameCount - consumed - capacity;
+            consumed += excess;
+            dropped += uint32_t(excess);
+        }
+        memmove(mHistory.data(), mHistory.data() + consumed, (mCount - consumed) * sizeof(float));
+        mCount -= consumed;
+        mPosition = std::max(mPosition - double(consumed), double(kHistoryFrames));
+    }
+
+    float* destination = mHistory.data() + mCount;
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        destination[frame] = source[frame * stride];
+    }
+    mCount += frameCount;
+    return dropped;
+}
+
+uint32_t VariableRateResampler::pull(float* destination, size_t stride, uint32_t frameCount) noexcept {
+    uint32_t produced = 0;
+    while (produced < frameCount) {
+        const auto index = size_t(mPosition);
+        if (index + kLookaheadFrames >= mCount) {
+            break;
+        }
+        destination[produced * stride] = interpolate(index, mPosition - double(index));
+        mPosition += mStep;
+        ++produced;
+    }
+    return produced;
+}
+
+float VariableRateResampler::interpolate(size_t index, double fraction) const noexcept {
+    const double phasePosition = fraction * kPhases;
+    const auto phase = std::min(uint32_t(phasePosition), kPhases - 1);
+    const float blend = float(phasePosition - phase);
+    const float* coefficients = mCoefficients.data() + size_t(phase) * kTaps * 2;
+    const float* samples = mHistory.data() + index - kHistoryFrames;
+
+    Float4 first = {};
+    Float4 second = {};
+    for (uint32_t tap = 0; tap < kTaps; tap += 8) {
+        first += LoadFloat4(samples + tap) * (LoadFloat4(coefficients + tap) + blend * LoadFloat4(coefficients + kTaps + tap));
+        second += LoadFloat4(samples + tap + 4) * (LoadFloat4(coefficients + tap + 4) + blend * LoadFloat4(coefficients + kTaps + tap + 4));
+    }
+    const Float4 sum = first + second;
+    return sum[0] + sum[1] + sum[2] + sum[3];
+}
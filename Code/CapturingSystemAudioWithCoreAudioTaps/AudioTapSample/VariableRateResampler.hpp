@@ -0,0 +1,56 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A streaming windowed-sinc resampler for one channel of audio.
+*/
+
+#ifndef VariableRateResampler_hpp
+#define VariableRateResampler_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Converts one channel between sample rates with a 32-tap windowed-sinc filter, interpolating
+// between 128 precomputed phases. Input collects in a history buffer that `push` fills and `pull`
+// drains, so the two sides can move different numbers of frames each cycle. Neither allocates.
+class VariableRateResampler {
+public:
+    static constexpr uint32_t kTaps = 32;
+    static constexpr uint32_t kPhases = 128;
+
+    // Holds room for two pushes of `maxInputFrames` beyond the filter's history.
+    VariableRateResampler(double inputSampleRate, double outputSampleRate, uint32_t maxInputFrames);
+
+    // Clears the history and restarts at the filter's delay.
+    void reset();
+
+    // Appends strided input samples, and returns how many of the oldest buffered samples it dropped to make room.
+    uint32_t push(const float* source, size_t stride, uint32_t frameCount) noexcept;
+
+    // Writes up to `frameCount` strided output samples, and returns how many it wrote before running out of input.
+    uint32_t pull(float* destination, size_t stride, uint32_t frameCount) noexcept;
+
+    // The input frames per output frame.
+    double step() const { return mStep; }
+
+    // Changes the input frames per output frame from the next output frame on, to follow a drifting
+    // clock. The filter keeps the cutoff it was built with, so keep the change small. Real-time safe.
+    void setStep(double step) noexcept { mStep = step; }
+
+    // The input frames, including a fraction of one, from the read position to the end of what's buffered.
+    // Right after `reset`, the read position is `bufferedFrames()` frames ahead of the first input frame.
+    double bufferedFrames() const { return double(mCount) - mPosition; }
+
+private:
+    float interpolate(size_t index, double fraction) const noexcept;
+
+    double mStep;
+    std::vector<float> mCoefficients;
+    std::vector<float> mHistory;
+    size_t mCount = 0;
+    double mPosition = 0;
+};
+
+#endif /* VariableRateResampler_hpp */
@@ -0,0 +1,210 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the analyzer's levels, loudness, spectra, and snapshots, and a benchmark of its CPU time for 32 streams.
+*/
+
+#include "CaptureAnalyzer.hpp"
+#include "TestSupport.h"
+
+#include <thread>
+
+constexpr double kSampleRate = 48000;
+
+const CaptureStreamFormat kStereoFloat{kSampleRate, 2, 8, CaptureSampleFormat::float32};
+
+// A sine on every channel of a float stream, continuous across cycles.
+struct SineInput {
+    SineInput(double amplitude, double frequency) : amplitude(amplitude), frequency(frequency) {}
+
+    double amplitude;
+    double frequency;
+    uint32_t channelCount = 2;
+    uint64_t frame = 0;
+    std::vector<float> samples;
+
+    CaptureBuffer next(uint32_t frameCount) {
+        samples.resize(size_t(frameCount) * channelCount);
+        for (uint32_t index = 0; index < frameCount; ++index, ++frame) {
+            const auto value = float(amplitude * std::sin(2 * M_PI * frequency * double(frame) / kSampleRate));
+            std::fill_n(samples.begin() + size_t(index) * channelCount, channelCount, value);
+        }
+        return CaptureBuffer{channelCount, uint32_t(samples.size() * sizeof(float)), samples.data()};
+    }
+};
+
+// Runs `seconds` of `input` through the analyzer in 50 ms passes, as its worker would.
+static void Play(CaptureAnalyzer& analyzer, SineInput& input, double seconds) {
+    for (int pass = 0; pass < int(seconds * 20); ++pass) {
+        analyzer.capture(0, input.next(2400));
+        analyzer.analyze();
+    }
+}
+
+// 20 s at -20 LUFS, then 20 s at -40 LUFS. The relative gate leaves the quiet half out of the
+// integrated loudness, while the momentary and short-term loudness follow the level down.
+static void checkLevelsAndLoudness() {
+    CaptureAnalyzer analyzer;
+    analyzer.start({kStereoFloat}, 0);
+    CHECK(analyzer.latest().sequence == 0);
+
+    SineInput loud(0.1, 997);
+    Play(analyzer, loud, 20);
+    SineInput quiet(0.01, 997);
+    quiet.frame = loud.frame;
+    Play(analyzer, quiet, 20);
+
+    const auto& snapshot = analyzer.latest();
+    CHECK(snapshot.sequence == 800);
+    const auto& stream = snapshot.streams[0];
+    CHECK(stream.analyzedFrames == 40 * uint64_t(kSampleRate));
+    CHECK(stream.droppedFrames == 0);
+    for (uint32_t channel = 0; channel < 2; ++channel) {
+        CHECK_NEAR(stream.peak[channel], 0.01, 1e-4);
+        CHECK_NEAR(stream.rms[channel], 0.01 / std::sqrt(2.0), 1e-4);
+    }
+    // A 997 Hz sine at amplitude A in each of two channels measures 20·log10(A) LUFS.
+    CHECK_NEAR(stream.momentaryLoudness, -40, 0.1);
+    CHECK_NEAR(stream.shortTermLoudness, -40, 0.1);
+    CHECK_NEAR(stream.integratedLoudness, -20, 0.1);
+
+    // The band holding the tone reads its level, within the window's scalloping, and bands far from it read nothing.
+    const auto strongest = uint32_t(std::max_element(stream.spectrum.begin(), stream.spectrum.end()) - stream.spectrum.begin());
+    CHECK(CaptureAnalyzer::bandFrequency(kSampleRate, strongest) <= 997);
+    CHECK(CaptureAnalyzer::bandFrequency(kSampleRate, strongest + 1) > 997);
+    CHECK_NEAR(stream.spectrum[strongest], -40, 2);
+    CHECK(stream.spectrum[10] < -100);
+}
+
+// The BS.1770 reference: a full-scale 997 Hz sine on one channel measures -3.01 LUFS, here from
+// 16-bit samples at 44.1 kHz.
+static void checkReferenceLoudness() {
+    CaptureAnalyzer analyzer;
+    analyzer.start({CaptureStreamFormat{44100, 1, 2, CaptureSampleFormat::int16}}, 0);
+    std::vector<int16_t> samples(4410);
+    uint64_t frame = 0;
+    for (int pass = 0; pass < 50; ++pass) {
+        for (auto& sample : samples) {
+            sample = int16_t(std::lround(32767 * std::sin(2 * M_PI * 997 * double(frame++) / 44100)));
+        }
+        analyzer.capture(0, CaptureBuffer{1, uint32_t(samples.size() * sizeof(int16_t)), samples.data()});
+        analyzer.analyze();
+    }
+    const auto& stream = analyzer.latest().streams[0];
+    CHECK_NEAR(stream.momentaryLoudness, -3.01, 0.05);
+    CHECK_NEAR(stream.integratedLoudness, -3.01, 0.05);
+    CHECK_NEAR(stream.peak[0], 1.0, 1e-3);
+}
+
+// Silence reads as no loudness at all. A stream the analyzer can't convert has no channels or
+// bands to report, and no loudness either.
+static void checkSilence() {
+    CaptureAnalyzer analyzer;
+    analyzer.start({kStereoFloat, CaptureStreamFormat{kSampleRate, 2, 16, CaptureSampleFormat::unsupported}}, 0);
+    SineInput silence(0, 997);
+    std::vector<uint8_t> other(2400 * 16, 0x7F);
+    for (int pass = 0; pass < 20; ++pass) {
+        analyzer.capture(0, silence.next(2400));
+        analyzer.capture(1, CaptureBuffer{2, uint32_t(other.size()), other.data()});
+        analyzer.analyze();
+    }
+    const auto& streams = analyzer.latest().streams;
+    CHECK(streams[0].peak[0] == 0 && streams[0].rms[1] == 0);
+    CHECK(streams[0].spectrum.size() == CaptureAnalyzer::kSpectrumBands);
+    CHECK(streams[1].peak.empty() && streams[1].spectrum.empty());
+    for (const auto& stream : streams) {
+        CHECK(std::isinf(stream.momentaryLoudness) && stream.momentaryLoudness < 0);
+        CHECK(std::isinf(stream.integratedLoudness) && stream.integratedLoudness < 0);
+    }
+}
+
+// When nothing drains the rings, the I/O side drops what doesn't fit and counts it.
+static void checkDroppedFrames() {
+    CaptureAnalyzer analyzer;
+    analyzer.start({kStereoFloat}, 0);
+    SineInput input(0.5, 440);
+    for (int cycle = 0; cycle < 100; ++cycle) {
+        analyzer.capture(0, input.next(480));
+    }
+    analyzer.analyze();
+    const auto& stream = analyzer.latest().streams[0];
+    CHECK(stream.analyzedFrames + stream.droppedFrames == 48000);
+    CHECK(stream.droppedFrames > 0);
+}
+
+// An I/O thread, the worker, and a reader run at once; the reader sees fresh snapshots and the worker keeps up.
+static void checkThreads() {
+    CaptureAnalyzer analyzer;
+    analyzer.start({kStereoFloat, kStereoFloat}, 0.01);
+    std::thread io([&] {
+        SineInput first(0.5, 440), second(0.25, 880);
+        for (int cycle = 0; cycle < 300; ++cycle) {
+            analyzer.capture(0, first.next(480));
+            analyzer.capture(1, second.next(480));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    uint64_t lastSequence = 0;
+    int freshSnapshots = 0;
+    float loudestPeak = 0;
+    for (int read = 0; read < 200; ++read) {
+        const auto& snapshot = analyzer.latest();
+        freshSnapshots += (snapshot.sequence != lastSequence);
+        lastSequence = snapshot.sequence;
+        loudestPeak = std::max(loudestPeak, snapshot.streams[1].peak[0]);
+        std::this_thread::sleep_for(std::chrono::microseconds(700));
+    }
+    io.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const auto& snapshot = analyzer.latest();
+    analyzer.stop();
+    CHECK(freshSnapshots > 1);
+    CHECK(snapshot.streams[1].analyzedFrames == 300 * 480);
+    CHECK(snapshot.streams[1].droppedFrames == 0);
+    CHECK_NEAR(loudestPeak, 0.25, 1e-3);
+}
+
+// Analyzes 32 streams in 50 ms passes, and reports the worker's CPU time as a share of one core.
+static void benchmark(uint32_t channelCount) {
+    constexpr uint32_t kStreams = 32;
+    constexpr uint32_t kPassFrames = 2400;
+    const CaptureStreamFormat format{kSampleRate, channelCount, channelCount * 4, CaptureSampleFormat::float32};
+    CaptureAnalyzer analyzer;
+    analyzer.start(std::vector<CaptureStreamFormat>(kStreams, format), 0);
+    std::vector<std::vector<float>> samples(kStreams, std::vector<float>(size_t(kPassFrames) * channelCount));
+    for (size_t stream = 0; stream < kStreams; ++stream) {
+        for (size_t index = 0; index < samples[stream].size(); ++index) {
+            samples[stream][index] = float(std::sin(double(index) * 0.01 * double(stream + 1)) * 0.3);
+        }
+    }
+
+    const double seconds = test::quickMode() ? 2 : 60;
+    const auto passes = int(seconds * kSampleRate / kPassFrames);
+    for (int pass = 0; pass < passes; ++pass) {
+        for (uint32_t stream = 0; stream < kStreams; ++stream) {
+            analyzer.capture(stream, CaptureBuffer{channelCount, uint32_t(samples[stream].size() * sizeof(float)), samples[stream].data()});
+        }
+        analyzer.analyze();
+    }
+    const double cpuSeconds = double(analyzer.analysisNanoseconds()) / 1e9;
+    CHECK(analyzer.latest().streams[kStreams - 1].droppedFrames == 0);
+    printf("%7u %8u %13.2f%% %16.1f\n", kStreams, channelCount, 100 * cpuSeconds / seconds, cpuSeconds * 1e6 / passes / kStreams);
+}
+
+int main(int argc, char** argv) {
+    test::parseArguments(argc, argv);
+
+    checkLevelsAndLoudness();
+    checkReferenceLoudness();
+    checkSilence();
+    checkDroppedFrames();
+    checkThreads();
+
+    printf("\nLevels, loudness, and spectrum of float streams at 48 kHz in 50 ms passes\n");
+    printf("%7s %8s %14s %16s\n", "streams", "channels", "CPU of a core", "µs/stream/pass");
+    for (uint32_t channelCount : {2u, 8u}) {
+        benchmark(channelCount);
+    }
+    return test::finish("CaptureAnalyzerTests");
+}
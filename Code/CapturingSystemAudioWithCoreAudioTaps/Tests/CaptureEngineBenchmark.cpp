@@ -0,0 +1,307 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A benchmark of the recorder's I/O proc without hardware: a fake HAL clock runs the capture engine's cycle
+at a device's buffer size, and measures each cycle's time and any allocation on the I/O thread.
+*/
+
+#include "CaptureEngine.hpp"
+#include "TestSupport.h"
+
+#include <new>
+#include <string>
+#include <thread>
+
+// Counts the allocations the I/O thread makes during cycles, which a real-time thread must never make.
+static thread_local bool tInCycle = false;
+static std::atomic<uint64_t> gCycleAllocations{0};
+
+void* operator new(size_t size) {
+    if (tInCycle) {
+        gCycleAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (auto* pointer = malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+enum class Mode { off, on, toggle };
+
+struct Options {
+    std::vector<uint32_t> streamCounts = {8, 32};
+    std::vector<uint32_t> bufferFrames = {16, 256, 4096};
+    std::string format = "mixed";
+    uint32_t channelCount = 2;
+    double sampleRate = 48000;
+    double seconds = 0;
+    Mode recording = Mode::toggle;
+    Mode loopback = Mode::toggle;
+    bool metering = false;
+};
+
+static std::vector<uint32_t> ParseList(const char* text) {
+    std::vector<uint32_t> values;
+    for (const char* cursor = text; *cursor != '\0';) {
+        char* end = nullptr;
+        const auto value = strtoul(cursor, &end, 10);
+        if (end == cursor) {
+            break;
+        }
+        values.push_back(uint32_t(value));
+        cursor = (*end == ',') ? end + 1 : end;
+    }
+    return values;
+}
+
+static Mode ParseMode(const char* text) {
+    return strcmp(text, "on") == 0 ? Mode::on : strcmp(text, "off") == 0 ? Mode::off : Mode::toggle;
+}
+
+static const char* ModeName(Mode mode) {
+    return mode == Mode::on ? "on" : mode == Mode::off ? "off" : "toggled";
+}
+
+static void PrintUsage() {
+    printf("usage: CaptureEngineBenchmark [--full] [--streams 8,32] [--frames 16,256,4096]\n"
+           "                              [--format float32|int16|int24|mixed] [--channels 2] [--rate 48000]\n"
+           "                              [--seconds S] [--recording on|off|toggle] [--loopback on|off|toggle]\n"
+           "                              [--metering on|off]\n");
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int index = 1; index < argc; ++index) {
+        const char* option = argv[index];
+        if (strcmp(option, "--full") == 0) {
+            continue;
+        }
+        if (index + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++index];
+        if (strcmp(option, "--streams") == 0) {
+            options.streamCounts = ParseList(value);
+        }
+        else if (strcmp(option, "--frames") == 0) {
+            options.bufferFrames = ParseList(value);
+        }
+        else if (strcmp(option, "--format") == 0) {
+            options.format = value;
+        }
+        else if (strcmp(option, "--channels") == 0) {
+            options.channelCount = uint32_t(std::max(1, atoi(value)));
+        }
+        else if (strcmp(option, "--rate") == 0) {
+            options.sampleRate = atof(value);
+        }
+        else if (strcmp(option, "--seconds") == 0) {
+            options.seconds = atof(value);
+        }
+        else if (strcmp(option, "--recording") == 0) {
+            options.recording = ParseMode(value);
+        }
+        else if (strcmp(option, "--loopback") == 0) {
+            options.loopback = ParseMode(value);
+        }
+        else if (strcmp(option, "--metering") == 0) {
+            options.metering = strcmp(value, "on") == 0;
+        }
+        else {
+            return false;
+        }
+    }
+    return !options.streamCounts.empty() && !options.bufferFrames.empty() && options.sampleRate > 0;
+}
+
+// The input streams' formats: all in one sample format, or float32, int16, and int24 in turn.
+static std::vector<CaptureStreamFormat> MakeFormats(const Options& options, uint32_t streamCount) {
+    const CaptureSampleFormat mixed[] = {CaptureSampleFormat::float32, CaptureSampleFormat::int16, CaptureSampleFormat::int24};
+    std::vector<CaptureStreamFormat> formats;
+    for (uint32_t stream = 0; stream < streamCount; ++stream) {
+        auto sampleFormat = mixed[stream % 3];
+        if (options.format == "float32") {
+            sampleFormat = CaptureSampleFormat::float32;
+        }
+        else if (options.format == "int16") {
+            sampleFormat = CaptureSampleFormat::int16;
+        }
+        else if (options.format == "int24") {
+            sampleFormat = CaptureSampleFormat::int24;
+        }
+        formats.push_back({options.sampleRate, options.channelCount, BytesPerSample(sampleFormat) * options.channelCount, sampleFormat});
+    }
+    return formats;
+}
+
+class NullSink : public CaptureSink {
+public:
+    bool write(uint32_t, const void*, uint32_t) override { return true; }
+};
+
+// Stands in for the HAL: a real-time-paced thread that hands the engine a cycle of every input stream, and
+// a stereo float output stream, every buffer period, as the HAL calls the recorder's I/O proc.
+class FakeHALClock {
+public:
+    FakeHALClock(CaptureEngine& engine, const std::vector<CaptureStreamFormat>& inputs, uint32_t bufferFrames, double sampleRate)
+        : mEngine(engine), mBufferFrames(bufferFrames), mSampleRate(sampleRate) {
+        for (const auto& format : inputs) {
+            mInputBytes.emplace_back(size_t(bufferFrames) * format.bytesPerFrame);
+            for (size_t index = 0; index < mInputBytes.back().size(); ++index) {
+                mInputBytes.back()[index] = uint8_t(index * 7);
+            }
+            mInputs.push_back(CaptureBuffer{format.channelCount, uint32_t(mInputBytes.back().size()), mInputBytes.back().data()});
+        }
+        mOutputBytes.resize(size_t(bufferFrames) * 8);
+        mOutputs.push_back(CaptureBuffer{2, uint32_t(mOutputBytes.size()), mOutputBytes.data()});
+    }
+
+    // Runs cycles until `stop`, timing each one into `nanoseconds`, which holds as many as it has room for.
+    void start(size_t maxCycles) {
+        mNanoseconds.reserve(maxCycles);
+        mRunning = true;
+        mThread = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        mRunning = false;
+        mThread.join();
+    }
+
+    const std::vector<uint64_t>& nanoseconds() const { return mNanoseconds; }
+    uint64_t lateCycles() const { return mLateCycles; }
+
+private:
+    void run() {
+        const auto period = std::chrono::nanoseconds(uint64_t(1e9 * mBufferFrames / mSampleRate));
+        auto next = std::chrono::steady_clock::now();
+        while (mRunning.load()) {
+            next += period;
+            std::this_thread::sleep_until(next);
+            // A thread that wakes a whole period late has missed a deadline before its cycle starts.
+            const auto started = std::chrono::steady_clock::now();
+            if (started - next > period) {
+                ++mLateCycles;
+                next = started;
+            }
+            tInCycle = true;
+            mEngine.process(mInputs.data(), uint32_t(mInputs.size()), mOutputs.data(), uint32_t(mOutputs.size()));
+            tInCycle = false;
+            const auto elapsed = std::chrono::steady_clock::now() - started;
+            if (mNanoseconds.size() < mNanoseconds.capacity()) {
+                mNanoseconds.push_back(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+            }
+        }
+    }
+
+    CaptureEngine& mEngine;
+    uint32_t mBufferFrames;
+    double mSampleRate;
+    std::vector<std::vector<uint8_t>> mInputBytes;
+    std::vector<uint8_t> mOutputBytes;
+    std::vector<CaptureBuffer> mInputs;
+    std::vector<CaptureBuffer> mOutputs;
+    std::vector<uint64_t> mNanoseconds;
+    uint64_t mLateCycles = 0;
+    std::atomic<bool> mRunning{false};
+    std::thread mThread;
+};
+
+// Runs the engine at one stream count and buffer size for the run's seconds. Recording and loopback that
+// toggle go on and off in quarters of the run, as the recorder's controls do: loopback comes on in the
+// second quarter, recording in the third, and loopback goes off in the fourth.
+static void benchmark(const Options& options, uint32_t streamCount, uint32_t bufferFrames) {
+    const auto inputs = MakeFormats(options, streamCount);
+    const CaptureStreamFormat output{options.sampleRate, 2, 8, CaptureSampleFormat::float32};
+    CaptureEngine engine;
+    engine.configure(inputs, 2.0);
+    engine.configureLoopback({output}, {}, std::max(bufferFrames, 4096u));
+    std::shared_ptr<CaptureAnalyzer> analyzer;
+    if (options.metering) {
+        analyzer = std::make_shared<CaptureAnalyzer>();
+        analyzer->start(inputs);
+        engine.setAnalyzer(analyzer);
+    }
+
+    auto set = [&](Mode recording, Mode loopback, bool recordingOn, bool loopbackOn) {
+        const bool record = recording == Mode::toggle ? recordingOn : recording == Mode::on;
+        if (record && !engine.isRecording()) {
+            engine.startRecording(std::make_unique<NullSink>());
+        }
+        else if (!record && engine.isRecording()) {
+            engine.stopRecording();
+        }
+        engine.setLoopbackEnabled(loopback == Mode::toggle ? loopbackOn : loopback == Mode::on);
+    };
+
+    const double seconds = options.seconds > 0 ? options.seconds : test::quickMode() ? 0.5 : 10;
+    const auto quarter = std::chrono::duration<double>(seconds / 4);
+    FakeHALClock clock(engine, inputs, bufferFrames, options.sampleRate);
+    set(options.recording, options.loopback, false, false);
+    clock.start(size_t(seconds * options.sampleRate / bufferFrames) + 16);
+    std::this_thread::sleep_for(quarter);
+    set(options.recording, options.loopback, false, true);
+    std::this_thread::sleep_for(quarter);
+    set(options.recording, options.loopback, true, true);
+    std::this_thread::sleep_for(quarter);
+    set(options.recording, options.loopback, true, false);
+    std::this_thread::sleep_for(quarter);
+    clock.stop();
+    engine.stopRecording();
+
+    uint64_t droppedFrames = 0;
+    for (uint32_t stream = 0; stream < streamCount; ++stream) {
+        droppedFrames += engine.statistics(stream).droppedFrames;
+    }
+    const auto allocations = gCycleAllocations.exchange(0);
+    CHECK(allocations == 0);
+    CHECK(droppedFrames == 0);
+    CHECK(engine.sinkErrorCount() == 0);
+    if (analyzer != nullptr) {
+        engine.setAnalyzer(nullptr);
+        analyzer->stop();
+    }
+
+    auto samples = clock.nanoseconds();
+    if (samples.empty()) {
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&](double fraction) {
+        return double(samples[std::min(samples.size() - 1, size_t(fraction * double(samples.size())))]) / 1e3;
+    };
+    const double budget = 1e6 * bufferFrames / options.sampleRate;
+    printf("%7u %6u %10.0f %7zu %8.2f %8.2f %8.2f %8.2f %8.2f%% %5llu %11llu %7llu\n", streamCount, bufferFrames, budget,
+           samples.size(), percentile(0.5), percentile(0.99), percentile(0.999), double(samples.back()) / 1e3,
+           100 * double(samples.back()) / 1e3 / budget, static_cast<unsigned long long>(clock.lateCycles()),
+           static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(droppedFrames));
+}
+
+int main(int argc, char** argv) {
+    test::parseArguments(argc, argv);
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    printf("%s streams of %u channels at %.0f Hz, recording %s, loopback %s, metering %s\n", options.format.c_str(),
+           options.channelCount, options.sampleRate, ModeName(options.recording), ModeName(options.loopback),
+           options.metering ? "on" : "off");
+    printf("%7s %6s %10s %7s %8s %8s %8s %8s %9s %5s %11s %7s\n", "streams", "frames", "budget µs", "cycles",
+           "p50 µs", "p99 µs", "p99.9 µs", "worst µs", "of budget", "late", "allocations", "dropped");
+    for (auto streamCount : options.streamCounts) {
+        for (auto bufferFrames : options.bufferFrames) {
+            benchmark(options, streamCount, std::clamp(bufferFrames, 16u, 4096u));
+        }
+    }
+    return test::finish("CaptureEngineBenchmark");
+}
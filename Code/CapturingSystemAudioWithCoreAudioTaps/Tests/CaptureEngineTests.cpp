@@ -0,0 +1,290 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the capture ring and the engine's fill levels and dropped frames, and a high-rate run of its I/O cycle.
+*/
+
+#include "CaptureEngine.hpp"
+#include "TestSupport.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+constexpr double kSampleRate = 48000;
+
+// Stereo frames whose first sample counts frames, so a sink can tell whether any went missing.
+const CaptureStreamFormat kCountingFormat{kSampleRate, 2, 8, CaptureSampleFormat::int32};
+
+// What a sink saw, kept outside the sink so it outlives the recording.
+struct SinkLog {
+    std::vector<uint32_t> nextFrame;
+    uint64_t frames = 0;
+    uint64_t gaps = 0;
+    uint64_t writes = 0;
+};
+
+// Checks that each stream arrives in order, starting from frame 0. Optionally holds its first
+// write until released, to stand in for a stalled disk.
+class CountingSink : public CaptureSink {
+public:
+    CountingSink(SinkLog& log, uint32_t streamCount, bool stall = false)
+        : mLog(log), mStall(stall) {
+        mLog.nextFrame.assign(streamCount, 0);
+    }
+
+    bool write(uint32_t stream, const void* data, uint32_t frameCount) override {
+        if (mStall) {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStalled = true;
+            mCondition.notify_all();
+            mCondition.wait(lock, [this] { return !mStall; });
+        }
+        const auto* samples = static_cast<const uint32_t*>(data);
+        auto& next = mLog.nextFrame[stream];
+        for (uint32_t frame = 0; frame < frameCount; ++frame) {
+            if (samples[frame * 2] != next) {
+                ++mLog.gaps;
+                next = samples[frame * 2];
+            }
+            ++next;
+        }
+        mLog.frames += frameCount;
+        ++mLog.writes;
+        return true;
+    }
+
+    // Waits until the writer thread is held in `write`.
+    bool waitUntilStalled() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mCondition.wait_for(lock, std::chrono::seconds(5), [this] { return mStalled; });
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStall = false;
+        mCondition.notify_all();
+    }
+
+private:
+    SinkLog& mLog;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStall;
+    bool mStalled = false;
+};
+
+// One cycle's buffers for every stream, continuing each stream's frame count.
+struct CountingInput {
+    CountingInput(uint32_t streamCount, uint32_t frameCount)
+        : samples(streamCount, std::vector<uint32_t>(frameCount * 2)), buffers(streamCount) {}
+
+    const CaptureBuffer* next(uint32_t frameCount) {
+        for (size_t stream = 0; stream < samples.size(); ++stream) {
+            for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                samples[stream][frame * 2] = position + frame;
+                samples[stream][frame * 2 + 1] = uint32_t(stream);
+            }
+            buffers[stream] = CaptureBuffer{2, frameCount * 8, samples[stream].data()};
+        }
+        position += frameCount;
+        return buffers.data();
+    }
+
+    std::vector<std::vector<uint32_t>> samples;
+    std::vector<CaptureBuffer> buffers;
+    uint32_t position = 0;
+};
+
+static void checkRing() {
+    CaptureRing ring(8, 100);
+    CHECK(ring.frameCapacity() == 128);
+
+    // Fill past the end so the readable frames wrap around.
+    std::vector<uint64_t> frames(200);
+    for (uint32_t i = 0; i < frames.size(); ++i) {
+        frames[i] = i;
+    }
+    CHECK(ring.write(frames.data(), 100) == 100);
+    ring.consume(90);
+    CHECK(ring.write(frames.data() + 100, 100) == 100);
+    CHECK(ring.availableFrames() == 110);
+
+    const uint8_t* first = nullptr;
+    const uint8_t* second = nullptr;
+    uint32_t firstFrames = 0, secondFrames = 0;
+    CHECK(ring.peek(first, firstFrames, second, secondFrames) == 110);
+    CHECK(firstFrames == 38 && secondFrames == 72);
+    CHECK(reinterpret_cast<const uint64_t*>(first)[0] == 90);
+    CHECK(reinterpret_cast<const uint64_t*>(second)[0] == 128);
+    CHECK(reinterpret_cast<const uint64_t*>(second)[secondFrames - 1] == 199);
+
+    // A full ring takes only what fits.
+    CHECK(ring.write(frames.data(), 50) == 18);
+    CHECK(ring.write(frames.data(), 1) == 0);
+    ring.discardAll();
+    CHECK(ring.availableFrames() == 0);
+}
+
+// A producer and a consumer on their own threads see every frame once, in order.
+static void checkRingAcrossThreads() {
+    CaptureRing ring(sizeof(uint64_t), 256);
+    const uint64_t total = test::quickMode() ? 1 << 20 : 1 << 26;
+    uint64_t gaps = 0;
+    std::thread consumer([&] {
+        for (uint64_t expected = 0; expected < total;) {
+            const uint8_t* first = nullptr;
+            const uint8_t* second = nullptr;
+            uint32_t firstFrames = 0, secondFrames = 0;
+            const auto available = ring.peek(first, firstFrames, second, secondFrames);
+            for (uint32_t i = 0; i < available; ++i) {
+                const auto* region = reinterpret_cast<const uint64_t*>(i < firstFrames ? first : second);
+                gaps += (region[i < firstFrames ? i : i - firstFrames] != expected++);
+            }
+            ring.consume(available);
+            if (available == 0) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint64_t block[37];
+    for (uint64_t produced = 0; produced < total;) {
+        const auto count = uint32_t(std::min<uint64_t>(37, total - produced));
+        for (uint32_t i = 0; i < count; ++i) {
+            block[i] = produced + i;
+        }
+        const auto written = ring.write(block, count);
+        if (written == 0) {
+            std::this_thread::yield();
+        }
+        produced += written;
+    }
+    consumer.join();
+    CHECK(gaps == 0);
+}
+
+// A recording writes every captured frame once, in order, and stops with empty rings.
+static void checkRecording() {
+    constexpr uint32_t kStreams = 4;
+    constexpr uint32_t kCycleFrames = 512;
+    CaptureEngine engine;
+    engine.configure(std::vector<CaptureStreamFormat>(kStreams, kCountingFormat), 2.0);
+
+    SinkLog log;
+    engine.startRecording(std::make_unique<CountingSink>(log, kStreams));
+    CHECK(engine.isRecording());
+    CountingInput input(kStreams, kCycleFrames);
+    for (int cycle = 0; cycle < 100; ++cycle) {
+        engine.process(input.next(kCycleFrames), kStreams, nullptr, 0);
+    }
+    engine.stopRecording();
+    CHECK(!engine.isRecording());
+
+    CHECK(log.gaps == 0);
+    CHECK(log.frames == uint64_t(kStreams) * 100 * kCycleFrames);
+    for (uint32_t stream = 0; stream < kStreams; ++stream) {
+        const auto statistics = engine.statistics(stream);
+        CHECK(statistics.capacityFrames == 131072);
+        CHECK(statistics.fillFrames == 0);
+        CHECK(statistics.capturedFrames == 100 * kCycleFrames);
+        CHECK(statistics.writtenFrames == statistics.capturedFrames);
+        CHECK(statistics.droppedFrames == 0);
+    }
+    CHECK(engine.sinkErrorCount() == 0);
+
+    // Nothing captures between recordings.
+    engine.process(input.next(kCycleFrames), kStreams, nullptr, 0);
+    CHECK(engine.statistics(0).capturedFrames == 100 * kCycleFrames);
+}
+
+// While the sink stalls, the ring fills to capacity, and the frames that don't fit are dropped and
+// counted. The frames that fit still reach the sink in order once it recovers.
+static void checkDroppedFrames() {
+    constexpr uint32_t kCycleFrames = 256;
+    CaptureEngine engine;
+    engine.configure({kCountingFormat}, 0.1);
+    const auto capacity = engine.statistics(0).capacityFrames;
+    CHECK(capacity == 8192);
+
+    SinkLog log;
+    auto sink = std::make_unique<CountingSink>(log, 1, true);
+    auto* stalledSink = sink.get();
+    engine.startRecording(std::move(sink));
+    CountingInput input(1, kCycleFrames);
+    engine.process(input.next(kCycleFrames), 1, nullptr, 0);
+    CHECK(stalledSink->waitUntilStalled());
+
+    constexpr uint32_t kCycles = 100;
+    for (uint32_t cycle = 1; cycle < kCycles; ++cycle) {
+        engine.process(input.next(kCycleFrames), 1, nullptr, 0);
+    }
+    auto statistics = engine.statistics(0);
+    CHECK(statistics.fillFrames == capacity);
+    CHECK(statistics.capturedFrames == kCycles * kCycleFrames);
+    CHECK(statistics.droppedFrames == kCycles * kCycleFrames - capacity);
+
+    stalledSink->release();
+    engine.stopRecording();
+    statistics = engine.statistics(0);
+    CHECK(statistics.fillFrames == 0);
+    CHECK(statistics.writtenFrames == capacity);
+    CHECK(log.frames == capacity);
+    CHECK(log.gaps == 0);
+}
+
+// Feeds `streamCount` streams in `cycleFrames`-frame cycles at `speed` times real time, and
+// reports how long each cycle takes on the thread that stands in for the I/O thread.
+static void benchmark(uint32_t streamCount, uint32_t cycleFrames, double speed) {
+    CaptureEngine engine;
+    engine.configure(std::vector<CaptureStreamFormat>(streamCount, kCountingFormat), 2.0);
+    SinkLog log;
+    engine.startRecording(std::make_unique<CountingSink>(log, streamCount));
+
+    const double audioSeconds = test::quickMode() ? 2 : 60;
+    const auto cycles = uint32_t(audioSeconds * kSampleRate / cycleFrames);
+    const auto period = std::chrono::duration<double>(cycleFrames / kSampleRate / speed);
+    CountingInput input(streamCount, cycleFrames);
+    std::vector<double> microseconds;
+    microseconds.reserve(cycles);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t cycle = 0; cycle < cycles; ++cycle) {
+        const auto* buffers = input.next(cycleFrames);
+        const auto cycleStart = std::chrono::steady_clock::now();
+        engine.process(buffers, streamCount, nullptr, 0);
+        microseconds.push_back(test::secondsSince(cycleStart) * 1e6);
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(period * (cycle + 1)));
+    }
+    engine.stopRecording();
+
+    uint64_t dropped = 0;
+    for (uint32_t stream = 0; stream < streamCount; ++stream) {
+        dropped += engine.statistics(stream).droppedFrames;
+    }
+    CHECK(dropped == 0);
+    CHECK(log.gaps == 0);
+    CHECK(log.frames == uint64_t(streamCount) * cycles * cycleFrames);
+
+    std::sort(microseconds.begin(), microseconds.end());
+    printf("%7u %6u %5.0f× %10.2f %10.2f %10.2f %8llu\n", streamCount, cycleFrames, speed,
+           microseconds[microseconds.size() / 2], microseconds[microseconds.size() * 99 / 100], microseconds.back(),
+           static_cast<unsigned long long>(dropped));
+}
+
+int main(int argc, char** argv) {
+    test::parseArguments(argc, argv);
+
+    checkRing();
+    checkRingAcrossThreads();
+    checkRecording();
+    checkDroppedFrames();
+
+    printf("\nStereo streams at 48 kHz, recording, cycle times in µs\n");
+    printf("%7s %6s %6s %10s %10s %10s %8s\n", "streams", "frames", "speed", "median", "p99", "longest", "dropped");
+    for (uint32_t streamCount : {16u, 64u}) {
+        for (uint32_t cycleFrames : {64u, 512u}) {
+            benchmark(streamCount, cycleFrames, 8);
+        }
+    }
+    return test::finish("CaptureEngineTests");
+}
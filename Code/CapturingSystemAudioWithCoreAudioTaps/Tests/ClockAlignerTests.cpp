@@ -0,0 +1,374 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the clock estimator and the aligner against simulated devices whose clocks drift, and a benchmark of the aligner's CPU time.
+*/
+
+#include "ClockAligner.hpp"
+#include "TestSupport.h"
+
+#include <random>
+
+// The tone every simulated device records, as a function of host time, so that aligned streams match sample for sample.
+constexpr double kToneFrequency = 997;
+constexpr double kToneAmplitude = 0.5;
+
+// How often the simulation runs the aligner, as its worker would.
+constexpr double kAlignInterval = 0.05;
+
+// A device with its own sample clock, `ppm` fast or slow against its nominal rate, that delivers
+// cycles of `cycleFrames` starting at `startSeconds` of host time.
+struct SimulatedDevice {
+    double nominalRate;
+    double ppm;
+    double startSeconds;
+    uint32_t cycleFrames;
+    uint32_t channelCount;
+    CaptureSampleFormat sampleFormat;
+    uint64_t cycle = 0;
+
+    double rate() const { return nominalRate * (1 + ppm * 1e-6); }
+    double cycleStart() const { return startSeconds + double(cycle * cycleFrames) / rate(); }
+    // The host time the device delivers its current cycle: when the cycle's last frame is in.
+    double delivery() const { return startSeconds + double((cycle + 1) * cycleFrames) / rate(); }
+
+    CaptureStreamFormat format() const {
+        return CaptureStreamFormat{nominalRate, channelCount, BytesPerSample(sampleFormat) * channelCount, sampleFormat};
+    }
+
+    // Fills `bytes` with the current cycle: the tone on the first channel, and half of it on the rest.
+    CaptureBuffer record(std::vector<uint8_t>& bytes) const {
+        const auto bytesPerSample = BytesPerSample(sampleFormat);
+        bytes.resize(size_t(cycleFrames) * channelCount * bytesPerSample);
+        const double start = cycleStart();
+        for (uint32_t frame = 0; frame < cycleFrames; ++frame) {
+            const double value = kToneAmplitude * std::sin(2 * M_PI * kToneFrequency * (start + frame / rate()));
+            for (uint32_t channel = 0; channel < channelCount; ++channel) {
+                auto* destination = bytes.data() + (size_t(frame) * channelCount + channel) * bytesPerSample;
+                const double sample = channel == 0 ? value : value / 2;
+                if (sampleFormat == CaptureSampleFormat::int16) {
+                    const auto integer = int16_t(std::lrint(sample * 32767));
+                    memcpy(destination, &integer, sizeof(integer));
+                }
+                else if (sampleFormat == CaptureSampleFormat::int32) {
+                    const auto integer = int32_t(std::lrint(sample * 2147483647.0));
+                    memcpy(destination, &integer, sizeof(integer));
+                }
+                else {
+                    const auto real = float(sample);
+                    memcpy(destination, &real, sizeof(real));
+                }
+            }
+        }
+        return CaptureBuffer{channelCount, uint32_t(bytes.size()), bytes.data()};
+    }
+};
+
+// Keeps every float frame the aligner writes, per stream.
+class RecordingSink : public CaptureSink {
+public:
+    RecordingSink(std::vector<std::vector<float>>& streams, std::vector<uint32_t> channelCounts)
+        : mStreams(streams), mChannelCounts(std::move(channelCounts)) {}
+
+    bool write(uint32_t stream, const void* frames, uint32_t frameCount) override {
+        const auto* samples = static_cast<const float*>(frames);
+        mStreams[stream].insert(mStreams[stream].end(), samples, samples + size_t(frameCount) * mChannelCounts[stream]);
+        return true;
+    }
+
+private:
+    std::vector<std::vector<float>>& mStreams;
+    std::vector<uint32_t> mChannelCounts;
+};
+
+// Runs devices against one host clock, delivering their cycles in the order they complete, with
+// each cycle's host time off by up to `jitter` seconds, and aligns every 50 ms.
+class Simulation {
+public:
+    Simulation(std::vector<SimulatedDevice> devices, double jitter, bool recordOutput = true)
+        : mDevices(std::move(devices)), mJitter(-jitter, jitter), mRecordOutput(recordOutput) {
+        std::vector<CaptureStreamFormat> formats;
+        std::vector<uint32_t> channelCounts;
+        for (const auto& device : mDevices) {
+            formats.push_back(device.format());
+            channelCounts.push_back(device.channelCount);
+        }
+        mOutput.resize(mDevices.size());
+        std::unique_ptr<CaptureSink> sink;
+        if (mRecordOutput) {
+            sink = std::make_unique<RecordingSink>(mOutput, channelCounts);
+        }
+        else {
+            sink = std::make_unique<DiscardingSink>();
+        }
+        mStarted = mAligner.start(formats, std::move(sink), 0);
+        mNextAlign = mDevices.front().startSeconds + kAlignInterval;
+    }
+
+    bool started() const { return mStarted; }
+    ClockAligner& aligner() { return mAligner; }
+    double alignSeconds() const { return mAlignSeconds; }
+
+    // Runs until `endSeconds` of host time. Stream `silentStream` delivers no cycles between `silentFrom` and
+    // `silentTo`, and the aligner doesn't run between `stallFrom` and `stallTo`.
+    void run(double endSeconds, int silentStream = -1, double silentFrom = 0, double silentTo = 0,
+             double stallFrom = 0, double stallTo = 0) {
+        std::vector<uint8_t> bytes;
+        while (true) {
+            size_t next = 0;
+            for (size_t index = 1; index < mDevices.size(); ++index) {
+                if (mDevices[index].delivery() < mDevices[next].delivery()) {
+                    next = index;
+                }
+            }
+            auto& device = mDevices[next];
+            const double now = device.delivery();
+            if (now > endSeconds) {
+                break;
+            }
+            if (now > stallFrom && now < stallTo) {
+                mNextAlign = now + kAlignInterval;
+            }
+            for (; mNextAlign < now; mNextAlign += kAlignInterval) {
+                const auto start = std::chrono::steady_clock::now();
+                mAligner.align();
+                mAlignSeconds += test::secondsSince(start);
+            }
+            const bool silent = int(next) == silentStream && now > silentFrom && now < silentTo;
+            if (!silent) {
+                mAligner.capture(uint32_t(next), device.cycleStart() + mJitter(mRandom), device.record(bytes));
+            }
+            ++device.cycle;
+        }
+    }
+
+    void stop() { mAligner.stop(); }
+
+    size_t outputFrames(uint32_t stream) const { return mOutput[stream].size() / mDevices[stream].channelCount; }
+
+    // The power of the difference between the first channel of `stream` and of the reference, against the
+    // reference's, between two output times. Output frames of aligned streams are the same host time.
+    double residualDecibels(uint32_t stream, double fromSeconds, double toSeconds) const {
+        const double rate = mDevices.front().nominalRate;
+        const auto from = size_t(fromSeconds * rate);
+        const auto to = std::min({size_t(toSeconds * rate), outputFrames(0), outputFrames(stream)});
+        double error = 0, power = 0;
+        for (size_t frame = from; frame < to; ++frame) {
+            const double reference = mOutput[0][frame * mDevices[0].channelCount];
+            const double difference = mOutput[stream][frame * mDevices[stream].channelCount] - reference;
+            error += difference * difference;
+            power += reference * reference;
+        }
+        return 10 * std::log10(error / power + 1e-30);
+    }
+
+private:
+    class DiscardingSink : public CaptureSink {
+    public:
+        bool write(uint32_t, const void*, uint32_t) override { return true; }
+    };
+
+    std::vector<SimulatedDevice> mDevices;
+    std::mt19937 mRandom{1};
+    std::uniform_real_distribution<double> mJitter;
+    bool mRecordOutput;
+    std::vector<std::vector<float>> mOutput;
+    ClockAligner mAligner;
+    bool mStarted = false;
+    double mNextAlign = 0;
+    double mAlignSeconds = 0;
+};
+
+// A reference and three devices that drift against it, at other rates, cycle sizes, and formats,
+// starting at different times.
+static std::vector<SimulatedDevice> DriftingDevices() {
+    return {{48000, 0, 10.0, 512, 2, CaptureSampleFormat::float32},
+            {48000, 150, 10.013, 256, 1, CaptureSampleFormat::int16},
+            {44100, -80, 9.9, 441, 2, CaptureSampleFormat::float32},
+            {96000, 40, 10.5, 1024, 1, CaptureSampleFormat::int32}};
+}
+
+// The estimator finds a clock's true rate through jittery cycle times, and restarts where a cycle
+// lands far from where it expects.
+static void checkEstimator() {
+    SimulatedDevice device{48000, 150, 10, 512, 1, CaptureSampleFormat::float32};
+    std::mt19937 random(2);
+    std::uniform_real_distribution<double> jitter(-100e-6, 100e-6);
+    ClockEstimator clock;
+    clock.reset(device.nominalRate);
+    for (; device.cycleStart() < 70; ++device.cycle) {
+        clock.update(device.cycleStart() + jitter(random), device.cycleFrames);
+    }
+    CHECK(clock.hasStarted());
+    CHECK(clock.restartCount() == 0);
+    CHECK_NEAR(clock.sampleRate(), device.rate(), device.rate() * 1e-6);
+    // The loop's time for its frame is closer to the truth than any one cycle's time.
+    CHECK(clock.frame() == double((device.cycle - 1) * device.cycleFrames));
+    CHECK_NEAR(clock.time(), device.startSeconds + clock.frame() / device.rate(), 20e-6);
+
+    // A cycle 200 ms late, as after an overload, restarts the loop there, and the rate carries over.
+    const double rate = clock.sampleRate();
+    clock.update(device.cycleStart() + 0.2, device.cycleFrames);
+    CHECK(clock.restartCount() == 1);
+    CHECK_NEAR(clock.time(), device.cycleStart() + 0.2, 1e-9);
+    CHECK(clock.sampleRate() == rate);
+}
+
+// With exact cycle times, every stream converges to its device's rate and lines up with the reference
+// to within the resampler's own error.
+static void checkAlignment() {
+    auto devices = DriftingDevices();
+    Simulation simulation(devices, 0);
+    CHECK(simulation.started());
+    simulation.run(50);
+    for (uint32_t stream = 1; stream < devices.size(); ++stream) {
+        const auto statistics = simulation.aligner().statistics(stream);
+        CHECK(statistics.aligned);
+        CHECK_NEAR(statistics.sampleRate, devices[stream].rate(), 0.01);
+        CHECK_NEAR(statistics.alignmentError, 0, 0.01);
+        CHECK(statistics.droppedFrames == 0);
+        CHECK(statistics.realignmentCount == 0);
+        CHECK(simulation.residualDecibels(stream, 30, 40) < -80);
+    }
+    simulation.stop();
+    for (uint32_t stream = 1; stream < devices.size(); ++stream) {
+        CHECK(simulation.outputFrames(stream) == simulation.outputFrames(0));
+    }
+    CHECK(simulation.aligner().sinkErrorCount() == 0);
+}
+
+// With 100 µs of jitter on every cycle time, the estimates stay within a part per million of the true
+// rates, and the streams stay locked to a fraction of a frame.
+static void checkJitter() {
+    auto devices = DriftingDevices();
+    Simulation simulation(devices, 100e-6);
+    simulation.run(70);
+    for (uint32_t stream = 1; stream < devices.size(); ++stream) {
+        const auto statistics = simulation.aligner().statistics(stream);
+        CHECK_NEAR(statistics.sampleRate, devices[stream].rate(), devices[stream].rate() * 1e-6);
+        CHECK_NEAR(statistics.alignmentError, 0, 0.25);
+        CHECK(statistics.realignmentCount == 0);
+        CHECK(simulation.residualDecibels(stream, 20, 60) < -20);
+    }
+    simulation.stop();
+}
+
+// A device that delivers nothing for a while joins again, and only it does. When the aligner itself
+// stalls for longer than the rings hold, every stream drops frames and joins again.
+static void checkDropouts() {
+    auto devices = DriftingDevices();
+    Simulation silence(devices, 0);
+    silence.run(70, 1, 30, 30.2);
+    for (uint32_t stream = 1; stream < devices.size(); ++stream) {
+        const auto statistics = silence.aligner().statistics(stream);
+        CHECK(statistics.aligned);
+        CHECK(statistics.realignmentCount == (stream == 1 ? 1 : 0));
+        CHECK(silence.residualDecibels(stream, 50, 60) < -70);
+    }
+    silence.stop();
+
+    Simulation stall(devices, 0);
+    stall.run(80, -1, 0, 0, 30, 31.2);
+    for (uint32_t stream = 0; stream < devices.size(); ++stream) {
+        const auto statistics = stall.aligner().statistics(stream);
+        CHECK(statistics.droppedFrames > 0);
+        CHECK(statistics.realignmentCount == 1);
+    }
+    // The reference's dropped frames are missing from the recording, so it ends early.
+    for (uint32_t stream = 1; stream < devices.size(); ++stream) {
+        CHECK(stall.residualDecibels(stream, 55, 65) < -70);
+    }
+    stall.stop();
+}
+
+// Two device threads on a real clock and the aligner's own worker: the resampled stream keeps pace with the reference.
+static void checkThreads() {
+    const std::vector<CaptureStreamFormat> formats = {{48000, 2, 8, CaptureSampleFormat::float32},
+                                                      {44100, 1, 2, CaptureSampleFormat::int16}};
+    std::vector<std::vector<float>> output(2);
+    ClockAligner aligner;
+    CHECK(aligner.start(formats, std::make_unique<RecordingSink>(output, std::vector<uint32_t>{2, 1}), 0.01));
+
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<bool> running{true};
+    auto device = [&](uint32_t stream, uint32_t cycleFrames, double rate) {
+        std::vector<uint8_t> bytes(size_t(cycleFrames) * formats[stream].bytesPerFrame);
+        for (uint64_t cycle = 0; running; ++cycle) {
+            const double due = double((cycle + 1) * cycleFrames) / rate;
+            while (test::secondsSince(start) < due) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            aligner.capture(stream, 100 + double(cycle * cycleFrames) / rate,
+                            CaptureBuffer{formats[stream].channelCount, uint32_t(bytes.size()), bytes.data()});
+        }
+    };
+    std::thread reference(device, 0, 512, 48000.0);
+    std::thread other(device, 1, 441, 44100 * 1.0002);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    const auto statistics = aligner.statistics(1);
+    running = false;
+    reference.join();
+    other.join();
+    aligner.stop();
+
+    CHECK(statistics.aligned);
+    CHECK_NEAR(statistics.sampleRate, 44100 * 1.0002, 0.5);
+    CHECK(statistics.realignmentCount == 0);
+    CHECK(aligner.sinkErrorCount() == 0);
+    CHECK(output[0].size() / 2 > 48000);
+    CHECK(output[1].size() == output[0].size() / 2);
+}
+
+// Aligns `streamCount` streams, alternating 48, 44.1, and 96 kHz devices that drift by up to 100 ppm,
+// with 100 µs of jitter. Reports the aligner's CPU time as a share of one core, and how well the
+// streams line up once the clocks have settled.
+static void benchmark(uint32_t streamCount) {
+    const double seconds = test::quickMode() ? 10 : 300;
+    std::vector<SimulatedDevice> devices;
+    const double rates[] = {48000, 44100, 96000};
+    for (uint32_t stream = 0; stream < streamCount; ++stream) {
+        const double rate = rates[stream % 3];
+        const double ppm = stream == 0 ? 0 : 10.0 * (int(stream * 37 % 21) - 10);
+        devices.push_back({rate, ppm, 10 + 0.003 * stream, uint32_t(rate / 100) + 32 * (stream % 4), 2, CaptureSampleFormat::float32});
+    }
+    Simulation simulation(devices, 100e-6, streamCount <= 8);
+    simulation.run(10 + seconds);
+
+    double worstResidual = -INFINITY;
+    double worstError = 0;
+    for (uint32_t stream = 1; stream < streamCount; ++stream) {
+        if (streamCount <= 8) {
+            worstResidual = std::max(worstResidual, simulation.residualDecibels(stream, seconds / 2, seconds));
+        }
+        worstError = std::max(worstError, std::abs(simulation.aligner().statistics(stream).alignmentError));
+        CHECK(simulation.aligner().statistics(stream).realignmentCount == 0);
+    }
+    const auto passes = seconds / kAlignInterval;
+    printf("%7u %13.2f%% %16.1f %15.3f", streamCount, 100 * simulation.alignSeconds() / seconds,
+           simulation.alignSeconds() * 1e6 / passes / streamCount, worstError);
+    if (streamCount <= 8) {
+        printf(" %17.1f\n", worstResidual);
+    }
+    else {
+        printf(" %17s\n", "-");
+    }
+    simulation.stop();
+}
+
+int main(int argc, char** argv) {
+    test::parseArguments(argc, argv);
+
+    checkEstimator();
+    checkAlignment();
+    checkJitter();
+    checkDropouts();
+    checkThreads();
+
+    printf("\nStereo float streams drifting by up to 100 ppm with 100 µs of jitter, aligned in 50 ms passes\n");
+    printf("%7s %14s %16s %15s %17s\n", "streams", "CPU of a core", "µs/stream/pass", "worst error fr", "worst residual dB");
+    for (uint32_t streamCount : {2u, 8u, 32u}) {
+        benchmark(streamCount);
+    }
+    return test::finish("ClockAlignerTests");
+}
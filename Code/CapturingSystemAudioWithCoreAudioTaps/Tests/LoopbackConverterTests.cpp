@@ -0,0 +1,245 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the loopback converter's sample formats, channel maps, and resampling, and a benchmark of its throughput.
+*/
+
+#include "LoopbackConverter.hpp"
+#include "TestSupport.h"
+
+using Format = CaptureSampleFormat;
+
+static CaptureStreamFormat MakeFormat(double sampleRate, uint32_t channelCount, Format format) {
+    return CaptureStreamFormat{sampleRate, channelCount, BytesPerSample(format) * channelCount, format};
+}
+
+template <typename Sample>
+static CaptureBuffer MakeBuffer(uint32_t channelCount, std::vector<Sample>& samples) {
+    return CaptureBuffer{channelCount, uint32_t(samples.size() * sizeof(Sample)), samples.data()};
+}
+
+// Reads a packed, little-endian 24-bit sample.
+static int32_t Int24At(const std::vector<uint8_t>& bytes, size_t index) {
+    return int32_t(uint32_t(bytes[index * 3]) << 8 | uint32_t(bytes[index * 3 + 1]) << 16 | uint32_t(bytes[index * 3 + 2]) << 24) >> 8;
+}
+
+// Matching formats copy through bit for bit.
+static void checkPassthrough() {
+    LoopbackConverter converter;
+    converter.configure({MakeFormat(48000, 2, Format::int16)}, {MakeFormat(48000, 2, Format::int16)}, {}, 512);
+    std::vector<int16_t> input(1024), output(1024, 7);
+    for (size_t index = 0; index < input.size(); ++index) {
+        input[index] = int16_t(int(index) * 37 - 20000);
+    }
+    auto inputBuffer = MakeBuffer(2, input);
+    auto outputBuffer = MakeBuffer(2, output);
+    converter.process(&inputBuffer, 1, &outputBuffer, 1);
+    CHECK(input == output);
+}
+
+// Every 16-bit value survives a trip through float, and out-of-range floats clamp to full scale.
+static void checkInt16RoundTrip() {
+    LoopbackConverter toFloat, toInt16;
+    toFloat.configure({MakeFormat(48000, 1, Format::int16)}, {MakeFormat(48000, 1, Format::float32)}, {}, 65536);
+    toInt16.configure({MakeFormat(48000, 1, Format::float32)}, {MakeFormat(48000, 1, Format::int16)}, {}, 65536);
+    std::vector<int16_t> input(65536), output(65536);
+    std::vector<float> samples(65536);
+    for (size_t index = 0; index < input.size(); ++index) {
+        input[index] = int16_t(int(index) - 32768);
+    }
+    auto inputBuffer = MakeBuffer(1, input);
+    auto floatBuffer = MakeBuffer(1, samples);
+    auto outputBuffer = MakeBuffer(1, output);
+    toFloat.process(&inputBuffer, 1, &floatBuffer, 1);
+    toInt16.process(&floatBuffer, 1, &outputBuffer, 1);
+    CHECK(samples[0] == -1.0f);
+    CHECK(input == output);
+
+    std::vector<float> unusual = {2.0f, -3.0f, NAN, 0.99999f, -1.0f};
+    std::vector<int16_t> clamped(unusual.size());
+    auto unusualBuffer = MakeBuffer(1, unusual);
+    auto clampedBuffer = MakeBuffer(1, clamped);
+    toInt16.process(&unusualBuffer, 1, &clampedBuffer, 1);
+    CHECK(clamped == std::vector<int16_t>({32767, -32768, 0, 32767, -32768}));
+}
+
+// Packed 24-bit samples survive a trip through float into 32-bit integers and back.
+static void checkInt24RoundTrip() {
+    constexpr size_t kCount = 4096;
+    LoopbackConverter toInt32, toInt24;
+    toInt32.configure({MakeFormat(48000, 1, Format::int24)}, {MakeFormat(48000, 1, Format::int32)}, {}, kCount);
+    toInt24.configure({MakeFormat(48000, 1, Format::int32)}, {MakeFormat(48000, 1, Format::int24)}, {}, kCount);
+    std::vector<uint8_t> input(kCount * 3), output(kCount * 3);
+    std::vector<int32_t> wide(kCount);
+    for (size_t index = 0; index < kCount; ++index) {
+        const auto sample = std::clamp(int32_t(index * 4098) - 8388608 + int32_t(index & 1), -8388608, 8388607);
+        input[index * 3] = uint8_t(sample);
+        input[index * 3 + 1] = uint8_t(sample >> 8);
+        input[index * 3 + 2] = uint8_t(sample >> 16);
+    }
+    auto inputBuffer = MakeBuffer(1, input);
+    auto wideBuffer = MakeBuffer(1, wide);
+    auto outputBuffer = MakeBuffer(1, output);
+    toInt32.process(&inputBuffer, 1, &wideBuffer, 1);
+    toInt24.process(&wideBuffer, 1, &outputBuffer, 1);
+    CHECK(wide[1] == Int24At(input, 1) * 256);
+    CHECK(input == output);
+}
+
+// A map picks channels from any input stream, and unmapped channels play silence.
+static void checkChannelMap() {
+    LoopbackConverter converter;
+    converter.configure({MakeFormat(48000, 1, Format::int16), MakeFormat(48000, 2, Format::float32)},
+                        {MakeFormat(48000, 2, Format::int24), MakeFormat(48000, 2, Format::float64)},
+                        {2, 0, 1, -1}, 256);
+    std::vector<int16_t> mono(256);
+    std::vector<float> stereo(512);
+    std::vector<uint8_t> packed(256 * 6, 0xAB);
+    std::vector<double> wide(512, 9);
+    for (size_t frame = 0; frame < 256; ++frame) {
+        mono[frame] = int16_t(frame * 100);
+        stereo[frame * 2] = 0.25f;
+        stereo[frame * 2 + 1] = -0.5f;
+    }
+    CaptureBuffer inputs[] = {MakeBuffer(1, mono), MakeBuffer(2, stereo)};
+    CaptureBuffer outputs[] = {MakeBuffer(2, packed), MakeBuffer(2, wide)};
+    converter.process(inputs, 2, outputs, 2);
+    CHECK(Int24At(packed, 0) == -4194304);
+    CHECK(Int24At(packed, 1) == 0);
+    CHECK(Int24At(packed, 21) == 1000 * 256);
+    CHECK(wide[0] == 0.25 && wide[1] == 0 && wide[511] == 0);
+
+    // When the input brings fewer frames than the output needs, the rest is silence.
+    inputs[0].byteSize = 100 * 2;
+    inputs[1].byteSize = 100 * 8;
+    converter.process(inputs, 2, outputs, 2);
+    CHECK(Int24At(packed, 198) == -4194304);
+    CHECK(Int24At(packed, 200) == 0);
+
+    // By default, a mono input plays on every channel.
+    LoopbackConverter upmix;
+    upmix.configure({MakeFormat(48000, 1, Format::float32)}, {MakeFormat(48000, 2, Format::float32)}, {}, 256);
+    std::vector<float> input(256, 0.5f), output(512, 3);
+    auto inputBuffer = MakeBuffer(1, input);
+    auto outputBuffer = MakeBuffer(2, output);
+    upmix.process(&inputBuffer, 1, &outputBuffer, 1);
+    CHECK(output[0] == 0.5f && output[1] == 0.5f && output[511] == 0.5f);
+}
+
+// A 1 kHz sine resampled from 44.1 kHz to 48 kHz, in output cycles sized as the HAL sizes them,
+// stays continuous and clean.
+static void checkResampling() {
+    LoopbackConverter converter;
+    converter.configure({MakeFormat(44100, 2, Format::float32)}, {MakeFormat(48000, 2, Format::float32)}, {}, 1024);
+    std::vector<float> input(1024), output(2048);
+    double phase = 0;
+    uint64_t inputFrames = 0, outputFrames = 0;
+    double snr = 0;
+    for (int cycle = 0; cycle < 2000; ++cycle) {
+        for (size_t frame = 0; frame < 512; ++frame) {
+            input[frame * 2] = input[frame * 2 + 1] = float(0.5 * std::sin(phase));
+            phase += 2 * M_PI * 1000 / 44100;
+        }
+        inputFrames += 512;
+        const auto frames = uint32_t(inputFrames * 48000 / 44100 - outputFrames);
+        auto inputBuffer = MakeBuffer(2, input);
+        CaptureBuffer outputBuffer{2, frames * 8, output.data()};
+        converter.process(&inputBuffer, 1, &outputBuffer, 1);
+
+        if (cycle == 1000) {
+            // Fit a 1 kHz sine to the cycle by least squares and compare what's left over.
+            double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0, yy = 0;
+            for (uint32_t frame = 0; frame < frames; ++frame) {
+                const double angle = 2 * M_PI * 1000 * double(outputFrames + frame) / 48000;
+                const double s = std::sin(angle), c = std::cos(angle), y = output[frame * 2];
+                ss += s * s;
+                sc += s * c;
+                cc += c * c;
+                ys += y * s;
+                yc += y * c;
+                yy += y * y;
+            }
+            const double determinant = ss * cc - sc * sc;
+            const double a = (ys * cc - yc * sc) / determinant, b = (yc * ss - ys * sc) / determinant;
+            const double signal = a * a * ss + 2 * a * b * sc + b * b * cc;
+            snr = 10 * std::log10(signal / (yy - signal));
+            CHECK_NEAR(std::sqrt(a * a + b * b), 0.5, 0.01);
+        }
+        outputFrames += frames;
+    }
+    printf("44.1 kHz to 48 kHz: %.1f dB SNR at 1 kHz\n", snr);
+    CHECK(snr > 80);
+    CHECK(converter.discontinuityCount() == 0);
+}
+
+struct Case {
+    const char* name;
+    std::vector<CaptureStreamFormat> inputs;
+    std::vector<CaptureStreamFormat> outputs;
+    LoopbackConverter::ChannelMap channelMap;
+};
+
+// Converts 512-frame cycles and reports input frames per second on one core.
+static void benchmark(const Case& test) {
+    constexpr uint32_t kCycleFrames = 512;
+    LoopbackConverter converter;
+    converter.configure(test.inputs, test.outputs, test.channelMap, kCycleFrames);
+
+    std::vector<std::vector<float>> inputStorage, outputStorage;
+    std::vector<CaptureBuffer> inputs, outputs;
+    for (const auto& format : test.inputs) {
+        // Quiet noise that's valid in any of the formats.
+        inputStorage.emplace_back(format.bytesPerFrame * kCycleFrames / sizeof(float) + 1);
+        for (size_t index = 0; index < inputStorage.back().size(); ++index) {
+            inputStorage.back()[index] = float(std::sin(double(index) * 0.01) * 0.5);
+        }
+        inputs.push_back(CaptureBuffer{format.channelCount, format.bytesPerFrame * kCycleFrames, inputStorage.back().data()});
+    }
+    for (const auto& format : test.outputs) {
+        const auto frames = uint32_t(kCycleFrames * format.sampleRate / test.inputs[0].sampleRate);
+        outputStorage.emplace_back(format.bytesPerFrame * frames / sizeof(float) + 1);
+        outputs.push_back(CaptureBuffer{format.channelCount, format.bytesPerFrame * frames, outputStorage.back().data()});
+    }
+
+    const int cycles = test::quickMode() ? 200 : 200000;
+    double seconds = 1e12;
+    for (int round = 0; round < 3; ++round) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int cycle = 0; cycle < cycles; ++cycle) {
+            converter.process(inputs.data(), uint32_t(inputs.size()), outputs.data(), uint32_t(outputs.size()));
+        }
+        seconds = std::min(seconds, test::secondsSince(start));
+    }
+    const double frames = double(cycles) * kCycleFrames;
+    printf("%-36s %10.1f %12.0f %14.0f\n", test.name, frames / seconds / 1e6, seconds / cycles * 1e9, frames / seconds / 48000);
+}
+
+int main(int argc, char** argv) {
+    test::parseArguments(argc, argv);
+
+    checkPassthrough();
+    checkInt16RoundTrip();
+    checkInt24RoundTrip();
+    checkChannelMap();
+    checkResampling();
+
+    const Case cases[] = {
+        {"float32 stereo passthrough", {MakeFormat(48000, 2, Format::float32)}, {MakeFormat(48000, 2, Format::float32)}, {}},
+        {"int16 to float32, stereo", {MakeFormat(48000, 2, Format::int16)}, {MakeFormat(48000, 2, Format::float32)}, {}},
+        {"float32 to int16, stereo", {MakeFormat(48000, 2, Format::float32)}, {MakeFormat(48000, 2, Format::int16)}, {}},
+        {"float32 to int24, stereo", {MakeFormat(48000, 2, Format::float32)}, {MakeFormat(48000, 2, Format::int24)}, {}},
+        {"int32 to float32, 8 channels", {MakeFormat(48000, 8, Format::int32)}, {MakeFormat(48000, 8, Format::float32)}, {}},
+        {"float32 to int32, 8 channels", {MakeFormat(48000, 8, Format::float32)}, {MakeFormat(48000, 8, Format::int32)}, {}},
+        {"2 stereo float32 mapped to int16", {MakeFormat(48000, 2, Format::float32), MakeFormat(48000, 2, Format::float32)},
+            {MakeFormat(48000, 2, Format::int16)}, {3, 0}},
+        {"48 kHz to 44.1 kHz, stereo", {MakeFormat(48000, 2, Format::float32)}, {MakeFormat(44100, 2, Format::float32)}, {}},
+        {"44.1 kHz to 48 kHz, stereo", {MakeFormat(44100, 2, Format::float32)}, {MakeFormat(48000, 2, Format::float32)}, {}},
+    };
+    printf("\n512-frame cycles, one core\n");
+    printf("%-36s %10s %12s %14s\n", "conversion", "Mframes/s", "ns/cycle", "×48k real time");
+    for (const auto& test : cases) {
+        benchmark(test);
+    }
+    return test::finish("LoopbackConverterTests");
+}
@@ -0,0 +1,262 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Bit-exact round trips through the lossless codec and the compressing sink, and a benchmark of compression ratio and encoder CPU time.
+*/
+
+#include "CompressedRecording.hpp"
+#include "TestSupport.h"
+
+#include <random>
+#include <string>
+#include <unistd.h>
+
+using Format = CaptureSampleFormat;
+
+constexpr double kSampleRate = 48000;
+
+// Bytes past the encoder's bound that it must never touch.
+constexpr size_t kGuardBytes = 64;
+constexpr uint8_t kGuardValue = 0xA5;
+
+static CaptureStreamFormat MakeFormat(uint32_t channelCount, Format format) {
+    return CaptureStreamFormat{kSampleRate, channelCount, BytesPerSample(format) * channelCount, format};
+}
+
+static const char* FormatName(Format format) {
+    switch (format) {
+        case Format::int16: return "int16";
+        case Format::int24: return "int24";
+        case Format::int32: return "int32";
+        case Format::float32: return "float32";
+        case Format::float64: return "float64";
+        default: return "";
+    }
+}
+
+// Stores `value`, a sample in [-1, 1), in `format` at `destination`.
+static void StoreSample(Format format, double value, uint8_t* destination) {
+    switch (format) {
+        case Format::int16: {
+            const auto sample = int16_t(std::lrint(std::clamp(value, -1.0, 1.0) * 32767));
+            memcpy(destination, &sample, sizeof(sample));
+            break;
+        }
+        case Format::int24: {
+            const auto sample = int32_t(std::lrint(std::clamp(value, -1.0, 1.0) * 8388607));
+            destination[0] = uint8_t(sample);
+            destination[1] = uint8_t(sample >> 8);
+            destination[2] = uint8_t(sample >> 16);
+            break;
+        }
+        case Format::int32: {
+            const auto sample = int32_t(std::lrint(std::clamp(value, -1.0, 1.0) * 2147483000.0));
+            memcpy(destination, &sample, sizeof(sample));
+            break;
+        }
+        case Format::float32: {
+            const auto sample = float(value);
+            memcpy(destination, &sample, sizeof(sample));
+            break;
+        }
+        case Format::float64:
+            memcpy(destination, &value, sizeof(value));
+            break;
+        default:
+            break;
+    }
+}
+
+// Tones with a slow tremolo and a little noise, like a busy mix.
+static std::vector<uint8_t> MakeMusic(const CaptureStreamFormat& format, uint32_t frameCount, uint32_t seed) {
+    std::vector<uint8_t> frames(size_t(frameCount) * format.bytesPerFrame);
+    std::mt19937 random(seed);
+    std::normal_distribution<double> noise(0, 0.01);
+    const auto bytesPerSample = format.bytesPerFrame / format.channelCount;
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        const double t = frame / kSampleRate;
+        for (uint32_t channel = 0; channel < format.channelCount; ++channel) {
+            const double value = 0.3 * std::sin(2 * M_PI * 220 * t + channel) +
+                                 0.2 * std::sin(2 * M_PI * 331 * t) * std::sin(2 * M_PI * 0.5 * t) +
+                                 0.1 * std::sin(2 * M_PI * 1760 * t + 0.3 * channel) + noise(random);
+            StoreSample(format.sampleFormat, value, frames.data() + size_t(frame) * format.bytesPerFrame + channel * bytesPerSample);
+        }
+    }
+    return frames;
+}
+
+// Encodes `frames` in blocks of `blockFrames`, checks that each block stays within the codec's
+// bound and decodes to the same bits, and returns the encoded size.
+static size_t RoundTrip(const CaptureStreamFormat& format, const std::vector<uint8_t>& frames, uint32_t blockFrames,
+                        double* encodeSeconds = nullptr) {
+    LosslessEncoder encoder(format, blockFrames);
+    LosslessDecoder decoder(format, blockFrames);
+    std::vector<uint8_t> encoded(LosslessCodec::maxEncodedBytes(format, blockFrames) + kGuardBytes);
+    std::vector<uint8_t> decoded(size_t(blockFrames) * format.bytesPerFrame);
+    const auto frameCount = uint32_t(frames.size() / format.bytesPerFrame);
+    size_t encodedBytes = 0;
+    for (uint32_t offset = 0; offset < frameCount || (frameCount == 0 && offset == 0); offset += blockFrames) {
+        const auto count = std::min(blockFrames, frameCount - offset);
+        const auto bound = LosslessCodec::maxEncodedBytes(format, count);
+        std::fill(encoded.begin() + bound, encoded.end(), kGuardValue);
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto size = encoder.encode(frames.data() + size_t(offset) * format.bytesPerFrame, count, encoded.data());
+        if (encodeSeconds != nullptr) {
+            *encodeSeconds += test::secondsSince(start);
+        }
+        CHECK(size <= bound);
+        CHECK(std::all_of(encoded.begin() + bound, encoded.end(), [](uint8_t byte) { return byte == kGuardValue; }));
+        encodedBytes += size;
+
+        std::fill(decoded.begin(), decoded.end(), 0xCD);
+        CHECK(decoder.decode(encoded.data(), size, count, decoded.data()));
+        CHECK(memcmp(decoded.data(), frames.data() + size_t(offset) * format.bytesPerFrame, size_t(count) * format.bytesPerFrame) == 0);
+
+        // A truncated block may fail to decode, but must not read past its end.
+        decoder.decode(encoded.data(), size / 2, count, decoded.data());
+        if (frameCount == 0) {
+            break;
+        }
+    }
+    return encodedBytes;
+}
+
+const Format kCompressibleFormats[] = {Format::int16, Format::int24, Format::int32, Format::float32};
+
+// Blocks of a frame or two leave no room to spare beyond each channel's header, so every mode,
+// a constant channel's included, has to fit the bound with many channels.
+static void checkShortBlocks() {
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (auto sampleFormat : kCompressibleFormats) {
+        for (uint32_t channelCount : {1u, 2u, 7u, 16u, 64u}) {
+            const auto format = MakeFormat(channelCount, sampleFormat);
+            for (uint32_t frameCount = 0; frameCount <= 3; ++frameCount) {
+                std::vector<uint8_t> frames(size_t(frameCount) * format.bytesPerFrame);
+                for (auto& value : frames) {
+                    value = uint8_t(byte(random));
+                }
+                RoundTrip(format, frames, std::max(frameCount, 1u));
+
+                // Full-scale constants take every bit of the sample.
+                std::fill(frames.begin(), frames.end(), 0xFF);
+                RoundTrip(format, frames, std::max(frameCount, 1u));
+                std::fill(frames.begin(), frames.end(), 0x80);
+                RoundTrip(format, frames, std::max(frameCount, 1u));
+            }
+        }
+    }
+}
+
+static void checkSignals() {
+    const uint32_t frameCount = 48000;
+    for (auto sampleFormat : kCompressibleFormats) {
+        const auto format = MakeFormat(2, sampleFormat);
+        RoundTrip(format, MakeMusic(format, frameCount, 1), 4096);
+        // Blocks that don't divide the signal evenly, and a final short block.
+        RoundTrip(format, MakeMusic(format, frameCount, 2), 1000);
+    }
+
+    // Float audio that came from 16-bit samples, and float audio with silence, NaNs, infinities, and negative zeros.
+    const auto format = MakeFormat(2, Format::float32);
+    std::vector<uint8_t> frames(size_t(frameCount) * format.bytesPerFrame);
+    auto* samples = reinterpret_cast<float*>(frames.data());
+    for (uint32_t index = 0; index < frameCount * 2; ++index) {
+        samples[index] = float(std::lrint(std::sin(index * 0.01) * 32767)) / 32768.0f;
+    }
+    RoundTrip(format, frames, 4096);
+    for (uint32_t index = 0; index < frameCount * 2; ++index) {
+        const auto section = (index / 8192) % 3;
+        samples[index] = (section == 0) ? 0.0f :
+                         (index % 1000 == 0) ? NAN :
+                         (index % 777 == 0) ? -0.0f :
+                         (index % 555 == 0) ? INFINITY : float(std::sin(index * 0.003) * (section == 1 ? 1e-3 : 0.5));
+    }
+    RoundTrip(format, frames, 4096);
+
+    // Noise doesn't compress, and codes verbatim.
+    std::mt19937 random(5);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (auto& value : frames) {
+        value = uint8_t(byte(random));
+    }
+    CHECK(RoundTrip(format, frames, 4096) <= frames.size() + frames.size() / 100);
+
+    // Other formats are stored as they are.
+    const auto doubles = MakeFormat(2, Format::float64);
+    CHECK(!LosslessCodec::isCompressible(doubles));
+    CHECK(RoundTrip(doubles, MakeMusic(doubles, 1000, 4), 256) == 1000 * 16 + 4);
+}
+
+// Several streams through the sink's worker pool come back from their files bit for bit.
+static void checkSink() {
+    const std::vector<CaptureStreamFormat> formats = {MakeFormat(2, Format::float32), MakeFormat(1, Format::int16),
+                                                      MakeFormat(6, Format::int24), MakeFormat(2, Format::float64)};
+    std::vector<std::string> paths;
+    std::vector<std::vector<uint8_t>> streams;
+    for (size_t index = 0; index < formats.size(); ++index) {
+        paths.push_back("/tmp/LosslessCodecTests-" + std::to_string(getpid()) + "-" + std::to_string(index) + ".tapz");
+        streams.push_back(MakeMusic(formats[index], 30000, uint32_t(index)));
+    }
+
+    auto statistics = std::make_shared<CompressedRecording::Statistics>();
+    {
+        CompressingSink sink;
+        CHECK(sink.open(paths, formats, statistics, 4, 2048));
+        // Write in odd sizes, as the capture engine's writer thread does.
+        for (uint32_t offset = 0; offset < 30000;) {
+            const auto count = std::min(30000 - offset, 977 + offset % 1500);
+            for (uint32_t stream = 0; stream < formats.size(); ++stream) {
+                CHECK(sink.write(stream, streams[stream].data() + size_t(offset) * formats[stream].bytesPerFrame, count));
+            }
+            offset += count;
+        }
+        CHECK(sink.close());
+    }
+    CHECK(statistics->fileErrorCount.load() == 0);
+    CHECK(statistics->encodedBytes.load() < statistics->rawBytes.load());
+
+    for (size_t index = 0; index < formats.size(); ++index) {
+        CompressedStreamReader reader;
+        CHECK(reader.open(paths[index]));
+        std::vector<uint8_t> decoded, block;
+        uint32_t frameCount = 0;
+        while (reader.readBlock(block, frameCount)) {
+            decoded.insert(decoded.end(), block.begin(), block.begin() + size_t(frameCount) * formats[index].bytesPerFrame);
+        }
+        CHECK(decoded == streams[index]);
+        reader.close();
+        unlink(paths[index].c_str());
+    }
+}
+
+// Encodes music in 4096-frame blocks and reports the compression ratio, and the encoder's CPU time
+// as a share of one core at 48 kHz.
+static void benchmark(const CaptureStreamFormat& format) {
+    const uint32_t frameCount = test::quickMode() ? 48000 : 48000 * 20;
+    const auto frames = MakeMusic(format, frameCount, 7);
+    double seconds = 0;
+    const auto encodedBytes = RoundTrip(format, frames, 4096, &seconds);
+    printf("%-8s %8u %7.3f %10.1f %13.2f%%\n", FormatName(format.sampleFormat), format.channelCount,
+           double(frames.size()) / double(encodedBytes), frameCount / seconds / 1e6,
+           100 * seconds / (frameCount / kSampleRate));
+}
+
+int main(int argc, char** argv) {
+    test::parseArguments(argc, argv);
+
+    checkShortBlocks();
+    checkSignals();
+    checkSink();
+
+    printf("\nTones and noise in 4096-frame blocks, one core\n");
+    printf("%-8s %8s %7s %10s %14s\n", "format", "channels", "ratio", "Mframes/s", "core at 48 kHz");
+    for (auto sampleFormat : kCompressibleFormats) {
+        for (uint32_t channelCount : {2u, 8u}) {
+            benchmark(MakeFormat(channelCount, sampleFormat));
+        }
+    }
+    return test::finish("LosslessCodecTests");
+}
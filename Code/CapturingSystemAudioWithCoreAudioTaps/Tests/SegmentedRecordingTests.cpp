@@ -0,0 +1,232 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the segmenting sink's files and manifest, and a benchmark of its write bandwidth and worst-case write latency.
+*/
+
+#include "SegmentedRecording.hpp"
+#include "TestSupport.h"
+
+#include <dirent.h>
+#include <string>
+#include <unistd.h>
+
+const CaptureStreamFormat kStereoFloat{48000, 2, 8, CaptureSampleFormat::float32};
+const CaptureStreamFormat kMonoInt16{44100, 1, 2, CaptureSampleFormat::int16};
+
+// A directory of its own for each recording, removed with everything in it.
+class ScratchDirectory {
+public:
+    ScratchDirectory() {
+        char path[] = "/tmp/SegmentedRecordingTests-XXXXXX";
+        mPath = mkdtemp(path) ? path : "";
+    }
+
+    ~ScratchDirectory() {
+        for (const auto& name : fileNames()) {
+            unlink((mPath + "/" + name).c_str());
+        }
+        rmdir(mPath.c_str());
+    }
+
+    const std::string& path() const { return mPath; }
+
+    std::vector<std::string> fileNames() const {
+        std::vector<std::string> names;
+        if (auto* directory = opendir(mPath.c_str())) {
+            while (auto* entry = readdir(directory)) {
+                if (entry->d_name[0] != '.') {
+                    names.push_back(entry->d_name);
+                }
+            }
+            closedir(directory);
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+private:
+    std::string mPath;
+};
+
+static std::vector<uint8_t> ReadFile(const std::string& path) {
+    std::vector<uint8_t> bytes;
+    if (auto* file = fopen(path.c_str(), "rb")) {
+        uint8_t buffer[65536];
+        size_t count = 0;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            bytes.insert(bytes.end(), buffer, buffer + count);
+        }
+        fclose(file);
+    }
+    return bytes;
+}
+
+static uint64_t BigEndian(const uint8_t* bytes, int byteCount) {
+    uint64_t value = 0;
+    for (int index = 0; index < byteCount; ++index) {
+        value = (value << 8) | bytes[index];
+    }
+    return value;
+}
+
+// Checks that a segment is a CAF file of `format` whose `data` chunk holds exactly its frames,
+// and returns the frames.
+static std::vector<uint8_t> ReadSegment(const std::string& path, const CaptureStreamFormat& format) {
+    const auto bytes = ReadFile(path);
+    if (bytes.size() < SegmentedRecording::kHeaderBytes) {
+        CHECK(bytes.size() >= SegmentedRecording::kHeaderBytes);
+        return {};
+    }
+    CHECK(memcmp(bytes.data(), "caff", 4) == 0);
+    CHECK(memcmp(bytes.data() + 8, "desc", 4) == 0 && BigEndian(bytes.data() + 12, 8) == 32);
+    double sampleRate = 0;
+    const auto rateBits = BigEndian(bytes.data() + 20, 8);
+    memcpy(&sampleRate, &rateBits, sizeof(sampleRate));
+    CHECK(sampleRate == format.sampleRate);
+    CHECK(memcmp(bytes.data() + 28, "lpcm", 4) == 0);
+    CHECK(BigEndian(bytes.data() + 36, 4) == format.bytesPerFrame);
+    CHECK(BigEndian(bytes.data() + 44, 4) == format.channelCount);
+    CHECK(memcmp(bytes.data() + 52, "data", 4) == 0);
+    // The `data` chunk's size counts its 4-byte edit count as well as the audio.
+    const auto dataSize = BigEndian(bytes.data() + 56, 8);
+    CHECK(dataSize + 64 == bytes.size());
+    CHECK((dataSize - 4) % format.bytesPerFrame == 0);
+    return std::vector<uint8_t>(bytes.begin() + SegmentedRecording::kHeaderBytes, bytes.end());
+}
+
+// Frames whose first sample counts them, in either test format.
+static void FillFrames(const CaptureStreamFormat& format, uint64_t firstFrame, uint32_t frameCount, std::vector<uint8_t>& frames) {
+    frames.resize(size_t(frameCount) * format.bytesPerFrame);
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        auto* destination = frames.data() + size_t(frame) * format.bytesPerFrame;
+        if (format.sampleFormat == CaptureSampleFormat::float32) {
+            const float samples[2] = {float(firstFrame + frame), -float(firstFrame + frame)};
+            memcpy(destination, samples, sizeof(samples));
+        }
+        else {
+            const auto sample = int16_t((firstFrame + frame) & 0x7FFF);
+            memcpy(destination, &sample, sizeof(sample));
+        }
+    }
+}
+
+// Records 3.3 s of two streams at different rates in 1 s segments, then reads every segment back.
+static void checkSegments() {
+    ScratchDirectory directory;
+    const std::vector<CaptureStreamFormat> formats = {kStereoFloat, kMonoInt16};
+    auto statistics = std::make_shared<SegmentedRecording::Statistics>();
+    SegmentingSink sink;
+    CHECK(sink.open(directory.path() + "/Rec", formats, 1.0, 0, statistics));
+
+    // Write 50 ms at a time, as the capture engine's writer thread does.
+    std::vector<uint64_t> written(formats.size(), 0);
+    std::vector<uint8_t> frames;
+    for (int pass = 0; pass < 66; ++pass) {
+        for (uint32_t stream = 0; stream < formats.size(); ++stream) {
+            const auto count = uint32_t(formats[stream].sampleRate / 20);
+            FillFrames(formats[stream], written[stream], count, frames);
+            CHECK(sink.write(stream, frames.data(), count));
+            written[stream] += count;
+        }
+    }
+    CHECK(sink.close());
+    CHECK(statistics->fileErrorCount.load() == 0);
+    CHECK(statistics->segmentCount.load() == 8);
+
+    // Four segments per stream and the manifest, with none of the segments made ahead left over.
+    const auto names = directory.fileNames();
+    CHECK(names.size() == 9);
+    for (uint32_t stream = 0; stream < formats.size(); ++stream) {
+        std::vector<uint8_t> expected, recorded;
+        FillFrames(formats[stream], 0, uint32_t(written[stream]), expected);
+        for (uint32_t segment = 0; segment < 4; ++segment) {
+            char name[64];
+            snprintf(name, sizeof(name), "/Rec-Stream_%u-Segment_%04u.caf", stream, segment);
+            const auto audio = ReadSegment(directory.path() + name, formats[stream]);
+            // Every segment but the last holds exactly one second.
+            if (segment < 3) {
+                CHECK(audio.size() == size_t(formats[stream].sampleRate) * formats[stream].bytesPerFrame);
+            }
+            recorded.insert(recorded.end(), audio.begin(), audio.end());
+        }
+        CHECK(recorded == expected);
+    }
+
+    const auto manifestBytes = ReadFile(sink.manifestPath());
+    const std::string manifest(manifestBytes.begin(), manifestBytes.end());
+    CHECK(manifest.find("\"firstFrame\": 96000, \"frameCount\": 48000, \"startSeconds\": 2.000000000") != std::string::npos);
+    CHECK(manifest.find("\"firstFrame\": 132300, \"frameCount\": 13230, \"startSeconds\": 3.000000000") != std::string::npos);
+}
+
+// A byte limit cuts segments before the time limit does, and no segment grows past it.
+static void checkByteLimit() {
+    ScratchDirectory directory;
+    constexpr uint64_t kSegmentBytes = 100000;
+    SegmentingSink sink;
+    CHECK(sink.open(directory.path() + "/Rec", {kStereoFloat}, 60, kSegmentBytes, nullptr));
+    std::vector<uint8_t> frames;
+    for (uint64_t frame = 0; frame < 48000; frame += 1000) {
+        FillFrames(kStereoFloat, frame, 1000, frames);
+        CHECK(sink.write(0, frames.data(), 1000));
+    }
+    CHECK(sink.close());
+
+    const auto names = directory.fileNames();
+    const auto framesPerSegment = (kSegmentBytes - SegmentedRecording::kHeaderBytes) / kStereoFloat.bytesPerFrame;
+    CHECK(names.size() == 1 + (48000 + framesPerSegment - 1) / framesPerSegment);
+    for (const auto& name : names) {
+        if (name.find(".caf") != std::string::npos) {
+            CHECK(ReadFile(directory.path() + "/" + name).size() <= kSegmentBytes);
+        }
+    }
+}
+
+// Writes `streamCount` stereo float streams as fast as the file system takes them, in 50 ms batches
+// and 10 s segments. Reports the bandwidth, and how long the longest write held up the writer thread.
+static void benchmark(uint32_t streamCount) {
+    ScratchDirectory directory;
+    constexpr uint32_t kBatchFrames = 2400;
+    const double seconds = test::quickMode() ? 12 : 120;
+    auto statistics = std::make_shared<SegmentedRecording::Statistics>();
+    SegmentingSink sink;
+    CHECK(sink.open(directory.path() + "/Rec", std::vector<CaptureStreamFormat>(streamCount, kStereoFloat), 10, 0, statistics));
+
+    std::vector<uint8_t> frames;
+    FillFrames(kStereoFloat, 0, kBatchFrames, frames);
+    const auto batches = uint32_t(seconds * kStereoFloat.sampleRate / kBatchFrames);
+    std::vector<double> microseconds;
+    microseconds.reserve(size_t(batches) * streamCount);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t batch = 0; batch < batches; ++batch) {
+        for (uint32_t stream = 0; stream < streamCount; ++stream) {
+            const auto writeStart = std::chrono::steady_clock::now();
+            sink.write(stream, frames.data(), kBatchFrames);
+            microseconds.push_back(test::secondsSince(writeStart) * 1e6);
+        }
+    }
+    CHECK(sink.close());
+    const auto elapsed = test::secondsSince(start);
+    CHECK(statistics->fileErrorCount.load() == 0);
+
+    std::sort(microseconds.begin(), microseconds.end());
+    const double megabytes = double(statistics->bytesWritten.load()) / 1e6;
+    printf("%7u %9.0f %10.0f %10.0f %10.0f %12.0f %14.0f\n", streamCount, megabytes, megabytes / elapsed,
+           microseconds[microseconds.size() / 2], microseconds[microseconds.size() * 99 / 100], microseconds.back(),
+           double(statistics->longestWriteNanoseconds.load()) / 1e3);
+}
+
+int main(int argc, char** argv) {
+    test::parseArguments(argc, argv);
+
+    checkSegments();
+    checkByteLimit();
+
+    printf("\nStereo float streams at 48 kHz in 50 ms writes and 10 s segments, in /tmp\n");
+    printf("%7s %9s %10s %10s %10s %12s %14s\n", "streams", "MB", "MB/s", "median µs", "p99 µs", "longest µs", "longest file µs");
+    for (uint32_t streamCount : {1u, 16u}) {
+        benchmark(streamCount);
+    }
+    return test::finish("SegmentedRecordingTests");
+}
@@ -2,8 +2,8 @@
 See the LICENSE.txt file for this sample’s licensing information.
 
 Abstract:
-The implementation of CreatingMIDIDriverSampleAppDevice, a MIDIDriverKit device that does
-     a basic MIDI roundtrip, copying data from the input port to the output port.
+The implementation of CreatingMIDIDriverSampleAppDevice, a MIDIDriverKit device that routes
+     MIDI from the input ports to the output ports through a filtering routing matrix.
 */
 
 #include <MIDIDriverKit/MIDIDriverKit.h>
@@ -11,6 +11,7 @@ The implementation of CreatingMIDIDriverSampleAppDevice, a MIDIDriverKit device
 #include "CreatingMIDIDriverSampleAppDevice.h"
 #include "CreatingMIDIDriverSampleAppDriver.h"
 #include "CreatingMIDIDriverSampleAppDriverKeys.h"
+#include "CreatingMIDIDriverSampleAppRouting.h"
 
 #include <cstdio>
 
@@ -30,8 +31,38 @@ struct CreatingMIDIDriverSampleAppDevice_IVars
 	OSSharedPtr<IODispatchQueue> mWorkQueue;
 
 	OSSharedPtr<OSArray> mDestinations;
+
+	// `mRouteLock` guards the routing matrix.
+	IOLock* mRouteLock;
+	RoutingMatrix<IOUserMIDISource> mRouting;
 };
 
+// MARK: - Routing
+
+static void FlushRoutes(CreatingMIDIDriverSampleAppDevice_IVars* ivars)
+{
+	IOLockLock(ivars->mRouteLock);
+	FlushPendingWords(ivars->mRouting);
+	IOLockUnlock(ivars->mRouteLock);
+}
+
+// Adds the messages of a destination's batch to the sources its routes pass them to. The sources
+// send what they collect when the work queue next runs, so that the batches of every destination
+// that arrive before then go out in one `Send` per source.
+static void RouteWords(CreatingMIDIDriverSampleAppDevice_IVars* ivars, uint32_t destinationIndex,
+					   IOUserMIDIUMPWord const* umpWords, size_t numWords)
+{
+	IOLockLock(ivars->mRouteLock);
+	const bool scheduleFlush = AddRoutedWords(ivars->mRouting, destinationIndex, umpWords, numWords);
+	IOLockUnlock(ivars->mRouteLock);
+
+	if (scheduleFlush) {
+		ivars->mWorkQueue->DispatchAsync(^{
+			FlushRoutes(ivars);
+		});
+	}
+}
+
 
 // A typical UMP-native device has a single UMP endpoint
 // consisting of a UMP-native source and a UMP-native destination.
@@ -54,6 +85,15 @@ bool CreatingMIDIDriverSampleAppDevice::init(
 	ivars->mDriver = OSSharedPtr(driver, OSRetain);
 	ivars->mWorkQueue = GetWorkQueue();
 
+	ivars->mRouteLock = IOLockAlloc();
+	if (ivars->mRouteLock == nullptr) {
+		return false;
+	}
+	// Start with each entity looping back to itself.
+	for (uint32_t index = 0; index < kMaxRoutedEntities; index++) {
+		ivars->mRouting.mRoutes[index][index] = RouteFilter{ kAllRouteBits, kAllRouteBits, kAllRouteBits };
+	}
+
 	auto entityName = CreateEntityName(1);
 	auto entity = IOUserMIDIEntity::Create(
 					driver, this, entityName.get(),
@@ -72,6 +112,10 @@ void CreatingMIDIDriverSampleAppDevice::free()
 	if (ivars != nullptr) {
 		ivars->mDriver.reset();
 		ivars->mWorkQueue.reset();
+		if (ivars->mRouteLock != nullptr) {
+			IOLockFree(ivars->mRouteLock);
+			ivars->mRouteLock = nullptr;
+		}
 	}
 	IOSafeDeleteNULL(ivars, CreatingMIDIDriverSampleAppDevice_IVars, 1);
 	super::free();
@@ -108,6 +152,8 @@ kern_return_t CreatingMIDIDriverSampleAppDevice::StopIO()
 	__block kern_return_t error;
 
 	ivars->mWorkQueue->DispatchSync(^{
+		// Send what the routes have collected since the last flush.
+		FlushRoutes(ivars);
 		error = super::StopIO();
 	});
 
@@ -116,6 +162,9 @@ kern_return_t CreatingMIDIDriverSampleAppDevice::StopIO()
 		DebugMsg("Failed to stop I/O, error %d", error);
 	}
 
+	DebugMsg("Routed %llu words in %llu sends, %llu failed",
+			 ivars->mRouting.mRoutedWordCount, ivars->mRouting.mSendCount, ivars->mRouting.mSendErrorCount);
+
 	return error;
 }
 
@@ -123,19 +172,59 @@ void CreatingMIDIDriverSampleAppDevice::SetupEntities()
 {
 	ivars->mDestinations = OSSharedPtr(OSArray::withCapacity(1), OSNoRetain);
 
+	// I/O isn't running, so nothing is routing. Drop what the sources of removed entities still hold.
+	IOLockLock(ivars->mRouteLock);
+	for (uint32_t index = 0; index < kMaxRoutedEntities; index++) {
+		ivars->mRouting.mSources[index] = nullptr;
+		ivars->mRouting.mPendingWordCount[index] = 0;
+	}
+
+	__block uint32_t entityIndex = 0;
 	GetEntities()->iterateObjects(^bool(OSObject* object){
 		auto entity = OSDynamicCast(IOUserMIDIEntity, object);
 		if (entity != nullptr)
 		{
 			auto source = entity->GetSource(0);
 			auto destination = entity->GetDestination(0);
-			auto ioBlock = ^kern_return_t(IOUserMIDIUMPWord const* umpWords, size_t numWords) {
-				return source->Send(umpWords, numWords);
-			};
-			destination->SetIOBlock(ioBlock);
+			const auto destinationIndex = entityIndex++;
+			if (destinationIndex < kMaxRoutedEntities) {
+				ivars->mRouting.mSources[destinationIndex] = source;
+				auto ioBlock = ^kern_return_t(IOUserMIDIUMPWord const* umpWords, size_t numWords) {
+					RouteWords(ivars, destinationIndex, umpWords, numWords);
+					return kIOReturnSuccess;
+				};
+				destination->SetIOBlock(ioBlock);
+			}
+			else {
+				auto ioBlock = ^kern_return_t(IOUserMIDIUMPWord const* umpWords, size_t numWords) {
+					return source->Send(umpWords, numWords);
+				};
+				destination->SetIOBlock(ioBlock);
+			}
 		}
 		return false;
 	});
+	IOLockUnlock(ivars->mRouteLock);
+}
+
+kern_return_t CreatingMIDIDriverSampleAppDevice::SetRoute(
+		uint32_t destinationIndex, uint32_t sourceIndex,
+		uint32_t groupMask, uint32_t channelMask, uint32_t messageTypeMask)
+{
+	if (destinationIndex >= kMaxRoutedEntities || sourceIndex >= kMaxRoutedEntities) {
+		return kIOReturnBadArgument;
+	}
+
+	DebugMsg("destination %u to source %u: groups 0x%04x, channels 0x%04x, message types 0x%04x",
+			 destinationIndex, sourceIndex, groupMask, channelMask, messageTypeMask);
+
+	IOLockLock(ivars->mRouteLock);
+	ivars->mRouting.mRoutes[destinationIndex][sourceIndex] = RouteFilter{
+		static_cast<uint16_t>(groupMask & kAllRouteBits),
+		static_cast<uint16_t>(channelMask & kAllRouteBits),
+		static_cast<uint16_t>(messageTypeMask & kAllRouteBits) };
+	IOLockUnlock(ivars->mRouteLock);
+	return kIOReturnSuccess;
 }
 
 kern_return_t CreatingMIDIDriverSampleAppDevice::PerformDeviceConfigurationChange(
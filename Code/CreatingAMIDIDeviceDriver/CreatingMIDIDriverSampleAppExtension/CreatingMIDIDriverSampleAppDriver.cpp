@@ -208,3 +208,15 @@ kern_return_t CreatingMIDIDriverSampleAppDriver::HandleToggleOffline()
 	});
 	return ret;
 }
+
+kern_return_t CreatingMIDIDriverSampleAppDriver::HandleSetRoute(
+		uint32_t destinationIndex, uint32_t sourceIndex,
+		uint32_t groupMask, uint32_t channelMask, uint32_t messageTypeMask)
+{
+	__block kern_return_t ret = kIOReturnSuccess;
+	ivars->mWorkQueue->DispatchSync(^{
+		ret = ivars->mCreatingMIDIDriverSampleAppDevice->SetRoute(destinationIndex, sourceIndex,
+																  groupMask, channelMask, messageTypeMask);
+	});
+	return ret;
+}
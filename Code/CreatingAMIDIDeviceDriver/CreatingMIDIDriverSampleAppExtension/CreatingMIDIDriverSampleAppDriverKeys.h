@@ -20,6 +20,7 @@ enum CreatingMIDIDriverSampleAppDriverExternalMethod
 	CreatingMIDIDriverSampleAppDriverExternalMethod_AddPort,
 	CreatingMIDIDriverSampleAppDriverExternalMethod_RemovePort,
 	CreatingMIDIDriverSampleAppDriverExternalMethod_ToggleOffline,
+	CreatingMIDIDriverSampleAppDriverExternalMethod_SetRoute,
 };
 
 #endif /* CreatingMIDIDriverSampleAppDriverKeys_h */
@@ -114,6 +114,20 @@ kern_return_t	CreatingMIDIDriverSampleAppDriverUserClient::ExternalMethod(
 			break;
 		}
 
+		// Scalar inputs: destination entity, source entity, group mask, channel mask, message type mask.
+		case CreatingMIDIDriverSampleAppDriverExternalMethod_SetRoute: {
+			if (arguments == nullptr || arguments->scalarInput == nullptr || arguments->scalarInputCount != 5) {
+				ret = kIOReturnBadArgument;
+				break;
+			}
+			ret = ivars->mProvider->HandleSetRoute(static_cast<uint32_t>(arguments->scalarInput[0]),
+												   static_cast<uint32_t>(arguments->scalarInput[1]),
+												   static_cast<uint32_t>(arguments->scalarInput[2]),
+												   static_cast<uint32_t>(arguments->scalarInput[3]),
+												   static_cast<uint32_t>(arguments->scalarInput[4]));
+			break;
+		}
+
 		default:
 			ret = super::ExternalMethod(selector, arguments, dispatch, target, reference);
 	};
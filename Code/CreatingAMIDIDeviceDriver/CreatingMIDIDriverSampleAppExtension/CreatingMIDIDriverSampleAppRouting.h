@@ -0,0 +1,148 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+The routing matrix that CreatingMIDIDriverSampleAppDevice sends MIDI through: filters by group,
+     channel, and message type, and the words each source collects between flushes.
+*/
+
+#ifndef CreatingMIDIDriverSampleAppRouting_h
+#define CreatingMIDIDriverSampleAppRouting_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// The entities the routing matrix covers. A destination past these loops back to its own source.
+constexpr uint32_t kMaxRoutedEntities = 16;
+
+// The most words a source collects before it sends them without waiting for the flush.
+constexpr uint32_t kMaxPendingWords = 512;
+
+constexpr uint32_t kAllRouteBits = 0xFFFF;
+
+// What a route passes: a bit for each group, channel, and UMP message type. A route that
+// passes no message types is off.
+struct RouteFilter
+{
+	uint16_t mGroups;
+	uint16_t mChannels;
+	uint16_t mMessageTypes;
+};
+
+// The routing matrix, by destination entity and then by source entity, and the words each source
+// has collected since the last flush. It doesn't lock; the device guards it with its route lock.
+// `Source` is the entity's source, `IOUserMIDISource` in the driver, whose `Send` returns 0,
+// `kIOReturnSuccess`, when it succeeds. The matrix has no constructor, so that zeroed memory is an
+// empty matrix with every route off.
+template <typename Source>
+struct RoutingMatrix
+{
+	Source* mSources[kMaxRoutedEntities];
+	RouteFilter mRoutes[kMaxRoutedEntities][kMaxRoutedEntities];
+	uint32_t mPendingWords[kMaxRoutedEntities][kMaxPendingWords];
+	uint32_t mPendingWordCount[kMaxRoutedEntities];
+	bool mFlushScheduled;
+	uint64_t mRoutedWordCount;
+	uint64_t mSendCount;
+	uint64_t mSendErrorCount;
+};
+
+// The number of words in a UMP message, from its first word's message type.
+inline uint32_t GetMessageWordCount(uint32_t word)
+{
+	static constexpr uint8_t kWordCounts[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+	return kWordCounts[(word >> 28) & 0xF];
+}
+
+inline bool RoutePassesMessage(const RouteFilter& route, uint32_t word)
+{
+	const auto messageType = (word >> 28) & 0xF;
+	if ((route.mMessageTypes & (1u << messageType)) == 0) {
+		return false;
+	}
+	// Utility and UMP stream messages don't belong to a group.
+	if (messageType != 0x0 && messageType != 0xF && (route.mGroups & (1u << ((word >> 24) & 0xF))) == 0) {
+		return false;
+	}
+	// Only MIDI 1.0 and MIDI 2.0 channel voice messages have a channel.
+	if ((messageType == 0x2 || messageType == 0x4) && (route.mChannels & (1u << ((word >> 16) & 0xF))) == 0) {
+		return false;
+	}
+	return true;
+}
+
+// Sends what a source has collected.
+template <typename Source>
+void SendPendingWords(RoutingMatrix<Source>& matrix, uint32_t sourceIndex)
+{
+	const auto wordCount = matrix.mPendingWordCount[sourceIndex];
+	if (wordCount == 0) {
+		return;
+	}
+	matrix.mPendingWordCount[sourceIndex] = 0;
+
+	auto source = matrix.mSources[sourceIndex];
+	if (source == nullptr) {
+		return;
+	}
+	matrix.mSendCount++;
+	if (source->Send(matrix.mPendingWords[sourceIndex], wordCount) != 0) {
+		matrix.mSendErrorCount++;
+	}
+}
+
+// Sends what every source has collected, and lets the next routed batch schedule a flush again.
+template <typename Source>
+void FlushPendingWords(RoutingMatrix<Source>& matrix)
+{
+	for (uint32_t sourceIndex = 0; sourceIndex < kMaxRoutedEntities; sourceIndex++) {
+		SendPendingWords(matrix, sourceIndex);
+	}
+	matrix.mFlushScheduled = false;
+}
+
+// Adds the messages of a destination's batch to the sources its routes pass them to. Returns true
+// when the caller should schedule a flush: the first time a batch routes anything after a flush. The
+// batches of every destination that arrive before the flush go out in one `Send` per source.
+template <typename Source>
+bool AddRoutedWords(RoutingMatrix<Source>& matrix, uint32_t destinationIndex,
+					uint32_t const* umpWords, size_t numWords)
+{
+	bool routed = false;
+	for (uint32_t sourceIndex = 0; sourceIndex < kMaxRoutedEntities; sourceIndex++) {
+		const auto& route = matrix.mRoutes[destinationIndex][sourceIndex];
+		if (route.mMessageTypes == 0 || matrix.mSources[sourceIndex] == nullptr) {
+			continue;
+		}
+
+		auto pending = matrix.mPendingWords[sourceIndex];
+		auto& pendingCount = matrix.mPendingWordCount[sourceIndex];
+		size_t index = 0;
+		while (index < numWords) {
+			const auto wordCount = GetMessageWordCount(umpWords[index]);
+			// Drop a message that the batch cuts short.
+			if (index + wordCount > numWords) {
+				break;
+			}
+			if (RoutePassesMessage(route, umpWords[index])) {
+				if (pendingCount + wordCount > kMaxPendingWords) {
+					SendPendingWords(matrix, sourceIndex);
+				}
+				memcpy(pending + pendingCount, umpWords + index, wordCount * sizeof(uint32_t));
+				pendingCount += wordCount;
+				matrix.mRoutedWordCount += wordCount;
+				routed = true;
+			}
+			index += wordCount;
+		}
+	}
+
+	const bool scheduleFlush = routed && !matrix.mFlushScheduled;
+	if (scheduleFlush) {
+		matrix.mFlushScheduled = true;
+	}
+	return scheduleFlush;
+}
+
+#endif /* CreatingMIDIDriverSampleAppRouting_h */
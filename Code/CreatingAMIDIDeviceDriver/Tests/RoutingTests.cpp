@@ -0,0 +1,440 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the routing matrix's filters and coalescing, and a messages-per-second benchmark of it
+     against a mock entity layer.
+*/
+
+#include "CreatingMIDIDriverSampleAppRouting.h"
+#include "TestSupport.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// UMP messages, as their first word and the words after it.
+static uint32_t MIDI2NoteOn(uint32_t group, uint32_t channel) { return 0x40900000 | (group << 24) | (channel << 16) | 0x3C00; }
+static uint32_t MIDI1ControlChange(uint32_t group, uint32_t channel) { return 0x20B00000 | (group << 24) | (channel << 16) | 0x0740; }
+static uint32_t SystemClock(uint32_t group) { return 0x10F80000 | (group << 24); }
+static uint32_t UtilityNoOp() { return 0x00000000; }
+static uint32_t StreamEndpointDiscovery() { return 0xF0000101; }
+
+// A source that keeps every `Send`, and can be told to fail them.
+struct RecordingSource
+{
+	std::vector<std::vector<uint32_t>> mSends;
+	bool mFails = false;
+
+	int Send(const uint32_t* words, size_t wordCount)
+	{
+		mSends.emplace_back(words, words + wordCount);
+		return mFails ? 1 : 0;
+	}
+};
+
+using RecordingMatrix = RoutingMatrix<RecordingSource>;
+
+// A zeroed matrix, as the device's `IONewZero` makes it, with `sources` connected.
+static std::unique_ptr<RecordingMatrix> MakeMatrix(std::vector<RecordingSource>& sources)
+{
+	auto matrix = std::make_unique<RecordingMatrix>();
+	for (size_t index = 0; index < sources.size(); index++) {
+		matrix->mSources[index] = &sources[index];
+	}
+	return matrix;
+}
+
+static void checkWordCounts()
+{
+	CHECK(GetMessageWordCount(UtilityNoOp()) == 1);
+	CHECK(GetMessageWordCount(SystemClock(0)) == 1);
+	CHECK(GetMessageWordCount(MIDI1ControlChange(0, 0)) == 1);
+	CHECK(GetMessageWordCount(0x30000000) == 2);
+	CHECK(GetMessageWordCount(MIDI2NoteOn(0, 0)) == 2);
+	CHECK(GetMessageWordCount(0x50000000) == 4);
+	CHECK(GetMessageWordCount(0xD0000000) == 4);
+	CHECK(GetMessageWordCount(StreamEndpointDiscovery()) == 4);
+}
+
+// Each mask filters on its own; messages without a group or channel pass on their message type alone.
+static void checkFilters()
+{
+	const RouteFilter group3{ 1u << 3, kAllRouteBits, kAllRouteBits };
+	CHECK(RoutePassesMessage(group3, MIDI2NoteOn(3, 9)));
+	CHECK(!RoutePassesMessage(group3, MIDI2NoteOn(2, 9)));
+	CHECK(!RoutePassesMessage(group3, SystemClock(0)));
+	CHECK(RoutePassesMessage(group3, UtilityNoOp()));
+	CHECK(RoutePassesMessage(group3, StreamEndpointDiscovery()));
+
+	const RouteFilter lowChannels{ kAllRouteBits, 0x00FF, kAllRouteBits };
+	CHECK(RoutePassesMessage(lowChannels, MIDI2NoteOn(5, 7)));
+	CHECK(!RoutePassesMessage(lowChannels, MIDI2NoteOn(5, 8)));
+	CHECK(!RoutePassesMessage(lowChannels, MIDI1ControlChange(0, 15)));
+	// System messages have a group but no channel, though the low bits of their status would read as channel 8.
+	CHECK(RoutePassesMessage(lowChannels, SystemClock(0)));
+
+	const RouteFilter voiceOnly{ kAllRouteBits, kAllRouteBits, (1u << 2) | (1u << 4) };
+	CHECK(RoutePassesMessage(voiceOnly, MIDI2NoteOn(0, 0)));
+	CHECK(RoutePassesMessage(voiceOnly, MIDI1ControlChange(0, 0)));
+	CHECK(!RoutePassesMessage(voiceOnly, SystemClock(0)));
+	CHECK(!RoutePassesMessage(voiceOnly, UtilityNoOp()));
+
+	CHECK(!RoutePassesMessage(RouteFilter{ kAllRouteBits, kAllRouteBits, 0 }, UtilityNoOp()));
+}
+
+// The batches of several destinations go out in one `Send` per source, in the order they arrived,
+// and only the first batch after a flush asks for one.
+static void checkCoalescing()
+{
+	std::vector<RecordingSource> sources(3);
+	auto matrix = MakeMatrix(sources);
+	const RouteFilter all{ kAllRouteBits, kAllRouteBits, kAllRouteBits };
+	matrix->mRoutes[0][1] = all;
+	matrix->mRoutes[0][2] = all;
+	matrix->mRoutes[1][1] = all;
+	matrix->mRoutes[2][2] = RouteFilter{ kAllRouteBits, 0x0001, kAllRouteBits };
+
+	const uint32_t first[] = { MIDI2NoteOn(0, 0), 0x80000000, SystemClock(1) };
+	const uint32_t second[] = { MIDI1ControlChange(0, 0), MIDI1ControlChange(0, 1) };
+	CHECK(AddRoutedWords(*matrix, 0, first, 3));
+	CHECK(!AddRoutedWords(*matrix, 1, second, 2));
+	CHECK(!AddRoutedWords(*matrix, 2, second, 2));
+	CHECK(sources[1].mSends.empty() && sources[2].mSends.empty());
+
+	FlushPendingWords(*matrix);
+	CHECK(sources[0].mSends.empty());
+	CHECK(sources[1].mSends.size() == 1);
+	CHECK((sources[1].mSends[0] == std::vector<uint32_t>{ first[0], first[1], first[2], second[0], second[1] }));
+	CHECK(sources[2].mSends.size() == 1);
+	CHECK((sources[2].mSends[0] == std::vector<uint32_t>{ first[0], first[1], first[2], second[0] }));
+	CHECK(matrix->mSendCount == 2);
+	CHECK(matrix->mRoutedWordCount == 9);
+
+	// A batch that routes nothing doesn't ask for a flush, and the next one that does, does.
+	const uint32_t filtered[] = { MIDI1ControlChange(0, 5) };
+	CHECK(!AddRoutedWords(*matrix, 2, filtered, 1));
+	CHECK(AddRoutedWords(*matrix, 1, second, 2));
+}
+
+// A message the batch cuts short is dropped. A source that fills sends early, between messages.
+static void checkLimits()
+{
+	std::vector<RecordingSource> sources(1);
+	auto matrix = MakeMatrix(sources);
+	matrix->mRoutes[0][0] = RouteFilter{ kAllRouteBits, kAllRouteBits, kAllRouteBits };
+
+	const uint32_t truncated[] = { SystemClock(0), 0x50000000, 0, 0 };
+	AddRoutedWords(*matrix, 0, truncated, 4);
+	FlushPendingWords(*matrix);
+	CHECK(sources[0].mSends.size() == 1 && sources[0].mSends[0].size() == 1);
+
+	// Three-word messages don't divide 512 words, so the early sends must stop short of it.
+	sources[0].mSends.clear();
+	std::vector<uint32_t> batch;
+	for (uint32_t message = 0; message < 400; message++) {
+		batch.insert(batch.end(), { 0xC0000000 | message, message, message });
+	}
+	AddRoutedWords(*matrix, 0, batch.data(), batch.size());
+	FlushPendingWords(*matrix);
+	std::vector<uint32_t> received;
+	for (const auto& send : sources[0].mSends) {
+		CHECK(send.size() <= kMaxPendingWords);
+		CHECK(send.size() % 3 == 0);
+		received.insert(received.end(), send.begin(), send.end());
+	}
+	CHECK(sources[0].mSends.size() == 3);
+	CHECK(received == batch);
+}
+
+// Routes to a missing source collect nothing, a source that goes away drops what it held, and
+// failed sends are counted.
+static void checkSources()
+{
+	std::vector<RecordingSource> sources(2);
+	auto matrix = MakeMatrix(sources);
+	matrix->mRoutes[0][0] = RouteFilter{ kAllRouteBits, kAllRouteBits, kAllRouteBits };
+	matrix->mRoutes[0][5] = RouteFilter{ kAllRouteBits, kAllRouteBits, kAllRouteBits };
+	const uint32_t words[] = { UtilityNoOp() };
+	AddRoutedWords(*matrix, 0, words, 1);
+	CHECK(matrix->mPendingWordCount[5] == 0);
+
+	matrix->mSources[0] = nullptr;
+	FlushPendingWords(*matrix);
+	CHECK(sources[0].mSends.empty());
+	CHECK(matrix->mPendingWordCount[0] == 0);
+
+	matrix->mSources[0] = &sources[0];
+	sources[0].mFails = true;
+	AddRoutedWords(*matrix, 0, words, 1);
+	FlushPendingWords(*matrix);
+	CHECK(matrix->mSendCount == 1);
+	CHECK(matrix->mSendErrorCount == 1);
+}
+
+// MARK: - Mock entity layer
+
+// Spins for the time a `Send` to the MIDI server takes, so that saving sends saves time.
+static void Spin(std::chrono::nanoseconds duration)
+{
+	const auto end = std::chrono::steady_clock::now() + duration;
+	while (std::chrono::steady_clock::now() < end) {
+	}
+}
+
+// A source that counts what it sends, and the channel voice messages that its route should have filtered out.
+struct CountingSource
+{
+	std::atomic<uint64_t> mSends{ 0 };
+	std::atomic<uint64_t> mMessages{ 0 };
+	std::atomic<uint64_t> mFilterViolations{ 0 };
+	uint32_t mChannels = kAllRouteBits;
+
+	int Send(const uint32_t* words, size_t wordCount)
+	{
+		uint64_t messages = 0;
+		for (size_t index = 0; index < wordCount; index += GetMessageWordCount(words[index])) {
+			const auto messageType = words[index] >> 28;
+			if ((messageType == 0x2 || messageType == 0x4) && (mChannels & (1u << ((words[index] >> 16) & 0xF))) == 0) {
+				mFilterViolations++;
+			}
+			messages++;
+		}
+		mSends++;
+		mMessages += messages;
+		Spin(std::chrono::microseconds(3));
+		return 0;
+	}
+};
+
+// A serial queue on its own thread, like the device's work queue.
+class WorkQueue
+{
+public:
+	WorkQueue() : mThread([this] { run(); }) {}
+
+	~WorkQueue()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+		}
+		mCondition.notify_one();
+		mThread.join();
+	}
+
+	void DispatchAsync(std::function<void()> block)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mBlocks.push_back(std::move(block));
+		}
+		mCondition.notify_one();
+	}
+
+private:
+	void run()
+	{
+		while (true) {
+			std::function<void()> block;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this] { return mStopping || !mBlocks.empty(); });
+				if (mBlocks.empty()) {
+					return;
+				}
+				block = std::move(mBlocks.front());
+				mBlocks.pop_front();
+			}
+			block();
+		}
+	}
+
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::deque<std::function<void()>> mBlocks;
+	bool mStopping = false;
+	std::thread mThread;
+};
+
+// Routes as the device's `RouteWords` and `FlushRoutes` do, with a mutex for its route lock.
+class MockDevice
+{
+public:
+	explicit MockDevice(std::vector<CountingSource>& sources) : mRouting(std::make_unique<RoutingMatrix<CountingSource>>())
+	{
+		for (size_t index = 0; index < sources.size(); index++) {
+			mRouting->mSources[index] = &sources[index];
+		}
+	}
+
+	// Call before any destination routes.
+	RoutingMatrix<CountingSource>& routing() { return *mRouting; }
+
+	void RouteWords(uint32_t destinationIndex, const uint32_t* umpWords, size_t numWords)
+	{
+		mRouteLock.lock();
+		const bool scheduleFlush = AddRoutedWords(*mRouting, destinationIndex, umpWords, numWords);
+		mRouteLock.unlock();
+
+		if (scheduleFlush) {
+			mWorkQueue.DispatchAsync([this] { FlushRoutes(); });
+		}
+	}
+
+	// Waits for the work queue, then sends what's left, as `StopIO` does.
+	void StopIO()
+	{
+		std::promise<void> flushed;
+		mWorkQueue.DispatchAsync([&] { FlushRoutes(); flushed.set_value(); });
+		flushed.get_future().wait();
+	}
+
+private:
+	void FlushRoutes()
+	{
+		std::lock_guard<std::mutex> lock(mRouteLock);
+		FlushPendingWords(*mRouting);
+	}
+
+	std::mutex mRouteLock;
+	std::unique_ptr<RoutingMatrix<CountingSource>> mRouting;
+	WorkQueue mWorkQueue;
+};
+
+// A note on, a note off, a control change, and a timing clock, on a channel that turns with each batch.
+static void MakeBatch(uint32_t batchIndex, uint32_t (&words)[6])
+{
+	const auto channel = batchIndex & 15;
+	words[0] = MIDI2NoteOn(0, channel);
+	words[1] = 0x80000000;
+	words[2] = 0x40800000 | (channel << 16) | 0x3C00;
+	words[3] = 0;
+	words[4] = MIDI1ControlChange(0, channel);
+	words[5] = SystemClock(0);
+}
+
+constexpr uint64_t kMessagesPerBatch = 4;
+
+// Several destinations route at once, and every message reaches every source its route passes it to, once.
+static void checkThreads()
+{
+	constexpr uint32_t kEntities = 4;
+	constexpr uint32_t kBatches = 20000;
+	std::vector<CountingSource> sources(kEntities);
+	{
+		MockDevice device(sources);
+		for (uint32_t destination = 0; destination < kEntities; destination++) {
+			for (uint32_t source = 0; source < kEntities; source++) {
+				device.routing().mRoutes[destination][source] = RouteFilter{ kAllRouteBits, kAllRouteBits, kAllRouteBits };
+			}
+		}
+		std::vector<std::thread> destinations;
+		for (uint32_t destination = 0; destination < kEntities; destination++) {
+			destinations.emplace_back([&device, destination] {
+				uint32_t words[6];
+				for (uint32_t batch = 0; batch < kBatches; batch++) {
+					MakeBatch(batch, words);
+					device.RouteWords(destination, words, 6);
+				}
+			});
+		}
+		for (auto& thread : destinations) {
+			thread.join();
+		}
+		device.StopIO();
+		CHECK(device.routing().mSendErrorCount == 0);
+	}
+	for (const auto& source : sources) {
+		CHECK(source.mMessages == uint64_t(kEntities) * kBatches * kMessagesPerBatch);
+		CHECK(source.mSends < uint64_t(kEntities) * kBatches);
+	}
+}
+
+// Every destination routes to every source, and source 0 takes only MIDI 2.0 channel voice messages
+// on channels 0-7. Each destination's thread sends batches of four messages as fast as it can, for a
+// fixed time. Forwarding each batch with a `Send` per route, as the device did before the matrix,
+// is the baseline.
+static void benchmark(uint32_t entityCount, bool coalesce)
+{
+	const auto duration = std::chrono::milliseconds(test::quickMode() ? 500 : 5000);
+	std::vector<CountingSource> sources(entityCount);
+	sources[0].mChannels = 0x00FF;
+	std::atomic<uint64_t> messagesIn{ 0 };
+	{
+		MockDevice device(sources);
+		for (uint32_t destination = 0; destination < entityCount; destination++) {
+			for (uint32_t source = 0; source < entityCount; source++) {
+				device.routing().mRoutes[destination][source] = RouteFilter{ kAllRouteBits, kAllRouteBits, kAllRouteBits };
+			}
+			device.routing().mRoutes[destination][0] = RouteFilter{ kAllRouteBits, 0x00FF, 1u << 4 };
+		}
+
+		std::atomic<bool> running{ true };
+		std::vector<std::thread> destinations;
+		for (uint32_t destination = 0; destination < entityCount; destination++) {
+			destinations.emplace_back([&, destination] {
+				uint32_t words[6];
+				uint64_t messages = 0;
+				for (uint32_t batch = 0; running.load(std::memory_order_relaxed); batch++) {
+					MakeBatch(batch, words);
+					if (coalesce) {
+						device.RouteWords(destination, words, 6);
+					}
+					else {
+						for (uint32_t source = 0; source < entityCount; source++) {
+							sources[source].Send(words, 6);
+						}
+					}
+					messages += kMessagesPerBatch;
+				}
+				messagesIn += messages;
+			});
+		}
+		std::this_thread::sleep_for(duration);
+		running = false;
+		for (auto& thread : destinations) {
+			thread.join();
+		}
+		device.StopIO();
+	}
+
+	uint64_t sends = 0;
+	uint64_t messagesOut = 0;
+	uint64_t violations = 0;
+	for (const auto& source : sources) {
+		sends += source.mSends;
+		messagesOut += source.mMessages;
+		violations += coalesce ? source.mFilterViolations.load() : 0;
+	}
+	CHECK(violations == 0);
+	const double seconds = std::chrono::duration<double>(duration).count();
+	printf("%-10s %8u %14.0f %11.0f %17.1f %10llu\n", coalesce ? "coalesced" : "per batch", entityCount,
+		   double(messagesIn) / seconds, double(sends) / seconds, double(messagesOut) / double(std::max<uint64_t>(sends, 1)),
+		   static_cast<unsigned long long>(violations));
+}
+
+int main(int argc, char** argv)
+{
+	test::parseArguments(argc, argv);
+
+	checkWordCounts();
+	checkFilters();
+	checkCoalescing();
+	checkLimits();
+	checkSources();
+	checkThreads();
+
+	printf("\nEvery destination to every source, 4-message batches, 3 µs per Send\n");
+	printf("%-10s %8s %14s %11s %17s %10s\n", "routing", "entities", "messages/s in", "Sends/s", "messages per Send", "violations");
+	for (uint32_t entityCount : { 4u, 16u }) {
+		benchmark(entityCount, false);
+		benchmark(entityCount, true);
+	}
+	return test::finish("RoutingTests");
+}
@@ -8,14 +8,52 @@ An audio engine that contains audio units.
 
 NS_ASSUME_NONNULL_BEGIN
 
+// A snapshot of how the render callback is keeping up with the device.
+@interface RenderStatistics : NSObject
+
+@property (nonatomic) uint64_t callbackCount;
+// Callbacks that took longer than the audio they rendered.
+@property (nonatomic) uint64_t lateCount;
+// Device cycles the render callback missed, from gaps in the host's sample time.
+@property (nonatomic) uint64_t discontinuityCount;
+// Cycles the current file's streaming decoder couldn't fill.
+@property (nonatomic) uint64_t underrunCount;
+@property (nonatomic) uint64_t renderErrorCount;
+
+// Callback durations in microseconds, and the duration of the audio in the most recent callback.
+@property (nonatomic) double medianDuration;
+@property (nonatomic) double p99Duration;
+@property (nonatomic) double maxDuration;
+@property (nonatomic) double period;
+
+@end
+
 @interface AudioEngine : NSObject
 
 @property (readonly) AudioFileReader * __nullable fileReader;
 
+// The I/O buffer size the device granted, in frames. The engine sizes its render buffers from it.
+@property (readonly) NSUInteger bufferFrameSize;
+
+// The time from the engine pulling audio from a file to that audio leaving the device, in seconds:
+// the renderer's own delay, plus the I/O buffer and the device's output latency.
+@property (readonly) double outputLatency;
+
+// Asks the device for an I/O buffer of `bufferFrameSize` frames, such as 32, 64, or 128 for a
+// low-latency monitor. The device can grant a different size; `bufferFrameSize` reports it.
+// Pass 0 to keep the device's current size, as `init` does.
+-(instancetype)initWithBufferFrameSize:(NSUInteger)bufferFrameSize;
+
 +(NSArray<NSString *> *)audioSamples;
 -(BOOL)loadAudio:(NSString *)filePath;
 -(void)handleRouteChange:(NSNotification *)notification;
 
+// Sets the listener's head orientation, in degrees, for renderers that don't track the head themselves.
+-(void)setListenerOrientationYaw:(float)yaw pitch:(float)pitch roll:(float)roll;
+
+// Reads the render statistics without blocking the render thread.
+-(RenderStatistics *)renderStatistics;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -8,19 +8,32 @@ An audio engine implementation that contains audio units.
 #import "AudioKernel.h"
 #import "OutputAU.hpp"
 
-#define kMaxBlockSize 4096
+// The render block size when the device doesn't report its I/O buffer size.
+#define kFallbackBlockSize 4096
+
+@implementation RenderStatistics
+@end
 
 @implementation AudioEngine
 {
     std::unique_ptr<AudioKernel> kernel;
     OutputAU outputAU;
+    NSUInteger preferredBufferFrameSize;
 }
 
 -(instancetype)init
+{
+    return [self initWithBufferFrameSize:0];
+}
+
+-(instancetype)initWithBufferFrameSize:(NSUInteger)bufferFrameSize
 {
     self = [super init];
     if (self) {
+        preferredBufferFrameSize = bufferFrameSize;
         
+        // A sample that hasn't been cached yet streams while its reader builds the cache,
+        // so only the samples someone plays take up disk space and decoding time.
         [self loadAudio:[AudioEngine.audioSamples objectAtIndex:0]];
         
 #if TARGET_OS_OSX
@@ -41,13 +54,47 @@ An audio engine implementation that contains audio units.
 
 -(BOOL)loadAudio:(NSString *)filePath
 {
-    outputAU.stop();
+    AudioFileReader* fileReader = [[AudioFileReader alloc] init:filePath];
+    
+    // Build the kernel and start the output once; later files swap in while the output keeps running.
+    const bool starting = (kernel == nullptr);
+    if (starting) {
+        // Size every render buffer from the granted I/O buffer, so a small buffer keeps the
+        // render loop's working set small. The kernel slices any larger request the device makes.
+        // If the device refuses the request, play at its current size.
+        if (preferredBufferFrameSize > 0) {
+            try {
+                outputAU.setBufferFrameSize(UInt32(preferredBufferFrameSize));
+            }
+            catch (const std::runtime_error&) {
+            }
+        }
+        [self buildKernel];
+    }
+    
+    if (![self playFileReader:fileReader]) {
+        return NO;
+    }
+    _fileReader = fileReader;
     
-    _fileReader = [[AudioFileReader alloc] init:filePath];
+    if (starting) {
+        outputAU.start();
+    }
+    return YES;
+}
+
+// Builds a kernel for the device's current rate, channel count, and output type, and renders through it.
+// Call it before the output starts or while it's stopped.
+-(void)buildKernel
+{
+    _bufferFrameSize = outputAU.getBufferFrameSize();
+    if (_bufferFrameSize == 0) {
+        _bufferFrameSize = kFallbackBlockSize;
+    }
     
     auto outputType = outputAU.getSpatialMixerOutputType();
-    kernel = std::make_unique<AudioKernel>(outputType, _fileReader.sampleRate, outputAU.getSampleRate(), kMaxBlockSize);
-    kernel->setAudioPullBlock(_fileReader.pullAudioBlock);
+    kernel = std::make_unique<AudioKernel>(outputType, outputAU.getSampleRate(), UInt32(_bufferFrameSize),
+                                           ResamplerQuality::Medium, nullptr, false, outputAU.getOutputChannelCount());
     
     outputAU.setCallback(kernel.get(), [] (void * __nullable inRefCon,
                                            AudioUnitRenderActionFlags * __nullable ioActionFlags,
@@ -57,16 +104,81 @@ An audio engine implementation that contains audio units.
                                            AudioBufferList * __nullable    ioData) {
         return static_cast<AudioKernel *>(inRefCon)->process(inRefCon, ioActionFlags, inTimeStamp, inBusNumber, inNumberFrames, ioData);
     });
-    
-    outputAU.start();
-    return YES;
+}
+
+// Crossfades the kernel to the reader's audio.
+-(BOOL)playFileReader:(AudioFileReader *)fileReader
+{
+    // The reader's block points into the reader, so keep the reader alive for as long as the kernel holds the block.
+    PullAudioBlock readerBlock = fileReader.pullAudioBlock;
+    PullAudioBlock sourceBlock = ^(AudioBufferList * __nullable dstBufferList, size_t bufferSize) {
+        (void)fileReader;
+        readerBlock(dstBufferList, bufferSize);
+    };
+    return kernel->setSource(sourceBlock, fileReader.sampleRate);
 }
 
 -(void)handleRouteChange:(NSNotification *)notification
 {
+    // The notification arrives on a secondary thread, so handle it on the main thread with `loadAudio:`,
+    // which is the only other place that replaces the kernel.
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (!self->kernel) {
+            return;
+        }
+        
+        // A kernel renders at one rate and channel count for its whole life. For a device that
+        // differs in either, stop the output and render through a new kernel instead.
+        if (self->outputAU.getSampleRate() != self->kernel->getSampleRate() ||
+            self->outputAU.getOutputChannelCount() != self->kernel->getDeviceChannelCount()) {
+            self->outputAU.stop();
+            [self buildKernel];
+            if (self->_fileReader != nil) {
+                [self playFileReader:self->_fileReader];
+            }
+            self->outputAU.start();
+            return;
+        }
+        
+        // The kernel applies the rest of the change on the render thread between blocks.
+        self->kernel->setOutputType(self->outputAU.getSpatialMixerOutputType());
+    });
+}
+
+-(void)setListenerOrientationYaw:(float)yaw pitch:(float)pitch roll:(float)roll
+{
+    if (kernel) {
+        kernel->setListenerOrientation(yaw, pitch, roll);
+    }
+}
+
+-(double)outputLatency
+{
+    if (!kernel) {
+        return 0;
+    }
+    const auto sampleRate = outputAU.getSampleRate();
+    const auto rendererLatency = sampleRate > 0 ? kernel->getLatencyFrames() / sampleRate : 0;
+    return rendererLatency + outputAU.getOutputLatency();
+}
+
+-(RenderStatistics *)renderStatistics
+{
+    RenderStatistics * statistics = [RenderStatistics new];
     if (kernel) {
-        kernel->setOutputType(outputAU.getSpatialMixerOutputType());
+        RenderTelemetry::Snapshot snapshot;
+        kernel->getTelemetry().snapshot(snapshot);
+        statistics.callbackCount = snapshot.callbackCount;
+        statistics.lateCount = snapshot.lateCount;
+        statistics.discontinuityCount = snapshot.discontinuityCount;
+        statistics.renderErrorCount = snapshot.renderErrorCount;
+        statistics.medianDuration = RenderTelemetry::Snapshot::percentile(snapshot.duration, 0.5) / 1000.0;
+        statistics.p99Duration = RenderTelemetry::Snapshot::percentile(snapshot.duration, 0.99) / 1000.0;
+        statistics.maxDuration = snapshot.maxDurationNanos / 1000.0;
+        statistics.period = snapshot.lastPeriodNanos / 1000.0;
     }
+    statistics.underrunCount = _fileReader.underrunCount;
+    return statistics;
 }
 
 @end
@@ -9,31 +9,221 @@ A kernel that manages the real-time aspects of the audio engine.
 
 #import "CoreAudioHelpers.h"
 #import "AUSMRenderer.h"
+#import "SoftwareSpatialRenderer.h"
+#import "BinauralSpatialRenderer.h"
+#import "AmbisonicSpatialRenderer.h"
+#import "PolyphaseResampler.hpp"
+#import "FDNReverb.hpp"
 #import "AllocatedAudioBufferList.h"
+#import "RenderSlicer.h"
+#import "LockFreeQueue.h"
+#import "VectorKernels.h"
+#import "RenderTelemetry.h"
 
 #import <AudioToolbox/AudioToolbox.h>
+#import <mach/mach_time.h>
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include <string>
 #include <mutex>
+#include <cassert>
+
+// Set to 1 to render with the CPU panner even when the spatial mixer audio unit is available.
+#define USE_SOFTWARE_SPATIAL_RENDERER 0
+
+// Set to 1 to render headphone output with the HRTF convolver instead of the renderer's own binaural path.
+// Add measured responses to the app as `HRIR.bin` first; without them, the convolver falls back to a
+// spherical head model, which lacks the pinna cues of the spatial mixer's own HRTFs.
+#define USE_CONVOLUTION_BINAURAL_RENDERER 0
+
+// Set to 1 to render through a third-order ambisonic sound field that follows `setListenerOrientation`,
+// instead of the spatial mixer, which tracks the head itself.
+#define USE_AMBISONIC_RENDERER 0
+
+// The 7.1.4 input bed has 12 channels.
+constexpr UInt32 kInputChannelCount = 12;
 
 class AudioKernel {
     
 public:
     
-    AudioKernel(AUSpatialMixerOutputType outputType, double inSampleRate, double ioSampleRate, uint32_t maxBufferSize): mOutputBuffer(2, maxBufferSize)
+    // Every buffer holds `maxBufferSize` frames, so size it from the device's I/O buffer rather than
+    // the largest block a host could ask for; the kernel renders larger requests in slices.
+    // Pass a `bufferPool` to take the kernel's scratch buffers from it instead of the heap.
+    // Pass `offline` when something other than a device drives `process`, such as a render to a file.
+    // The CPU panner feeds a device with `deviceChannelCount` channels the largest speaker layout that fits.
+    AudioKernel(AUSpatialMixerOutputType outputType, double ioSampleRate, uint32_t maxBufferSize,
+                ResamplerQuality resamplerQuality = ResamplerQuality::Medium,
+                AudioBufferListPool * _Nullable bufferPool = nullptr,
+                bool offline = false,
+                UInt32 deviceChannelCount = 2)
+    : mIOSampleRate(ioSampleRate), mMaxBufferSize(maxBufferSize), mResamplerQuality(resamplerQuality),
+      mDeviceChannelCount(deviceChannelCount)
+    {
+        // Fall back to the CPU panner when the system doesn't provide the spatial mixer.
+        if (USE_AMBISONIC_RENDERER) {
+            mRenderer = std::make_unique<AmbisonicSpatialRenderer>();
+        }
+        else if (USE_SOFTWARE_SPATIAL_RENDERER || !AUSMRenderer::isAvailable()) {
+            mRenderer = std::make_unique<SoftwareSpatialRenderer>(speakerLayoutForChannelCount(deviceChannelCount));
+        }
+        else {
+            mRenderer = std::make_unique<AUSMRenderer>();
+        }
+        if (USE_CONVOLUTION_BINAURAL_RENDERER && !USE_AMBISONIC_RENDERER) {
+            mRenderer = std::make_unique<BinauralSpatialRenderer>(std::move(mRenderer));
+        }
+        
+        // Sources convert to the device rate before they reach the renderer,
+        // so the renderer always runs at the device rate and outlives them.
+        mRenderer->setOfflineRendering(offline);
+        mRenderer->setup(outputType, ioSampleRate, ioSampleRate, maxBufferSize);
+        
+        mTelemetry.setSampleRate(ioSampleRate);
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        mTelemetry.setNanosPerHostTick(double(timebase.numer) / double(timebase.denom));
+        
+        // Size the fallback buffer from the output format the mixer negotiated.
+        mOutputChannelCount = mRenderer->getOutputChannelCount();
+        mSlicer = RenderSlicer(makeBufferList(bufferPool, mOutputChannelCount, maxBufferSize));
+        
+        if (USE_FDN_REVERB) {
+            mReverb.setup(kReverbLineCount, ioSampleRate, mOutputChannelCount);
+            mReverbChannels.assign(mOutputChannelCount, nullptr);
+        }
+        
+        // Preallocate everything a source change needs on the render thread.
+        mFadeOutBuffer = makeBufferList(bufferPool, kInputChannelCount, maxBufferSize);
+        mFadeInBuffer = makeBufferList(bufferPool, kInputChannelCount, maxBufferSize);
+        mResamplerOutputs.assign(kInputChannelCount, nullptr);
+        mSourceBufferListStorage.assign(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * kInputChannelCount, 0);
+        
+        AudioKernel* kernel = this;
+        mRenderer->setAudioPullBlock(^(AudioBufferList * __nullable dstBufferList, size_t bufferSize) {
+            kernel->pullSources(dstBufferList, bufferSize);
+        });
+    }
+    
+    ~AudioKernel()
+    {
+        // The output unit no longer calls `process` by now, so release everything here.
+        Command command;
+        while (mCommands.pop(command)) {
+            if (command.type == CommandType::SetSource) {
+                releaseSource(command.source);
+            }
+        }
+        releaseSource(mCurrentSource);
+        releaseSource(mNextSource);
+        collectRetiredSources();
+    }
+    
+    AudioKernel(const AudioKernel&) = delete;
+    AudioKernel& operator=(const AudioKernel&) = delete;
+    
+    // MARK: - Commands
+    
+    // These functions run on the main thread or a notification thread, never the render thread.
+    // They queue a command that the render thread applies at the start of its next block,
+    // and return false if the queue is full.
+    
+    // Crossfades from the current source to `block`, which produces 12-channel audio at `sampleRate`.
+    // Pass nil to fade to silence, and `crossfade` false to cut over at the next block instead.
+    // The kernel keeps the block until the fade away from it finishes.
+    bool setSource(PullAudioBlock _Nullable block, double sampleRate, bool crossfade = true)
+    {
+        collectRetiredSources();
+        
+        // Build the source and its resampler here, because the render thread can't allocate.
+        Source source;
+        if (block != nil) {
+            source.block = (__bridge_retained void *)block;
+            if (sampleRate != mIOSampleRate) {
+                source.resampler = new PolyphaseResampler();
+                source.resampler->setup(kInputChannelCount, sampleRate, mIOSampleRate, mMaxBufferSize, mResamplerQuality);
+            }
+        }
+        
+        Command command;
+        command.type = CommandType::SetSource;
+        command.source = source;
+        command.crossfade = crossfade;
+        if (!pushCommand(command)) {
+            releaseSource(source);
+            return false;
+        }
+        return true;
+    }
+    
+    // Makes the part of the change that can lock or allocate, such as setting the spatial mixer's
+    // property, here; the render thread then only updates the renderer's state. Also returns false
+    // if the renderer rejects the output type.
+    bool setOutputType(AUSpatialMixerOutputType outputType)
+    {
+        collectRetiredSources();
+        
+        // The spatial mixer serializes property changes against its own render.
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        if (mRenderer->prepareOutputType(outputType) != noErr) {
+            return false;
+        }
+        Command command;
+        command.type = CommandType::SetOutputType;
+        command.outputType = outputType;
+        return mCommands.push(command);
+    }
+    
+    // Releases the sources the render thread has finished fading out.
+    void collectRetiredSources()
+    {
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        Source source;
+        while (mRetiredSources.pop(source)) {
+            releaseSource(source);
+        }
+    }
+    
+    UInt32 getOutputChannelCount() const
+    {
+        return mOutputChannelCount;
+    }
+    
+    // The device rate and channel count the kernel was built for. It can't change either while rendering.
+    double getSampleRate() const
+    {
+        return mIOSampleRate;
+    }
+    
+    UInt32 getDeviceChannelCount() const
+    {
+        return mDeviceChannelCount;
+    }
+    
+    // The renderer's delay from input to output for the current output type, in frames at the I/O rate.
+    UInt32 getLatencyFrames() const
+    {
+        return mRenderer->getLatencyFrames();
+    }
+    
+    // Passes the listener's head orientation to renderers that don't track the head themselves.
+    void setListenerOrientation(float yaw, float pitch, float roll)
     {
-        mAUSM.setup(outputType, inSampleRate, ioSampleRate, maxBufferSize);
+        mRenderer->setListenerOrientation(yaw, pitch, roll);
     }
     
-    void setAudioPullBlock(PullAudioBlock _Nullable block)
+    // Changes the reverb that follows renderers without their own. It applies at the next block.
+    void setReverbParameters(const FDNReverb::Parameters& parameters)
     {
-        mAUSM.setAudioPullBlock(block);
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        mReverb.setParameters(parameters);
     }
     
-    void setOutputType(AUSpatialMixerOutputType outputType)
+    FDNReverb::Parameters getReverbParameters() const
     {
-        mAUSM.setOutputType(outputType);
+        return mReverb.getParameters();
     }
     
     // MARK: - Process
@@ -45,25 +235,257 @@ public:
                      UInt32                            inNumberFrames,
                      AudioBufferList * __nullable    ioData)
     {
+        const auto startTime = RenderTelemetry::now();
         
-        // Set the byte size with the output audio buffer list.
-        for (UInt32 i = 0; i < mOutputBuffer.get()->mNumberBuffers; i++) {
-            mOutputBuffer.get()->mBuffers[i].mDataByteSize = inNumberFrames * sizeof(float);
-        }
-        
-        // Process the input frames with the audio unit spatial mixer.
-        mAUSM.process(mOutputBuffer.get(), inTimeStamp, inNumberFrames);
+        // Apply queued changes between blocks, so the renderer never changes during a render.
+        applyCommands();
         
-        // Copy the temporary buffer to the output.
-        for (UInt32 i = 0; i < mOutputBuffer.get()->mNumberBuffers; i++) {
-            memcpy(ioData->mBuffers[i].mData, mOutputBuffer.get()->mBuffers[i].mData, inNumberFrames * sizeof(float));
+        const auto err = render(inTimeStamp, inNumberFrames, ioData);
+        if (err != noErr) {
+            // Play silence rather than whatever the failed render left behind.
+            mTelemetry.recordRenderError(err);
+            RenderSlicer::silence(ioData, inNumberFrames);
         }
+        
+        const bool hasSampleTime = inTimeStamp != nullptr && (inTimeStamp->mFlags & kAudioTimeStampSampleTimeValid);
+        const bool hasHostTime = inTimeStamp != nullptr && (inTimeStamp->mFlags & kAudioTimeStampHostTimeValid);
+        mTelemetry.recordCallback(startTime, RenderTelemetry::now(),
+                                  hasSampleTime ? inTimeStamp->mSampleTime : -1,
+                                  hasHostTime ? inTimeStamp->mHostTime : 0,
+                                  inNumberFrames);
         return noErr;
     }
     
+    // Timing and error statistics for the render callback. Safe to read from any thread.
+    const RenderTelemetry& getTelemetry() const
+    {
+        return mTelemetry;
+    }
+    
 private:
-    AllocatedAudioBufferList mOutputBuffer;
-    AUSMRenderer mAUSM;
+    
+    OSStatus render(const AudioTimeStamp * __nullable inTimeStamp, UInt32 inNumberFrames, AudioBufferList * __nullable ioData)
+    {
+        return mSlicer.render(inTimeStamp, inNumberFrames, ioData,
+                              [this](AudioBufferList * __nonnull bufferList, const AudioTimeStamp * __nullable timeStamp, UInt32 frameCount) {
+            const auto err = mRenderer->process(bufferList, timeStamp, frameCount);
+            if (err == noErr) {
+                applyReverb(bufferList, frameCount);
+            }
+            return err;
+        });
+    }
+    
+    // Runs the reverb as a separate stage over the renderer's output.
+    void applyReverb(AudioBufferList * __nonnull bufferList, UInt32 inNumberFrames)
+    {
+        if (!USE_FDN_REVERB || mRenderer->usesInternalReverb()) {
+            return;
+        }
+        const auto channelCount = std::min<UInt32>(bufferList->mNumberBuffers, UInt32(mReverbChannels.size()));
+        for (UInt32 i = 0; i < channelCount; i++) {
+            mReverbChannels[i] = static_cast<float *>(bufferList->mBuffers[i].mData);
+        }
+        mReverb.process(mReverbChannels.data(), channelCount, inNumberFrames);
+    }
+    
+    // A source's pull block, retained as a plain pointer so the render thread never
+    // retains or releases it, and the resampler that converts it to the device rate.
+    struct Source
+    {
+        void* __nullable block{nullptr};
+        PolyphaseResampler* __nullable resampler{nullptr};
+    };
+    
+    enum class CommandType
+    {
+        SetOutputType,
+        SetSource
+    };
+    
+    struct Command
+    {
+        CommandType type{CommandType::SetOutputType};
+        AUSpatialMixerOutputType outputType{kSpatialMixerOutputType_ExternalSpeakers};
+        Source source;
+        bool crossfade{true};
+    };
+    
+    static AllocatedAudioBufferList makeBufferList(AudioBufferListPool * _Nullable pool, UInt32 channelCount, UInt32 frameCapacity)
+    {
+        if (pool != nullptr) {
+            auto bufferList = pool->acquire(channelCount, frameCapacity);
+            if (bufferList.get() != nullptr) {
+                return bufferList;
+            }
+        }
+        return AllocatedAudioBufferList(channelCount, frameCapacity);
+    }
+    
+    bool pushCommand(const Command& command)
+    {
+        // Serialize the control threads; the render thread only ever reads the queue.
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        return mCommands.push(command);
+    }
+    
+    static void releaseSource(Source& source)
+    {
+        if (source.block != nullptr) {
+            // Balance the retain from `setSource`.
+            (void)(__bridge_transfer PullAudioBlock)source.block;
+        }
+        delete source.resampler;
+        source = Source();
+    }
+    
+    void applyCommands()
+    {
+        Command command;
+        while (mCommands.front(command)) {
+            if (command.type == CommandType::SetSource) {
+                // Keep a new source waiting until the current crossfade finishes,
+                // so no more than two sources ever play at once.
+                if (mFadeFramesRemaining > 0) {
+                    break;
+                }
+                if (command.crossfade) {
+                    mNextSource = command.source;
+                    mFadeFramesRemaining = kCrossfadeFrames;
+                }
+                else {
+                    retireCurrentSource(command.source);
+                }
+            }
+            else {
+                mRenderer->applyOutputType(command.outputType);
+            }
+            mCommands.pop(command);
+        }
+    }
+    
+    // Fills the renderer's input with the current source, or a crossfade between two sources.
+    void pullSources(AudioBufferList * __nullable dstBufferList, size_t bufferSize)
+    {
+        if (dstBufferList == nullptr) {
+            return;
+        }
+        const auto frameCount = UInt32(bufferSize);
+        if (mFadeFramesRemaining == 0) {
+            pullSource(mCurrentSource, dstBufferList, frameCount);
+            return;
+        }
+        
+        AudioBufferList* fadeOut = mFadeOutBuffer.get();
+        AudioBufferList* fadeIn = mFadeInBuffer.get();
+        mFadeOutBuffer.setFrameCount(frameCount);
+        mFadeInBuffer.setFrameCount(frameCount);
+        pullSource(mCurrentSource, fadeOut, frameCount);
+        pullSource(mNextSource, fadeIn, frameCount);
+        
+        // Ramp linearly from the old source to the new one, and play only the
+        // new source for whatever's left of the block once the fade ends.
+        const auto fadeFrames = std::min(frameCount, mFadeFramesRemaining);
+        const float step = 1.0f / kCrossfadeFrames;
+        const float fadeInGain = float(kCrossfadeFrames - mFadeFramesRemaining) * step;
+        const auto channelCount = std::min(dstBufferList->mNumberBuffers, kInputChannelCount);
+        for (UInt32 i = 0; i < channelCount; i++) {
+            auto destination = static_cast<float *>(dstBufferList->mBuffers[i].mData);
+            auto oldChannel = static_cast<const float *>(fadeOut->mBuffers[i].mData);
+            auto newChannel = static_cast<const float *>(fadeIn->mBuffers[i].mData);
+            memset(destination, 0, fadeFrames * sizeof(float));
+            VectorKernels::mixRamped(destination, oldChannel, fadeFrames, 1.0f - fadeInGain, -step);
+            VectorKernels::mixRamped(destination, newChannel, fadeFrames, fadeInGain, step);
+            memcpy(destination + fadeFrames, newChannel + fadeFrames, (frameCount - fadeFrames) * sizeof(float));
+        }
+        
+        mFadeFramesRemaining -= fadeFrames;
+        if (mFadeFramesRemaining == 0) {
+            retireCurrentSource(mNextSource);
+            mNextSource = Source();
+        }
+    }
+    
+    void retireCurrentSource(const Source& replacement)
+    {
+        // Hand the old source back to a control thread to release. The queue can't
+        // fill up, because every command a control thread queues collects it first.
+        const bool retired = mRetiredSources.push(mCurrentSource);
+        assert(retired);
+        (void)retired;
+        mCurrentSource = replacement;
+    }
+    
+    void pullSource(const Source& source, AudioBufferList * __nonnull dstBufferList, UInt32 frameCount)
+    {
+        if (source.block == nullptr ||
+            (source.resampler != nullptr && dstBufferList->mNumberBuffers != kInputChannelCount)) {
+            for (UInt32 i = 0; i < dstBufferList->mNumberBuffers; i++) {
+                memset(dstBufferList->mBuffers[i].mData, 0, frameCount * sizeof(float));
+            }
+            return;
+        }
+        
+        if (source.resampler == nullptr) {
+            ((__bridge PullAudioBlock)source.block)(dstBufferList, frameCount);
+            return;
+        }
+        
+        // Put the resampler between the source and the renderer.
+        for (UInt32 i = 0; i < kInputChannelCount; i++) {
+            mResamplerOutputs[i] = static_cast<float *>(dstBufferList->mBuffers[i].mData);
+        }
+        mResamplingBlock = source.block;
+        source.resampler->process(mResamplerOutputs.data(), frameCount, pullResamplerInput, this);
+    }
+    
+    // Pulls the exact number of source frames the resampler asks for.
+    static void pullResamplerInput(void* context, float* const* channels, uint32_t channelCount, uint32_t frameCount)
+    {
+        auto kernel = static_cast<AudioKernel *>(context);
+        auto sourceBufferList = reinterpret_cast<AudioBufferList *>(kernel->mSourceBufferListStorage.data());
+        sourceBufferList->mNumberBuffers = channelCount;
+        for (UInt32 i = 0; i < channelCount; i++) {
+            sourceBufferList->mBuffers[i].mNumberChannels = 1;
+            sourceBufferList->mBuffers[i].mDataByteSize = frameCount * sizeof(float);
+            sourceBufferList->mBuffers[i].mData = channels[i];
+        }
+        ((__bridge PullAudioBlock)kernel->mResamplingBlock)(sourceBufferList, frameCount);
+    }
+    
+    // Sixteen lines give a dense tail and distinct taps for up to 16 output channels.
+    static constexpr uint32_t kReverbLineCount = 16;
+    
+    // About 43 ms at 48 kHz; long enough to hide the discontinuity, short enough to feel immediate.
+    static constexpr UInt32 kCrossfadeFrames = 2048;
+    
+    const double mIOSampleRate;
+    const uint32_t mMaxBufferSize;
+    const ResamplerQuality mResamplerQuality;
+    const UInt32 mDeviceChannelCount;
+    
+    UInt32 mOutputChannelCount{0};
+    RenderSlicer mSlicer;
+    std::unique_ptr<SpatialRenderer> mRenderer;
+    RenderTelemetry mTelemetry;
+    FDNReverb mReverb;
+    std::vector<float *> mReverbChannels;
+    
+    // Control threads to the render thread, and retired sources back again.
+    std::mutex mControlMutex;
+    LockFreeQueue<Command, 16> mCommands;
+    LockFreeQueue<Source, 32> mRetiredSources;
+    
+    // Render-thread state. `mNextSource` is only set while a crossfade runs.
+    Source mCurrentSource;
+    Source mNextSource;
+    UInt32 mFadeFramesRemaining{0};
+    AllocatedAudioBufferList mFadeOutBuffer;
+    AllocatedAudioBufferList mFadeInBuffer;
+    
+    void* __nullable mResamplingBlock{nullptr};
+    std::vector<float *> mResamplerOutputs;
+    std::vector<uint8_t> mSourceBufferListStorage;
     
 };
 
@@ -0,0 +1,39 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+An audio engine that renders one decoded file to several outputs at the same time.
+*/
+#import "AudioFileReader.h"
+
+#import <AudioToolbox/AudioToolbox.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Decodes a 7.1.4 file once and renders it to every output, each with its own output type,
+// device, and kernel. A decode thread keeps the shared buffer a little ahead of the fastest
+// output. Each device renders on its own I/O thread, and an output that falls behind skips
+// ahead rather than holding up the others.
+@interface FanOutEngine : NSObject
+
+- (nullable instancetype)initWithFile:(NSString *)filePath;
+
+@property (nonatomic, readonly) AudioFileReader * fileReader;
+@property (nonatomic, readonly) NSUInteger outputCount;
+
+// Adds an output that renders for `outputType`, and starts it if the engine is running.
+// On macOS, `deviceID` selects the device, and `kAudioObjectUnknown` selects the default output.
+// iOS has a single output route, so it ignores `deviceID`. Returns NO if the output can't open.
+- (BOOL)addOutputWithDeviceID:(uint32_t)deviceID outputType:(AUSpatialMixerOutputType)outputType;
+
+- (void)start;
+- (void)stop;
+
+// Frames an output skipped because it fell too far behind the others.
+- (uint64_t)droppedFramesForOutput:(NSUInteger)index;
+// Frames an output played as silence because the decode thread hadn't caught up.
+- (uint64_t)underrunFramesForOutput:(NSUInteger)index;
+
+@end
+
+NS_ASSUME_NONNULL_END
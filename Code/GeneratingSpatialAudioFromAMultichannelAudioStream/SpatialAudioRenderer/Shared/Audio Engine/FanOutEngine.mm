@@ -0,0 +1,204 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+An audio engine implementation that renders one decoded file to several outputs at the same time.
+*/
+#import "FanOutEngine.h"
+#import "AudioKernel.h"
+#import "OutputAU.hpp"
+#import "BroadcastRingBuffer.h"
+
+#include <pthread.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// The render block size when a device doesn't report its I/O buffer size.
+#define kFallbackBlockSize 4096
+
+// The shared buffer holds about 1.4 seconds at 48 kHz, which is how far an output can fall behind before it skips.
+constexpr size_t kSharedBufferFrames = 1 << 16;
+
+// How far the decode thread stays ahead of the fastest output, and how much it decodes at a time.
+constexpr uint64_t kDecodeLeadFrames = 4096;
+constexpr UInt32 kDecodeBlockFrames = 512;
+
+// How long the decode thread sleeps when it's far enough ahead.
+constexpr auto kDecodePollInterval = std::chrono::milliseconds(2);
+
+struct FanOutput
+{
+    std::unique_ptr<OutputAU> outputAU;
+    std::unique_ptr<AudioKernel> kernel;
+    uint32_t reader;
+};
+
+@implementation FanOutEngine
+{
+    std::unique_ptr<BroadcastRingBuffer> sharedBuffer;
+    std::vector<std::unique_ptr<FanOutput>> outputs;
+    std::thread decodeThread;
+    std::atomic<bool> decoding;
+    BOOL running;
+}
+
+- (nullable instancetype)initWithFile:(NSString *)filePath
+{
+    self = [super init];
+    if (self) {
+        _fileReader = [[AudioFileReader alloc] init:filePath];
+        if (_fileReader == nil) {
+            return nil;
+        }
+        sharedBuffer = std::make_unique<BroadcastRingBuffer>(kInputChannelCount, kSharedBufferFrames);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stop];
+
+    // The kernels' source blocks read the shared buffer, so release the kernels first.
+    outputs.clear();
+    sharedBuffer.reset();
+}
+
+- (NSUInteger)outputCount
+{
+    return outputs.size();
+}
+
+- (BOOL)addOutputWithDeviceID:(uint32_t)deviceID outputType:(AUSpatialMixerOutputType)outputType
+{
+    auto output = std::make_unique<FanOutput>();
+    try {
+#if TARGET_OS_OSX
+        output->outputAU = std::make_unique<OutputAU>(AudioDeviceID(deviceID));
+#else
+        output->outputAU = std::make_unique<OutputAU>();
+#endif
+    }
+    catch (const std::runtime_error&) {
+        return NO;
+    }
+
+    const auto reader = sharedBuffer->addReader();
+    if (reader < 0) {
+        return NO;
+    }
+    output->reader = uint32_t(reader);
+
+    // Each output's kernel converts the shared audio to its own device's rate, in blocks of its device's I/O buffer.
+    const auto bufferFrameSize = output->outputAU->getBufferFrameSize();
+    output->kernel = std::make_unique<AudioKernel>(outputType, output->outputAU->getSampleRate(), bufferFrameSize > 0 ? bufferFrameSize : kFallbackBlockSize,
+                                                   ResamplerQuality::Medium, nullptr, false, output->outputAU->getOutputChannelCount());
+
+    BroadcastRingBuffer * buffer = sharedBuffer.get();
+    const uint32_t readerIndex = output->reader;
+    PullAudioBlock sourceBlock = ^(AudioBufferList * __nullable dstBufferList, size_t bufferSize) {
+        if (dstBufferList == nullptr || dstBufferList->mNumberBuffers < kInputChannelCount) {
+            return;
+        }
+        float * channels[kInputChannelCount];
+        for (UInt32 i = 0; i < kInputChannelCount; i++) {
+            channels[i] = static_cast<float *>(dstBufferList->mBuffers[i].mData);
+        }
+        buffer->read(readerIndex, channels, bufferSize);
+    };
+    if (!output->kernel->setSource(sourceBlock, _fileReader.sampleRate, false)) {
+        sharedBuffer->removeReader(output->reader);
+        return NO;
+    }
+
+    output->outputAU->setCallback(output->kernel.get(), [] (void * __nullable inRefCon,
+                                                            AudioUnitRenderActionFlags * __nullable ioActionFlags,
+                                                            const AudioTimeStamp * __nullable inTimeStamp,
+                                                            UInt32                            inBusNumber,
+                                                            UInt32                            inNumberFrames,
+                                                            AudioBufferList * __nullable    ioData) {
+        return static_cast<AudioKernel *>(inRefCon)->process(inRefCon, ioActionFlags, inTimeStamp, inBusNumber, inNumberFrames, ioData);
+    });
+
+    if (running) {
+        output->outputAU->start();
+    }
+    outputs.push_back(std::move(output));
+    return YES;
+}
+
+// MARK: - Transport
+
+- (void)start
+{
+    if (running) {
+        return;
+    }
+    running = YES;
+
+    // Decode on a thread of its own, so no output's I/O thread ever waits on the file.
+    decoding.store(true);
+    BroadcastRingBuffer * buffer = sharedBuffer.get();
+    PullAudioBlock pullBlock = _fileReader.pullAudioBlock;
+    AudioFileReader * fileReader = _fileReader;
+    std::atomic<bool> * isDecoding = &decoding;
+    decodeThread = std::thread([buffer, pullBlock, fileReader, isDecoding] {
+        pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+
+        AllocatedAudioBufferList block(kInputChannelCount, kDecodeBlockFrames);
+        float * channels[kInputChannelCount];
+        for (UInt32 i = 0; i < kInputChannelCount; i++) {
+            channels[i] = static_cast<float *>(block.get()->mBuffers[i].mData);
+        }
+
+        while (isDecoding->load(std::memory_order_relaxed)) {
+            if (!buffer->hasReaders() || buffer->writePosition() - buffer->leadingReadPosition() >= kDecodeLeadFrames) {
+                std::this_thread::sleep_for(kDecodePollInterval);
+                continue;
+            }
+            block.setFrameCount(kDecodeBlockFrames);
+            for (UInt32 i = 0; i < kInputChannelCount; i++) {
+                memset(channels[i], 0, kDecodeBlockFrames * sizeof(float));
+            }
+            pullBlock(block.get(), kDecodeBlockFrames);
+            buffer->write(channels, kDecodeBlockFrames);
+        }
+        (void)fileReader;
+    });
+
+    for (auto& output : outputs) {
+        output->outputAU->start();
+    }
+}
+
+- (void)stop
+{
+    if (!running) {
+        return;
+    }
+    running = NO;
+
+    for (auto& output : outputs) {
+        output->outputAU->stop();
+    }
+    decoding.store(false);
+    if (decodeThread.joinable()) {
+        decodeThread.join();
+    }
+}
+
+// MARK: - Statistics
+
+- (uint64_t)droppedFramesForOutput:(NSUInteger)index
+{
+    return index < outputs.size() ? sharedBuffer->droppedFrames(outputs[index]->reader) : 0;
+}
+
+- (uint64_t)underrunFramesForOutput:(NSUInteger)index
+{
+    return index < outputs.size() ? sharedBuffer->underrunFrames(outputs[index]->reader) : 0;
+}
+
+@end
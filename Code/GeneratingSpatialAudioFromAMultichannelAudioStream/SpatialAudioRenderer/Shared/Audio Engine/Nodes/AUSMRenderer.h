@@ -8,6 +8,7 @@ A wrapper around the spatial mixer audio unit.
 #define AUSMRenderer_hpp
 
 #include "CoreAudioHelpers.h"
+#include "SpatialRenderer.h"
 
 #import <AudioUnit/AudioUnit.h>
 #import <AVFoundation/AVFoundation.h>
@@ -16,31 +17,44 @@ A wrapper around the spatial mixer audio unit.
 #include <cstdio>
 #include <optional>
 
-class AUSMRenderer
+class AUSMRenderer : public SpatialRenderer
 {
 
 public:
+    // Returns whether the system provides the spatial mixer audio unit.
+    static bool isAvailable();
+
     AUSMRenderer();
     AUSMRenderer(const AUSMRenderer& other) = delete;
     AUSMRenderer& operator=(const AUSMRenderer& other) = delete;
-    ~AUSMRenderer();
+    ~AUSMRenderer() override;
 
     AudioUnit _Nonnull & getAU();
     
     // A function to set up the channel layout and stream format.
     OSStatus setStreamFormatAndACL(float inSampleRate, AudioChannelLayoutTag inLayoutTag, AudioUnitScope inScope, AudioUnitElement inElement);
 
-    // A function to set the output type and determine the spatialization algorithm to use for rendering.
-    OSStatus setOutputType(AUSpatialMixerOutputType outputType);
+    // Sets the unit's output type, which determines the spatialization algorithm to use for rendering.
+    // The unit serializes the change against its render, so the render thread has nothing left to apply.
+    OSStatus prepareOutputType(AUSpatialMixerOutputType outputType) override;
     OSStatus setupInputCallback();
-    void setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize);
+    void setOfflineRendering(bool offline) override;
+    void setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize) override;
+
+    // The number of deinterleaved channels in the negotiated output format.
+    UInt32 getOutputChannelCount() override;
+
+    bool usesInternalReverb() override;
+    UInt32 getLatencyFrames() override;
 
-    void setAudioPullBlock(PullAudioBlock _Nullable block);
-    void process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames);
+    void setAudioPullBlock(PullAudioBlock _Nullable block) override;
+    OSStatus process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames) override;
 
 private:
     AudioUnit _Nonnull mAU;
     PullAudioBlock __nullable mInputBlock;
+    bool mOfflineRendering{false};
+    float mOutputSampleRate{0};
 };
 
 #endif /* AUSMRenderer */
@@ -8,14 +8,20 @@ A wrapper around the spatial mixer audio unit.
 
 #define USE_MEDIA_PLAYBACK_FACTORY_PRESET 1
 
+static constexpr AudioComponentDescription kSpatialMixerDescription = {kAudioUnitType_Mixer,
+                                                                       kAudioUnitSubType_SpatialMixer,
+                                                                       kAudioUnitManufacturer_Apple,
+                                                                       0,
+                                                                       0};
+
+bool AUSMRenderer::isAvailable()
+{
+    return AudioComponentFindNext(NULL, &kSpatialMixerDescription) != nullptr;
+}
+
 AUSMRenderer::AUSMRenderer()
 {
-    AudioComponentDescription auDescription = {kAudioUnitType_Mixer,
-                                               kAudioUnitSubType_SpatialMixer,
-                                               kAudioUnitManufacturer_Apple,
-                                               0,
-                                               0};
-    AudioComponent comp = AudioComponentFindNext(NULL, &auDescription);
+    AudioComponent comp = AudioComponentFindNext(NULL, &kSpatialMixerDescription);
     assert(comp);
     
     OSStatus err = AudioComponentInstanceNew(comp, &mAU);
@@ -72,7 +78,7 @@ OSStatus AUSMRenderer::setStreamFormatAndACL(float inSampleRate,
 }
 
 // Set the output type to determine what spatialization algorithm to use for rendering.
-OSStatus AUSMRenderer::setOutputType(AUSpatialMixerOutputType outputType)
+OSStatus AUSMRenderer::prepareOutputType(AUSpatialMixerOutputType outputType)
 {
     OSStatus err = AudioUnitSetProperty(mAU,
                                         kAudioUnitProperty_SpatialMixerOutputType,
@@ -115,9 +121,15 @@ OSStatus AUSMRenderer::setupInputCallback()
     return status;
 }
 
+void AUSMRenderer::setOfflineRendering(bool offline)
+{
+    mOfflineRendering = offline;
+}
+
 void AUSMRenderer::setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize)
 {
     OSStatus err = noErr;
+    mOutputSampleRate = inOutputSampleRate;
     
     // Set the number of input elements (buses).
     UInt32 numInputs = 1;
@@ -168,7 +180,8 @@ void AUSMRenderer::setup(AUSpatialMixerOutputType outputType, float inInputSampl
     err = setOutputType(outputType);
     assert(err == noErr);
     
-    if (outputType == kSpatialMixerOutputType_Headphones) {
+    // Head tracking follows the listener in real time, so an offline render leaves it off.
+    if (outputType == kSpatialMixerOutputType_Headphones && !mOfflineRendering) {
 
 #if !TARGET_OS_SIMULATOR && (TARGET_OS_OSX || TARGET_OS_IOS || TARGET_OS_TV)
         
@@ -233,7 +246,7 @@ void AUSMRenderer::setup(AUSpatialMixerOutputType outputType, float inInputSampl
         err = AudioUnitSetProperty(mAU, kAudioUnitProperty_PresentPreset, kAudioUnitScope_Global, 0, &preset, sizeof(AUPreset));
     }
     
-#else
+#elif !USE_FDN_REVERB
     
     // Enable a reverb effect.
     UInt32 enableReverb = 1;
@@ -255,20 +268,53 @@ void AUSMRenderer::setup(AUSpatialMixerOutputType outputType, float inInputSampl
     err = setupInputCallback();
     assert(err == noErr);
     
+    // Let the unit use its highest-quality processing when it doesn't need to keep up with a device.
+    if (mOfflineRendering) {
+        UInt32 offlineRender = 1;
+        err = AudioUnitSetProperty(mAU, kAudioUnitProperty_OfflineRender, kAudioUnitScope_Global, 0, &offlineRender, sizeof(offlineRender));
+        assert(err == noErr);
+    }
+    
     // Initialize the audio unit.
     err = AudioUnitInitialize(mAU);
     assert(err == noErr);
 }
 
+UInt32 AUSMRenderer::getOutputChannelCount()
+{
+    AudioStreamBasicDescription asbd = {};
+    UInt32 size = sizeof(asbd);
+    OSStatus err = AudioUnitGetProperty(mAU, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &asbd, &size);
+    if (err != noErr) {
+        return 0;
+    }
+    return asbd.mChannelsPerFrame;
+}
+
+bool AUSMRenderer::usesInternalReverb()
+{
+    // The factory preset brings its own reverb; otherwise the kernel adds one.
+    return USE_MEDIA_PLAYBACK_FACTORY_PRESET || !USE_FDN_REVERB;
+}
+
+UInt32 AUSMRenderer::getLatencyFrames()
+{
+    Float64 latency = 0;
+    UInt32 size = sizeof(latency);
+    if (AudioUnitGetProperty(mAU, kAudioUnitProperty_Latency, kAudioUnitScope_Global, 0, &latency, &size) != noErr) {
+        return 0;
+    }
+    return UInt32(latency * mOutputSampleRate + 0.5);
+}
+
 void AUSMRenderer::setAudioPullBlock(PullAudioBlock _Nullable block)
 {
     mInputBlock = block;
 }
 
-void AUSMRenderer::process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames)
+OSStatus AUSMRenderer::process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames)
 {
     // Process the audio unit spatial mixer.
     AudioUnitRenderActionFlags  actionFlags = {};
-    auto err = AudioUnitRender(mAU, &actionFlags, inTimeStamp, 0, inNumberFrames, outputABL);
-    assert(err == noErr);
+    return AudioUnitRender(mAU, &actionFlags, inTimeStamp, 0, inNumberFrames, outputABL);
 }
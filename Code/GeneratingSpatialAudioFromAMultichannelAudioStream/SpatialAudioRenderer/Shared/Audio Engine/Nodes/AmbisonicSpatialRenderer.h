@@ -0,0 +1,56 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A spatial renderer that renders through a head-tracked third-order ambisonic sound field.
+*/
+#ifndef AmbisonicSpatialRenderer_h
+#define AmbisonicSpatialRenderer_h
+
+#include "SpatialRenderer.h"
+#include "Ambisonics.hpp"
+#include "AllocatedAudioBufferList.h"
+
+#include <vector>
+
+// Encodes the bed into a sound field once, rotates the field to follow the listener's head,
+// and decodes it to headphones or stereo speakers. The head rotation costs the same however
+// many sources the field holds. The LFE channel goes around the field to every output.
+class AmbisonicSpatialRenderer : public SpatialRenderer
+{
+
+public:
+    AmbisonicSpatialRenderer() = default;
+    AmbisonicSpatialRenderer(const AmbisonicSpatialRenderer& other) = delete;
+    AmbisonicSpatialRenderer& operator=(const AmbisonicSpatialRenderer& other) = delete;
+
+    void applyOutputType(AUSpatialMixerOutputType outputType) override;
+    void setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize) override;
+    UInt32 getOutputChannelCount() override;
+    UInt32 getLatencyFrames() override;
+    void setListenerOrientation(float yaw, float pitch, float roll) override;
+
+    void setAudioPullBlock(PullAudioBlock _Nullable block) override;
+    OSStatus process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames) override;
+
+    static constexpr UInt32 kPartitionFrames = 128;
+
+private:
+    AmbisonicEncoder mEncoder;
+    AmbisonicRotator mRotator;
+    AmbisonicDecoder mBinauralDecoder;
+    AmbisonicDecoder mSpeakerDecoder;
+    PullAudioBlock __nullable mInputBlock;
+    AUSpatialMixerOutputType mOutputType{kSpatialMixerOutputType_Headphones};
+    int32_t mLFEChannel{-1};
+
+    AllocatedAudioBufferList mBedBuffer;
+    AllocatedAudioBufferList mFieldBuffer;
+    AllocatedAudioBufferList mRotatedFieldBuffer;
+    std::vector<float*> mBedPointers;
+    std::vector<float*> mFieldPointers;
+    std::vector<float*> mRotatedFieldPointers;
+    std::vector<float*> mOutputPointers;
+};
+
+#endif /* AmbisonicSpatialRenderer_h */
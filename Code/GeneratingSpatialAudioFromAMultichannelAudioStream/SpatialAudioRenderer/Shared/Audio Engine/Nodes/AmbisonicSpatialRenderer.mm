@@ -0,0 +1,125 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A spatial renderer implementation that renders through a head-tracked third-order ambisonic sound field.
+*/
+#import "AmbisonicSpatialRenderer.h"
+#import "VectorKernels.h"
+
+#import <Foundation/Foundation.h>
+
+#include <algorithm>
+
+// The 7.1.4 bed has 12 channels.
+constexpr UInt32 kBedChannelCount = 12;
+
+// The gain for the LFE channel, which mixes into every output.
+constexpr float kLFEGain = 0.5f;
+
+void AmbisonicSpatialRenderer::applyOutputType(AUSpatialMixerOutputType outputType)
+{
+    // Built-in and external speakers both get the stereo speaker decode.
+    mOutputType = outputType;
+}
+
+void AmbisonicSpatialRenderer::setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize)
+{
+    // The field doesn’t resample; the kernel converts the input to the output rate first.
+    assert(inInputSampleRate == inOutputSampleRate);
+
+    setOutputType(outputType);
+
+    const auto bed = speakerPositions(SpeakerLayout::Atmos_7_1_4);
+    mEncoder.setup(bed);
+    mLFEChannel = -1;
+    for (UInt32 i = 0; i < bed.size(); i++) {
+        if (bed[i].isLFE) {
+            mLFEChannel = int32_t(i);
+        }
+    }
+
+    HRIRSet hrirs;
+    NSString * path = [[NSBundle mainBundle] pathForResource:@"HRIR" ofType:@"bin"];
+    if (path != nil && hrirs.load(path.UTF8String)) {
+        hrirs.resample(inOutputSampleRate);
+    }
+    else {
+        hrirs = HRIRSet::sphericalHead(inOutputSampleRate);
+    }
+    mBinauralDecoder.setupBinaural(hrirs, kPartitionFrames);
+    mSpeakerDecoder.setupSpeakers(SpeakerLayout::Stereo);
+
+    mBedBuffer = AllocatedAudioBufferList(kBedChannelCount, inMaxFrameSize);
+    mFieldBuffer = AllocatedAudioBufferList(Ambisonics::kChannelCount, inMaxFrameSize);
+    mRotatedFieldBuffer = AllocatedAudioBufferList(Ambisonics::kChannelCount, inMaxFrameSize);
+    mBedPointers.assign(kBedChannelCount, nullptr);
+    mFieldPointers.assign(Ambisonics::kChannelCount, nullptr);
+    mRotatedFieldPointers.assign(Ambisonics::kChannelCount, nullptr);
+    mOutputPointers.assign(getOutputChannelCount(), nullptr);
+}
+
+UInt32 AmbisonicSpatialRenderer::getOutputChannelCount()
+{
+    // Match the spatial mixer's stereo output.
+    return 2;
+}
+
+UInt32 AmbisonicSpatialRenderer::getLatencyFrames()
+{
+    return mOutputType == kSpatialMixerOutputType_Headphones ? mBinauralDecoder.getLatencyFrames() : mSpeakerDecoder.getLatencyFrames();
+}
+
+void AmbisonicSpatialRenderer::setListenerOrientation(float yaw, float pitch, float roll)
+{
+    mRotator.setOrientation(yaw, pitch, roll);
+}
+
+void AmbisonicSpatialRenderer::setAudioPullBlock(PullAudioBlock _Nullable block)
+{
+    mInputBlock = block;
+}
+
+OSStatus AmbisonicSpatialRenderer::process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames)
+{
+    const auto frameCount = UInt32(inNumberFrames);
+    if (outputABL == nullptr || frameCount > mBedBuffer.getFrameCapacity()) {
+        return kAudio_ParamError;
+    }
+
+    AudioBufferList* bed = mBedBuffer.get();
+    AudioBufferList* field = mFieldBuffer.get();
+    AudioBufferList* rotatedField = mRotatedFieldBuffer.get();
+    mBedBuffer.setFrameCount(frameCount);
+    mFieldBuffer.setFrameCount(frameCount);
+    mRotatedFieldBuffer.setFrameCount(frameCount);
+    for (UInt32 i = 0; i < kBedChannelCount; i++) {
+        memset(bed->mBuffers[i].mData, 0, frameCount * sizeof(float));
+        mBedPointers[i] = static_cast<float *>(bed->mBuffers[i].mData);
+    }
+    for (UInt32 i = 0; i < Ambisonics::kChannelCount; i++) {
+        memset(field->mBuffers[i].mData, 0, frameCount * sizeof(float));
+        mFieldPointers[i] = static_cast<float *>(field->mBuffers[i].mData);
+        mRotatedFieldPointers[i] = static_cast<float *>(rotatedField->mBuffers[i].mData);
+    }
+    if (mInputBlock != nil) {
+        mInputBlock(bed, frameCount);
+    }
+
+    mEncoder.process(mBedPointers.data(), kBedChannelCount, mFieldPointers.data(), frameCount);
+    mRotator.process(mFieldPointers.data(), mRotatedFieldPointers.data(), frameCount);
+
+    const auto outputCount = std::min<UInt32>(outputABL->mNumberBuffers, UInt32(mOutputPointers.size()));
+    for (UInt32 i = 0; i < outputCount; i++) {
+        mOutputPointers[i] = static_cast<float *>(outputABL->mBuffers[i].mData);
+    }
+    auto& decoder = (mOutputType == kSpatialMixerOutputType_Headphones) ? mBinauralDecoder : mSpeakerDecoder;
+    decoder.process(mRotatedFieldPointers.data(), mOutputPointers.data(), outputCount, frameCount);
+
+    if (mLFEChannel >= 0) {
+        for (UInt32 i = 0; i < outputCount; i++) {
+            VectorKernels::mix(mOutputPointers[i], mBedPointers[mLFEChannel], frameCount, kLFEGain);
+        }
+    }
+    return noErr;
+}
@@ -0,0 +1,420 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements portable third-order ambisonic encoding, rotation, and decoding.
+*/
+#include "Ambisonics.hpp"
+#include "VectorKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+using Ambisonics::kChannelCount;
+using Ambisonics::kOrder;
+
+namespace {
+
+// Enough virtual speakers to sample a third-order field evenly.
+constexpr uint32_t kVirtualSpeakerCount = 50;
+
+// Directions that check the speaker decode's loudness.
+constexpr uint32_t kNormalizationPointCount = 400;
+
+// Where each order's block starts in `AmbisonicRotator::Matrix`.
+constexpr uint32_t kBlockOffsets[kOrder + 1] = {0, 1, 10, 35};
+
+// Returns `count` nearly uniform directions on the sphere, as azimuth and elevation.
+std::vector<std::array<float, 2>> fibonacciSphere(uint32_t count)
+{
+    const double goldenAngle = M_PI * (3.0 - std::sqrt(5.0));
+    std::vector<std::array<float, 2>> points;
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto z = 1.0 - (2.0 * i + 1.0) / count;
+        const auto azimuth = std::remainder(i * goldenAngle, 2.0 * M_PI);
+        points.push_back({float(azimuth * 180.0 / M_PI), float(std::asin(z) * 180.0 / M_PI)});
+    }
+    return points;
+}
+
+// Evaluates the harmonics for a unit vector with x to the front, y to the left, and z up.
+void evaluateVector(double x, double y, double z, float* c)
+{
+    const double sqrt3 = std::sqrt(3.0);
+    const double sqrt15 = std::sqrt(15.0);
+    const double sqrt5_8 = std::sqrt(5.0 / 8.0);
+    const double sqrt3_8 = std::sqrt(3.0 / 8.0);
+    c[0] = 1.0f;
+    c[1] = float(y);
+    c[2] = float(z);
+    c[3] = float(x);
+    c[4] = float(sqrt3 * x * y);
+    c[5] = float(sqrt3 * y * z);
+    c[6] = float(0.5 * (3.0 * z * z - 1.0));
+    c[7] = float(sqrt3 * x * z);
+    c[8] = float(0.5 * sqrt3 * (x * x - y * y));
+    c[9] = float(sqrt5_8 * y * (3.0 * x * x - y * y));
+    c[10] = float(sqrt15 * x * y * z);
+    c[11] = float(sqrt3_8 * y * (5.0 * z * z - 1.0));
+    c[12] = float(0.5 * z * (5.0 * z * z - 3.0));
+    c[13] = float(sqrt3_8 * x * (5.0 * z * z - 1.0));
+    c[14] = float(0.5 * sqrt15 * z * (x * x - y * y));
+    c[15] = float(sqrt5_8 * x * (x * x - 3.0 * y * y));
+}
+
+std::array<double, 3> unitVector(float azimuth, float elevation)
+{
+    // Ambisonic azimuth runs counterclockwise, the opposite of `SpeakerPosition`.
+    const auto a = -azimuth * M_PI / 180.0;
+    const auto e = elevation * M_PI / 180.0;
+    return {std::cos(e) * std::cos(a), std::cos(e) * std::sin(a), std::sin(e)};
+}
+
+// Returns the pseudo-inverse, [point][channel], of the harmonics at `points`: Yᵀ (Y Yᵀ)⁻¹.
+std::vector<float> pseudoInverse(const std::vector<std::array<float, 2>>& points)
+{
+    const auto count = points.size();
+    std::vector<double> harmonics(count * kChannelCount);
+    float c[kChannelCount];
+    for (size_t p = 0; p < count; ++p) {
+        Ambisonics::evaluate(points[p][0], points[p][1], c);
+        std::copy_n(c, kChannelCount, harmonics.begin() + p * kChannelCount);
+    }
+
+    // Invert the Gram matrix with Gauss-Jordan elimination.
+    constexpr auto n = kChannelCount;
+    std::vector<double> gram(n * n, 0.0), inverse(n * n, 0.0);
+    for (uint32_t i = 0; i < n; ++i) {
+        inverse[i * n + i] = 1.0;
+        for (uint32_t j = 0; j < n; ++j) {
+            for (size_t p = 0; p < count; ++p) {
+                gram[i * n + j] += harmonics[p * n + i] * harmonics[p * n + j];
+            }
+        }
+    }
+    for (uint32_t column = 0; column < n; ++column) {
+        uint32_t pivot = column;
+        for (uint32_t row = column + 1; row < n; ++row) {
+            if (std::fabs(gram[row * n + column]) > std::fabs(gram[pivot * n + column])) {
+                pivot = row;
+            }
+        }
+        for (uint32_t j = 0; j < n; ++j) {
+            std::swap(gram[column * n + j], gram[pivot * n + j]);
+            std::swap(inverse[column * n + j], inverse[pivot * n + j]);
+        }
+        const auto scale = 1.0 / gram[column * n + column];
+        for (uint32_t j = 0; j < n; ++j) {
+            gram[column * n + j] *= scale;
+            inverse[column * n + j] *= scale;
+        }
+        for (uint32_t row = 0; row < n; ++row) {
+            const auto factor = gram[row * n + column];
+            if (row == column || factor == 0.0) {
+                continue;
+            }
+            for (uint32_t j = 0; j < n; ++j) {
+                gram[row * n + j] -= factor * gram[column * n + j];
+                inverse[row * n + j] -= factor * inverse[column * n + j];
+            }
+        }
+    }
+
+    std::vector<float> result(count * n, 0.0f);
+    for (size_t p = 0; p < count; ++p) {
+        for (uint32_t j = 0; j < n; ++j) {
+            double sum = 0;
+            for (uint32_t i = 0; i < n; ++i) {
+                sum += harmonics[p * n + i] * inverse[i * n + j];
+            }
+            result[p * n + j] = float(sum);
+        }
+    }
+    return result;
+}
+
+// The per-order weights that concentrate a decoded source's energy in its direction,
+// after Zotter and Frank, "All-Round Ambisonic Panning and Decoding", 2012.
+std::array<float, kOrder + 1> maxREWeights()
+{
+    const auto x = std::cos(137.9 * M_PI / 180.0 / (kOrder + 1.51));
+    std::array<float, kOrder + 1> weights;
+    double previous = 1.0;
+    double current = x;
+    weights[0] = 1.0f;
+    weights[1] = float(x);
+    for (uint32_t l = 1; l < kOrder; ++l) {
+        // The Legendre recurrence.
+        const auto next = ((2 * l + 1) * x * current - l * previous) / (l + 1);
+        previous = current;
+        current = next;
+        weights[l + 1] = float(current);
+    }
+    return weights;
+}
+
+uint32_t orderOfChannel(uint32_t channel)
+{
+    return uint32_t(std::sqrt(float(channel)));
+}
+
+} // namespace
+
+void Ambisonics::evaluate(float azimuth, float elevation, float* coefficients)
+{
+    const auto v = unitVector(azimuth, elevation);
+    evaluateVector(v[0], v[1], v[2], coefficients);
+}
+
+// MARK: - AmbisonicEncoder
+
+void AmbisonicEncoder::setup(const std::vector<SpeakerPosition>& positions)
+{
+    mSources.clear();
+    for (const auto& position : positions) {
+        auto source = std::make_unique<Source>();
+        source->isLFE = position.isLFE;
+        source->azimuth = position.azimuth;
+        source->elevation = position.elevation;
+        Ambisonics::evaluate(position.azimuth, position.elevation, source->gains.data());
+        source->appliedVersion = source->version.load();
+        mSources.push_back(std::move(source));
+    }
+}
+
+void AmbisonicEncoder::setSourcePosition(uint32_t source, float azimuth, float elevation)
+{
+    if (source >= mSources.size()) {
+        return;
+    }
+    mSources[source]->azimuth.store(azimuth, std::memory_order_relaxed);
+    mSources[source]->elevation.store(elevation, std::memory_order_relaxed);
+    mSources[source]->version.fetch_add(1, std::memory_order_release);
+}
+
+void AmbisonicEncoder::process(const float* const* sources, uint32_t sourceCount, float* const* field, uint32_t frameCount)
+{
+    const auto count = std::min<uint32_t>(sourceCount, uint32_t(mSources.size()));
+    for (uint32_t s = 0; s < count; ++s) {
+        auto& source = *mSources[s];
+        if (source.isLFE) {
+            continue;
+        }
+
+        const auto version = source.version.load(std::memory_order_acquire);
+        if (version == source.appliedVersion) {
+            for (uint32_t c = 0; c < kChannelCount; ++c) {
+                VectorKernels::mix(field[c], sources[s], frameCount, source.gains[c]);
+            }
+            continue;
+        }
+
+        // Ramp to the new position's gains over this block.
+        std::array<float, kChannelCount> target;
+        Ambisonics::evaluate(source.azimuth.load(std::memory_order_relaxed),
+                             source.elevation.load(std::memory_order_relaxed),
+                             target.data());
+        for (uint32_t c = 0; c < kChannelCount; ++c) {
+            VectorKernels::mixRamped(field[c], sources[s], frameCount, source.gains[c], (target[c] - source.gains[c]) / frameCount);
+        }
+        source.gains = target;
+        source.appliedVersion = version;
+    }
+}
+
+// MARK: - AmbisonicRotator
+
+AmbisonicRotator::AmbisonicRotator()
+{
+    const auto points = fibonacciSphere(kProjectionPointCount);
+    mProjection = pseudoInverse(points);
+    for (const auto& point : points) {
+        const auto v = unitVector(point[0], point[1]);
+        mProjectionPoints.push_back({float(v[0]), float(v[1]), float(v[2])});
+    }
+    computeMatrix(0, 0, 0, mCurrent);
+    mTarget = mCurrent;
+}
+
+void AmbisonicRotator::setOrientation(float yaw, float pitch, float roll)
+{
+    mYaw.store(yaw, std::memory_order_relaxed);
+    mPitch.store(pitch, std::memory_order_relaxed);
+    mRoll.store(roll, std::memory_order_relaxed);
+    mVersion.fetch_add(1, std::memory_order_release);
+}
+
+void AmbisonicRotator::computeMatrix(float yaw, float pitch, float roll, Matrix& matrix) const
+{
+    // The head's axes in the field's coordinates: turning right is clockwise about z,
+    // looking up turns the front toward z, and rolling right lifts the left axis.
+    const auto a = -yaw * M_PI / 180.0;
+    const auto b = -pitch * M_PI / 180.0;
+    const auto g = roll * M_PI / 180.0;
+    const double rz[3][3] = {{std::cos(a), -std::sin(a), 0}, {std::sin(a), std::cos(a), 0}, {0, 0, 1}};
+    const double ry[3][3] = {{std::cos(b), 0, std::sin(b)}, {0, 1, 0}, {-std::sin(b), 0, std::cos(b)}};
+    const double rx[3][3] = {{1, 0, 0}, {0, std::cos(g), -std::sin(g)}, {0, std::sin(g), std::cos(g)}};
+    double zy[3][3] = {};
+    double head[3][3] = {};
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            for (int k = 0; k < 3; ++k) {
+                zy[i][j] += rz[i][k] * ry[k][j];
+            }
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            for (int k = 0; k < 3; ++k) {
+                head[i][j] += zy[i][k] * rx[k][j];
+            }
+        }
+    }
+
+    // A field direction `d` appears at `headᵀ d` to the listener. The rotated harmonics at the
+    // projection points, times the pseudo-inverse, map each order's coefficients to the rotated ones.
+    std::vector<std::array<float, kChannelCount>> rotated(mProjectionPoints.size());
+    for (size_t p = 0; p < mProjectionPoints.size(); ++p) {
+        const auto& d = mProjectionPoints[p];
+        evaluateVector(head[0][0] * d[0] + head[1][0] * d[1] + head[2][0] * d[2],
+                       head[0][1] * d[0] + head[1][1] * d[1] + head[2][1] * d[2],
+                       head[0][2] * d[0] + head[1][2] * d[1] + head[2][2] * d[2],
+                       rotated[p].data());
+    }
+    for (uint32_t l = 0; l <= kOrder; ++l) {
+        const auto first = l * l;
+        const auto size = 2 * l + 1;
+        for (uint32_t row = 0; row < size; ++row) {
+            for (uint32_t column = 0; column < size; ++column) {
+                double sum = 0;
+                for (size_t p = 0; p < mProjectionPoints.size(); ++p) {
+                    sum += double(rotated[p][first + row]) * mProjection[p * kChannelCount + first + column];
+                }
+                matrix[kBlockOffsets[l] + row * size + column] = float(sum);
+            }
+        }
+    }
+}
+
+void AmbisonicRotator::process(const float* const* input, float* const* output, uint32_t frameCount)
+{
+    const auto version = mVersion.load(std::memory_order_acquire);
+    const bool changed = version != mAppliedVersion;
+    if (changed) {
+        computeMatrix(mYaw.load(std::memory_order_relaxed),
+                      mPitch.load(std::memory_order_relaxed),
+                      mRoll.load(std::memory_order_relaxed),
+                      mTarget);
+        mAppliedVersion = version;
+    }
+
+    const float step = 1.0f / frameCount;
+    for (uint32_t l = 0; l <= kOrder; ++l) {
+        const auto first = l * l;
+        const auto size = 2 * l + 1;
+        for (uint32_t row = 0; row < size; ++row) {
+            float* destination = output[first + row];
+            memset(destination, 0, frameCount * sizeof(float));
+            for (uint32_t column = 0; column < size; ++column) {
+                const auto index = kBlockOffsets[l] + row * size + column;
+                const float* source = input[first + column];
+                if (!changed) {
+                    VectorKernels::mix(destination, source, frameCount, mCurrent[index]);
+                    continue;
+                }
+                // Crossfade from the old rotation to the new one.
+                VectorKernels::mixRamped(destination, source, frameCount, mCurrent[index], -mCurrent[index] * step);
+                VectorKernels::mixRamped(destination, source, frameCount, 0.0f, mTarget[index] * step);
+            }
+        }
+    }
+    if (changed) {
+        mCurrent = mTarget;
+    }
+}
+
+// MARK: - AmbisonicDecoder
+
+void AmbisonicDecoder::setupSpeakers(SpeakerLayout layout)
+{
+    mBinaural = false;
+
+    const auto virtualSpeakers = fibonacciSphere(kVirtualSpeakerCount);
+    const auto decode = pseudoInverse(virtualSpeakers);
+    const auto weights = maxREWeights();
+
+    SpatialPanner panner;
+    panner.setup(layout, 1);
+    const auto speakerCount = panner.getOutputChannelCount();
+    mOutputChannelCount = speakerCount;
+    mMatrix.assign(speakerCount * kChannelCount, 0.0f);
+
+    std::vector<float> gains(speakerCount);
+    for (uint32_t v = 0; v < kVirtualSpeakerCount; ++v) {
+        panner.computeGains(virtualSpeakers[v][0], virtualSpeakers[v][1], gains.data());
+        for (uint32_t s = 0; s < speakerCount; ++s) {
+            for (uint32_t c = 0; c < kChannelCount; ++c) {
+                mMatrix[s * kChannelCount + c] += gains[s] * decode[v * kChannelCount + c] * weights[orderOfChannel(c)];
+            }
+        }
+    }
+
+    // Scale the decode so that a source has unit power on average, like the panner's.
+    double power = 0;
+    float c[kChannelCount];
+    for (const auto& point : fibonacciSphere(kNormalizationPointCount)) {
+        Ambisonics::evaluate(point[0], point[1], c);
+        for (uint32_t s = 0; s < speakerCount; ++s) {
+            const auto gain = VectorKernels::dotProduct(mMatrix.data() + s * kChannelCount, c, kChannelCount);
+            power += gain * gain;
+        }
+    }
+    VectorKernels::scale(mMatrix.data(), mMatrix.size(), float(1.0 / std::sqrt(power / kNormalizationPointCount)));
+}
+
+void AmbisonicDecoder::setupBinaural(const HRIRSet& hrirs, uint32_t partitionFrames)
+{
+    mBinaural = true;
+    mOutputChannelCount = 2;
+
+    const auto virtualSpeakers = fibonacciSphere(kVirtualSpeakerCount);
+    const auto decode = pseudoInverse(virtualSpeakers);
+    std::vector<std::vector<float>> left(kChannelCount, std::vector<float>(hrirs.getLength(), 0.0f));
+    std::vector<std::vector<float>> right(kChannelCount, std::vector<float>(hrirs.getLength(), 0.0f));
+    for (uint32_t v = 0; v < kVirtualSpeakerCount; ++v) {
+        const auto& measurement = hrirs.nearest(virtualSpeakers[v][0], virtualSpeakers[v][1]);
+        for (uint32_t c = 0; c < kChannelCount; ++c) {
+            const auto gain = decode[v * kChannelCount + c];
+            VectorKernels::mix(left[c].data(), measurement.left.data(), hrirs.getLength(), gain);
+            VectorKernels::mix(right[c].data(), measurement.right.data(), hrirs.getLength(), gain);
+        }
+    }
+    mConvolver.setup(left, right, partitionFrames);
+    mMatrix.clear();
+}
+
+void AmbisonicDecoder::process(const float* const* field, float* const* outputs, uint32_t outputCount, uint32_t frameCount)
+{
+    uint32_t decodedCount = 0;
+    if (mBinaural) {
+        if (outputCount >= 2) {
+            mConvolver.process(field, kChannelCount, outputs[0], outputs[1], frameCount);
+            decodedCount = 2;
+        }
+    }
+    else {
+        decodedCount = std::min(outputCount, mOutputChannelCount);
+        for (uint32_t s = 0; s < decodedCount; ++s) {
+            memset(outputs[s], 0, frameCount * sizeof(float));
+            for (uint32_t c = 0; c < kChannelCount; ++c) {
+                const auto gain = mMatrix[s * kChannelCount + c];
+                if (gain != 0.0f) {
+                    VectorKernels::mix(outputs[s], field[c], frameCount, gain);
+                }
+            }
+        }
+    }
+    for (uint32_t o = decodedCount; o < outputCount; ++o) {
+        memset(outputs[o], 0, frameCount * sizeof(float));
+    }
+}
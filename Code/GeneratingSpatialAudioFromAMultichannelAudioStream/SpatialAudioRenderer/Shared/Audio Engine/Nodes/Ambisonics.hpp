@@ -0,0 +1,140 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Portable third-order ambisonic encoding, rotation, and decoding.
+*/
+#ifndef Ambisonics_hpp
+#define Ambisonics_hpp
+
+#include "BinauralConvolver.hpp"
+#include "SpatialPanner.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A sound field stores its spherical harmonic coefficients in ACN channel order with
+// SN3D normalization, the AmbiX convention. Directions use `SpeakerPosition`'s convention:
+// azimuth in degrees clockwise from the front, and elevation in degrees up.
+namespace Ambisonics {
+
+constexpr uint32_t kOrder = 3;
+constexpr uint32_t kChannelCount = (kOrder + 1) * (kOrder + 1);
+
+// Evaluates the real spherical harmonics up to `kOrder` for a direction.
+void evaluate(float azimuth, float elevation, float* coefficients);
+
+} // namespace Ambisonics
+
+// Encodes mono sources at positions into a sound field.
+class AmbisonicEncoder
+{
+public:
+    AmbisonicEncoder() = default;
+    AmbisonicEncoder(const AmbisonicEncoder&) = delete;
+    AmbisonicEncoder& operator=(const AmbisonicEncoder&) = delete;
+
+    // Prepares one source per position. LFE positions don't encode; the renderer routes them around the field.
+    void setup(const std::vector<SpeakerPosition>& positions);
+
+    // Moves a source. Safe to call from any thread while rendering;
+    // the change is picked up and smoothed over the next block.
+    void setSourcePosition(uint32_t source, float azimuth, float elevation);
+
+    // Adds the sources to the field's channels. Real-time safe.
+    void process(const float* const* sources, uint32_t sourceCount, float* const* field, uint32_t frameCount);
+
+private:
+    struct Source
+    {
+        bool isLFE;
+        std::array<float, Ambisonics::kChannelCount> gains;
+        std::atomic<float> azimuth{0};
+        std::atomic<float> elevation{0};
+        std::atomic<uint32_t> version{1};
+        uint32_t appliedVersion{0};
+    };
+
+    std::vector<std::unique_ptr<Source>> mSources;
+};
+
+// Rotates a sound field to follow the listener's head. The rotation is a block-diagonal
+// matrix with a block per order, so it costs the same however many sources the field holds.
+class AmbisonicRotator
+{
+public:
+    AmbisonicRotator();
+    AmbisonicRotator(const AmbisonicRotator&) = delete;
+    AmbisonicRotator& operator=(const AmbisonicRotator&) = delete;
+
+    // Sets the head's orientation, in degrees: yaw to the right, pitch up, and roll toward the
+    // right shoulder, applied in that order. Safe to call from any thread while rendering;
+    // the renderer crossfades to the new rotation over the next block.
+    void setOrientation(float yaw, float pitch, float roll);
+
+    // Writes the head-relative field to `output`, which can't be `input`. Real-time safe.
+    void process(const float* const* input, float* const* output, uint32_t frameCount);
+
+    // The coefficients of the order blocks, each stored row by row.
+    using Matrix = std::array<float, 1 + 9 + 25 + 49>;
+
+    // Computes the rotation of the coefficients for a head orientation.
+    void computeMatrix(float yaw, float pitch, float roll, Matrix& matrix) const;
+
+private:
+    // Rotated harmonics at fixed points, projected back onto the harmonics, give the rotation exactly.
+    static constexpr uint32_t kProjectionPointCount = 36;
+
+    std::vector<std::array<float, 3>> mProjectionPoints;
+    // The pseudo-inverse of the harmonics at the projection points, [point][channel].
+    std::vector<float> mProjection;
+
+    Matrix mCurrent{};
+    Matrix mTarget{};
+
+    std::atomic<float> mYaw{0};
+    std::atomic<float> mPitch{0};
+    std::atomic<float> mRoll{0};
+    std::atomic<uint32_t> mVersion{1};
+    uint32_t mAppliedVersion{0};
+};
+
+// Decodes a sound field to a speaker layout or to headphones.
+class AmbisonicDecoder
+{
+public:
+    AmbisonicDecoder() = default;
+    AmbisonicDecoder(const AmbisonicDecoder&) = delete;
+    AmbisonicDecoder& operator=(const AmbisonicDecoder&) = delete;
+
+    // Decodes to a dense set of virtual speakers, and pans those onto the layout with VBAP (AllRAD).
+    // The LFE channel receives nothing. Weights the orders for the most concentrated energy (max rE).
+    void setupSpeakers(SpeakerLayout layout);
+
+    // Decodes to virtual speakers and folds their responses into a pair of filters per channel,
+    // so the binaural render convolves the 16 field channels rather than every virtual speaker.
+    // `hrirs` needs to be at the render rate.
+    void setupBinaural(const HRIRSet& hrirs, uint32_t partitionFrames);
+
+    uint32_t getOutputChannelCount() const { return mOutputChannelCount; }
+
+    // The binaural decode's delay, in frames. The speaker decode has none.
+    uint32_t getLatencyFrames() const { return mBinaural ? mConvolver.getLatencyFrames() : 0; }
+
+    // Writes the decoded field to `outputs`. Real-time safe.
+    void process(const float* const* field, float* const* outputs, uint32_t outputCount, uint32_t frameCount);
+
+    // The decoding matrix from channels to speakers, [speaker][channel].
+    const std::vector<float>& getMatrix() const { return mMatrix; }
+
+private:
+    bool mBinaural{false};
+    uint32_t mOutputChannelCount{0};
+    std::vector<float> mMatrix;
+    BinauralConvolver mConvolver;
+};
+
+#endif /* Ambisonics_hpp */
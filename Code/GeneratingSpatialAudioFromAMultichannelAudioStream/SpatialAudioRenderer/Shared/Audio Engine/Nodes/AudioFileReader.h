@@ -2,7 +2,7 @@
 See the LICENSE.txt file for this sample’s licensing information.
 
 Abstract:
-A class that loads a small audio file into memory.
+A class that plays an audio file from a memory-mapped decoded cache, from memory, or streamed from disk.
 */
 #import "CoreAudioHelpers.h"
 
@@ -13,9 +13,29 @@ NS_ASSUME_NONNULL_BEGIN
 
 @interface AudioFileReader : NSObject
 
+// Maps the file's decoded cache if it exists. Otherwise streams the file while a
+// background task makes the cache, and switches to the cache when it's ready.
 - (instancetype)init:(NSString *)filePath;
 
+// When `streaming` is true, the reader decodes the file on a background thread
+// and holds only a few seconds of audio in memory at a time.
+- (instancetype)init:(NSString *)filePath streaming:(BOOL)streaming;
+
+// Decodes the file into its cache unless a current cache already exists.
+// Safe to call from any thread.
++ (BOOL)prepareCacheForFile:(NSString *)filePath;
+
 @property (nonatomic, readonly) double sampleRate;
+@property (nonatomic, readonly) BOOL streaming;
+
+// When `cached` is true, the reader plays a decoded copy of the file that it maps
+// from disk. Every reader of the same file in the process shares the mapped pages.
+// A reader that starts by streaming sets it on the main queue when it switches to the cache.
+@property (nonatomic, readonly) BOOL cached;
+
+// The number of render cycles that ran ahead of the streaming decoder. Cached and
+// in-memory playback can't underrun, so they add nothing to the count.
+@property (nonatomic, readonly) uint64_t underrunCount;
 @property (nonatomic, copy) PullAudioBlock pullAudioBlock;
 
 @end
@@ -2,28 +2,87 @@
 See the LICENSE.txt file for this sample’s licensing information.
 
 Abstract:
-A class that implements loading a small audio file into memory.
+A class that implements playing an audio file from a memory-mapped decoded cache, from memory, or streamed from disk.
 */
 #import "AudioFileReader.h"
+#import "StreamingDecoder.hpp"
+#import "PCMCache.hpp"
+
+#include <atomic>
+#include <vector>
+
+// The amount of decoded audio the streaming reader holds ahead of playback.
+constexpr double kStreamingBufferSeconds = 2.0;
+
+// The largest channel count the streaming pull block forwards to the decoder.
+constexpr UInt32 kMaxStreamingChannels = 32;
+
+// The sample format for new caches. Half precision halves the footprint at about 66 dB of signal-to-noise ratio.
+constexpr PCMSampleFormat kCacheSampleFormat = PCMSampleFormat::Float32;
+
+// The size of each read while decoding a file into its cache.
+constexpr AVAudioFrameCount kCacheWriteChunkFrames = 16384;
 
 inline void copyBufferList(AudioBufferList * __nullable dstBufferList,
 						   const AudioBufferList * __nullable srcBufferList,
 						   UInt32 inNumberFrames,
-						   size_t offset)
+						   size_t offset,
+						   size_t dstOffset = 0)
 {
 	if (srcBufferList->mNumberBuffers != dstBufferList->mNumberBuffers) return;
 
 	const AudioBuffer* src = srcBufferList->mBuffers;
 	AudioBuffer* dst = dstBufferList->mBuffers;
 	
-	const auto requiredByteSz = sizeof(float) * inNumberFrames;
+	// Both sides need room for the frames past their offsets.
+	const auto srcRequiredByteSz = sizeof(float) * (offset + inNumberFrames);
+	const auto dstRequiredByteSz = sizeof(float) * (dstOffset + inNumberFrames);
 	for (UInt32 i = 0; i < srcBufferList->mNumberBuffers; ++i) {
-		if (src[i].mDataByteSize < requiredByteSz && dst[i].mDataByteSize < requiredByteSz) continue;
+		if (src[i].mDataByteSize < srcRequiredByteSz || dst[i].mDataByteSize < dstRequiredByteSz) continue;
 
-		memcpy(dst[i].mData, static_cast<const float *>(src[i].mData) + offset, sizeof(float) * inNumberFrames);
+		memcpy(static_cast<float *>(dst[i].mData) + dstOffset, static_cast<const float *>(src[i].mData) + offset, sizeof(float) * inNumberFrames);
 	}
 }
 
+// A streaming source that decodes an audio file in chunks on the decoder thread.
+class AudioFileSource : public StreamingSource
+{
+public:
+    AudioFileSource(AVAudioFile* file, AVAudioFrameCount chunkFrames)
+    : mFile(file),
+      mBuffer([[AVAudioPCMBuffer alloc] initWithPCMFormat:file.processingFormat frameCapacity:chunkFrames])
+    {
+    }
+    
+    uint32_t channelCount() const override { return mFile.processingFormat.channelCount; }
+    double sampleRate() const override { return mFile.processingFormat.sampleRate; }
+    
+    size_t read(float* const* channels, size_t frameCount) override
+    {
+        const auto frames = std::min<AVAudioFrameCount>(AVAudioFrameCount(frameCount), mBuffer.frameCapacity);
+        NSError* error = nil;
+        if (![mFile readIntoBuffer:mBuffer frameCount:frames error:&error]) {
+            return 0;
+        }
+        
+        const auto framesRead = mBuffer.frameLength;
+        for (uint32_t c = 0; c < mBuffer.format.channelCount; ++c) {
+            memcpy(channels[c], mBuffer.floatChannelData[c], framesRead * sizeof(float));
+        }
+        return framesRead;
+    }
+    
+    bool rewind() override
+    {
+        mFile.framePosition = 0;
+        return true;
+    }
+    
+private:
+    AVAudioFile* mFile;
+    AVAudioPCMBuffer* mBuffer;
+};
+
 struct RealtimeInfo {
     NSInteger fileLength{0};
     NSInteger currentPos{0};
@@ -32,28 +91,145 @@ struct RealtimeInfo {
     const AudioBufferList* bufferList {nullptr};
 };
 
+// Plays `rtInfo->bufferList` in a loop, for files in memory and single-precision caches.
+static void pullBufferList(RealtimeInfo* rtInfo, AudioBufferList* dstBufferList, size_t bufferSize)
+{
+    if (rtInfo->bufferList == nullptr || rtInfo->fileLength == 0) return;
+    
+    // Wrap around the end of the file within the cycle, rather than reading past it.
+    size_t framesDone = 0;
+    while (framesDone < bufferSize) {
+        const auto frames = std::min<size_t>(bufferSize - framesDone, rtInfo->fileLength - rtInfo->currentPos);
+        copyBufferList(dstBufferList, rtInfo->bufferList, (UInt32)frames, rtInfo->currentPos, framesDone);
+        framesDone += frames;
+        (rtInfo->currentPos) += frames;
+        if (rtInfo->currentPos >= rtInfo->fileLength) {
+            rtInfo->currentPos = 0;
+        }
+    }
+}
+
+// Plays a cache in a loop. Half-precision planes convert as they're read.
+static void pullCache(const PCMCache* mappedCache, RealtimeInfo* rtInfo, AudioBufferList* dstBufferList, size_t bufferSize)
+{
+    if (mappedCache->sampleFormat() == PCMSampleFormat::Float32) {
+        pullBufferList(rtInfo, dstBufferList, bufferSize);
+        return;
+    }
+    
+    float* channels[kMaxStreamingChannels];
+    const auto channelCount = std::min(dstBufferList->mNumberBuffers, kMaxStreamingChannels);
+    size_t framesDone = 0;
+    while (framesDone < bufferSize) {
+        for (UInt32 i = 0; i < channelCount; ++i) {
+            channels[i] = static_cast<float *>(dstBufferList->mBuffers[i].mData) + framesDone;
+        }
+        const auto frames = mappedCache->read(channels, channelCount, uint64_t(rtInfo->currentPos), bufferSize - framesDone);
+        framesDone += frames;
+        (rtInfo->currentPos) += frames;
+        if (rtInfo->currentPos >= rtInfo->fileLength) {
+            rtInfo->currentPos = 0;
+        }
+    }
+}
+
 @implementation AudioFileReader {
     RealtimeInfo realtimeInfo;
+    std::unique_ptr<StreamingDecoder> decoder;
+    std::shared_ptr<const PCMCache> cache;
+    // The cache the streaming pull block switches to once the background build finishes.
+    std::atomic<const PCMCache*> liveCache;
+    // An audio buffer list whose channels point into the cache's mapping.
+    std::vector<uint8_t> mappedBufferListStorage;
 }
 
 - (instancetype)init:(NSString *)fileUrl
 {
     self = [super init];
     if (self) {
-        [self loadFile:fileUrl];
-        
-        auto rtInfo = &realtimeInfo;
-        _pullAudioBlock = ^(AudioBufferList * __nullable dstBufferList, size_t bufferSize) {
-            copyBufferList(dstBufferList, rtInfo->bufferList, (UInt32)bufferSize, rtInfo->currentPos);
-            (rtInfo->currentPos) += bufferSize;
-            if (rtInfo->currentPos >= rtInfo->fileLength) {
-                rtInfo->currentPos = 0;
-            }
-        };
+        // Play a decoded copy of the file straight from the system's page cache when one exists.
+        // Otherwise, stream the file while a background task decodes it into a cache, and
+        // switch to the cache once it's ready.
+        if ([self openCache:fileUrl]) {
+            _cached = YES;
+            [self makeCachePullBlock];
+        }
+        else {
+            _streaming = YES;
+            [self openStream:fileUrl];
+            [self makeStreamingPullBlock];
+            [self buildCacheInBackground:fileUrl];
+        }
+    }
+    return self;
+}
+
+- (instancetype)init:(NSString *)fileUrl streaming:(BOOL)streaming
+{
+    self = [super init];
+    if (self) {
+        _streaming = streaming;
+        if (streaming) {
+            [self openStream:fileUrl];
+            [self makeStreamingPullBlock];
+        }
+        else {
+            [self loadFile:fileUrl];
+            [self makeBufferPullBlock];
+        }
     }
     return self;
 }
 
++ (NSString *)cachePathForFile:(NSString *)filePath
+{
+    NSDictionary<NSFileAttributeKey, id> * attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:filePath error:nil];
+    if (attributes == nil) {
+        return nil;
+    }
+    NSString * directory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject
+                            stringByAppendingPathComponent:@"PCMCache"];
+    if (![[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil]) {
+        return nil;
+    }
+    
+    // Key the cache by a hash of the source's full path, file number, size, and modification date,
+    // so files with the same name in different directories, and edited files, get their own caches.
+    NSString * identity = [NSString stringWithFormat:@"%@|%@|%llu|%.0f",
+                           filePath.stringByStandardizingPath,
+                           attributes[NSFileSystemFileNumber],
+                           attributes.fileSize,
+                           attributes.fileModificationDate.timeIntervalSince1970];
+    uint64_t hash = 14695981039346656037ull;
+    for (const char* character = identity.UTF8String; *character != 0; ++character) {
+        hash = (hash ^ uint8_t(*character)) * 1099511628211ull;
+    }
+    NSString * name = [NSString stringWithFormat:@"%@-%016llx-%@.pcm",
+                       filePath.lastPathComponent.stringByDeletingPathExtension,
+                       hash,
+                       kCacheSampleFormat == PCMSampleFormat::Float16 ? @"f16" : @"f32"];
+    return [directory stringByAppendingPathComponent:name];
+}
+
++ (BOOL)prepareCacheForFile:(NSString *)filePath
+{
+    NSString * cachePath = [AudioFileReader cachePathForFile:filePath];
+    if (cachePath == nil) {
+        return NO;
+    }
+    if ([[NSFileManager defaultManager] fileExistsAtPath:cachePath]) {
+        return YES;
+    }
+    
+    NSError * error = nil;
+    AVAudioFile * audioFile = [[AVAudioFile alloc] initForReading:[NSURL fileURLWithPath:filePath] error:&error];
+    if (error != nil) {
+        return NO;
+    }
+    AudioFileSource source(audioFile, kCacheWriteChunkFrames);
+    return PCMCache::write(cachePath.UTF8String, source, uint64_t(audioFile.length), kCacheSampleFormat);
+}
+
 -(BOOL)loadFile:(NSString *)filePath
 {
     NSError * error = nil;
@@ -75,9 +251,139 @@ struct RealtimeInfo {
     return error == nil;
 }
 
+-(BOOL)openStream:(NSString *)filePath
+{
+    NSError * error = nil;
+    AVAudioFile * _audioFile  = [[AVAudioFile alloc] initForReading:[NSURL fileURLWithPath:filePath] error:&error];
+    if (error != nil) {
+        return NO;
+    }
+    
+    NSAssert(_audioFile.processingFormat.channelCount == 12, @"[Error] This sample requires 7.1.4, 12 channel audio..");
+    realtimeInfo.fileLength = _audioFile.length;
+    realtimeInfo.sampleRate = _audioFile.processingFormat.sampleRate;
+    
+    // Only the decoder's ring and one chunk stay resident, regardless of the file length.
+    const auto bufferFrames = size_t(realtimeInfo.sampleRate * kStreamingBufferSeconds);
+    decoder = std::make_unique<StreamingDecoder>(std::make_unique<AudioFileSource>(_audioFile, 4096), bufferFrames, 4096);
+    decoder->start();
+    return YES;
+}
+
+// Maps the file's cache if it already exists. While the reader streams, the render thread
+// owns the playback position, so the cache has to match the stream it replaces.
+-(BOOL)openCache:(NSString *)filePath
+{
+    NSString * cachePath = [AudioFileReader cachePathForFile:filePath];
+    if (cachePath == nil || ![[NSFileManager defaultManager] fileExistsAtPath:cachePath]) {
+        return NO;
+    }
+    auto mappedCache = PCMCache::open(cachePath.UTF8String);
+    if (mappedCache == nullptr || mappedCache->frameCount() == 0) {
+        return NO;
+    }
+    
+    NSAssert(mappedCache->channelCount() == 12, @"[Error] This sample requires 7.1.4, 12 channel audio..");
+    if (_streaming) {
+        if (NSInteger(mappedCache->frameCount()) != realtimeInfo.fileLength || mappedCache->sampleRate() != realtimeInfo.sampleRate) {
+            return NO;
+        }
+    }
+    else {
+        realtimeInfo.fileLength = NSInteger(mappedCache->frameCount());
+        realtimeInfo.sampleRate = mappedCache->sampleRate();
+    }
+    cache = std::move(mappedCache);
+    
+    // Single-precision planes need no conversion, so point the buffer list at the mapped pages.
+    if (cache->sampleFormat() == PCMSampleFormat::Float32) {
+        const auto channelCount = cache->channelCount();
+        mappedBufferListStorage.assign(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channelCount, 0);
+        auto bufferList = reinterpret_cast<AudioBufferList *>(mappedBufferListStorage.data());
+        bufferList->mNumberBuffers = channelCount;
+        for (UInt32 i = 0; i < channelCount; ++i) {
+            bufferList->mBuffers[i].mNumberChannels = 1;
+            bufferList->mBuffers[i].mDataByteSize = UInt32(std::min<uint64_t>(cache->frameCount() * sizeof(float), UINT32_MAX));
+            bufferList->mBuffers[i].mData = const_cast<float *>(cache->floatChannel(i));
+        }
+        realtimeInfo.bufferList = bufferList;
+    }
+    return YES;
+}
+
+// Decodes the file into its cache on a utility queue, then hands the cache to the render thread on the main queue.
+-(void)buildCacheInBackground:(NSString *)filePath
+{
+    __weak AudioFileReader * weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        if (![AudioFileReader prepareCacheForFile:filePath]) {
+            return;
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            AudioFileReader * reader = weakSelf;
+            if (reader == nil || reader->cache != nullptr || ![reader openCache:filePath]) {
+                return;
+            }
+            reader->_cached = YES;
+            reader->liveCache.store(reader->cache.get(), std::memory_order_release);
+        });
+    });
+}
+
+// MARK: - Pull blocks
+
+-(void)makeStreamingPullBlock
+{
+    auto streamDecoder = decoder.get();
+    auto rtInfo = &realtimeInfo;
+    auto readyCache = &liveCache;
+    _pullAudioBlock = ^(AudioBufferList * __nullable dstBufferList, size_t bufferSize) {
+        // Once the background build hands over the cache, play from it at the same position.
+        // The decoder idles with its ring full until the reader goes away.
+        if (const auto mappedCache = readyCache->load(std::memory_order_acquire)) {
+            pullCache(mappedCache, rtInfo, dstBufferList, bufferSize);
+            return;
+        }
+        if (streamDecoder == nullptr) return;
+        
+        float* channels[kMaxStreamingChannels];
+        const auto channelCount = std::min(dstBufferList->mNumberBuffers, kMaxStreamingChannels);
+        for (UInt32 i = 0; i < channelCount; ++i) {
+            channels[i] = static_cast<float *>(dstBufferList->mBuffers[i].mData);
+        }
+        const auto framesRead = streamDecoder->pull(channels, channelCount, bufferSize);
+        if (rtInfo->fileLength > 0) {
+            rtInfo->currentPos = NSInteger((size_t(rtInfo->currentPos) + framesRead) % size_t(rtInfo->fileLength));
+        }
+    };
+}
+
+-(void)makeBufferPullBlock
+{
+    auto rtInfo = &realtimeInfo;
+    _pullAudioBlock = ^(AudioBufferList * __nullable dstBufferList, size_t bufferSize) {
+        pullBufferList(rtInfo, dstBufferList, bufferSize);
+    };
+}
+
+-(void)makeCachePullBlock
+{
+    auto mappedCache = cache.get();
+    auto rtInfo = &realtimeInfo;
+    _pullAudioBlock = ^(AudioBufferList * __nullable dstBufferList, size_t bufferSize) {
+        pullCache(mappedCache, rtInfo, dstBufferList, bufferSize);
+    };
+}
+
 -(double)sampleRate
 {
     return realtimeInfo.sampleRate;
 }
 
+-(uint64_t)underrunCount
+{
+    // Cached and in-memory playback never wait on a decoder, so only streamed cycles count.
+    return decoder ? decoder->underrunCount() : 0;
+}
+
 @end
@@ -0,0 +1,401 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable binaural renderer implementation that convolves each speaker feed with a head-related impulse response.
+*/
+#include "BinauralConvolver.hpp"
+#include "PolyphaseResampler.hpp"
+#include "VectorKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+struct Direction
+{
+    double x;
+    double y;
+    double z;
+};
+
+// x points right, y to the front, and z up.
+Direction direction(double azimuth, double elevation)
+{
+    const auto a = azimuth * M_PI / 180.0;
+    const auto e = elevation * M_PI / 180.0;
+    return {std::cos(e) * std::sin(a), std::cos(e) * std::cos(a), std::sin(e)};
+}
+
+double dot(const Direction& a, const Direction& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+template <typename T>
+bool readValue(std::ifstream& stream, T& value)
+{
+    return bool(stream.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+// The spherical head model, after Brown and Duda, "A Structural Model for Binaural Sound Synthesis", 1998.
+constexpr double kHeadRadius = 0.0875;
+constexpr double kSpeedOfSound = 343.0;
+constexpr double kMinimumShadowAlpha = 0.1;
+constexpr double kMinimumShadowAngle = 150.0;
+// Leaves room ahead of the earliest arrival for the fractional-delay ringing.
+constexpr double kPreDelayFrames = 16.0;
+
+// Computes one ear's response to a source `angle` radians away from the ear's axis.
+void sphericalHeadResponse(RealFFT& fft, double sampleRate, double angle, float* response, uint32_t length)
+{
+    const auto size = fft.getSize();
+    const auto binCount = fft.getBinCount();
+    std::vector<float> real(binCount), imaginary(binCount), impulse(size);
+
+    // Woodworth's delay, relative to the arrival at the center of the head.
+    const auto delay = (angle < M_PI / 2) ? -kHeadRadius / kSpeedOfSound * std::cos(angle)
+                                          : kHeadRadius / kSpeedOfSound * (angle - M_PI / 2);
+    const auto totalDelay = delay + kHeadRadius / kSpeedOfSound + kPreDelayFrames / sampleRate;
+
+    // A one-pole, one-zero shelf that boosts the near ear and shadows the far ear.
+    const auto alpha = (1.0 + kMinimumShadowAlpha / 2) +
+                       (1.0 - kMinimumShadowAlpha / 2) * std::cos(angle * 180.0 / kMinimumShadowAngle);
+    const auto cornerFrequency = kSpeedOfSound / kHeadRadius;
+
+    for (uint32_t k = 0; k < binCount; ++k) {
+        const auto omega = 2.0 * M_PI * k * sampleRate / size;
+        const auto x = omega / (2.0 * cornerFrequency);
+        // (1 + j alpha x) / (1 + j x)
+        const auto denominator = 1.0 + x * x;
+        const auto shadowReal = (1.0 + alpha * x * x) / denominator;
+        const auto shadowImaginary = (alpha * x - x) / denominator;
+        const auto phase = -omega * totalDelay;
+        real[k] = float(shadowReal * std::cos(phase) - shadowImaginary * std::sin(phase));
+        imaginary[k] = float(shadowReal * std::sin(phase) + shadowImaginary * std::cos(phase));
+    }
+    fft.inverse(real.data(), imaginary.data(), impulse.data());
+
+    // Keep the start of the response and fade out its tail.
+    const auto fadeLength = length / 4;
+    for (uint32_t i = 0; i < length; ++i) {
+        auto gain = 1.0;
+        if (i >= length - fadeLength) {
+            gain = 0.5 * (1.0 + std::cos(M_PI * (i - (length - fadeLength)) / fadeLength));
+        }
+        response[i] = float(impulse[i] * gain);
+    }
+}
+
+struct ResponseReader
+{
+    const float* response;
+    uint32_t length;
+    uint32_t position;
+};
+
+// Feeds one response, then silence, to every channel the resampler asks for.
+void pullResponse(void* context, float* const* channels, uint32_t channelCount, uint32_t frameCount)
+{
+    auto reader = static_cast<ResponseReader *>(context);
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        for (uint32_t i = 0; i < frameCount; ++i) {
+            const auto position = reader->position + i;
+            channels[c][i] = position < reader->length ? reader->response[position] : 0.0f;
+        }
+    }
+    reader->position += frameCount;
+}
+
+} // namespace
+
+// MARK: - HRIRSet
+
+bool HRIRSet::load(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    char tag[4];
+    uint32_t version = 0;
+    double sampleRate = 0;
+    uint32_t length = 0;
+    uint32_t count = 0;
+    if (!stream.read(tag, sizeof(tag)) || memcmp(tag, "HRIR", sizeof(tag)) != 0 ||
+        !readValue(stream, version) || version != 1 ||
+        !readValue(stream, sampleRate) || sampleRate <= 0 ||
+        !readValue(stream, length) || length == 0 ||
+        !readValue(stream, count) || count == 0) {
+        return false;
+    }
+
+    std::vector<Measurement> measurements(count);
+    for (auto& measurement : measurements) {
+        float counterclockwiseAzimuth = 0;
+        measurement.left.resize(length);
+        measurement.right.resize(length);
+        if (!readValue(stream, counterclockwiseAzimuth) || !readValue(stream, measurement.elevation) ||
+            !stream.read(reinterpret_cast<char *>(measurement.left.data()), length * sizeof(float)) ||
+            !stream.read(reinterpret_cast<char *>(measurement.right.data()), length * sizeof(float))) {
+            return false;
+        }
+        measurement.azimuth = -counterclockwiseAzimuth;
+    }
+
+    mSampleRate = sampleRate;
+    mLength = length;
+    mMeasurements = std::move(measurements);
+    return true;
+}
+
+HRIRSet HRIRSet::sphericalHead(double sampleRate, uint32_t length)
+{
+    HRIRSet set;
+    set.mSampleRate = sampleRate;
+    set.mLength = length;
+
+    // Build the responses with twice the length, so the circular delay doesn't wrap.
+    uint32_t size = 4;
+    while (size < 2 * length) {
+        size <<= 1;
+    }
+    RealFFT fft(size);
+
+    const auto leftEar = direction(-90, 0);
+    const auto rightEar = direction(90, 0);
+    for (int elevation = -45; elevation <= 90; elevation += 15) {
+        for (int azimuth = -175; azimuth <= 180; azimuth += 5) {
+            Measurement measurement{float(azimuth), float(elevation), std::vector<float>(length), std::vector<float>(length)};
+            const auto source = direction(azimuth, elevation);
+            sphericalHeadResponse(fft, sampleRate, std::acos(std::clamp(dot(source, leftEar), -1.0, 1.0)), measurement.left.data(), length);
+            sphericalHeadResponse(fft, sampleRate, std::acos(std::clamp(dot(source, rightEar), -1.0, 1.0)), measurement.right.data(), length);
+            set.mMeasurements.push_back(std::move(measurement));
+            if (elevation == 90) {
+                // Every azimuth is the same direction straight up.
+                break;
+            }
+        }
+    }
+    return set;
+}
+
+const HRIRSet::Measurement& HRIRSet::nearest(float azimuth, float elevation) const
+{
+    const auto target = direction(azimuth, elevation);
+    size_t best = 0;
+    double bestDot = -2;
+    for (size_t i = 0; i < mMeasurements.size(); ++i) {
+        const auto d = dot(target, direction(mMeasurements[i].azimuth, mMeasurements[i].elevation));
+        if (d > bestDot) {
+            bestDot = d;
+            best = i;
+        }
+    }
+    return mMeasurements[best];
+}
+
+void HRIRSet::resample(double sampleRate)
+{
+    if (sampleRate == mSampleRate || mMeasurements.empty()) {
+        return;
+    }
+    const auto length = uint32_t(std::ceil(mLength * sampleRate / mSampleRate));
+
+    // A response holds the same energy per second at any rate, so scale
+    // its samples to keep the filter's gain the same.
+    const auto gain = float(mSampleRate / sampleRate);
+
+    PolyphaseResampler resampler;
+    resampler.setup(1, mSampleRate, sampleRate, length, ResamplerQuality::High);
+    std::vector<float> output(length);
+    float* outputs[] = {output.data()};
+
+    for (auto& measurement : mMeasurements) {
+        for (auto* response : {&measurement.left, &measurement.right}) {
+            ResponseReader reader{response->data(), mLength, 0};
+            resampler.reset();
+            resampler.process(outputs, length, pullResponse, &reader);
+            response->assign(output.begin(), output.end());
+            VectorKernels::scale(response->data(), length, gain);
+        }
+    }
+    mSampleRate = sampleRate;
+    mLength = length;
+}
+
+// MARK: - BinauralConvolver
+
+void BinauralConvolver::setup(const std::vector<SpeakerPosition>& inputs, const HRIRSet& hrirs, uint32_t partitionFrames)
+{
+    std::vector<const std::vector<float>*> leftResponses;
+    std::vector<const std::vector<float>*> rightResponses;
+    for (const auto& position : inputs) {
+        if (position.isLFE) {
+            leftResponses.push_back(nullptr);
+            rightResponses.push_back(nullptr);
+            continue;
+        }
+        const auto& measurement = hrirs.nearest(position.azimuth, position.elevation);
+        leftResponses.push_back(&measurement.left);
+        rightResponses.push_back(&measurement.right);
+    }
+    setupFilters(leftResponses, rightResponses, partitionFrames);
+}
+
+void BinauralConvolver::setup(const std::vector<std::vector<float>>& leftResponses,
+                              const std::vector<std::vector<float>>& rightResponses,
+                              uint32_t partitionFrames)
+{
+    std::vector<const std::vector<float>*> left;
+    std::vector<const std::vector<float>*> right;
+    for (size_t i = 0; i < leftResponses.size() && i < rightResponses.size(); ++i) {
+        left.push_back(&leftResponses[i]);
+        right.push_back(&rightResponses[i]);
+    }
+    setupFilters(left, right, partitionFrames);
+}
+
+void BinauralConvolver::setupFilters(const std::vector<const std::vector<float>*>& leftResponses,
+                                     const std::vector<const std::vector<float>*>& rightResponses,
+                                     uint32_t partitionFrames)
+{
+    size_t length = 1;
+    for (const auto* response : leftResponses) {
+        length = std::max(length, response != nullptr ? response->size() : 0);
+    }
+    for (const auto* response : rightResponses) {
+        length = std::max(length, response != nullptr ? response->size() : 0);
+    }
+    mPartitionFrames = partitionFrames;
+    mPartitionCount = uint32_t((length + partitionFrames - 1) / partitionFrames);
+    mFFT.setup(2 * partitionFrames);
+    mBinCount = mFFT.getBinCount();
+
+    const auto makeSpectrum = [this] {
+        return Spectrum{std::vector<float>(mBinCount, 0.0f), std::vector<float>(mBinCount, 0.0f)};
+    };
+
+    // Transform each partition of a response, zero-padded to the FFT size.
+    std::vector<float> segment(2 * partitionFrames);
+    const auto makeFilter = [&](const std::vector<float>& response) {
+        std::vector<Spectrum> filter;
+        for (uint32_t p = 0; p < mPartitionCount; ++p) {
+            std::fill(segment.begin(), segment.end(), 0.0f);
+            const auto start = std::min<size_t>(p * partitionFrames, response.size());
+            const auto count = std::min<size_t>(partitionFrames, response.size() - start);
+            std::copy_n(response.begin() + start, count, segment.begin());
+            auto spectrum = makeSpectrum();
+            mFFT.forward(segment.data(), spectrum.real.data(), spectrum.imaginary.data());
+            filter.push_back(std::move(spectrum));
+        }
+        return filter;
+    };
+
+    mInputs.clear();
+    for (size_t i = 0; i < leftResponses.size(); ++i) {
+        Input input;
+        input.isLFE = leftResponses[i] == nullptr || rightResponses[i] == nullptr;
+        input.window.assign(2 * partitionFrames, 0.0f);
+        if (!input.isLFE) {
+            input.leftFilter = makeFilter(*leftResponses[i]);
+            input.rightFilter = makeFilter(*rightResponses[i]);
+            for (uint32_t p = 0; p < mPartitionCount; ++p) {
+                input.delayLine.push_back(makeSpectrum());
+            }
+        }
+        mInputs.push_back(std::move(input));
+    }
+
+    mLeftOutput.assign(partitionFrames, 0.0f);
+    mRightOutput.assign(partitionFrames, 0.0f);
+    mLeftAccumulator = makeSpectrum();
+    mRightAccumulator = makeSpectrum();
+    mTimeScratch.assign(2 * partitionFrames, 0.0f);
+    reset();
+}
+
+void BinauralConvolver::reset()
+{
+    for (auto& input : mInputs) {
+        std::fill(input.window.begin(), input.window.end(), 0.0f);
+        for (auto& spectrum : input.delayLine) {
+            std::fill(spectrum.real.begin(), spectrum.real.end(), 0.0f);
+            std::fill(spectrum.imaginary.begin(), spectrum.imaginary.end(), 0.0f);
+        }
+    }
+    std::fill(mLeftOutput.begin(), mLeftOutput.end(), 0.0f);
+    std::fill(mRightOutput.begin(), mRightOutput.end(), 0.0f);
+    mDelayLineHead = 0;
+    mBlockFill = 0;
+}
+
+void BinauralConvolver::process(const float* const* inputs, uint32_t inputCount, float* left, float* right, uint32_t frameCount)
+{
+    const auto channelCount = std::min<uint32_t>(inputCount, uint32_t(mInputs.size()));
+    uint32_t framesDone = 0;
+    while (framesDone < frameCount) {
+        const auto frames = std::min(frameCount - framesDone, mPartitionFrames - mBlockFill);
+
+        // Collect the input into the second half of each window, and play the previous block.
+        for (uint32_t c = 0; c < channelCount; ++c) {
+            memcpy(mInputs[c].window.data() + mPartitionFrames + mBlockFill, inputs[c] + framesDone, frames * sizeof(float));
+        }
+        memcpy(left + framesDone, mLeftOutput.data() + mBlockFill, frames * sizeof(float));
+        memcpy(right + framesDone, mRightOutput.data() + mBlockFill, frames * sizeof(float));
+
+        mBlockFill += frames;
+        framesDone += frames;
+        if (mBlockFill == mPartitionFrames) {
+            processBlock();
+            mBlockFill = 0;
+        }
+    }
+}
+
+void BinauralConvolver::processBlock()
+{
+    mDelayLineHead = (mDelayLineHead + 1) % mPartitionCount;
+
+    std::fill(mLeftAccumulator.real.begin(), mLeftAccumulator.real.end(), 0.0f);
+    std::fill(mLeftAccumulator.imaginary.begin(), mLeftAccumulator.imaginary.end(), 0.0f);
+    std::fill(mRightAccumulator.real.begin(), mRightAccumulator.real.end(), 0.0f);
+    std::fill(mRightAccumulator.imaginary.begin(), mRightAccumulator.imaginary.end(), 0.0f);
+
+    for (auto& input : mInputs) {
+        if (input.isLFE) {
+            continue;
+        }
+        auto& newest = input.delayLine[mDelayLineHead];
+        mFFT.forward(input.window.data(), newest.real.data(), newest.imaginary.data());
+
+        // Partition `p` of the filter applies to the input from `p` blocks ago.
+        for (uint32_t p = 0; p < mPartitionCount; ++p) {
+            const auto& spectrum = input.delayLine[(mDelayLineHead + mPartitionCount - p) % mPartitionCount];
+            VectorKernels::complexMultiplyAccumulate(mLeftAccumulator.real.data(), mLeftAccumulator.imaginary.data(),
+                                                     spectrum.real.data(), spectrum.imaginary.data(),
+                                                     input.leftFilter[p].real.data(), input.leftFilter[p].imaginary.data(),
+                                                     mBinCount);
+            VectorKernels::complexMultiplyAccumulate(mRightAccumulator.real.data(), mRightAccumulator.imaginary.data(),
+                                                     spectrum.real.data(), spectrum.imaginary.data(),
+                                                     input.rightFilter[p].real.data(), input.rightFilter[p].imaginary.data(),
+                                                     mBinCount);
+        }
+    }
+
+    // Overlap-save: the second half of each inverse transform is the block's linear convolution.
+    mFFT.inverse(mLeftAccumulator.real.data(), mLeftAccumulator.imaginary.data(), mTimeScratch.data());
+    memcpy(mLeftOutput.data(), mTimeScratch.data() + mPartitionFrames, mPartitionFrames * sizeof(float));
+    mFFT.inverse(mRightAccumulator.real.data(), mRightAccumulator.imaginary.data(), mTimeScratch.data());
+    memcpy(mRightOutput.data(), mTimeScratch.data() + mPartitionFrames, mPartitionFrames * sizeof(float));
+
+    for (auto& input : mInputs) {
+        const float* block = input.window.data() + mPartitionFrames;
+        if (input.isLFE) {
+            VectorKernels::mix(mLeftOutput.data(), block, mPartitionFrames, kLFEGain);
+            VectorKernels::mix(mRightOutput.data(), block, mPartitionFrames, kLFEGain);
+        }
+        // Slide the window so the current block becomes the previous one.
+        memcpy(input.window.data(), block, mPartitionFrames * sizeof(float));
+    }
+}
@@ -0,0 +1,132 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable binaural renderer that convolves each speaker feed with a head-related impulse response.
+*/
+#ifndef BinauralConvolver_hpp
+#define BinauralConvolver_hpp
+
+#include "RealFFT.hpp"
+#include "SpatialPanner.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A set of head-related impulse responses (HRIRs) measured at different directions.
+class HRIRSet
+{
+public:
+    struct Measurement
+    {
+        // In the same convention as `SpeakerPosition`: degrees clockwise from the front, and up.
+        float azimuth;
+        float elevation;
+        std::vector<float> left;
+        std::vector<float> right;
+    };
+
+    // Reads a flat HRIR file: the 4-byte tag "HRIR", a UInt32 version of 1, a Float64 sample
+    // rate, a UInt32 response length, and a UInt32 measurement count, all little endian, followed
+    // by each measurement's Float32 azimuth and elevation and its left and right responses.
+    // Azimuths in the file are counterclockwise, as in SOFA's spherical coordinates, so a
+    // SOFA file's `Data.IR` and `SourcePosition` export to this format as they are.
+    bool load(const std::string& path);
+
+    // Builds responses from a rigid spherical head model: interaural time and level differences
+    // without pinna cues. It needs no data files, which makes it a fallback for measured responses.
+    static HRIRSet sphericalHead(double sampleRate, uint32_t length = 256);
+
+    // Returns the measurement closest in angle to a direction.
+    const Measurement& nearest(float azimuth, float elevation) const;
+
+    double getSampleRate() const { return mSampleRate; }
+    uint32_t getLength() const { return mLength; }
+    bool empty() const { return mMeasurements.empty(); }
+
+    // Resamples every response to a new rate.
+    void resample(double sampleRate);
+
+private:
+    double mSampleRate{0};
+    uint32_t mLength{0};
+    std::vector<Measurement> mMeasurements;
+};
+
+// Renders a speaker bed to two ears with uniformly partitioned overlap-save convolution.
+// Each input channel is transformed once per block, and its spectrum feeds both ears' filters
+// through a frequency-domain delay line. The ears then accumulate every channel's contribution
+// in the frequency domain, so a block costs one FFT per input and one inverse FFT per ear.
+class BinauralConvolver
+{
+public:
+    BinauralConvolver() = default;
+    BinauralConvolver(const BinauralConvolver&) = delete;
+    BinauralConvolver& operator=(const BinauralConvolver&) = delete;
+
+    // Prepares filters for a bed with the given speaker positions, taking the nearest response
+    // for each speaker. `hrirs` needs to be at the render rate. LFE channels bypass the filters.
+    void setup(const std::vector<SpeakerPosition>& inputs, const HRIRSet& hrirs, uint32_t partitionFrames);
+
+    // Prepares one pair of filters per input, for inputs that aren't speaker feeds,
+    // such as the channels of an ambisonic sound field.
+    void setup(const std::vector<std::vector<float>>& leftResponses,
+               const std::vector<std::vector<float>>& rightResponses,
+               uint32_t partitionFrames);
+
+    // Real-time safe. Renders any number of frames, `getLatencyFrames()` behind the input.
+    void process(const float* const* inputs, uint32_t inputCount, float* left, float* right, uint32_t frameCount);
+
+    // Clears the delay lines and the partial block.
+    void reset();
+
+    uint32_t getLatencyFrames() const { return mPartitionFrames; }
+    uint32_t getPartitionCount() const { return mPartitionCount; }
+
+    // The gain for LFE channels, which mix into both ears unfiltered.
+    static constexpr float kLFEGain = 0.5f;
+
+private:
+    struct Spectrum
+    {
+        std::vector<float> real;
+        std::vector<float> imaginary;
+    };
+
+    struct Input
+    {
+        bool isLFE;
+        // The previous and current blocks, the window the overlap-save transform reads.
+        std::vector<float> window;
+        // The last `mPartitionCount` input spectra, newest at `mDelayLineHead`.
+        std::vector<Spectrum> delayLine;
+        // Each ear's filter, one spectrum per partition of the response.
+        std::vector<Spectrum> leftFilter;
+        std::vector<Spectrum> rightFilter;
+    };
+
+    // An input with no responses bypasses the filters as an LFE channel.
+    void setupFilters(const std::vector<const std::vector<float>*>& leftResponses,
+                      const std::vector<const std::vector<float>*>& rightResponses,
+                      uint32_t partitionFrames);
+    void processBlock();
+
+    RealFFT mFFT;
+    uint32_t mPartitionFrames{0};
+    uint32_t mPartitionCount{0};
+    uint32_t mBinCount{0};
+    std::vector<Input> mInputs;
+    uint32_t mDelayLineHead{0};
+
+    // The block being collected, and the previous block's output being played.
+    uint32_t mBlockFill{0};
+    std::vector<float> mLeftOutput;
+    std::vector<float> mRightOutput;
+
+    Spectrum mLeftAccumulator;
+    Spectrum mRightAccumulator;
+    std::vector<float> mTimeScratch;
+};
+
+#endif /* BinauralConvolver_hpp */
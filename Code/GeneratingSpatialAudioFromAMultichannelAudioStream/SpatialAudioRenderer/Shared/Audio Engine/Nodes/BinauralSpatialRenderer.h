@@ -0,0 +1,53 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A spatial renderer that renders headphone output with its own HRTF convolution.
+*/
+#ifndef BinauralSpatialRenderer_h
+#define BinauralSpatialRenderer_h
+
+#include "SpatialRenderer.h"
+#include "BinauralConvolver.hpp"
+#include "AllocatedAudioBufferList.h"
+
+#include <memory>
+#include <vector>
+
+// Convolves the bed with head-related impulse responses for the headphones output type,
+// and passes every other output type to a wrapped renderer. The responses come from
+// `HRIR.bin` in the main bundle when it's present, in the format `HRIRSet::load` reads,
+// and from a spherical head model otherwise.
+class BinauralSpatialRenderer : public SpatialRenderer
+{
+
+public:
+    explicit BinauralSpatialRenderer(std::unique_ptr<SpatialRenderer> speakerRenderer);
+    BinauralSpatialRenderer(const BinauralSpatialRenderer& other) = delete;
+    BinauralSpatialRenderer& operator=(const BinauralSpatialRenderer& other) = delete;
+
+    OSStatus prepareOutputType(AUSpatialMixerOutputType outputType) override;
+    void applyOutputType(AUSpatialMixerOutputType outputType) override;
+    void setOfflineRendering(bool offline) override;
+    void setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize) override;
+    UInt32 getOutputChannelCount() override;
+    bool usesInternalReverb() override;
+    UInt32 getLatencyFrames() override;
+
+    void setAudioPullBlock(PullAudioBlock _Nullable block) override;
+    OSStatus process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames) override;
+
+    // 2.7 ms at 48 kHz. Shorter partitions lower the latency and raise the cost per frame.
+    static constexpr UInt32 kPartitionFrames = 128;
+
+private:
+    std::unique_ptr<SpatialRenderer> mSpeakerRenderer;
+    BinauralConvolver mConvolver;
+    PullAudioBlock __nullable mInputBlock;
+    AUSpatialMixerOutputType mOutputType{kSpatialMixerOutputType_Headphones};
+
+    AllocatedAudioBufferList mBedBuffer;
+    std::vector<const float*> mBedPointers;
+};
+
+#endif /* BinauralSpatialRenderer_h */
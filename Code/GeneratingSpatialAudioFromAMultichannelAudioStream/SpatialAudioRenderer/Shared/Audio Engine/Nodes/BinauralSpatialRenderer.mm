@@ -0,0 +1,115 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A spatial renderer implementation that renders headphone output with its own HRTF convolution.
+*/
+#import "BinauralSpatialRenderer.h"
+
+#import <Foundation/Foundation.h>
+
+#include <algorithm>
+
+// The 7.1.4 bed has 12 channels.
+constexpr UInt32 kBedChannelCount = 12;
+
+BinauralSpatialRenderer::BinauralSpatialRenderer(std::unique_ptr<SpatialRenderer> speakerRenderer)
+: mSpeakerRenderer(std::move(speakerRenderer))
+{
+}
+
+OSStatus BinauralSpatialRenderer::prepareOutputType(AUSpatialMixerOutputType outputType)
+{
+    return mSpeakerRenderer->prepareOutputType(outputType);
+}
+
+void BinauralSpatialRenderer::applyOutputType(AUSpatialMixerOutputType outputType)
+{
+    // Start the convolution from silence rather than the tail of an earlier session.
+    if (outputType == kSpatialMixerOutputType_Headphones && mOutputType != outputType) {
+        mConvolver.reset();
+    }
+    mOutputType = outputType;
+    mSpeakerRenderer->applyOutputType(outputType);
+}
+
+void BinauralSpatialRenderer::setOfflineRendering(bool offline)
+{
+    mSpeakerRenderer->setOfflineRendering(offline);
+}
+
+void BinauralSpatialRenderer::setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize)
+{
+    // The convolver doesn’t resample; the kernel converts the input to the output rate first.
+    assert(inInputSampleRate == inOutputSampleRate);
+
+    mSpeakerRenderer->setup(outputType, inInputSampleRate, inOutputSampleRate, inMaxFrameSize);
+    mOutputType = outputType;
+
+    HRIRSet hrirs;
+    NSString * path = [[NSBundle mainBundle] pathForResource:@"HRIR" ofType:@"bin"];
+    if (path != nil && hrirs.load(path.UTF8String)) {
+        hrirs.resample(inOutputSampleRate);
+    }
+    else {
+        hrirs = HRIRSet::sphericalHead(inOutputSampleRate);
+    }
+    mConvolver.setup(speakerPositions(SpeakerLayout::Atmos_7_1_4), hrirs, kPartitionFrames);
+
+    mBedBuffer = AllocatedAudioBufferList(kBedChannelCount, inMaxFrameSize);
+    mBedPointers.assign(kBedChannelCount, nullptr);
+}
+
+UInt32 BinauralSpatialRenderer::getOutputChannelCount()
+{
+    // The wrapped renderer's output format serves every output type; headphones use the first two channels.
+    return mSpeakerRenderer->getOutputChannelCount();
+}
+
+bool BinauralSpatialRenderer::usesInternalReverb()
+{
+    return mOutputType != kSpatialMixerOutputType_Headphones && mSpeakerRenderer->usesInternalReverb();
+}
+
+UInt32 BinauralSpatialRenderer::getLatencyFrames()
+{
+    return mOutputType == kSpatialMixerOutputType_Headphones ? mConvolver.getLatencyFrames() : mSpeakerRenderer->getLatencyFrames();
+}
+
+void BinauralSpatialRenderer::setAudioPullBlock(PullAudioBlock _Nullable block)
+{
+    mInputBlock = block;
+    mSpeakerRenderer->setAudioPullBlock(block);
+}
+
+OSStatus BinauralSpatialRenderer::process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames)
+{
+    if (mOutputType != kSpatialMixerOutputType_Headphones) {
+        return mSpeakerRenderer->process(outputABL, inTimeStamp, inNumberFrames);
+    }
+
+    const auto frameCount = UInt32(inNumberFrames);
+    if (outputABL == nullptr || outputABL->mNumberBuffers < 2 || frameCount > mBedBuffer.getFrameCapacity()) {
+        return kAudio_ParamError;
+    }
+
+    AudioBufferList* bed = mBedBuffer.get();
+    mBedBuffer.setFrameCount(frameCount);
+    for (UInt32 i = 0; i < kBedChannelCount; i++) {
+        memset(bed->mBuffers[i].mData, 0, frameCount * sizeof(float));
+        mBedPointers[i] = static_cast<const float *>(bed->mBuffers[i].mData);
+    }
+    if (mInputBlock != nil) {
+        mInputBlock(bed, frameCount);
+    }
+
+    mConvolver.process(mBedPointers.data(), kBedChannelCount,
+                       static_cast<float *>(outputABL->mBuffers[0].mData),
+                       static_cast<float *>(outputABL->mBuffers[1].mData),
+                       frameCount);
+
+    for (UInt32 i = 2; i < outputABL->mNumberBuffers; i++) {
+        memset(outputABL->mBuffers[i].mData, 0, frameCount * sizeof(float));
+    }
+    return noErr;
+}
@@ -0,0 +1,226 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a portable feedback-delay-network reverb.
+*/
+#include "FDNReverb.hpp"
+#include "VectorKernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+// The line lengths at size 1 spread geometrically between these, in seconds.
+constexpr double kShortestDelay = 0.019;
+constexpr double kLongestDelay = 0.071;
+
+// How far each chunk moves a line's delay toward a new size.
+constexpr double kSizeSmoothing = 0.05;
+
+// Lines modulate at slightly different rates, so their swings don't line up.
+constexpr double kModulationRateSpread = 0.1;
+
+// ln(1000), for a decay of 60 dB.
+constexpr double kDecayExponent = 6.907755278982137;
+
+constexpr float kDenormalThreshold = 1e-15f;
+
+// The sign of a Hadamard matrix entry.
+float hadamardSign(uint32_t row, uint32_t column)
+{
+    return (__builtin_popcount(row & column) & 1) ? -1.0f : 1.0f;
+}
+
+} // namespace
+
+void FDNReverb::setup(uint32_t lineCount, double sampleRate, uint32_t channelCount)
+{
+    assert(lineCount == 8 || lineCount == 16);
+    mSampleRate = sampleRate;
+
+    const auto maxDelay = sampleRate * (kLongestDelay * kMaxSize + kMaxModulationDepth / 1000.0) + kChunkFrames + 2;
+    uint32_t capacity = 1;
+    while (capacity < maxDelay) {
+        capacity <<= 1;
+    }
+    mBufferMask = capacity - 1;
+    mWritePosition = 0;
+
+    mLines.assign(lineCount, Line());
+    mReadDelays.assign(lineCount, 0);
+    mLineInputs.assign(lineCount, std::vector<float>(kChunkFrames, 0.0f));
+    mLineOutputs.assign(lineCount, std::vector<float>(kChunkFrames, 0.0f));
+    for (uint32_t l = 0; l < lineCount; ++l) {
+        auto& line = mLines[l];
+        line.buffer.assign(capacity, 0.0f);
+        line.baseDelay = sampleRate * kShortestDelay * std::pow(kLongestDelay / kShortestDelay, double(l) / (lineCount - 1));
+        line.modulationPhase = 2.0 * M_PI * l / lineCount;
+    }
+    mTapSigns.assign(channelCount, std::vector<float>(lineCount));
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        for (uint32_t l = 0; l < lineCount; ++l) {
+            mTapSigns[c][l] = hadamardSign(c % lineCount, l);
+        }
+    }
+
+    // Start at the current size rather than gliding to it.
+    mAppliedVersion = 0;
+    applyParameters();
+    for (uint32_t l = 0; l < lineCount; ++l) {
+        mLines[l].delay = mLines[l].baseDelay * mTargetSize;
+        mReadDelays[l] = mLines[l].delay;
+    }
+}
+
+void FDNReverb::setParameters(const Parameters& parameters)
+{
+    mDecayTime.store(parameters.decayTime, std::memory_order_relaxed);
+    mHighFrequencyDecayRatio.store(parameters.highFrequencyDecayRatio, std::memory_order_relaxed);
+    mSize.store(parameters.size, std::memory_order_relaxed);
+    mModulationDepth.store(parameters.modulationDepth, std::memory_order_relaxed);
+    mModulationRate.store(parameters.modulationRate, std::memory_order_relaxed);
+    mWetLevel.store(parameters.wetLevel, std::memory_order_relaxed);
+    mDryLevel.store(parameters.dryLevel, std::memory_order_relaxed);
+    mVersion.fetch_add(1, std::memory_order_release);
+}
+
+FDNReverb::Parameters FDNReverb::getParameters() const
+{
+    Parameters parameters;
+    parameters.decayTime = mDecayTime.load(std::memory_order_relaxed);
+    parameters.highFrequencyDecayRatio = mHighFrequencyDecayRatio.load(std::memory_order_relaxed);
+    parameters.size = mSize.load(std::memory_order_relaxed);
+    parameters.modulationDepth = mModulationDepth.load(std::memory_order_relaxed);
+    parameters.modulationRate = mModulationRate.load(std::memory_order_relaxed);
+    parameters.wetLevel = mWetLevel.load(std::memory_order_relaxed);
+    parameters.dryLevel = mDryLevel.load(std::memory_order_relaxed);
+    return parameters;
+}
+
+void FDNReverb::reset()
+{
+    for (auto& line : mLines) {
+        std::fill(line.buffer.begin(), line.buffer.end(), 0.0f);
+        line.filterState = 0;
+    }
+}
+
+void FDNReverb::applyParameters()
+{
+    const auto version = mVersion.load(std::memory_order_acquire);
+    if (version == mAppliedVersion) {
+        return;
+    }
+    mAppliedVersion = version;
+
+    const auto parameters = getParameters();
+    mTargetSize = std::clamp(parameters.size, kMinSize, kMaxSize);
+    mModulationDepthFrames = std::clamp(parameters.modulationDepth, 0.0f, kMaxModulationDepth) / 1000.0 * mSampleRate;
+    mModulationIncrement = 2.0 * M_PI * std::max(parameters.modulationRate, 0.0f) / mSampleRate;
+    mWetGain = parameters.wetLevel;
+    mDryGain = parameters.dryLevel;
+
+    // Give each line the loss that decays the whole network at the requested rate,
+    // in proportion to its length, with more loss at high frequencies.
+    const auto decayTime = std::max(parameters.decayTime, 0.05f);
+    const auto highFrequencyDecayTime = decayTime * std::clamp(parameters.highFrequencyDecayRatio, 0.05f, 1.0f);
+    for (auto& line : mLines) {
+        const auto delay = line.baseDelay * mTargetSize;
+        const auto gain = std::exp(-kDecayExponent * delay / (decayTime * mSampleRate));
+        const auto highFrequencyGain = std::exp(-kDecayExponent * delay / (highFrequencyDecayTime * mSampleRate));
+        line.gain = float(gain);
+        line.pole = float((gain - highFrequencyGain) / (gain + highFrequencyGain));
+    }
+}
+
+void FDNReverb::process(float* const* channels, uint32_t channelCount, uint32_t frameCount)
+{
+    if (mLines.empty()) {
+        return;
+    }
+    applyParameters();
+
+    channelCount = std::min(channelCount, getChannelCount());
+    for (uint32_t offset = 0; offset < frameCount; offset += kChunkFrames) {
+        processChunk(channels, channelCount, offset, std::min(kChunkFrames, frameCount - offset));
+    }
+}
+
+void FDNReverb::processChunk(float* const* channels, uint32_t channelCount, uint32_t offset, uint32_t frameCount)
+{
+    const auto lineCount = uint32_t(mLines.size());
+    const auto normalization = 1.0f / std::sqrt(float(lineCount));
+
+    // Sum the channels into the lines, wrapping around when there are more channels than lines.
+    for (auto& input : mLineInputs) {
+        std::fill_n(input.begin(), frameCount, 0.0f);
+    }
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        VectorKernels::mix(mLineInputs[c % lineCount].data(), channels[c] + offset, frameCount, 1.0f);
+    }
+
+    // Read each line at its modulated delay, ramping from the last chunk's delay to this one's.
+    const auto minimumDelay = double(kChunkFrames) + mModulationDepthFrames + 2;
+    for (uint32_t l = 0; l < lineCount; ++l) {
+        auto& line = mLines[l];
+        line.delay += (line.baseDelay * mTargetSize - line.delay) * kSizeSmoothing;
+        line.modulationPhase += mModulationIncrement * frameCount * (1.0 + kModulationRateSpread * l / lineCount);
+        if (line.modulationPhase >= 2.0 * M_PI) {
+            line.modulationPhase -= 2.0 * M_PI;
+        }
+        const auto endDelay = std::max(line.delay + mModulationDepthFrames * std::sin(line.modulationPhase), minimumDelay);
+        const auto startDelay = mReadDelays[l];
+        const auto delayStep = (endDelay - startDelay) / frameCount;
+        mReadDelays[l] = endDelay;
+
+        const float* buffer = line.buffer.data();
+        const float feedforward = line.gain * (1.0f - line.pole);
+        const float pole = line.pole;
+        float state = line.filterState;
+        float* output = mLineOutputs[l].data();
+        for (uint32_t t = 0; t < frameCount; ++t) {
+            const auto position = double(mWritePosition) + t - (startDelay + delayStep * t);
+            const auto index = int64_t(std::floor(position));
+            const auto fraction = float(position - double(index));
+            const float a = buffer[uint32_t(index) & mBufferMask];
+            const float b = buffer[uint32_t(index + 1) & mBufferMask];
+            state = feedforward * (a + (b - a) * fraction) + pole * state;
+            output[t] = state;
+        }
+        line.filterState = std::fabs(state) < kDenormalThreshold ? 0.0f : state;
+    }
+
+    // Tap the lines into each channel through a row of a Hadamard matrix.
+    const auto tapGain = mWetGain * normalization;
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        float* channel = channels[c] + offset;
+        VectorKernels::scale(channel, frameCount, mDryGain);
+        for (uint32_t l = 0; l < lineCount; ++l) {
+            VectorKernels::mix(channel, mLineOutputs[l].data(), frameCount, mTapSigns[c][l] * tapGain);
+        }
+    }
+
+    // Mix the lines through the Hadamard matrix in butterfly stages, and feed them back with the input.
+    for (uint32_t half = 1; half < lineCount; half <<= 1) {
+        for (uint32_t start = 0; start < lineCount; start += 2 * half) {
+            for (uint32_t l = start; l < start + half; ++l) {
+                VectorKernels::butterfly(mLineOutputs[l].data(), mLineOutputs[l + half].data(), frameCount);
+            }
+        }
+    }
+    const auto writeStart = mWritePosition & mBufferMask;
+    const auto firstFrames = std::min(frameCount, mBufferMask + 1 - writeStart);
+    for (uint32_t l = 0; l < lineCount; ++l) {
+        float* buffer = mLines[l].buffer.data();
+        const float* input = mLineInputs[l].data();
+        const float* feedback = mLineOutputs[l].data();
+        memcpy(buffer + writeStart, input, firstFrames * sizeof(float));
+        VectorKernels::mix(buffer + writeStart, feedback, firstFrames, normalization);
+        memcpy(buffer, input + firstFrames, (frameCount - firstFrames) * sizeof(float));
+        VectorKernels::mix(buffer, feedback + firstFrames, frameCount - firstFrames, normalization);
+    }
+    mWritePosition += frameCount;
+}
@@ -0,0 +1,117 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable feedback-delay-network reverb for deinterleaved audio.
+*/
+#ifndef FDNReverb_hpp
+#define FDNReverb_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Feeds every output channel into a network of modulated delay lines that
+// mix through a Hadamard matrix, and adds the decorrelated network output back
+// to each channel. The matrix runs as butterfly stages across whole blocks of
+// each line, so it vectorizes over time rather than over lines.
+class FDNReverb
+{
+public:
+    struct Parameters
+    {
+        // The time for the reverb to decay by 60 dB at low frequencies, in seconds.
+        float decayTime{1.8f};
+        // The high-frequency decay time as a fraction of `decayTime`, from 0.05 to 1.
+        float highFrequencyDecayRatio{0.5f};
+        // Scales the delay lengths, from `kMinSize` to `kMaxSize`. Larger rooms sound sparser.
+        float size{1.0f};
+        // How far the delay lengths swing, in milliseconds, and how fast, in hertz.
+        // The swing breaks up the metallic ringing of fixed delays.
+        float modulationDepth{0.5f};
+        float modulationRate{0.6f};
+        float wetLevel{0.2f};
+        float dryLevel{1.0f};
+    };
+
+    FDNReverb() = default;
+    FDNReverb(const FDNReverb&) = delete;
+    FDNReverb& operator=(const FDNReverb&) = delete;
+
+    // Allocates delay lines for `lineCount` lines, 8 or 16, long enough for every size,
+    // and the taps for `channelCount` channels. Channels past the line count share the
+    // network outputs of earlier channels.
+    void setup(uint32_t lineCount, double sampleRate, uint32_t channelCount);
+
+    // Safe to call from any one thread while rendering; the change is picked up at the next block.
+    void setParameters(const Parameters& parameters);
+    Parameters getParameters() const;
+
+    // Adds the reverb to `channels` in place. Channels past the count passed to `setup`
+    // pass through unchanged. Real-time safe.
+    void process(float* const* channels, uint32_t channelCount, uint32_t frameCount);
+
+    // Clears the delay lines.
+    void reset();
+
+    uint32_t getLineCount() const { return static_cast<uint32_t>(mLines.size()); }
+    uint32_t getChannelCount() const { return static_cast<uint32_t>(mTapSigns.size()); }
+
+    static constexpr float kMinSize = 0.25f;
+    static constexpr float kMaxSize = 2.0f;
+    static constexpr float kMaxModulationDepth = 2.0f;
+
+private:
+    // Each block runs in chunks no longer than the shortest delay, so a chunk
+    // only reads what earlier chunks have already written.
+    static constexpr uint32_t kChunkFrames = 64;
+
+    struct Line
+    {
+        std::vector<float> buffer;
+        // The delay at size 1 and the current, smoothed delay, in frames.
+        double baseDelay{0};
+        double delay{0};
+        double modulationPhase{0};
+        // A one-pole low-pass with a DC gain of `gain`, which sets both decay times.
+        float gain{0};
+        float pole{0};
+        float filterState{0};
+    };
+
+    void applyParameters();
+    void processChunk(float* const* channels, uint32_t channelCount, uint32_t offset, uint32_t frameCount);
+
+    std::vector<Line> mLines;
+    uint32_t mBufferMask{0};
+    uint32_t mWritePosition{0};
+    double mSampleRate{0};
+
+    // Each channel's row of the Hadamard matrix, which decorrelates the channels' taps.
+    std::vector<std::vector<float>> mTapSigns;
+
+    // The delay each line reads at the start of the next chunk, including modulation.
+    std::vector<double> mReadDelays;
+    std::vector<std::vector<float>> mLineInputs;
+    std::vector<std::vector<float>> mLineOutputs;
+
+    std::atomic<float> mDecayTime{Parameters().decayTime};
+    std::atomic<float> mHighFrequencyDecayRatio{Parameters().highFrequencyDecayRatio};
+    std::atomic<float> mSize{Parameters().size};
+    std::atomic<float> mModulationDepth{Parameters().modulationDepth};
+    std::atomic<float> mModulationRate{Parameters().modulationRate};
+    std::atomic<float> mWetLevel{Parameters().wetLevel};
+    std::atomic<float> mDryLevel{Parameters().dryLevel};
+    std::atomic<uint32_t> mVersion{1};
+    uint32_t mAppliedVersion{0};
+
+    // Render-thread copies of the parameters.
+    double mTargetSize{1};
+    double mModulationDepthFrames{0};
+    // The modulation phase change per frame, in radians.
+    double mModulationIncrement{0};
+    float mWetGain{0};
+    float mDryGain{1};
+};
+
+#endif /* FDNReverb_hpp */
@@ -18,6 +18,10 @@ class OutputAU
 
 public:
     OutputAU();
+#if TARGET_OS_OSX
+    // Renders to a specific device instead of the default output device.
+    explicit OutputAU(AudioDeviceID deviceID);
+#endif
     OutputAU(const OutputAU&) = delete;
     OutputAU& operator=(const OutputAU&) = delete;
     ~OutputAU();
@@ -27,11 +31,23 @@ public:
     
     void setCallback(void * context, AURenderCallback callback);
     double getSampleRate();
+    // The number of channels the output device plays.
+    UInt32 getOutputChannelCount();
+    
+    // Asks for an I/O buffer of `frameCount` frames and returns the size the device granted,
+    // which can differ. Smaller buffers lower the latency and raise the render callback's rate.
+    UInt32 setBufferFrameSize(UInt32 frameCount);
+    UInt32 getBufferFrameSize();
+    
+    // The time from a frame leaving the render callback to it reaching the output, in seconds.
+    double getOutputLatency();
     
     bool start();
     bool stop();
     
 private:    
+    void create();
+    
     AudioComponentInstance mAU{nullptr};
 #if TARGET_OS_OSX
     AudioDeviceID mOutputDeviceID{};
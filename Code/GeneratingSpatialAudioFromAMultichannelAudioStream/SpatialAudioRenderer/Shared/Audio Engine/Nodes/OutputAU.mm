@@ -12,10 +12,39 @@ A class that implements wrapping a system I/O audio unit.
 #import <IOKit/audio/IOAudioTypes.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <string>
 
+#if TARGET_OS_OSX
+// Reads a 32-bit output property of a device or stream, or returns 0 if it has none.
+static UInt32 getOutputProperty(AudioObjectID object, AudioObjectPropertySelector selector)
+{
+	UInt32 value = 0;
+	UInt32 size = sizeof(value);
+	AudioObjectPropertyAddress address{selector, kAudioDevicePropertyScopeOutput, kAudioObjectPropertyElementMain};
+	if (AudioObjectGetPropertyData(object, &address, 0, nullptr, &size, &value) != noErr) {
+		return 0;
+	}
+	return value;
+}
+#endif
+
 OutputAU::OutputAU()
+{
+	create();
+}
+
+#if TARGET_OS_OSX
+OutputAU::OutputAU(AudioDeviceID deviceID)
+: mOutputDeviceID(deviceID)
+{
+	create();
+}
+#endif
+
+void OutputAU::create()
 {
 	AudioComponentDescription description;
 	description.componentType = kAudioUnitType_Output;
@@ -72,26 +101,20 @@ void OutputAU::init()
 	}
 	
 	uint32_t size = sizeof(AudioDeviceID);
-	AudioObjectPropertyAddress theAddress{kAudioHardwarePropertyDefaultOutputDevice, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMain};
-	
-	status = AudioObjectGetPropertyData(AudioObjectID(kAudioObjectSystemObject), &theAddress, outputElement, nil, &size, &mOutputDeviceID);
-	if (status != noErr) {
-		throw std::runtime_error("Failed to get the default output device [OSStatus: " + std::to_string(status) + "]");
+	if (mOutputDeviceID == kAudioObjectUnknown) {
+		AudioObjectPropertyAddress theAddress{kAudioHardwarePropertyDefaultOutputDevice, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMain};
+		
+		status = AudioObjectGetPropertyData(AudioObjectID(kAudioObjectSystemObject), &theAddress, outputElement, nil, &size, &mOutputDeviceID);
+		if (status != noErr) {
+			throw std::runtime_error("Failed to get the default output device [OSStatus: " + std::to_string(status) + "]");
+		}
 	}
 	
-	//Set the current device to the default output device.
+	//Set the current device to the requested or default output device.
 	//This should be done only after I/O is enabled on the output audio unit.
 	status = AudioUnitSetProperty(mAU, kAudioOutputUnitProperty_CurrentDevice, kAudioUnitScope_Global, outputElement, &mOutputDeviceID, size);
 	if (status != noErr) {
-		throw std::runtime_error("Failed to set the default output device [OSStatus: " + std::to_string(status) + "]");
-	}
-	
-	uint32_t bufferTypeSize = 0;
-	
-	AudioObjectPropertyAddress bufferFrameSizeAddress{kAudioDevicePropertyBufferFrameSize, kAudioDevicePropertyScopeOutput, kAudioObjectPropertyScopeGlobal};
-	status = AudioObjectGetPropertyData(mOutputDeviceID, &bufferFrameSizeAddress, 0, nil, &bufferTypeSize, &bufferTypeSize);
-	if (status != noErr) {
-		throw std::runtime_error("Failed to get the device buffer size [OSStatus: " + std::to_string(status) + "]");
+		throw std::runtime_error("Failed to set the output device [OSStatus: " + std::to_string(status) + "]");
 	}
 #endif
 }
@@ -203,6 +226,82 @@ double OutputAU::getSampleRate()
 #endif
 }
 
+UInt32 OutputAU::getOutputChannelCount()
+{
+	// The output scope of the output element is the device side of the unit.
+	AudioStreamBasicDescription asbd = {};
+	UInt32 size = sizeof(asbd);
+	const auto status = AudioUnitGetProperty(mAU, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &asbd, &size);
+	if (status != noErr) {
+		return 0;
+	}
+	return asbd.mChannelsPerFrame;
+}
+
+// MARK: - Latency
+
+UInt32 OutputAU::setBufferFrameSize(UInt32 frameCount)
+{
+#if TARGET_OS_OSX
+	// Keep the request within the range the device supports.
+	AudioValueRange range{};
+	UInt32 size = sizeof(range);
+	AudioObjectPropertyAddress rangeAddress{kAudioDevicePropertyBufferFrameSizeRange, kAudioDevicePropertyScopeOutput, kAudioObjectPropertyElementMain};
+	auto status = AudioObjectGetPropertyData(mOutputDeviceID, &rangeAddress, 0, nullptr, &size, &range);
+	if (status == noErr) {
+		frameCount = std::clamp(frameCount, UInt32(range.mMinimum), UInt32(range.mMaximum));
+	}
+	
+	AudioObjectPropertyAddress bufferFrameSizeAddress{kAudioDevicePropertyBufferFrameSize, kAudioDevicePropertyScopeOutput, kAudioObjectPropertyElementMain};
+	status = AudioObjectSetPropertyData(mOutputDeviceID, &bufferFrameSizeAddress, 0, nullptr, sizeof(frameCount), &frameCount);
+	if (status != noErr) {
+		throw std::runtime_error("Failed to set the device buffer size [OSStatus: " + std::to_string(status) + "]");
+	}
+#else
+	// The session rounds the duration to a buffer size the hardware supports.
+	AVAudioSession *audioSession = [AVAudioSession sharedInstance];
+	NSError *error = nil;
+	if (![audioSession setPreferredIOBufferDuration:frameCount / audioSession.sampleRate error:&error]) {
+		throw std::runtime_error("Failed to set the preferred I/O buffer duration [" + std::string(error.localizedDescription.UTF8String) + "]");
+	}
+#endif
+	return getBufferFrameSize();
+}
+
+UInt32 OutputAU::getBufferFrameSize()
+{
+#if TARGET_OS_OSX
+	return getOutputProperty(mOutputDeviceID, kAudioDevicePropertyBufferFrameSize);
+#else
+	AVAudioSession *audioSession = [AVAudioSession sharedInstance];
+	return UInt32(std::lround(audioSession.IOBufferDuration * audioSession.sampleRate));
+#endif
+}
+
+double OutputAU::getOutputLatency()
+{
+#if TARGET_OS_OSX
+	// A frame rendered now reaches the device after the rest of the buffer it's in, the
+	// safety offset the HAL writes ahead of the hardware, and the device and stream latencies.
+	UInt32 latencyFrames = getBufferFrameSize();
+	latencyFrames += getOutputProperty(mOutputDeviceID, kAudioDevicePropertySafetyOffset);
+	latencyFrames += getOutputProperty(mOutputDeviceID, kAudioDevicePropertyLatency);
+	
+	AudioStreamID stream = kAudioObjectUnknown;
+	UInt32 size = sizeof(stream);
+	AudioObjectPropertyAddress streamsAddress{kAudioDevicePropertyStreams, kAudioDevicePropertyScopeOutput, kAudioObjectPropertyElementMain};
+	if (AudioObjectGetPropertyData(mOutputDeviceID, &streamsAddress, 0, nullptr, &size, &stream) == noErr && size >= sizeof(stream)) {
+		latencyFrames += getOutputProperty(stream, kAudioStreamPropertyLatency);
+	}
+	
+	const auto sampleRate = getSampleRate();
+	return sampleRate > 0 ? latencyFrames / sampleRate : 0;
+#else
+	AVAudioSession *audioSession = [AVAudioSession sharedInstance];
+	return audioSession.IOBufferDuration + audioSession.outputLatency;
+#endif
+}
+
 // MARK: - Transport
 
 bool OutputAU::start()
@@ -0,0 +1,245 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements a memory-mapped cache of decoded, deinterleaved audio.
+*/
+#include "PCMCache.hpp"
+#include "VectorKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[4] = {'P', 'C', 'M', 'C'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kWriteChunkFrames = 16384;
+
+// How much of each plane to ask the system to read ahead when a cache opens.
+constexpr uint64_t kPrefetchFrames = 48000;
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t sampleSize(PCMSampleFormat format)
+{
+    return format == PCMSampleFormat::Float16 ? sizeof(uint16_t) : sizeof(float);
+}
+
+// Rounds a float to the nearest half-precision value, with ties to even.
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const auto sign = uint16_t((bits >> 16) & 0x8000);
+    const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude >= 0x7F800000) {
+        // Infinity stays infinity, and NaN stays a quiet NaN.
+        return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+    }
+    if (magnitude >= 0x477FF000) {
+        // 65520 and up round past the largest half.
+        return sign | 0x7C00;
+    }
+    if (magnitude < 0x38800000) {
+        // Below the smallest normal half, the value is a multiple of 2^-24.
+        return sign | uint16_t(std::nearbyint(std::fabs(value) * 16777216.0f));
+    }
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    const uint32_t remainder = magnitude & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        ++half;
+    }
+    return sign | uint16_t(half);
+}
+
+bool writeAll(int descriptor, const void* data, size_t length, off_t offset)
+{
+    auto bytes = static_cast<const uint8_t *>(data);
+    while (length > 0) {
+        const auto written = pwrite(descriptor, bytes, length, offset);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        length -= size_t(written);
+        offset += written;
+    }
+    return true;
+}
+
+std::mutex gOpenCachesMutex;
+std::unordered_map<std::string, std::weak_ptr<const PCMCache>> gOpenCaches;
+
+} // namespace
+
+bool PCMCache::write(const std::string& path, StreamingSource& source, uint64_t frameCount, PCMSampleFormat sampleFormat)
+{
+    const auto channelCount = source.channelCount();
+    if (channelCount == 0 || frameCount == 0 || !source.rewind()) {
+        return false;
+    }
+
+    PCMCacheHeader header{};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.channelCount = channelCount;
+    header.sampleFormat = sampleFormat;
+    header.sampleRate = source.sampleRate();
+    header.frameCount = frameCount;
+    header.dataOffset = alignUp(sizeof(PCMCacheHeader), kPlaneAlignment);
+    header.planeStride = alignUp(frameCount * sampleSize(sampleFormat), kPlaneAlignment);
+
+    // Write next to the destination and rename into place when complete.
+    std::string temporaryPath = path + ".XXXXXX";
+    const int descriptor = mkstemp(temporaryPath.data());
+    if (descriptor < 0) {
+        return false;
+    }
+    const auto fileLength = header.dataOffset + header.planeStride * channelCount;
+    bool succeeded = ftruncate(descriptor, off_t(fileLength)) == 0;
+
+    std::vector<std::vector<float>> chunk(channelCount, std::vector<float>(kWriteChunkFrames));
+    std::vector<float*> chunkPointers;
+    for (auto& plane : chunk) {
+        chunkPointers.push_back(plane.data());
+    }
+    std::vector<uint16_t> halfChunk(sampleFormat == PCMSampleFormat::Float16 ? kWriteChunkFrames : 0);
+
+    uint64_t position = 0;
+    while (succeeded && position < frameCount) {
+        const auto framesToRead = size_t(std::min<uint64_t>(kWriteChunkFrames, frameCount - position));
+        const auto framesRead = source.read(chunkPointers.data(), framesToRead);
+        if (framesRead == 0) {
+            // The source is shorter than it claimed; the rest of each plane stays silent.
+            break;
+        }
+        for (uint32_t c = 0; c < channelCount && succeeded; ++c) {
+            const auto offset = off_t(header.dataOffset + c * header.planeStride + position * sampleSize(sampleFormat));
+            if (sampleFormat == PCMSampleFormat::Float16) {
+                for (size_t i = 0; i < framesRead; ++i) {
+                    halfChunk[i] = floatToHalf(chunk[c][i]);
+                }
+                succeeded = writeAll(descriptor, halfChunk.data(), framesRead * sizeof(uint16_t), offset);
+            }
+            else {
+                succeeded = writeAll(descriptor, chunk[c].data(), framesRead * sizeof(float), offset);
+            }
+        }
+        position += framesRead;
+    }
+
+    // Write the header last, so an interrupted write never looks like a valid cache.
+    succeeded = succeeded && writeAll(descriptor, &header, sizeof(header), 0);
+    succeeded = (close(descriptor) == 0) && succeeded;
+    succeeded = succeeded && rename(temporaryPath.c_str(), path.c_str()) == 0;
+    if (!succeeded) {
+        unlink(temporaryPath.c_str());
+    }
+    return succeeded;
+}
+
+std::shared_ptr<const PCMCache> PCMCache::open(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(gOpenCachesMutex);
+    if (auto cache = gOpenCaches[path].lock()) {
+        return cache;
+    }
+
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || size_t(status.st_size) < sizeof(PCMCacheHeader)) {
+        close(descriptor);
+        return nullptr;
+    }
+
+    // A shared, read-only mapping is backed by the file's pages in the system
+    // cache, so other mappings of the same file don't duplicate the memory.
+    const auto mappingLength = size_t(status.st_size);
+    void* mapping = mmap(nullptr, mappingLength, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    PCMCacheHeader header;
+    memcpy(&header, mapping, sizeof(header));
+    const bool valid = memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+                       header.version == kVersion &&
+                       header.channelCount > 0 &&
+                       (header.sampleFormat == PCMSampleFormat::Float32 || header.sampleFormat == PCMSampleFormat::Float16) &&
+                       header.dataOffset % kPlaneAlignment == 0 &&
+                       header.planeStride % kPlaneAlignment == 0 &&
+                       header.planeStride >= header.frameCount * sampleSize(header.sampleFormat) &&
+                       header.dataOffset + header.planeStride * header.channelCount <= mappingLength;
+    if (!valid) {
+        munmap(mapping, mappingLength);
+        return nullptr;
+    }
+
+    // Start reading the beginning of each plane so the first render cycles don't fault.
+    const auto prefetchLength = std::min<uint64_t>(kPrefetchFrames, header.frameCount) * sampleSize(header.sampleFormat);
+    for (uint32_t c = 0; c < header.channelCount; ++c) {
+        const auto planeOffset = header.dataOffset + c * header.planeStride;
+        const auto pageStart = planeOffset / getpagesize() * getpagesize();
+        madvise(static_cast<uint8_t *>(mapping) + pageStart, size_t(planeOffset - pageStart + prefetchLength), MADV_WILLNEED);
+    }
+
+    std::shared_ptr<const PCMCache> cache(new PCMCache(header, static_cast<const uint8_t *>(mapping), mappingLength));
+    gOpenCaches[path] = cache;
+    return cache;
+}
+
+PCMCache::PCMCache(const PCMCacheHeader& header, const uint8_t* mapping, size_t mappingLength)
+: mHeader(header),
+  mMapping(mapping),
+  mMappingLength(mappingLength)
+{
+}
+
+PCMCache::~PCMCache()
+{
+    munmap(const_cast<uint8_t *>(mMapping), mMappingLength);
+}
+
+const float* PCMCache::floatChannel(uint32_t channel) const
+{
+    if (channel >= mHeader.channelCount || mHeader.sampleFormat != PCMSampleFormat::Float32) {
+        return nullptr;
+    }
+    return reinterpret_cast<const float *>(plane(channel));
+}
+
+size_t PCMCache::read(float* const* channels, uint32_t channelCount, uint64_t position, size_t frameCount) const
+{
+    if (position >= mHeader.frameCount) {
+        return 0;
+    }
+    const auto frames = size_t(std::min<uint64_t>(frameCount, mHeader.frameCount - position));
+    const auto count = std::min(channelCount, mHeader.channelCount);
+    for (uint32_t c = 0; c < count; ++c) {
+        if (mHeader.sampleFormat == PCMSampleFormat::Float16) {
+            VectorKernels::convertHalfToFloat(channels[c], reinterpret_cast<const uint16_t *>(plane(c)) + position, frames);
+        }
+        else {
+            memcpy(channels[c], reinterpret_cast<const float *>(plane(c)) + position, frames * sizeof(float));
+        }
+    }
+    return frames;
+}
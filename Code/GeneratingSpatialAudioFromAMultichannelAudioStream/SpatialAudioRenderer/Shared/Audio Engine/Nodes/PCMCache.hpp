@@ -0,0 +1,79 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A memory-mapped cache of decoded, deinterleaved audio.
+*/
+#ifndef PCMCache_hpp
+#define PCMCache_hpp
+
+#include "StreamingDecoder.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum class PCMSampleFormat : uint32_t
+{
+    Float32 = 0,
+    // IEEE half precision, for half the disk and memory footprint.
+    Float16 = 1
+};
+
+// The file starts with this header, followed by one plane per channel. Each
+// plane starts on a 64-byte boundary, so the mapped samples are ready for vector loads.
+struct PCMCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t channelCount;
+    PCMSampleFormat sampleFormat;
+    double sampleRate;
+    uint64_t frameCount;
+    // The byte offset of the first plane, and the distance between planes.
+    uint64_t dataOffset;
+    uint64_t planeStride;
+};
+
+class PCMCache
+{
+public:
+    static constexpr size_t kPlaneAlignment = 64;
+
+    // Decodes all of `source` into a new cache file at `path`. The file appears
+    // atomically, so a concurrent reader never maps a partial cache.
+    static bool write(const std::string& path, StreamingSource& source, uint64_t frameCount,
+                      PCMSampleFormat sampleFormat = PCMSampleFormat::Float32);
+
+    // Maps the cache at `path`, or returns null if it's missing or invalid.
+    // Every caller in the process that opens the same path shares one mapping.
+    static std::shared_ptr<const PCMCache> open(const std::string& path);
+
+    PCMCache(const PCMCache&) = delete;
+    PCMCache& operator=(const PCMCache&) = delete;
+    ~PCMCache();
+
+    uint32_t channelCount() const { return mHeader.channelCount; }
+    double sampleRate() const { return mHeader.sampleRate; }
+    uint64_t frameCount() const { return mHeader.frameCount; }
+    PCMSampleFormat sampleFormat() const { return mHeader.sampleFormat; }
+
+    // A channel's mapped samples when the format is `Float32`, or null otherwise.
+    const float* floatChannel(uint32_t channel) const;
+
+    // Real-time safe, apart from page faults. Copies up to `frameCount` frames
+    // starting at `position` into `channels`, converting from half precision if
+    // needed, and returns the number of frames copied.
+    size_t read(float* const* channels, uint32_t channelCount, uint64_t position, size_t frameCount) const;
+
+private:
+    PCMCache(const PCMCacheHeader& header, const uint8_t* mapping, size_t mappingLength);
+
+    const uint8_t* plane(uint32_t channel) const { return mMapping + mHeader.dataOffset + channel * mHeader.planeStride; }
+
+    PCMCacheHeader mHeader;
+    const uint8_t* mMapping;
+    size_t mMappingLength;
+};
+
+#endif /* PCMCache_hpp */
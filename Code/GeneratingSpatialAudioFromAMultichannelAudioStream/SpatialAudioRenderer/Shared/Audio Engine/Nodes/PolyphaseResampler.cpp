@@ -0,0 +1,166 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable polyphase FIR sample-rate converter that implements conversion of deinterleaved audio.
+*/
+#include "PolyphaseResampler.hpp"
+#include "VectorKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+struct FilterDesign
+{
+    uint32_t tapCount;
+    // The passband edge as a fraction of the lower Nyquist frequency.
+    double cutoff;
+    // The Kaiser window shape; larger values trade transition width for stopband attenuation.
+    double beta;
+};
+
+FilterDesign filterDesign(ResamplerQuality quality)
+{
+    switch (quality) {
+        case ResamplerQuality::Low:
+            return {16, 0.85, 6.0};
+        case ResamplerQuality::Medium:
+            return {32, 0.91, 8.0};
+        case ResamplerQuality::High:
+            return {64, 0.95, 10.0};
+    }
+    return {32, 0.91, 8.0};
+}
+
+// The zeroth-order modified Bessel function of the first kind.
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+} // namespace
+
+uint32_t PolyphaseResampler::tapCount(ResamplerQuality quality)
+{
+    return filterDesign(quality).tapCount;
+}
+
+void PolyphaseResampler::setup(uint32_t channelCount, double inputSampleRate, double outputSampleRate,
+                               uint32_t maxOutputFrames, ResamplerQuality quality)
+{
+    const auto design = filterDesign(quality);
+    mTapCount = design.tapCount;
+    mNominalStep = mStep = inputSampleRate / outputSampleRate;
+    mMaxOutputFrames = maxOutputFrames;
+
+    // When downsampling, lower the cutoff to the output's Nyquist frequency to prevent aliasing.
+    const double cutoff = design.cutoff * std::min(1.0, outputSampleRate / inputSampleRate);
+    const double halfLength = mTapCount / 2.0;
+    const double windowScale = 1.0 / besselI0(design.beta);
+
+    mFilterBank.assign((kPhaseCount + 1) * mTapCount, 0.0f);
+    for (uint32_t phase = 0; phase <= kPhaseCount; ++phase) {
+        const double fraction = double(phase) / kPhaseCount;
+        float* row = mFilterBank.data() + phase * mTapCount;
+        double sum = 0;
+        for (uint32_t k = 0; k < mTapCount; ++k) {
+            // The distance from the output instant to input tap `k`.
+            const double x = double(k) - (halfLength - 1.0) - fraction;
+            const double sinc = (x == 0) ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            const double r = x / halfLength;
+            const double window = (std::fabs(r) <= 1.0) ? besselI0(design.beta * std::sqrt(1.0 - r * r)) * windowScale : 0.0;
+            row[k] = float(sinc * window);
+            sum += row[k];
+        }
+        // Normalize each phase to unity gain at DC so the interpolated rows don't ripple.
+        for (uint32_t k = 0; k < mTapCount; ++k) {
+            row[k] = float(row[k] / sum);
+        }
+    }
+    mKernel.assign(mTapCount, 0.0f);
+
+    // Size the history for the most input a single request can need at the fastest allowed ratio.
+    const auto maxStep = mNominalStep * (1.0 + kMaxRatioDeviation);
+    mHistoryFrames = uint32_t(std::ceil(maxOutputFrames * maxStep)) + mTapCount + 2;
+    mHistory.assign(channelCount, std::vector<float>(mHistoryFrames, 0.0f));
+    mPullPointers.assign(channelCount, nullptr);
+    reset();
+}
+
+void PolyphaseResampler::setRatio(double inputFramesPerOutputFrame)
+{
+    const auto lower = mNominalStep * (1.0 - kMaxRatioDeviation);
+    const auto upper = mNominalStep * (1.0 + kMaxRatioDeviation);
+    mStep = std::clamp(inputFramesPerOutputFrame, lower, upper);
+}
+
+void PolyphaseResampler::reset()
+{
+    for (auto& channel : mHistory) {
+        std::fill(channel.begin(), channel.end(), 0.0f);
+    }
+    // Start with half a filter of silence behind the first input frame.
+    mAvailableFrames = mTapCount / 2 - 1;
+    mPosition = mTapCount / 2 - 1;
+}
+
+void PolyphaseResampler::process(float* const* outputs, uint32_t frameCount, PullCallback pull, void* context)
+{
+    const auto halfTaps = mTapCount / 2;
+
+    for (uint32_t offset = 0; offset < frameCount; offset += mMaxOutputFrames) {
+        const auto frames = std::min(frameCount - offset, mMaxOutputFrames);
+
+        // Pull enough input to cover the filter around the last output frame.
+        const auto lastPosition = mPosition + (frames - 1) * mStep;
+        const auto requiredFrames = std::min<uint32_t>(uint32_t(std::floor(lastPosition)) + halfTaps + 1, mHistoryFrames);
+        if (requiredFrames > mAvailableFrames) {
+            const auto pullFrames = requiredFrames - mAvailableFrames;
+            for (size_t c = 0; c < mHistory.size(); ++c) {
+                mPullPointers[c] = mHistory[c].data() + mAvailableFrames;
+                memset(mPullPointers[c], 0, pullFrames * sizeof(float));
+            }
+            pull(context, mPullPointers.data(), getChannelCount(), pullFrames);
+            mAvailableFrames = requiredFrames;
+        }
+
+        // Interpolate the filter once per output frame and apply it to every channel.
+        double position = mPosition;
+        for (uint32_t i = 0; i < frames; ++i) {
+            const auto index = uint32_t(position);
+            const double phase = (position - index) * kPhaseCount;
+            const auto row = std::min(uint32_t(phase), kPhaseCount - 1);
+            VectorKernels::interpolate(mKernel.data(),
+                                       mFilterBank.data() + row * mTapCount,
+                                       mFilterBank.data() + (row + 1) * mTapCount,
+                                       mTapCount,
+                                       float(phase - row));
+
+            const auto first = index + 1 - halfTaps;
+            for (size_t c = 0; c < mHistory.size(); ++c) {
+                outputs[c][offset + i] = VectorKernels::dotProduct(mHistory[c].data() + first, mKernel.data(), mTapCount);
+            }
+            position += mStep;
+        }
+
+        // Keep only the input the next request's filter can still reach.
+        const auto consumed = std::min<uint32_t>(uint32_t(position) + 1 - halfTaps, mAvailableFrames);
+        for (auto& channel : mHistory) {
+            memmove(channel.data(), channel.data() + consumed, (mAvailableFrames - consumed) * sizeof(float));
+        }
+        mAvailableFrames -= consumed;
+        mPosition = position - consumed;
+    }
+}
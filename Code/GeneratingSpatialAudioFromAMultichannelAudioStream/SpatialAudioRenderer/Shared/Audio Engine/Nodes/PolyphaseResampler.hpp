@@ -0,0 +1,81 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable polyphase FIR sample-rate converter for deinterleaved audio.
+*/
+#ifndef PolyphaseResampler_hpp
+#define PolyphaseResampler_hpp
+
+#include <cstdint>
+#include <vector>
+
+enum class ResamplerQuality
+{
+    // 16 taps, for previews and low-power devices.
+    Low,
+    // 32 taps, the default for playback.
+    Medium,
+    // 64 taps, for mastering and offline rendering.
+    High
+};
+
+class PolyphaseResampler
+{
+public:
+    // Fills `channels` with exactly `frameCount` frames of input. The resampler
+    // decides how much input to pull to produce the output it's asked for.
+    using PullCallback = void (*)(void* context, float* const* channels, uint32_t channelCount, uint32_t frameCount);
+
+    PolyphaseResampler() = default;
+    PolyphaseResampler(const PolyphaseResampler&) = delete;
+    PolyphaseResampler& operator=(const PolyphaseResampler&) = delete;
+
+    // Builds the filter bank and preallocates the input history for requests of up to `maxOutputFrames`.
+    void setup(uint32_t channelCount, double inputSampleRate, double outputSampleRate,
+               uint32_t maxOutputFrames, ResamplerQuality quality = ResamplerQuality::Medium);
+
+    // Changes the conversion ratio without reallocating, for ratios no more than
+    // `kMaxRatioDeviation` away from the one passed to `setup`. Real-time safe.
+    void setRatio(double inputFramesPerOutputFrame);
+    double getRatio() const { return mStep; }
+
+    // Produces `frameCount` output frames, pulling input as needed. Real-time safe.
+    void process(float* const* outputs, uint32_t frameCount, PullCallback pull, void* context);
+
+    // Clears the input history, for a seek or a source change.
+    void reset();
+
+    uint32_t getChannelCount() const { return static_cast<uint32_t>(mHistory.size()); }
+    uint32_t getTapCount() const { return mTapCount; }
+
+    // How far ahead of the current output the filter reads, in input frames.
+    // The filter is centered on each output frame, so the output has no delay, but
+    // it rings for this long past the input's last frame.
+    uint32_t getLookaheadFrames() const { return mTapCount / 2; }
+
+    // The tap count `setup` uses for a quality.
+    static uint32_t tapCount(ResamplerQuality quality);
+
+    // The largest relative change `setRatio` accepts.
+    static constexpr double kMaxRatioDeviation = 0.01;
+
+private:
+    static constexpr uint32_t kPhaseCount = 256;
+
+    uint32_t mTapCount{0};
+    // `kPhaseCount + 1` rows of `mTapCount` taps; row `p` delays the input by `p / kPhaseCount` frames.
+    std::vector<float> mFilterBank;
+    std::vector<float> mKernel;
+
+    std::vector<std::vector<float>> mHistory;
+    std::vector<float*> mPullPointers;
+    uint32_t mHistoryFrames{0};
+    uint32_t mAvailableFrames{0};
+    uint32_t mMaxOutputFrames{0};
+    double mStep{1.0};
+    double mNominalStep{1.0};
+    double mPosition{0};
+};
+
+#endif /* PolyphaseResampler_hpp */
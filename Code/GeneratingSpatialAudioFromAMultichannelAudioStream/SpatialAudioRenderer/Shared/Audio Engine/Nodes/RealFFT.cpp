@@ -0,0 +1,142 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable radix-2 FFT implementation for real signals, with split-complex spectra.
+*/
+#include "RealFFT.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+// The real transform runs as a complex transform of half the size, with the even
+// samples as the real parts and the odd samples as the imaginary parts, and then
+// splits the result into the spectra of the even and odd samples and recombines them.
+
+void RealFFT::setup(uint32_t size)
+{
+    assert(size >= 4 && (size & (size - 1)) == 0);
+    mSize = size;
+    const auto half = size / 2;
+
+    uint32_t bits = 0;
+    while ((1u << bits) < half) {
+        ++bits;
+    }
+    mBitReversal.assign(half, 0);
+    for (uint32_t i = 0; i < half; ++i) {
+        uint32_t reversed = 0;
+        for (uint32_t b = 0; b < bits; ++b) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        mBitReversal[i] = reversed;
+    }
+
+    mTwiddleReal.assign(half / 2, 0);
+    mTwiddleImaginary.assign(half / 2, 0);
+    for (uint32_t k = 0; k < half / 2; ++k) {
+        mTwiddleReal[k] = float(std::cos(-2.0 * M_PI * k / half));
+        mTwiddleImaginary[k] = float(std::sin(-2.0 * M_PI * k / half));
+    }
+
+    mSplitReal.assign(half + 1, 0);
+    mSplitImaginary.assign(half + 1, 0);
+    for (uint32_t k = 0; k <= half; ++k) {
+        mSplitReal[k] = float(std::cos(-2.0 * M_PI * k / size));
+        mSplitImaginary[k] = float(std::sin(-2.0 * M_PI * k / size));
+    }
+
+    mScratchReal.assign(half, 0);
+    mScratchImaginary.assign(half, 0);
+}
+
+void RealFFT::transform(float* real, float* imaginary) const
+{
+    const auto count = mSize / 2;
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto j = mBitReversal[i];
+        if (i < j) {
+            std::swap(real[i], real[j]);
+            std::swap(imaginary[i], imaginary[j]);
+        }
+    }
+
+    for (uint32_t length = 2; length <= count; length <<= 1) {
+        const auto halfLength = length / 2;
+        const auto stride = count / length;
+        for (uint32_t start = 0; start < count; start += length) {
+            for (uint32_t k = 0; k < halfLength; ++k) {
+                const float wr = mTwiddleReal[k * stride];
+                const float wi = mTwiddleImaginary[k * stride];
+                const auto a = start + k;
+                const auto b = a + halfLength;
+                const float tr = real[b] * wr - imaginary[b] * wi;
+                const float ti = real[b] * wi + imaginary[b] * wr;
+                real[b] = real[a] - tr;
+                imaginary[b] = imaginary[a] - ti;
+                real[a] += tr;
+                imaginary[a] += ti;
+            }
+        }
+    }
+}
+
+void RealFFT::forward(const float* input, float* real, float* imaginary)
+{
+    const auto half = mSize / 2;
+    float* zr = mScratchReal.data();
+    float* zi = mScratchImaginary.data();
+    for (uint32_t n = 0; n < half; ++n) {
+        zr[n] = input[2 * n];
+        zi[n] = input[2 * n + 1];
+    }
+    transform(zr, zi);
+
+    for (uint32_t k = 0; k <= half; ++k) {
+        const auto a = k % half;
+        const auto b = (half - k) % half;
+        // The spectra of the even and odd samples.
+        const float evenReal = 0.5f * (zr[a] + zr[b]);
+        const float evenImaginary = 0.5f * (zi[a] - zi[b]);
+        const float oddReal = 0.5f * (zi[a] + zi[b]);
+        const float oddImaginary = -0.5f * (zr[a] - zr[b]);
+        const float wr = mSplitReal[k];
+        const float wi = mSplitImaginary[k];
+        real[k] = evenReal + wr * oddReal - wi * oddImaginary;
+        imaginary[k] = evenImaginary + wr * oddImaginary + wi * oddReal;
+    }
+}
+
+void RealFFT::inverse(const float* real, const float* imaginary, float* output)
+{
+    const auto half = mSize / 2;
+    float* zr = mScratchReal.data();
+    float* zi = mScratchImaginary.data();
+    for (uint32_t k = 0; k < half; ++k) {
+        const auto mirror = half - k;
+        // The first and last bins of a real signal's spectrum are real.
+        const float xi = (k == 0) ? 0.0f : imaginary[k];
+        const float mi = (mirror == half) ? 0.0f : imaginary[mirror];
+        const float evenReal = 0.5f * (real[k] + real[mirror]);
+        const float evenImaginary = 0.5f * (xi - mi);
+        const float differenceReal = 0.5f * (real[k] - real[mirror]);
+        const float differenceImaginary = 0.5f * (xi + mi);
+        // Undo the odd spectrum's twiddle by multiplying by its conjugate.
+        const float wr = mSplitReal[k];
+        const float wi = -mSplitImaginary[k];
+        const float oddReal = differenceReal * wr - differenceImaginary * wi;
+        const float oddImaginary = differenceReal * wi + differenceImaginary * wr;
+        zr[k] = evenReal - oddImaginary;
+        zi[k] = evenImaginary + oddReal;
+    }
+
+    // Swapping the real and imaginary parts turns the forward transform into an inverse one.
+    transform(zi, zr);
+
+    const float scale = 1.0f / half;
+    for (uint32_t n = 0; n < half; ++n) {
+        output[2 * n] = zr[n] * scale;
+        output[2 * n + 1] = zi[n] * scale;
+    }
+}
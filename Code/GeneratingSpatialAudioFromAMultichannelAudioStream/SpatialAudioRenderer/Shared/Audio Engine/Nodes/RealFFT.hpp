@@ -0,0 +1,48 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable radix-2 FFT for real signals, with split-complex spectra.
+*/
+#ifndef RealFFT_hpp
+#define RealFFT_hpp
+
+#include <cstdint>
+#include <vector>
+
+// Transforms `size` real samples to `size / 2 + 1` complex bins, stored as
+// separate real and imaginary arrays. The size needs to be a power of two, at least 4.
+class RealFFT
+{
+public:
+    RealFFT() = default;
+    explicit RealFFT(uint32_t size) { setup(size); }
+
+    void setup(uint32_t size);
+
+    uint32_t getSize() const { return mSize; }
+    uint32_t getBinCount() const { return mSize / 2 + 1; }
+
+    // Real-time safe. `input` and the spectrum arrays can't overlap.
+    void forward(const float* input, float* real, float* imaginary);
+
+    // Real-time safe, and scaled so that `inverse` undoes `forward`. Reads only the
+    // first `getBinCount()` bins; the imaginary parts of the first and last bins are ignored.
+    void inverse(const float* real, const float* imaginary, float* output);
+
+private:
+    // An unscaled, in-place forward transform of `mSize / 2` complex values.
+    void transform(float* real, float* imaginary) const;
+
+    uint32_t mSize{0};
+    std::vector<uint32_t> mBitReversal;
+    // The complex transform's twiddles, and the ones that split its output into the real transform's bins.
+    std::vector<float> mTwiddleReal;
+    std::vector<float> mTwiddleImaginary;
+    std::vector<float> mSplitReal;
+    std::vector<float> mSplitImaginary;
+    std::vector<float> mScratchReal;
+    std::vector<float> mScratchImaginary;
+};
+
+#endif /* RealFFT_hpp */
@@ -0,0 +1,51 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A spatial renderer that pans on the CPU when the spatial mixer audio unit isn't available.
+*/
+#ifndef SoftwareSpatialRenderer_h
+#define SoftwareSpatialRenderer_h
+
+#include "SpatialRenderer.h"
+#include "SpatialPanner.hpp"
+
+#include <vector>
+
+class SoftwareSpatialRenderer : public SpatialRenderer
+{
+
+public:
+    // Pans onto `speakerLayout` for every output type. Stereo matches the spatial mixer's output;
+    // a surround layout feeds each of a multichannel device's speakers directly.
+    explicit SoftwareSpatialRenderer(SpeakerLayout speakerLayout = SpeakerLayout::Stereo)
+    : mSpeakerLayout(speakerLayout)
+    {
+    }
+    SoftwareSpatialRenderer(const SoftwareSpatialRenderer& other) = delete;
+    SoftwareSpatialRenderer& operator=(const SoftwareSpatialRenderer& other) = delete;
+
+    void applyOutputType(AUSpatialMixerOutputType outputType) override;
+    void setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize) override;
+    UInt32 getOutputChannelCount() override;
+
+    void setAudioPullBlock(PullAudioBlock _Nullable block) override;
+    OSStatus process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames) override;
+
+    // The panner that renders the bed on bus 0. Add object buses to it before rendering starts.
+    SpatialPanner& getPanner() { return mPanner; }
+
+private:
+    static void pullBed(void* _Nullable context, uint32_t bus, float* _Nonnull const* _Nonnull channels, uint32_t channelCount, uint32_t frameCount);
+
+    const SpeakerLayout mSpeakerLayout;
+    SpatialPanner mPanner;
+    PullAudioBlock __nullable mInputBlock;
+    AUSpatialMixerOutputType mOutputType{kSpatialMixerOutputType_Headphones};
+
+    // Describes the panner's bed buffers to the pull block without allocating.
+    std::vector<uint8_t> mInputBufferListStorage;
+    std::vector<float*> mOutputPointers;
+};
+
+#endif /* SoftwareSpatialRenderer_h */
@@ -0,0 +1,72 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A spatial renderer that implements panning on the CPU when the spatial mixer audio unit isn't available.
+*/
+#import "SoftwareSpatialRenderer.h"
+
+#include <algorithm>
+
+// The 7.1.4 bed has 12 channels.
+constexpr UInt32 kBedChannelCount = 12;
+
+void SoftwareSpatialRenderer::applyOutputType(AUSpatialMixerOutputType outputType)
+{
+    // The panner renders the same speaker feed for every output type; it has
+    // no HRTF for headphones or speaker virtualization for built-in speakers.
+    mOutputType = outputType;
+}
+
+void SoftwareSpatialRenderer::setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize)
+{
+    // The panner doesn’t resample; the kernel converts the input to the output rate first.
+    assert(inInputSampleRate == inOutputSampleRate);
+    
+    setOutputType(outputType);
+    
+    // Pan the ATMOS 7.1.4 bed onto the speaker layout.
+    mPanner.setup(mSpeakerLayout, inMaxFrameSize);
+    mPanner.addBedBus(SpeakerLayout::Atmos_7_1_4, pullBed, this);
+    
+    mInputBufferListStorage.assign(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * kBedChannelCount, 0);
+    mOutputPointers.assign(mPanner.getOutputChannelCount(), nullptr);
+}
+
+UInt32 SoftwareSpatialRenderer::getOutputChannelCount()
+{
+    return mPanner.getOutputChannelCount();
+}
+
+void SoftwareSpatialRenderer::setAudioPullBlock(PullAudioBlock _Nullable block)
+{
+    mInputBlock = block;
+}
+
+void SoftwareSpatialRenderer::pullBed(void* _Nullable context, uint32_t bus, float* _Nonnull const* _Nonnull channels, uint32_t channelCount, uint32_t frameCount)
+{
+    auto renderer = static_cast<SoftwareSpatialRenderer *>(context);
+    if (renderer->mInputBlock == nil) {
+        return;
+    }
+    
+    // Point the pull block at the panner's bed buffers, which the panner has already cleared.
+    auto inputBufferList = reinterpret_cast<AudioBufferList *>(renderer->mInputBufferListStorage.data());
+    inputBufferList->mNumberBuffers = std::min(channelCount, kBedChannelCount);
+    for (UInt32 i = 0; i < inputBufferList->mNumberBuffers; i++) {
+        inputBufferList->mBuffers[i].mNumberChannels = 1;
+        inputBufferList->mBuffers[i].mDataByteSize = frameCount * sizeof(float);
+        inputBufferList->mBuffers[i].mData = channels[i];
+    }
+    renderer->mInputBlock(inputBufferList, frameCount);
+}
+
+OSStatus SoftwareSpatialRenderer::process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames)
+{
+    const auto channelCount = std::min<UInt32>(outputABL->mNumberBuffers, UInt32(mOutputPointers.size()));
+    for (UInt32 i = 0; i < channelCount; i++) {
+        mOutputPointers[i] = static_cast<float *>(outputABL->mBuffers[i].mData);
+    }
+    mPanner.process(mOutputPointers.data(), channelCount, UInt32(inNumberFrames));
+    return noErr;
+}
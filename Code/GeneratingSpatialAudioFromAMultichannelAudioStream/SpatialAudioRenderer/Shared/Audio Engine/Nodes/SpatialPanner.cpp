@@ -0,0 +1,401 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable renderer that implements panning beds and objects to a speaker layout with VBAP.
+*/
+#include "SpatialPanner.hpp"
+#include "VectorKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// The gain of a bed's LFE channel when the output layout has no LFE speaker.
+constexpr float kLFEDownmixGain = 0.5f;
+
+constexpr float kGainEpsilon = 1e-4f;
+
+struct Vector3
+{
+    float x, y, z;
+};
+
+Vector3 unitVector(float azimuth, float elevation)
+{
+    const float az = azimuth * float(M_PI) / 180.0f;
+    const float el = elevation * float(M_PI) / 180.0f;
+    return {std::cos(el) * std::sin(az), std::cos(el) * std::cos(az), std::sin(el)};
+}
+
+// Wraps an azimuth to [-180, 180).
+float wrapAzimuth(float azimuth)
+{
+    azimuth = std::fmod(azimuth + 180.0f, 360.0f);
+    if (azimuth < 0) {
+        azimuth += 360.0f;
+    }
+    return azimuth - 180.0f;
+}
+
+void normalizePower(float* gains, size_t count)
+{
+    float power = 0;
+    for (size_t i = 0; i < count; ++i) {
+        gains[i] = std::max(gains[i], 0.0f);
+        power += gains[i] * gains[i];
+    }
+    if (power > 0) {
+        const float scale = 1.0f / std::sqrt(power);
+        for (size_t i = 0; i < count; ++i) {
+            gains[i] *= scale;
+        }
+    }
+}
+
+} // namespace
+
+std::vector<SpeakerPosition> speakerPositions(SpeakerLayout layout)
+{
+    switch (layout) {
+        case SpeakerLayout::Stereo:
+            return {{-30, 0, false}, {30, 0, false}};
+
+        case SpeakerLayout::Surround_5_1:
+            return {{-30, 0, false}, {30, 0, false}, {0, 0, false}, {0, 0, true}, {-110, 0, false}, {110, 0, false}};
+
+        case SpeakerLayout::Atmos_7_1_4:
+            return {{-30, 0, false}, {30, 0, false}, {0, 0, false}, {0, 0, true},
+                    {-90, 0, false}, {90, 0, false}, {-135, 0, false}, {135, 0, false},
+                    {-45, 45, false}, {45, 45, false}, {-135, 45, false}, {135, 45, false}};
+    }
+    return {};
+}
+
+SpeakerLayout speakerLayoutForChannelCount(uint32_t channelCount)
+{
+    if (channelCount >= speakerPositions(SpeakerLayout::Atmos_7_1_4).size()) {
+        return SpeakerLayout::Atmos_7_1_4;
+    }
+    if (channelCount >= speakerPositions(SpeakerLayout::Surround_5_1).size()) {
+        return SpeakerLayout::Surround_5_1;
+    }
+    return SpeakerLayout::Stereo;
+}
+
+void SpatialPanner::setup(SpeakerLayout outputLayout, uint32_t maxFrames)
+{
+    mSpeakers = speakerPositions(outputLayout);
+    mMaxFrames = maxFrames;
+    mFullRangeSpeakers.clear();
+    mLFESpeaker = -1;
+    mHasHeight = false;
+    mBuses.clear();
+
+    for (uint32_t s = 0; s < mSpeakers.size(); ++s) {
+        if (mSpeakers[s].isLFE) {
+            mLFESpeaker = int32_t(s);
+        }
+        else {
+            mFullRangeSpeakers.push_back(s);
+            mHasHeight = mHasHeight || mSpeakers[s].elevation != 0;
+        }
+    }
+    mGainScratch.assign(mSpeakers.size(), 0);
+
+    if (mHasHeight) {
+        computeTriplets();
+    }
+    else {
+        computePairs();
+    }
+}
+
+// MARK: - VBAP
+
+void SpatialPanner::computeTriplets()
+{
+    mTriplets.clear();
+    const auto count = mFullRangeSpeakers.size();
+    for (size_t a = 0; a < count; ++a) {
+        for (size_t b = a + 1; b < count; ++b) {
+            for (size_t c = b + 1; c < count; ++c) {
+                const std::array<uint32_t, 3> speakers{mFullRangeSpeakers[a], mFullRangeSpeakers[b], mFullRangeSpeakers[c]};
+                const auto l1 = unitVector(mSpeakers[speakers[0]].azimuth, mSpeakers[speakers[0]].elevation);
+                const auto l2 = unitVector(mSpeakers[speakers[1]].azimuth, mSpeakers[speakers[1]].elevation);
+                const auto l3 = unitVector(mSpeakers[speakers[2]].azimuth, mSpeakers[speakers[2]].elevation);
+
+                // The columns of M are the speaker directions, so M * g = p.
+                const float m[9] = {l1.x, l2.x, l3.x,
+                                    l1.y, l2.y, l3.y,
+                                    l1.z, l2.z, l3.z};
+                const float det = m[0] * (m[4] * m[8] - m[5] * m[7])
+                                - m[1] * (m[3] * m[8] - m[5] * m[6])
+                                + m[2] * (m[3] * m[7] - m[4] * m[6]);
+
+                // Skip speakers that lie on a plane through the listener.
+                if (std::fabs(det) < 1e-3f) {
+                    continue;
+                }
+
+                const float inv = 1.0f / det;
+                mTriplets.push_back({speakers, {
+                    (m[4] * m[8] - m[5] * m[7]) * inv, (m[2] * m[7] - m[1] * m[8]) * inv, (m[1] * m[5] - m[2] * m[4]) * inv,
+                    (m[5] * m[6] - m[3] * m[8]) * inv, (m[0] * m[8] - m[2] * m[6]) * inv, (m[2] * m[3] - m[0] * m[5]) * inv,
+                    (m[3] * m[7] - m[4] * m[6]) * inv, (m[1] * m[6] - m[0] * m[7]) * inv, (m[0] * m[4] - m[1] * m[3]) * inv}});
+            }
+        }
+    }
+}
+
+void SpatialPanner::computePairs()
+{
+    mPairs.clear();
+    auto speakers = mFullRangeSpeakers;
+    std::sort(speakers.begin(), speakers.end(), [this](uint32_t a, uint32_t b) {
+        return mSpeakers[a].azimuth < mSpeakers[b].azimuth;
+    });
+
+    for (size_t i = 0; i < speakers.size() && speakers.size() > 1; ++i) {
+        const auto first = speakers[i];
+        const auto second = speakers[(i + 1) % speakers.size()];
+        float gap = mSpeakers[second].azimuth - mSpeakers[first].azimuth;
+        if (gap <= 0) {
+            gap += 360.0f;
+        }
+        // A pair can't cover an arc of half a circle or more.
+        if (gap >= 180.0f) {
+            continue;
+        }
+
+        const auto l1 = unitVector(mSpeakers[first].azimuth, 0);
+        const auto l2 = unitVector(mSpeakers[second].azimuth, 0);
+        const float det = l1.x * l2.y - l2.x * l1.y;
+        mPairs.push_back({{first, second}, {l2.y / det, -l2.x / det, -l1.y / det, l1.x / det}});
+    }
+}
+
+void SpatialPanner::computeGains(float azimuth, float elevation, float* gains) const
+{
+    std::fill_n(gains, mSpeakers.size(), 0.0f);
+    if (mFullRangeSpeakers.empty()) {
+        return;
+    }
+
+    uint32_t nearest = mFullRangeSpeakers[0];
+    float nearestDot = -2;
+
+    if (mHasHeight) {
+        // The layouts have no speakers below the listener, so lift lower sources to the horizon.
+        const auto p = unitVector(azimuth, std::max(elevation, 0.0f));
+        float best[3] = {};
+        float bestSum = std::numeric_limits<float>::infinity();
+        const Triplet* bestTriplet = nullptr;
+        for (const auto& triplet : mTriplets) {
+            const auto& m = triplet.inverse;
+            const float g[3] = {m[0] * p.x + m[1] * p.y + m[2] * p.z,
+                                m[3] * p.x + m[4] * p.y + m[5] * p.z,
+                                m[6] * p.x + m[7] * p.y + m[8] * p.z};
+            if (g[0] < -kGainEpsilon || g[1] < -kGainEpsilon || g[2] < -kGainEpsilon) {
+                continue;
+            }
+            // Of the triplets that contain the source, the face of the layout's convex hull
+            // is the one farthest from the listener, which has the smallest gain sum.
+            const float sum = g[0] + g[1] + g[2];
+            if (sum < bestSum) {
+                bestSum = sum;
+                bestTriplet = &triplet;
+                std::copy_n(g, 3, best);
+            }
+        }
+        if (bestTriplet != nullptr) {
+            for (int i = 0; i < 3; ++i) {
+                gains[bestTriplet->speakers[i]] = best[i];
+            }
+            normalizePower(gains, mSpeakers.size());
+            return;
+        }
+
+        for (auto s : mFullRangeSpeakers) {
+            const auto l = unitVector(mSpeakers[s].azimuth, mSpeakers[s].elevation);
+            const float dot = l.x * p.x + l.y * p.y + l.z * p.z;
+            if (dot > nearestDot) {
+                nearestDot = dot;
+                nearest = s;
+            }
+        }
+    }
+    else {
+        azimuth = wrapAzimuth(azimuth);
+
+        // Without rear speakers, fold sources from behind onto the front arc.
+        const bool hasRear = std::any_of(mFullRangeSpeakers.begin(), mFullRangeSpeakers.end(), [this](uint32_t s) {
+            return std::fabs(mSpeakers[s].azimuth) > 90.0f;
+        });
+        if (!hasRear && std::fabs(azimuth) > 90.0f) {
+            azimuth = std::copysign(180.0f - std::fabs(azimuth), azimuth);
+        }
+
+        const auto p = unitVector(azimuth, 0);
+        for (const auto& pair : mPairs) {
+            const auto& m = pair.inverse;
+            const float g[2] = {m[0] * p.x + m[1] * p.y, m[2] * p.x + m[3] * p.y};
+            if (g[0] >= -kGainEpsilon && g[1] >= -kGainEpsilon) {
+                gains[pair.speakers[0]] = g[0];
+                gains[pair.speakers[1]] = g[1];
+                normalizePower(gains, mSpeakers.size());
+                return;
+            }
+        }
+
+        // Outside every pair, such as beyond the edges of a stereo layout.
+        for (auto s : mFullRangeSpeakers) {
+            const auto l = unitVector(mSpeakers[s].azimuth, 0);
+            const float dot = l.x * p.x + l.y * p.y;
+            if (dot > nearestDot) {
+                nearestDot = dot;
+                nearest = s;
+            }
+        }
+    }
+    gains[nearest] = 1.0f;
+}
+
+// MARK: - Buses
+
+SpatialPanner::Bus& SpatialPanner::addBus(SourceMode mode, std::vector<SpeakerPosition> positions, InputCallback callback, void* context)
+{
+    auto bus = std::make_unique<Bus>();
+    bus->mode = mode;
+    bus->inputPositions = std::move(positions);
+    bus->callback = callback;
+    bus->context = context;
+
+    const auto inputCount = bus->inputPositions.size();
+    bus->currentGains.assign(mSpeakers.size() * inputCount, 0);
+    bus->targetGains.assign(mSpeakers.size() * inputCount, 0);
+    bus->inputBuffers.assign(inputCount, std::vector<float>(mMaxFrames));
+    for (auto& buffer : bus->inputBuffers) {
+        bus->inputPointers.push_back(buffer.data());
+    }
+
+    mBuses.push_back(std::move(bus));
+    return *mBuses.back();
+}
+
+uint32_t SpatialPanner::addBedBus(SpeakerLayout bedLayout, InputCallback callback, void* context)
+{
+    auto& bus = addBus(SourceMode::Bed, speakerPositions(bedLayout), callback, context);
+
+    // Start on the target gains so the bed doesn't fade in.
+    updateTargetGains(bus);
+    bus.currentGains = bus.targetGains;
+    bus.appliedVersion = bus.version.load();
+    return getBusCount() - 1;
+}
+
+uint32_t SpatialPanner::addObjectBus(InputCallback callback, void* context)
+{
+    addBus(SourceMode::Object, {{0, 0, false}}, callback, context);
+    return getBusCount() - 1;
+}
+
+void SpatialPanner::setObjectPosition(uint32_t bus, float azimuth, float elevation)
+{
+    if (bus >= mBuses.size()) {
+        return;
+    }
+    mBuses[bus]->azimuth.store(azimuth, std::memory_order_relaxed);
+    mBuses[bus]->elevation.store(elevation, std::memory_order_relaxed);
+    mBuses[bus]->version.fetch_add(1, std::memory_order_release);
+}
+
+void SpatialPanner::setBusGain(uint32_t bus, float gain)
+{
+    if (bus >= mBuses.size()) {
+        return;
+    }
+    mBuses[bus]->gain.store(gain, std::memory_order_relaxed);
+    mBuses[bus]->version.fetch_add(1, std::memory_order_release);
+}
+
+void SpatialPanner::updateTargetGains(Bus& bus)
+{
+    const auto outputCount = mSpeakers.size();
+    const auto inputCount = bus.inputPositions.size();
+    const float busGain = bus.gain.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < inputCount; ++i) {
+        auto position = bus.inputPositions[i];
+        if (bus.mode == SourceMode::Object) {
+            position = {bus.azimuth.load(std::memory_order_relaxed), bus.elevation.load(std::memory_order_relaxed), false};
+        }
+
+        if (position.isLFE) {
+            std::fill(mGainScratch.begin(), mGainScratch.end(), 0.0f);
+            if (mLFESpeaker >= 0) {
+                mGainScratch[mLFESpeaker] = 1.0f;
+            }
+            else {
+                computeGains(0, 0, mGainScratch.data());
+                VectorKernels::scale(mGainScratch.data(), outputCount, kLFEDownmixGain);
+            }
+        }
+        else {
+            computeGains(position.azimuth, position.elevation, mGainScratch.data());
+        }
+
+        for (size_t o = 0; o < outputCount; ++o) {
+            bus.targetGains[o * inputCount + i] = mGainScratch[o] * busGain;
+        }
+    }
+}
+
+// MARK: - Process
+
+void SpatialPanner::process(float* const* outputs, uint32_t outputChannelCount, uint32_t frameCount)
+{
+    const auto outputCount = std::min<uint32_t>(outputChannelCount, getOutputChannelCount());
+    for (uint32_t o = 0; o < outputChannelCount; ++o) {
+        memset(outputs[o], 0, frameCount * sizeof(float));
+    }
+
+    for (uint32_t offset = 0; offset < frameCount; offset += mMaxFrames) {
+        const auto frames = std::min(frameCount - offset, mMaxFrames);
+
+        for (uint32_t b = 0; b < mBuses.size(); ++b) {
+            auto& bus = *mBuses[b];
+            const auto inputCount = static_cast<uint32_t>(bus.inputPointers.size());
+            for (auto input : bus.inputPointers) {
+                memset(input, 0, frames * sizeof(float));
+            }
+            bus.callback(bus.context, b, bus.inputPointers.data(), inputCount, frames);
+
+            const auto version = bus.version.load(std::memory_order_acquire);
+            if (version != bus.appliedVersion) {
+                updateTargetGains(bus);
+                bus.appliedVersion = version;
+            }
+
+            // Ramp from the gains the last block ended on to the target over this block.
+            for (uint32_t o = 0; o < outputCount; ++o) {
+                for (uint32_t i = 0; i < inputCount; ++i) {
+                    auto& current = bus.currentGains[o * inputCount + i];
+                    const auto target = bus.targetGains[o * inputCount + i];
+                    if (current == target) {
+                        if (target != 0) {
+                            VectorKernels::mix(outputs[o] + offset, bus.inputPointers[i], frames, target);
+                        }
+                    }
+                    else {
+                        VectorKernels::mixRamped(outputs[o] + offset, bus.inputPointers[i], frames, current, (target - current) / float(frames));
+                        current = target;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,133 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A portable renderer that pans beds and objects to a speaker layout with VBAP.
+*/
+#ifndef SpatialPanner_hpp
+#define SpatialPanner_hpp
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Azimuth is in degrees clockwise from the front, so a positive azimuth is to
+// the listener's right. Elevation is in degrees up from the horizontal plane.
+struct SpeakerPosition
+{
+    float azimuth;
+    float elevation;
+    bool isLFE;
+};
+
+enum class SpeakerLayout
+{
+    Stereo,
+    Surround_5_1,
+    // L R C LFE Ls Rs Rls Rrs Vhl Vhr Ltr Rtr, the channel order of `kAudioChannelLayoutTag_Atmos_7_1_4`.
+    Atmos_7_1_4
+};
+
+std::vector<SpeakerPosition> speakerPositions(SpeakerLayout layout);
+
+// The largest layout that fits in `channelCount` output channels.
+SpeakerLayout speakerLayoutForChannelCount(uint32_t channelCount);
+
+class SpatialPanner
+{
+public:
+    enum class SourceMode
+    {
+        // A multichannel bed whose channels play from the positions of the bed layout.
+        Bed,
+        // A mono source that plays from a position you set with `setObjectPosition`.
+        Object
+    };
+
+    // Fills `channels` with `frameCount` frames of a bus's input. The panner clears
+    // the channels before each call.
+    using InputCallback = void (*)(void* context, uint32_t bus, float* const* channels, uint32_t channelCount, uint32_t frameCount);
+
+    SpatialPanner() = default;
+    SpatialPanner(const SpatialPanner&) = delete;
+    SpatialPanner& operator=(const SpatialPanner&) = delete;
+
+    // Prepares the output layout and preallocates everything the render thread uses.
+    // The panner doesn't resample, so the inputs need to run at the output rate.
+    void setup(SpeakerLayout outputLayout, uint32_t maxFrames);
+
+    // Adds an input bus and returns its index. Call before rendering starts.
+    uint32_t addBedBus(SpeakerLayout bedLayout, InputCallback callback, void* context);
+    uint32_t addObjectBus(InputCallback callback, void* context);
+
+    // Moves an object bus. Safe to call from any thread while rendering;
+    // the change is picked up and smoothed at the next block.
+    void setObjectPosition(uint32_t bus, float azimuth, float elevation);
+
+    // Scales a bus. Safe to call from any thread while rendering.
+    void setBusGain(uint32_t bus, float gain);
+
+    uint32_t getOutputChannelCount() const { return static_cast<uint32_t>(mSpeakers.size()); }
+    uint32_t getBusCount() const { return static_cast<uint32_t>(mBuses.size()); }
+
+    // Renders all buses into `outputs`. Real-time safe.
+    void process(float* const* outputs, uint32_t outputChannelCount, uint32_t frameCount);
+
+    // Computes the power-normalized gains that place a source at a position on the output layout.
+    void computeGains(float azimuth, float elevation, float* gains) const;
+
+private:
+    struct Bus
+    {
+        SourceMode mode;
+        std::vector<SpeakerPosition> inputPositions;
+        InputCallback callback;
+        void* context;
+
+        // [output][input] gains; `current` is what the last block ended on.
+        std::vector<float> currentGains;
+        std::vector<float> targetGains;
+
+        std::vector<std::vector<float>> inputBuffers;
+        std::vector<float*> inputPointers;
+
+        std::atomic<float> azimuth{0};
+        std::atomic<float> elevation{0};
+        std::atomic<float> gain{1};
+        std::atomic<uint32_t> version{1};
+        uint32_t appliedVersion{0};
+    };
+
+    struct Triplet
+    {
+        std::array<uint32_t, 3> speakers;
+        // Maps a source direction to the gains whose weighted speaker directions sum to it.
+        std::array<float, 9> inverse;
+    };
+
+    struct Pair
+    {
+        std::array<uint32_t, 2> speakers;
+        std::array<float, 4> inverse;
+    };
+
+    Bus& addBus(SourceMode mode, std::vector<SpeakerPosition> positions, InputCallback callback, void* context);
+    void updateTargetGains(Bus& bus);
+    void computeTriplets();
+    void computePairs();
+
+    std::vector<SpeakerPosition> mSpeakers;
+    std::vector<uint32_t> mFullRangeSpeakers;
+    int32_t mLFESpeaker{-1};
+    bool mHasHeight{false};
+    std::vector<Triplet> mTriplets;
+    std::vector<Pair> mPairs;
+
+    std::vector<std::unique_ptr<Bus>> mBuses;
+    std::vector<float> mGainScratch;
+    uint32_t mMaxFrames{0};
+};
+
+#endif /* SpatialPanner_hpp */
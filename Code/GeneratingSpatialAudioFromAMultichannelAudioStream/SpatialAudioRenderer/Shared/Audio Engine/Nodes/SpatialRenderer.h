@@ -0,0 +1,64 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+The interface that the audio kernel uses to drive a spatial renderer.
+*/
+#ifndef SpatialRenderer_h
+#define SpatialRenderer_h
+
+#include "CoreAudioHelpers.h"
+
+#import <AudioToolbox/AudioToolbox.h>
+
+// Set to 1 to add the kernel's FDN reverb after renderers that have no reverb of their own,
+// and to leave the spatial mixer's internal reverb off when it isn't using a factory preset.
+// `FDNReverbBenchmark` in the Tests folder measures what it costs per output channel.
+#define USE_FDN_REVERB 0
+
+class SpatialRenderer
+{
+
+public:
+    virtual ~SpatialRenderer() = default;
+
+    // A function to set the output type and determine the spatialization algorithm to use for rendering.
+    // Call it while the renderer isn't rendering, such as from `setup`.
+    OSStatus setOutputType(AUSpatialMixerOutputType outputType)
+    {
+        const auto err = prepareOutputType(outputType);
+        if (err == noErr) {
+            applyOutputType(outputType);
+        }
+        return err;
+    }
+    // The two halves of an output type change while rendering. `prepareOutputType` runs on a control
+    // thread and does whatever can lock or allocate, such as setting an audio unit property;
+    // `applyOutputType` then runs on the render thread between blocks and only updates the renderer's state.
+    virtual OSStatus prepareOutputType(AUSpatialMixerOutputType outputType) { return noErr; }
+    virtual void applyOutputType(AUSpatialMixerOutputType outputType) {}
+    // Call before `setup` for a renderer that runs faster than real time, such as a render to a file.
+    // The output then depends only on the input, with nothing taken from live sensors.
+    virtual void setOfflineRendering(bool offline) {}
+
+    virtual void setup(AUSpatialMixerOutputType outputType, float inInputSampleRate, float inOutputSampleRate, uint32_t inMaxFrameSize) = 0;
+
+    // The number of deinterleaved channels in the negotiated output format.
+    virtual UInt32 getOutputChannelCount() = 0;
+
+    virtual void setAudioPullBlock(PullAudioBlock _Nullable block) = 0;
+    // Sets the listener's head orientation in degrees: yaw to the right, pitch up, and roll toward
+    // the right shoulder. Safe to call from any thread. Renderers that track the head themselves ignore it.
+    virtual void setListenerOrientation(float yaw, float pitch, float roll) {}
+
+    // The delay from the renderer's input to its output for the current output type, in output frames.
+    virtual UInt32 getLatencyFrames() { return 0; }
+
+    // Whether the renderer's output already includes reverb, for the current output type.
+    virtual bool usesInternalReverb() { return false; }
+
+    // Returns an error without producing output if rendering fails.
+    virtual OSStatus process(AudioBufferList* __nullable outputABL, const AudioTimeStamp* __nullable inTimeStamp, float inNumberFrames) = 0;
+};
+
+#endif /* SpatialRenderer_h */
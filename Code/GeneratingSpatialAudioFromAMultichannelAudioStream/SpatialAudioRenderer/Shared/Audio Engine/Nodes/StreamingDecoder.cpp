@@ -0,0 +1,128 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that implements decoding an audio source on a background thread into a bounded ring.
+*/
+#include "StreamingDecoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+StreamingDecoder::StreamingDecoder(std::unique_ptr<StreamingSource> source, size_t bufferFrames, size_t chunkFrames)
+: mSource(std::move(source)),
+  mRing(mSource->channelCount(), bufferFrames),
+  mChunk(mSource->channelCount(), std::vector<float>(chunkFrames)),
+  mChunkFrames(chunkFrames)
+{
+    for (auto& plane : mChunk) {
+        mChunkPointers.push_back(plane.data());
+    }
+}
+
+StreamingDecoder::~StreamingDecoder()
+{
+    stop();
+}
+
+void StreamingDecoder::start()
+{
+    if (mThread.joinable()) {
+        return;
+    }
+
+    // Prime the ring with one chunk so the first render cycle has audio,
+    // and leave the rest to the decoder thread.
+    fill(mChunkFrames);
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = true;
+    }
+    mThread = std::thread([this] { run(); });
+}
+
+void StreamingDecoder::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = false;
+    }
+    mCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+size_t StreamingDecoder::pull(float* const* channels, uint32_t channelCount, size_t frameCount)
+{
+    if (channelCount != mRing.channelCount()) {
+        // Play silence rather than whatever the host left in its buffers.
+        for (uint32_t c = 0; c < channelCount; ++c) {
+            memset(channels[c], 0, frameCount * sizeof(float));
+        }
+        return 0;
+    }
+
+    const auto framesRead = mRing.read(channels, frameCount);
+    if (framesRead < frameCount) {
+        for (uint32_t c = 0; c < channelCount; ++c) {
+            memset(channels[c] + framesRead, 0, (frameCount - framesRead) * sizeof(float));
+        }
+        mUnderrunCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return framesRead;
+}
+
+void StreamingDecoder::run()
+{
+    // The render thread never signals the decoder, so poll often enough to
+    // refill the ring several times before it can drain.
+    const auto ringDuration = std::chrono::duration<double>(mRing.capacity() / std::max(mSource->sampleRate(), 1.0));
+    const auto interval = std::clamp(std::chrono::duration_cast<std::chrono::milliseconds>(ringDuration / 8),
+                                     std::chrono::milliseconds(1),
+                                     std::chrono::milliseconds(50));
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mRunning) {
+        lock.unlock();
+        const auto canContinue = fill(mRing.capacity());
+        lock.lock();
+        if (!canContinue) {
+            break;
+        }
+        mCondition.wait_for(lock, interval, [this] { return !mRunning; });
+    }
+}
+
+bool StreamingDecoder::fill(size_t frameLimit)
+{
+    std::vector<const float*> chunk(mChunkPointers.size());
+
+    size_t framesWritten = 0;
+    while (framesWritten < frameLimit && mRing.availableToWrite() > 0) {
+        if (mChunkOffset == mChunkLength) {
+            mChunkOffset = 0;
+            mChunkLength = mSource->read(mChunkPointers.data(), mChunkFrames);
+            if (mChunkLength == 0) {
+                // Loop back to the start at the end of the source.
+                if (!mSource->rewind()) {
+                    return false;
+                }
+                mChunkLength = mSource->read(mChunkPointers.data(), mChunkFrames);
+                if (mChunkLength == 0) {
+                    return false;
+                }
+            }
+        }
+
+        for (size_t c = 0; c < chunk.size(); ++c) {
+            chunk[c] = mChunkPointers[c] + mChunkOffset;
+        }
+        const auto frames = mRing.write(chunk.data(), std::min(mChunkLength - mChunkOffset, frameLimit - framesWritten));
+        mChunkOffset += frames;
+        framesWritten += frames;
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A class that decodes an audio source on a background thread into a bounded ring.
+*/
+#ifndef StreamingDecoder_hpp
+#define StreamingDecoder_hpp
+
+#include "AudioRingBuffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A source of deinterleaved audio that the decoder thread reads from.
+// Implementations don't need to be real-time safe.
+class StreamingSource
+{
+public:
+    virtual ~StreamingSource() = default;
+
+    virtual uint32_t channelCount() const = 0;
+    virtual double sampleRate() const = 0;
+
+    // Reads up to `frameCount` frames and returns the number read, or 0 at the end of the source.
+    virtual size_t read(float* const* channels, size_t frameCount) = 0;
+
+    // Moves back to the start of the source so playback can loop.
+    virtual bool rewind() = 0;
+};
+
+class StreamingDecoder
+{
+public:
+    // `bufferFrames` bounds the memory the decoder holds ahead of playback;
+    // `chunkFrames` is the size of each read from the source.
+    StreamingDecoder(std::unique_ptr<StreamingSource> source, size_t bufferFrames, size_t chunkFrames = 4096);
+    StreamingDecoder(const StreamingDecoder&) = delete;
+    StreamingDecoder& operator=(const StreamingDecoder&) = delete;
+    ~StreamingDecoder();
+
+    // Decodes the first chunk on the calling thread and starts the decoder thread.
+    void start();
+    void stop();
+
+    // Real-time safe. Fills `channels` with `frameCount` frames, padding with
+    // silence and counting an underrun if the decoder has fallen behind. Fills
+    // them with silence if `channelCount` isn't the source's channel count.
+    // Returns the number of frames that came from the source.
+    size_t pull(float* const* channels, uint32_t channelCount, size_t frameCount);
+
+    uint32_t channelCount() const { return mRing.channelCount(); }
+    double sampleRate() const { return mSource->sampleRate(); }
+    size_t bufferedFrames() const { return mRing.availableToRead(); }
+    uint64_t underrunCount() const { return mUnderrunCount.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+
+    // Reads from the source and writes into the ring until the ring is full or
+    // `frameLimit` frames are written. Returns false if the source can't produce any more audio.
+    bool fill(size_t frameLimit);
+
+    std::unique_ptr<StreamingSource> mSource;
+    AudioRingBuffer mRing;
+
+    // The chunk staged between the source and the ring, used only by the decoder thread.
+    std::vector<std::vector<float>> mChunk;
+    std::vector<float*> mChunkPointers;
+    size_t mChunkFrames{0};
+    size_t mChunkOffset{0};
+    size_t mChunkLength{0};
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mRunning{false};
+
+    std::atomic<uint64_t> mUnderrunCount{0};
+};
+
+#endif /* StreamingDecoder_hpp */
@@ -0,0 +1,51 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A renderer that spatializes audio files to files faster than real time.
+*/
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OfflineRenderResult : NSObject
+
+@property (nonatomic, readonly) NSString * inputPath;
+@property (nonatomic, readonly) NSString * outputPath;
+@property (nonatomic, readonly) NSError * __nullable error;
+
+// The length of the rendered audio, and the wall-clock time it took to render, in seconds.
+@property (nonatomic, readonly) double audioDuration;
+@property (nonatomic, readonly) double renderDuration;
+
+// How many times faster than real time the render ran.
+@property (nonatomic, readonly) double speedFactor;
+
+@end
+
+// Renders 7.1.4 files through the same kernel and spatial renderer as the live engine,
+// in large blocks and without a device. The same input and settings always
+// produce the same output file, so renders can be compared against reference files.
+@interface OfflineRenderer : NSObject
+
+- (instancetype)initWithOutputType:(AUSpatialMixerOutputType)outputType sampleRate:(double)sampleRate;
+
+@property (nonatomic, readonly) AUSpatialMixerOutputType outputType;
+@property (nonatomic, readonly) double sampleRate;
+
+// The number of frames per render call. The default is 4096.
+@property (nonatomic) NSUInteger blockSize;
+
+// Renders one file to a 32-bit float CAF or WAV file, depending on the output path's extension.
+// The output lines up with the input: the renderer's delay is removed from its start, and it
+// runs past the input's end by the resampler's tail.
+- (OfflineRenderResult *)renderFile:(NSString *)inputPath toFile:(NSString *)outputPath;
+
+// Renders each file to a file of the same name in `directory`, one kernel per
+// file, spread across all cores. The results are in the same order as the inputs.
+- (NSArray<OfflineRenderResult *> *)renderFiles:(NSArray<NSString *> *)inputPaths toDirectory:(NSString *)directory;
+
+@end
+
+NS_ASSUME_NONNULL_END
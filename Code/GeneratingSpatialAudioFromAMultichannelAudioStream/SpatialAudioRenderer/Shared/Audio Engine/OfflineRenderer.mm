@@ -0,0 +1,223 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A renderer implementation that spatializes audio files to files faster than real time.
+*/
+#import "OfflineRenderer.h"
+#import "AudioKernel.h"
+#import "OfflineRenderLoop.h"
+
+#import <AVFAudio/AVFAudio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#define kDefaultBlockSize 4096
+
+// The size of each read from an input file.
+constexpr AVAudioFrameCount kReadChunkFrames = 8192;
+
+// Each kernel takes a mixer output buffer and two crossfade buffers from the pool.
+constexpr UInt32 kBufferListsPerKernel = 3;
+
+// Offline renders convert the input's sample rate at the highest quality.
+constexpr ResamplerQuality kResamplerQuality = ResamplerQuality::High;
+
+@interface OfflineRenderResult ()
+
+- (instancetype)initWithInputPath:(NSString *)inputPath
+                       outputPath:(NSString *)outputPath
+                            error:(NSError * __nullable)error
+                    audioDuration:(double)audioDuration
+                   renderDuration:(double)renderDuration;
+
+@end
+
+@implementation OfflineRenderResult
+
+- (instancetype)initWithInputPath:(NSString *)inputPath
+                       outputPath:(NSString *)outputPath
+                            error:(NSError * __nullable)error
+                    audioDuration:(double)audioDuration
+                   renderDuration:(double)renderDuration
+{
+    self = [super init];
+    if (self) {
+        _inputPath = [inputPath copy];
+        _outputPath = [outputPath copy];
+        _error = error;
+        _audioDuration = audioDuration;
+        _renderDuration = renderDuration;
+    }
+    return self;
+}
+
+-(double)speedFactor
+{
+    return _renderDuration > 0 ? _audioDuration / _renderDuration : 0;
+}
+
+@end
+
+@implementation OfflineRenderer
+
+- (instancetype)initWithOutputType:(AUSpatialMixerOutputType)outputType sampleRate:(double)sampleRate
+{
+    self = [super init];
+    if (self) {
+        _outputType = outputType;
+        _sampleRate = sampleRate;
+        _blockSize = kDefaultBlockSize;
+    }
+    return self;
+}
+
+- (OfflineRenderResult *)renderFile:(NSString *)inputPath toFile:(NSString *)outputPath
+{
+    const auto bufferPool = [self makeBufferPoolForKernelCount:1];
+    return [self renderFile:inputPath toFile:outputPath bufferPool:bufferPool.get()];
+}
+
+- (NSArray<OfflineRenderResult *> *)renderFiles:(NSArray<NSString *> *)inputPaths toDirectory:(NSString *)directory
+{
+    // Each call owns its pool, so calls on different threads never share one, and one
+    // call's change to `blockSize` can't replace a pool that another call's kernels use.
+    const auto bufferPool = [self makeBufferPoolForKernelCount:UInt32(std::min<NSUInteger>(inputPaths.count, NSProcessInfo.processInfo.activeProcessorCount))];
+
+    const NSUInteger count = inputPaths.count;
+    NSMutableArray<OfflineRenderResult *> * results = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [results addObject:(OfflineRenderResult *)[NSNull null]];
+    }
+
+    // Each file renders with its own kernel, so the workers share nothing but the buffer pool.
+    auto pool = bufferPool.get();
+    dispatch_apply(count, DISPATCH_APPLY_AUTO, ^(size_t i) {
+        NSString * inputPath = inputPaths[i];
+        NSString * outputName = [inputPath.lastPathComponent.stringByDeletingPathExtension stringByAppendingPathExtension:@"caf"];
+        OfflineRenderResult * result = [self renderFile:inputPath
+                                                 toFile:[directory stringByAppendingPathComponent:outputName]
+                                             bufferPool:pool];
+        @synchronized (results) {
+            results[i] = result;
+        }
+    });
+    return results;
+}
+
+// MARK: - Private
+
+// Sizes a pool for the kernels that run at once; kernels beyond that allocate their own buffers.
+-(std::unique_ptr<AudioBufferListPool>)makeBufferPoolForKernelCount:(UInt32)kernelCount
+{
+    const auto listCount = std::min<UInt32>(std::max<UInt32>(kernelCount, 1) * kBufferListsPerKernel,
+                                            AudioBufferListPool::kMaxListCount);
+    return std::make_unique<AudioBufferListPool>(listCount, kInputChannelCount, UInt32(_blockSize));
+}
+
+static NSError * renderError(OSStatus status, NSString * description)
+{
+    return [NSError errorWithDomain:NSOSStatusErrorDomain code:status userInfo:@{NSLocalizedDescriptionKey: description}];
+}
+
+- (OfflineRenderResult *)renderFile:(NSString *)inputPath toFile:(NSString *)outputPath bufferPool:(AudioBufferListPool *)pool
+{
+    auto failure = ^(NSError * error) {
+        return [[OfflineRenderResult alloc] initWithInputPath:inputPath outputPath:outputPath error:error audioDuration:0 renderDuration:0];
+    };
+
+    NSError * error = nil;
+    AVAudioFile * inputFile = [[AVAudioFile alloc] initForReading:[NSURL fileURLWithPath:inputPath] error:&error];
+    if (error != nil) {
+        return failure(error);
+    }
+    if (inputFile.processingFormat.channelCount != kInputChannelCount) {
+        return failure(renderError(kAudioFormatUnsupportedDataFormatError, @"This sample requires 7.1.4, 12 channel audio."));
+    }
+
+    const auto blockSize = UInt32(_blockSize);
+    AudioKernel kernel(_outputType, _sampleRate, blockSize, kResamplerQuality, pool, true);
+
+    // Read the file on the rendering thread. Nothing here needs to be real-time
+    // safe, and reading synchronously keeps the output independent of timing.
+    AVAudioPCMBuffer * readBuffer = [[AVAudioPCMBuffer alloc] initWithPCMFormat:inputFile.processingFormat frameCapacity:kReadChunkFrames];
+    PullAudioBlock source = ^(AudioBufferList * __nullable dstBufferList, size_t bufferSize) {
+        OfflineRenderLoop::pullInput(dstBufferList, bufferSize, [&](AudioBufferList * bufferList, size_t frameOffset, size_t frameCount) -> size_t {
+            const auto frames = AVAudioFrameCount(std::min<size_t>(frameCount, readBuffer.frameCapacity));
+            if (![inputFile readIntoBuffer:readBuffer frameCount:frames error:nil]) {
+                return 0;
+            }
+            const auto channelCount = std::min(bufferList->mNumberBuffers, kInputChannelCount);
+            for (UInt32 i = 0; i < channelCount; i++) {
+                memcpy(static_cast<float *>(bufferList->mBuffers[i].mData) + frameOffset,
+                       readBuffer.floatChannelData[i],
+                       readBuffer.frameLength * sizeof(float));
+            }
+            return readBuffer.frameLength;
+        });
+    };
+    kernel.setSource(source, inputFile.processingFormat.sampleRate, false);
+
+    const auto outputChannelCount = kernel.getOutputChannelCount();
+    AVAudioFormat * outputFormat = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:_sampleRate channels:outputChannelCount];
+    NSDictionary<NSString *, id> * settings = @{AVFormatIDKey: @(kAudioFormatLinearPCM),
+                                                AVSampleRateKey: @(_sampleRate),
+                                                AVNumberOfChannelsKey: @(outputChannelCount),
+                                                AVLinearPCMBitDepthKey: @32,
+                                                AVLinearPCMIsFloatKey: @YES,
+                                                AVLinearPCMIsNonInterleaved: @NO};
+    AVAudioFile * outputFile = [[AVAudioFile alloc] initForWriting:[NSURL fileURLWithPath:outputPath]
+                                                          settings:settings
+                                                      commonFormat:AVAudioPCMFormatFloat32
+                                                       interleaved:NO
+                                                             error:&error];
+    if (error != nil) {
+        return failure(error);
+    }
+
+    // Render the whole input at the output rate. Render past the end by the renderer's delay and drop
+    // that much from the start, so the output lines up with the input. The source feeds silence past
+    // the end of the file meanwhile.
+    const auto timing = OfflineRenderTiming::make(inputFile.length, inputFile.processingFormat.sampleRate, _sampleRate,
+                                                  kernel.getLatencyFrames(), PolyphaseResampler::tapCount(kResamplerQuality));
+    AVAudioPCMBuffer * renderBuffer = [[AVAudioPCMBuffer alloc] initWithPCMFormat:outputFormat frameCapacity:blockSize];
+    AudioTimeStamp timeStamp = {};
+    timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+
+    const auto startTime = RenderTelemetry::now();
+    auto renderBlock = [&](AudioBufferList * bufferList, int64_t position, UInt32 frames) {
+        renderBuffer.frameLength = frames;
+        timeStamp.mSampleTime = Float64(position);
+        AudioUnitRenderActionFlags actionFlags = 0;
+        kernel.process(nullptr, &actionFlags, &timeStamp, 0, frames, bufferList);
+        return true;
+    };
+    auto writeBlock = [&](AudioBufferList * bufferList, UInt32 frames) {
+        renderBuffer.frameLength = frames;
+        NSError * writeError = nil;
+        if (![outputFile writeFromBuffer:renderBuffer error:&writeError]) {
+            error = writeError;
+            return false;
+        }
+        return true;
+    };
+    OfflineRenderLoop::run(timing, blockSize, renderBuffer.mutableAudioBufferList, renderBlock, writeBlock);
+    const auto renderDuration = (RenderTelemetry::now() - startTime) / 1e9;
+
+    // The kernel silences a block that fails to render, so check that none did.
+    RenderTelemetry::Snapshot snapshot;
+    kernel.getTelemetry().snapshot(snapshot);
+    if (error == nil && snapshot.renderErrorCount > 0) {
+        error = renderError(snapshot.lastRenderError, @"The spatial renderer failed to render part of the file.");
+    }
+
+    return [[OfflineRenderResult alloc] initWithInputPath:inputPath
+                                               outputPath:outputPath
+                                                    error:error
+                                            audioDuration:timing.outputFrames / _sampleRate
+                                           renderDuration:renderDuration];
+}
+
+@end
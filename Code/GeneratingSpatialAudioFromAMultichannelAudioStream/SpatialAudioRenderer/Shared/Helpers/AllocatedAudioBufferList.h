@@ -2,50 +2,237 @@
 See the LICENSE.txt file for this sample’s licensing information.
 
 Abstract:
-An audio buffer list.
+An audio buffer list in one aligned allocation, and a pool that reuses them.
 */
 #ifndef AllocatedAudioBufferList_h
 #define AllocatedAudioBufferList_h
 
 #import <AudioToolbox/AudioToolbox.h>
 
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+class AudioBufferListPool;
+
+// A deinterleaved audio buffer list whose header and channel planes share one
+// allocation. Every plane starts on a 64-byte boundary for vector loads and stores.
 class AllocatedAudioBufferList
 {
 public:
-    AllocatedAudioBufferList(UInt32 channelCount, uint16_t bufferSize)
-    {
-		
-        mBufferList = static_cast<AudioBufferList *>(malloc(sizeof(AudioBufferList) + (sizeof(AudioBuffer) * channelCount)));
-        mBufferList->mNumberBuffers = channelCount;
-        for (UInt32 c = 0;  c < channelCount; ++c) {
-            mBufferList->mBuffers[c].mNumberChannels = 1;
-            mBufferList->mBuffers[c].mDataByteSize = bufferSize * sizeof(float);
-            mBufferList->mBuffers[c].mData = malloc(sizeof(float) * bufferSize);
+    static constexpr size_t kAlignment = 64;
+
+    // An empty list, which `get` returns null for.
+    AllocatedAudioBufferList() = default;
+
+    AllocatedAudioBufferList(UInt32 channelCount, UInt32 frameCapacity)
+    {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, kAlignment, requiredByteSize(channelCount, frameCapacity)) != 0) {
+            throw std::bad_alloc();
         }
+        mBufferList = format(memory, channelCount, frameCapacity);
+        mFrameCapacity = frameCapacity;
     }
-    
+
     AllocatedAudioBufferList(const AllocatedAudioBufferList&) = delete;
-    
+
     AllocatedAudioBufferList& operator=(const AllocatedAudioBufferList&) = delete;
-    
-    ~AllocatedAudioBufferList()
+
+    AllocatedAudioBufferList(AllocatedAudioBufferList&& other) noexcept
     {
-        if (mBufferList == nullptr) { return; }
-        
-        for (UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
-            free(mBufferList->mBuffers[i].mData);
+        *this = std::move(other);
+    }
+
+    AllocatedAudioBufferList& operator=(AllocatedAudioBufferList&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            mBufferList = other.mBufferList;
+            mFrameCapacity = other.mFrameCapacity;
+            mPool = other.mPool;
+            mSlot = other.mSlot;
+            other.mBufferList = nullptr;
+            other.mPool = nullptr;
         }
-        free(mBufferList);
-        mBufferList = nullptr;
+        return *this;
+    }
+
+    ~AllocatedAudioBufferList()
+    {
+        reset();
     }
-    
-    AudioBufferList * _Nonnull get()
+
+    AudioBufferList * _Nullable get() const
     {
         return mBufferList;
     }
-    
+
+    UInt32 getChannelCount() const
+    {
+        return mBufferList ? mBufferList->mNumberBuffers : 0;
+    }
+
+    UInt32 getFrameCapacity() const
+    {
+        return mFrameCapacity;
+    }
+
+    // Sets every buffer's byte size for `frameCount` frames.
+    void setFrameCount(UInt32 frameCount)
+    {
+        assert(frameCount <= mFrameCapacity);
+        for (UInt32 c = 0; c < getChannelCount(); ++c) {
+            mBufferList->mBuffers[c].mDataByteSize = frameCount * sizeof(float);
+        }
+    }
+
+    // The number of bytes a list with these dimensions occupies, including alignment padding.
+    static size_t requiredByteSize(UInt32 channelCount, UInt32 frameCapacity)
+    {
+        return headerByteSize(channelCount) + size_t(channelCount) * planeByteSize(frameCapacity);
+    }
+
+    // Frees the list or returns it to its pool, and leaves this list empty.
+    inline void reset();
+
 private:
-    AudioBufferList * _Nonnull mBufferList  = { nullptr };
+    friend class AudioBufferListPool;
+
+    static size_t alignUp(size_t value)
+    {
+        return (value + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    static size_t headerByteSize(UInt32 channelCount)
+    {
+        return alignUp(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channelCount);
+    }
+
+    static size_t planeByteSize(UInt32 frameCapacity)
+    {
+        return alignUp(size_t(frameCapacity) * sizeof(float));
+    }
+
+    // Lays out the header and planes in `memory`, which needs to be aligned and `requiredByteSize` long.
+    static AudioBufferList * _Nonnull format(void * _Nonnull memory, UInt32 channelCount, UInt32 frameCapacity)
+    {
+        auto bytes = static_cast<uint8_t *>(memory);
+        auto bufferList = reinterpret_cast<AudioBufferList *>(bytes);
+        bufferList->mNumberBuffers = channelCount;
+        auto plane = bytes + headerByteSize(channelCount);
+        for (UInt32 c = 0; c < channelCount; ++c) {
+            bufferList->mBuffers[c].mNumberChannels = 1;
+            bufferList->mBuffers[c].mDataByteSize = frameCapacity * sizeof(float);
+            bufferList->mBuffers[c].mData = plane;
+            plane += planeByteSize(frameCapacity);
+        }
+        return bufferList;
+    }
+
+    AllocatedAudioBufferList(AudioBufferList * _Nonnull bufferList, UInt32 frameCapacity, AudioBufferListPool * _Nonnull pool, uint32_t slot)
+    : mBufferList(bufferList), mFrameCapacity(frameCapacity), mPool(pool), mSlot(slot)
+    {
+    }
+
+    AudioBufferList * _Nullable mBufferList  = { nullptr };
+    UInt32 mFrameCapacity{0};
+    AudioBufferListPool * _Nullable mPool{nullptr};
+    uint32_t mSlot{0};
 };
 
+// A fixed set of audio buffer lists carved from one arena. Acquiring and
+// releasing a list is lock-free and doesn't touch the heap, so render threads,
+// engines, and offline renders can share buffers.
+class AudioBufferListPool
+{
+public:
+    static constexpr UInt32 kMaxListCount = 64;
+
+    // Preallocates `listCount` lists of up to `maxChannelCount` channels and `maxFrameCapacity` frames each.
+    AudioBufferListPool(UInt32 listCount, UInt32 maxChannelCount, UInt32 maxFrameCapacity)
+    : mListCount(listCount),
+      mMaxChannelCount(maxChannelCount),
+      mMaxFrameCapacity(maxFrameCapacity),
+      mSlotByteSize(AllocatedAudioBufferList::requiredByteSize(maxChannelCount, maxFrameCapacity))
+    {
+        assert(listCount > 0 && listCount <= kMaxListCount);
+        void* memory = nullptr;
+        if (posix_memalign(&memory, AllocatedAudioBufferList::kAlignment, mSlotByteSize * listCount) != 0) {
+            throw std::bad_alloc();
+        }
+        mArena = static_cast<uint8_t *>(memory);
+        mFreeSlots.store(listCount == kMaxListCount ? ~uint64_t(0) : (uint64_t(1) << listCount) - 1);
+    }
+
+    AudioBufferListPool(const AudioBufferListPool&) = delete;
+
+    AudioBufferListPool& operator=(const AudioBufferListPool&) = delete;
+
+    ~AudioBufferListPool()
+    {
+        // Every list needs to come back before the arena goes away.
+        assert(getAvailableCount() == mListCount);
+        free(mArena);
+    }
+
+    // Real-time safe. Returns an empty list if every slot is in use or the
+    // request is larger than the pool's lists.
+    AllocatedAudioBufferList acquire(UInt32 channelCount, UInt32 frameCapacity)
+    {
+        if (channelCount > mMaxChannelCount || frameCapacity > mMaxFrameCapacity) {
+            return AllocatedAudioBufferList();
+        }
+        auto freeSlots = mFreeSlots.load(std::memory_order_acquire);
+        while (freeSlots != 0) {
+            const auto slot = uint32_t(__builtin_ctzll(freeSlots));
+            if (mFreeSlots.compare_exchange_weak(freeSlots, freeSlots & ~(uint64_t(1) << slot),
+                                                 std::memory_order_acq_rel, std::memory_order_acquire)) {
+                auto bufferList = AllocatedAudioBufferList::format(mArena + slot * mSlotByteSize, channelCount, frameCapacity);
+                return AllocatedAudioBufferList(bufferList, frameCapacity, this, slot);
+            }
+        }
+        return AllocatedAudioBufferList();
+    }
+
+    UInt32 getAvailableCount() const
+    {
+        return UInt32(__builtin_popcountll(mFreeSlots.load(std::memory_order_relaxed)));
+    }
+
+private:
+    friend class AllocatedAudioBufferList;
+
+    void release(uint32_t slot)
+    {
+        mFreeSlots.fetch_or(uint64_t(1) << slot, std::memory_order_release);
+    }
+
+    const UInt32 mListCount;
+    const UInt32 mMaxChannelCount;
+    const UInt32 mMaxFrameCapacity;
+    const size_t mSlotByteSize;
+    uint8_t * _Nullable mArena{nullptr};
+    std::atomic<uint64_t> mFreeSlots{0};
+};
+
+inline void AllocatedAudioBufferList::reset()
+{
+    if (mBufferList == nullptr) { return; }
+
+    if (mPool != nullptr) {
+        mPool->release(mSlot);
+    }
+    else {
+        free(mBufferList);
+    }
+    mBufferList = nullptr;
+    mPool = nullptr;
+    mFrameCapacity = 0;
+}
+
 #endif /* AllocatedAudioBufferList_h */
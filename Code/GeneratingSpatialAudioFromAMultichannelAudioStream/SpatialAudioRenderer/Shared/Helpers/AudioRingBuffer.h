@@ -0,0 +1,114 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A lock-free, single-producer/single-consumer ring of deinterleaved audio.
+*/
+#ifndef AudioRingBuffer_h
+#define AudioRingBuffer_h
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Each channel has its own plane, and all planes share one pair of read and
+// write positions so the channels can't drift apart. One thread writes and
+// one thread reads; neither call locks or allocates.
+class AudioRingBuffer
+{
+public:
+    AudioRingBuffer(uint32_t channelCount, size_t minimumCapacity)
+    {
+        // Round up to a power of two so positions wrap with a mask.
+        mCapacity = 1;
+        while (mCapacity < minimumCapacity) {
+            mCapacity <<= 1;
+        }
+        mMask = mCapacity - 1;
+
+        mPlanes.resize(channelCount);
+        for (auto& plane : mPlanes) {
+            plane = std::make_unique<float[]>(mCapacity);
+            std::fill_n(plane.get(), mCapacity, 0.0f);
+        }
+    }
+
+    AudioRingBuffer(const AudioRingBuffer&) = delete;
+    AudioRingBuffer& operator=(const AudioRingBuffer&) = delete;
+
+    uint32_t channelCount() const { return static_cast<uint32_t>(mPlanes.size()); }
+    size_t capacity() const { return mCapacity; }
+
+    size_t availableToRead() const
+    {
+        return mWritePosition.load(std::memory_order_acquire) - mReadPosition.load(std::memory_order_relaxed);
+    }
+
+    size_t availableToWrite() const
+    {
+        return mCapacity - (mWritePosition.load(std::memory_order_relaxed) - mReadPosition.load(std::memory_order_acquire));
+    }
+
+    // Producer side. Writes up to `frameCount` frames and returns the number written.
+    size_t write(const float* const* source, size_t frameCount)
+    {
+        const auto writePosition = mWritePosition.load(std::memory_order_relaxed);
+        const auto frames = std::min(frameCount, availableToWrite());
+
+        for (size_t c = 0; c < mPlanes.size(); ++c) {
+            copyIn(mPlanes[c].get(), writePosition, source[c], frames);
+        }
+        mWritePosition.store(writePosition + frames, std::memory_order_release);
+        return frames;
+    }
+
+    // Consumer side. Reads up to `frameCount` frames and returns the number read.
+    size_t read(float* const* destination, size_t frameCount)
+    {
+        const auto readPosition = mReadPosition.load(std::memory_order_relaxed);
+        const auto frames = std::min(frameCount, availableToRead());
+
+        for (size_t c = 0; c < mPlanes.size(); ++c) {
+            copyOut(destination[c], mPlanes[c].get(), readPosition, frames);
+        }
+        mReadPosition.store(readPosition + frames, std::memory_order_release);
+        return frames;
+    }
+
+    // Discards everything that's been written. Call only when neither side is running.
+    void reset()
+    {
+        mReadPosition.store(0, std::memory_order_relaxed);
+        mWritePosition.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    void copyIn(float* plane, size_t position, const float* source, size_t frames) const
+    {
+        const auto start = position & mMask;
+        const auto firstPart = std::min(frames, mCapacity - start);
+        memcpy(plane + start, source, firstPart * sizeof(float));
+        memcpy(plane, source + firstPart, (frames - firstPart) * sizeof(float));
+    }
+
+    void copyOut(float* destination, const float* plane, size_t position, size_t frames) const
+    {
+        const auto start = position & mMask;
+        const auto firstPart = std::min(frames, mCapacity - start);
+        memcpy(destination, plane + start, firstPart * sizeof(float));
+        memcpy(destination + firstPart, plane, (frames - firstPart) * sizeof(float));
+    }
+
+    std::vector<std::unique_ptr<float[]>> mPlanes;
+    size_t mCapacity{0};
+    size_t mMask{0};
+
+    // Keep the positions on separate cache lines so the two threads don't share one.
+    alignas(64) std::atomic<size_t> mWritePosition{0};
+    alignas(64) std::atomic<size_t> mReadPosition{0};
+};
+
+#endif /* AudioRingBuffer_h */
@@ -0,0 +1,199 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A lock-free ring of deinterleaved audio with one writer and several independent readers.
+*/
+#ifndef BroadcastRingBuffer_h
+#define BroadcastRingBuffer_h
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Hands the same audio to several readers, each at its own position. The writer never
+// waits for a reader: it paces itself to the reader that's furthest ahead, and writes over
+// frames that slower readers haven't reached. A reader that finds its frames overwritten
+// jumps forward to the leading reader, so a slow reader drops audio rather than holding up
+// the others. Neither side locks or allocates.
+class BroadcastRingBuffer
+{
+public:
+    static constexpr uint32_t kMaxReaders = 8;
+
+    BroadcastRingBuffer(uint32_t channelCount, size_t minimumCapacity)
+    {
+        // Round up to a power of two so positions wrap with a mask.
+        mCapacity = 1;
+        while (mCapacity < minimumCapacity) {
+            mCapacity <<= 1;
+        }
+        mMask = mCapacity - 1;
+
+        mPlanes.resize(channelCount);
+        for (auto& plane : mPlanes) {
+            plane = std::make_unique<float[]>(mCapacity);
+            std::fill_n(plane.get(), mCapacity, 0.0f);
+        }
+    }
+
+    BroadcastRingBuffer(const BroadcastRingBuffer&) = delete;
+    BroadcastRingBuffer& operator=(const BroadcastRingBuffer&) = delete;
+
+    uint32_t channelCount() const { return static_cast<uint32_t>(mPlanes.size()); }
+    size_t capacity() const { return mCapacity; }
+
+    // MARK: - Writer
+
+    // Writes `frameCount` frames, up to the capacity, over the oldest frames.
+    void write(const float* const* source, size_t frameCount)
+    {
+        const auto frames = std::min(frameCount, mCapacity);
+        const auto writePosition = mWritePosition.load(std::memory_order_relaxed);
+
+        // Announce the frames about to be overwritten before touching them, so a reader
+        // that copies them at the same time can tell.
+        mReservedPosition.store(writePosition + frames, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t c = 0; c < mPlanes.size(); ++c) {
+            const auto start = writePosition & mMask;
+            const auto firstPart = std::min(frames, mCapacity - start);
+            memcpy(mPlanes[c].get() + start, source[c], firstPart * sizeof(float));
+            memcpy(mPlanes[c].get(), source[c] + firstPart, (frames - firstPart) * sizeof(float));
+        }
+        mWritePosition.store(writePosition + frames, std::memory_order_release);
+    }
+
+    uint64_t writePosition() const
+    {
+        return mWritePosition.load(std::memory_order_acquire);
+    }
+
+    bool hasReaders() const
+    {
+        for (const auto& reader : mReaders) {
+            if (reader.active.load(std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The position of the reader furthest ahead, or the write position when no reader is active.
+    uint64_t leadingReadPosition() const
+    {
+        uint64_t leading = 0;
+        bool anyActive = false;
+        for (const auto& reader : mReaders) {
+            if (reader.active.load(std::memory_order_acquire)) {
+                leading = std::max(leading, reader.position.load(std::memory_order_acquire));
+                anyActive = true;
+            }
+        }
+        return anyActive ? leading : writePosition();
+    }
+
+    // MARK: - Readers
+
+    // Adds a reader that starts level with the leading reader. Returns -1 when all readers are in use.
+    // Call from one control thread at a time.
+    int32_t addReader()
+    {
+        const auto start = leadingReadPosition();
+        for (uint32_t i = 0; i < kMaxReaders; ++i) {
+            auto& reader = mReaders[i];
+            if (!reader.active.load(std::memory_order_relaxed)) {
+                reader.position.store(start, std::memory_order_relaxed);
+                reader.droppedFrames.store(0, std::memory_order_relaxed);
+                reader.underrunFrames.store(0, std::memory_order_relaxed);
+                reader.active.store(true, std::memory_order_release);
+                return int32_t(i);
+            }
+        }
+        return -1;
+    }
+
+    // Call once the reader's thread no longer reads.
+    void removeReader(uint32_t index)
+    {
+        mReaders[index].active.store(false, std::memory_order_release);
+    }
+
+    // Reads `frameCount` frames for a reader, with silence for any the writer hasn't written yet,
+    // and for any past the capacity, which the buffer can never hold at once.
+    // Real-time safe, and safe to call for different readers from different threads at once.
+    void read(uint32_t index, float* const* destination, size_t frameCount)
+    {
+        auto& reader = mReaders[index];
+        auto readPosition = reader.position.load(std::memory_order_relaxed);
+        auto writePosition = mWritePosition.load(std::memory_order_acquire);
+        const auto readableCount = std::min(frameCount, mCapacity);
+
+        // Frames older than a capacity are gone; catch up with the other readers.
+        if (writePosition - readPosition > mCapacity - readableCount) {
+            const auto resumePosition = std::max(leadingReadPosition(), writePosition + readableCount - mCapacity);
+            reader.droppedFrames.fetch_add(resumePosition - readPosition, std::memory_order_relaxed);
+            readPosition = resumePosition;
+        }
+
+        const auto frames = std::min<size_t>(readableCount, writePosition - readPosition);
+        for (size_t c = 0; c < mPlanes.size(); ++c) {
+            const auto start = readPosition & mMask;
+            const auto firstPart = std::min(frames, mCapacity - start);
+            memcpy(destination[c], mPlanes[c].get() + start, firstPart * sizeof(float));
+            memcpy(destination[c] + firstPart, mPlanes[c].get(), (frames - firstPart) * sizeof(float));
+            memset(destination[c] + frames, 0, (frameCount - frames) * sizeof(float));
+        }
+
+        // If the writer started overwriting these frames during the copy, play silence instead.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mReservedPosition.load(std::memory_order_relaxed) > readPosition + mCapacity) {
+            for (size_t c = 0; c < mPlanes.size(); ++c) {
+                memset(destination[c], 0, frames * sizeof(float));
+            }
+            reader.droppedFrames.fetch_add(frames, std::memory_order_relaxed);
+        }
+
+        if (frames < frameCount) {
+            reader.underrunFrames.fetch_add(frameCount - frames, std::memory_order_relaxed);
+        }
+        reader.position.store(readPosition + frames, std::memory_order_release);
+    }
+
+    // Frames a reader skipped because the writer overwrote them.
+    uint64_t droppedFrames(uint32_t index) const
+    {
+        return mReaders[index].droppedFrames.load(std::memory_order_relaxed);
+    }
+
+    // Frames a reader filled with silence because the writer hadn't written them yet.
+    uint64_t underrunFrames(uint32_t index) const
+    {
+        return mReaders[index].underrunFrames.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Each reader's state sits on its own cache line, so readers on different cores don't share one.
+    struct alignas(64) Reader
+    {
+        std::atomic<bool> active{false};
+        std::atomic<uint64_t> position{0};
+        std::atomic<uint64_t> droppedFrames{0};
+        std::atomic<uint64_t> underrunFrames{0};
+    };
+
+    std::vector<std::unique_ptr<float[]>> mPlanes;
+    size_t mCapacity{0};
+    size_t mMask{0};
+
+    alignas(64) std::atomic<uint64_t> mWritePosition{0};
+    std::atomic<uint64_t> mReservedPosition{0};
+    std::array<Reader, kMaxReaders> mReaders;
+};
+
+#endif /* BroadcastRingBuffer_h */
@@ -0,0 +1,70 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A fixed-capacity, lock-free, single-producer/single-consumer queue.
+*/
+#ifndef LockFreeQueue_h
+#define LockFreeQueue_h
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Passes small messages between one producer thread and one consumer thread
+// without locking or allocating, so either side can be the render thread.
+template <typename T, size_t Capacity>
+class LockFreeQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "The capacity needs to be a power of two.");
+
+public:
+    LockFreeQueue() = default;
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+    // Producer side. Returns false if the queue is full.
+    bool push(const T& item)
+    {
+        const auto tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        mItems[tail & (Capacity - 1)] = item;
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Copies the oldest item without removing it. Returns false if the queue is empty.
+    bool front(T& item) const
+    {
+        const auto head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = mItems[head & (Capacity - 1)];
+        return true;
+    }
+
+    // Consumer side. Removes the oldest item. Returns false if the queue is empty.
+    bool pop(T& item)
+    {
+        if (!front(item)) {
+            return false;
+        }
+        mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<T, Capacity> mItems{};
+    alignas(64) std::atomic<size_t> mTail{0};
+    alignas(64) std::atomic<size_t> mHead{0};
+};
+
+#endif /* LockFreeQueue_h */
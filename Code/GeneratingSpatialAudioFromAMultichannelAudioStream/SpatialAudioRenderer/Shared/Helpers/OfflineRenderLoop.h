@@ -0,0 +1,75 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+The block loop of an offline render, apart from the files it reads and writes.
+*/
+#ifndef OfflineRenderLoop_h
+#define OfflineRenderLoop_h
+
+#import "OfflineRenderTiming.h"
+
+#import <AudioToolbox/AudioToolbox.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace OfflineRenderLoop {
+
+// Fills the first `frameCount` frames of each of the list's channels with input, and with silence past the
+// input's end so that the resampler's filter drains. `readInput(bufferList, frameOffset, frameCount)` copies
+// up to `frameCount` frames into each channel from `frameOffset` on, and returns how many, or 0 at the end.
+template <typename ReadInputFunction>
+void pullInput(AudioBufferList * _Nonnull bufferList, size_t frameCount, ReadInputFunction&& readInput)
+{
+    size_t framesDone = 0;
+    while (framesDone < frameCount) {
+        const size_t frames = std::min<size_t>(readInput(bufferList, framesDone, frameCount - framesDone), frameCount - framesDone);
+        if (frames == 0) {
+            break;
+        }
+        framesDone += frames;
+    }
+    for (UInt32 i = 0; i < bufferList->mNumberBuffers; i++) {
+        memset(static_cast<float *>(bufferList->mBuffers[i].mData) + framesDone, 0, (frameCount - framesDone) * sizeof(float));
+    }
+}
+
+// Renders `timing.renderFrames()` frames in blocks of up to `blockSize`, timed by the frame count rather
+// than a device clock, and drops the renderer's delay from the start so the output lines up with the input.
+// `renderBlock(bufferList, position, frameCount)` renders a block into the first `frameCount` frames of each
+// of the list's channels, and `writeBlock(bufferList, frameCount)` writes the first `frameCount` frames.
+// Either returns false to stop the render, and `run` then returns false too.
+template <typename RenderBlockFunction, typename WriteBlockFunction>
+bool run(const OfflineRenderTiming& timing, uint32_t blockSize, AudioBufferList * _Nonnull bufferList,
+         RenderBlockFunction&& renderBlock, WriteBlockFunction&& writeBlock)
+{
+    for (int64_t position = 0; position < timing.renderFrames(); position += blockSize) {
+        const auto frames = uint32_t(std::min<int64_t>(blockSize, timing.renderFrames() - position));
+        if (!renderBlock(bufferList, position, frames)) {
+            return false;
+        }
+
+        // Drop whatever part of the block falls within the renderer's delay.
+        const auto skipFrames = uint32_t(std::clamp<int64_t>(timing.latencyFrames - position, 0, frames));
+        if (skipFrames == frames) {
+            continue;
+        }
+        if (skipFrames > 0) {
+            for (UInt32 i = 0; i < bufferList->mNumberBuffers; i++) {
+                auto channel = static_cast<float *>(bufferList->mBuffers[i].mData);
+                memmove(channel, channel + skipFrames, (frames - skipFrames) * sizeof(float));
+            }
+        }
+        if (!writeBlock(bufferList, frames - skipFrames)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace OfflineRenderLoop
+
+#endif /* OfflineRenderLoop_h */
@@ -0,0 +1,41 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+The frame counts an offline render needs to line its output up with its input.
+*/
+#ifndef OfflineRenderTiming_h
+#define OfflineRenderTiming_h
+
+#include <cmath>
+#include <cstdint>
+
+// An offline render produces `latencyFrames + outputFrames` frames and drops the first
+// `latencyFrames`, so the output file starts at the input's first frame instead of the
+// renderer's delay, and the last of the input still reaches the file. The output also
+// includes the resampler's tail, the part of its filter that rings past the input's end.
+struct OfflineRenderTiming
+{
+    // The frames to render and then discard, the renderer's delay.
+    int64_t latencyFrames{0};
+    // The frames to write to the output file.
+    int64_t outputFrames{0};
+
+    int64_t renderFrames() const { return latencyFrames + outputFrames; }
+
+    // `resamplerTapCount` is the length of the filter that converts the input to the output rate.
+    static OfflineRenderTiming make(int64_t inputFrames, double inputSampleRate, double outputSampleRate,
+                                    uint32_t latencyFrames, uint32_t resamplerTapCount)
+    {
+        const double ratio = outputSampleRate / inputSampleRate;
+        OfflineRenderTiming timing;
+        timing.latencyFrames = latencyFrames;
+        timing.outputFrames = int64_t(std::ceil(double(inputFrames) * ratio));
+        if (inputSampleRate != outputSampleRate) {
+            timing.outputFrames += int64_t(std::ceil(resamplerTapCount / 2 * ratio));
+        }
+        return timing;
+    }
+};
+
+#endif /* OfflineRenderTiming_h */
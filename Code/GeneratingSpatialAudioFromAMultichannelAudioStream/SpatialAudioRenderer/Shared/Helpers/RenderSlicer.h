@@ -0,0 +1,131 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+The stage that takes a renderer's output to the host's buffers, in place when it can and in slices otherwise.
+*/
+#ifndef RenderSlicer_h
+#define RenderSlicer_h
+
+#import "AllocatedAudioBufferList.h"
+
+#import <AudioToolbox/AudioToolbox.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+// Renders a host's request for output. When the host's buffers match the renderer's output, the renderer
+// writes straight into them. Otherwise it renders into a scratch list a slice of up to `maxFrames` at a
+// time, and the slicer copies what the host can take and silences the channels the renderer doesn't make.
+class RenderSlicer
+{
+public:
+    RenderSlicer() = default;
+
+    // Takes the scratch list, whose channel count is the renderer's output channel count and whose frame
+    // capacity is the largest slice the renderer can make.
+    explicit RenderSlicer(AllocatedAudioBufferList scratch)
+    : mScratch(std::move(scratch))
+    {
+    }
+
+    UInt32 getOutputChannelCount() const
+    {
+        return mScratch.getChannelCount();
+    }
+
+    UInt32 getMaxSliceFrames() const
+    {
+        return mScratch.getFrameCapacity();
+    }
+
+    // Real-time safe. Calls `renderSlice(bufferList, timeStamp, frameCount)`, which returns an `OSStatus`,
+    // once for an in-place render or once per slice, and stops at the first error.
+    template <typename RenderSliceFunction>
+    OSStatus render(const AudioTimeStamp * __nullable inTimeStamp, UInt32 inNumberFrames,
+                    AudioBufferList * __nullable ioData, RenderSliceFunction&& renderSlice)
+    {
+        // Render straight into the host's buffers when they match the renderer's output.
+        if (inNumberFrames <= getMaxSliceFrames() && canRenderInPlace(ioData, inNumberFrames)) {
+            for (UInt32 i = 0; i < ioData->mNumberBuffers; i++) {
+                ioData->mBuffers[i].mDataByteSize = inNumberFrames * sizeof(float);
+            }
+            return renderSlice(ioData, inTimeStamp, inNumberFrames);
+        }
+
+        // Otherwise, render into the temporary buffer and copy what the host can take,
+        // a slice at a time when the host asks for more than the buffer holds.
+        AudioBufferList* outputBuffer = mScratch.get();
+        if (outputBuffer == nullptr) {
+            return kAudio_ParamError;
+        }
+        AudioTimeStamp sliceTimeStamp = (inTimeStamp != nullptr) ? *inTimeStamp : AudioTimeStamp{};
+        for (UInt32 offset = 0; offset < inNumberFrames; offset += getMaxSliceFrames()) {
+            const auto sliceFrames = std::min(inNumberFrames - offset, getMaxSliceFrames());
+            mScratch.setFrameCount(sliceFrames);
+
+            const auto err = renderSlice(outputBuffer, (inTimeStamp != nullptr) ? &sliceTimeStamp : nullptr, sliceFrames);
+            if (err != noErr || ioData == nullptr) {
+                return err;
+            }
+            sliceTimeStamp.mSampleTime += sliceFrames;
+
+            // Copy the temporary buffer to the output, and silence any channels the renderer doesn't produce.
+            const auto byteOffset = offset * sizeof(float);
+            for (UInt32 i = 0; i < ioData->mNumberBuffers; i++) {
+                AudioBuffer& destination = ioData->mBuffers[i];
+                if (destination.mDataByteSize <= byteOffset) {
+                    continue;
+                }
+                const auto byteSize = std::min<UInt32>(destination.mDataByteSize - byteOffset, sliceFrames * sizeof(float));
+                auto destinationBytes = static_cast<uint8_t *>(destination.mData) + byteOffset;
+                if (i < outputBuffer->mNumberBuffers) {
+                    memcpy(destinationBytes, outputBuffer->mBuffers[i].mData, byteSize);
+                }
+                else {
+                    memset(destinationBytes, 0, byteSize);
+                }
+            }
+        }
+        return noErr;
+    }
+
+    // The host's buffers can take the render directly when they're deinterleaved,
+    // one per output channel, large enough, and aligned for vector stores.
+    bool canRenderInPlace(const AudioBufferList * __nullable ioData, UInt32 inNumberFrames) const
+    {
+        if (ioData == nullptr || ioData->mNumberBuffers != getOutputChannelCount()) {
+            return false;
+        }
+        for (UInt32 i = 0; i < ioData->mNumberBuffers; i++) {
+            const AudioBuffer& buffer = ioData->mBuffers[i];
+            if (buffer.mData == nullptr ||
+                buffer.mNumberChannels != 1 ||
+                buffer.mDataByteSize < inNumberFrames * sizeof(float) ||
+                (reinterpret_cast<uintptr_t>(buffer.mData) % kRenderInPlaceAlignment) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void silence(AudioBufferList * __nullable ioData, UInt32 inNumberFrames)
+    {
+        if (ioData == nullptr) {
+            return;
+        }
+        for (UInt32 i = 0; i < ioData->mNumberBuffers; i++) {
+            AudioBuffer& destination = ioData->mBuffers[i];
+            memset(destination.mData, 0, std::min<UInt32>(destination.mDataByteSize, inNumberFrames * sizeof(float)));
+        }
+    }
+
+    static constexpr uintptr_t kRenderInPlaceAlignment = 16;
+
+private:
+    AllocatedAudioBufferList mScratch;
+};
+
+#endif /* RenderSlicer_h */
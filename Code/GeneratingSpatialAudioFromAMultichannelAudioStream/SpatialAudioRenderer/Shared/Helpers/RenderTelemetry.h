@@ -0,0 +1,232 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Render-thread timing statistics that other threads can read without blocking it.
+*/
+#ifndef RenderTelemetry_h
+#define RenderTelemetry_h
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Records how long each render callback takes against the time its buffer covers.
+// One render thread writes; any number of threads can take snapshots. Writing
+// costs two clock reads and a handful of relaxed stores, and never blocks.
+class RenderTelemetry
+{
+public:
+    // Histogram buckets are exact below 8 ns, then split every power of two into
+    // 8 sub-buckets, so a bucket's width is at most 12.5% of its value.
+    static constexpr uint32_t kSubBucketBits = 3;
+    static constexpr uint32_t kSubBucketCount = 1 << kSubBucketBits;
+    static constexpr uint32_t kBucketCount = 41 * kSubBucketCount;
+
+    using Histogram = std::array<uint64_t, kBucketCount>;
+
+    struct Snapshot
+    {
+        uint64_t callbackCount{0};
+        // Callbacks that took longer than the audio they rendered.
+        uint64_t lateCount{0};
+        // Gaps in the host's sample time, where the device skipped at least one cycle.
+        uint64_t discontinuityCount{0};
+        uint64_t renderErrorCount{0};
+        int32_t lastRenderError{0};
+
+        uint64_t maxDurationNanos{0};
+        uint64_t lastPeriodNanos{0};
+
+        // Time spent in each callback, and time between the starts of consecutive callbacks.
+        Histogram duration{};
+        Histogram interval{};
+
+        // The upper edge of the bucket that holds the given fraction of samples.
+        static uint64_t percentile(const Histogram& histogram, double fraction)
+        {
+            uint64_t total = 0;
+            for (auto count : histogram) {
+                total += count;
+            }
+            if (total == 0) {
+                return 0;
+            }
+            const auto rank = uint64_t(std::max(1.0, fraction * double(total) + 0.5));
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < kBucketCount; ++i) {
+                seen += histogram[i];
+                if (seen >= rank) {
+                    return bucketUpperBound(i);
+                }
+            }
+            return bucketUpperBound(kBucketCount - 1);
+        }
+    };
+
+    static uint64_t now()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void setSampleRate(double sampleRate)
+    {
+        mSampleRate = sampleRate;
+    }
+
+    // The length of one host clock tick, for converting the time stamps' host times.
+    void setNanosPerHostTick(double nanosPerHostTick)
+    {
+        mNanosPerHostTick = nanosPerHostTick;
+    }
+
+    // MARK: - Render thread
+
+    // Records one callback that started at `startNanos` and rendered `frameCount` frames at
+    // `sampleTime` and `hostTime`. Pass a negative `sampleTime` or a zero `hostTime` when the
+    // host didn't provide one.
+    //
+    // The buffer's period comes from how far the host time moved against the sample time since
+    // the previous callback, so it follows the device's actual rate. Without two consecutive
+    // time stamps to compare, it falls back to the nominal sample rate.
+    void recordCallback(uint64_t startNanos, uint64_t endNanos, double sampleTime, uint64_t hostTime, uint32_t frameCount)
+    {
+        const bool hasTimeStamp = sampleTime >= 0 && hostTime != 0;
+        const bool isContinuous = sampleTime >= 0 && mExpectedSampleTime >= 0 && sampleTime == mExpectedSampleTime;
+        uint64_t periodNanos = 0;
+        if (hasTimeStamp && isContinuous && mPreviousHostTime != 0 && hostTime > mPreviousHostTime) {
+            const double nanosPerFrame = double(hostTime - mPreviousHostTime) * mNanosPerHostTick / (sampleTime - mPreviousSampleTime);
+            periodNanos = uint64_t(frameCount * nanosPerFrame);
+        }
+        else if (mSampleRate > 0) {
+            periodNanos = uint64_t(frameCount * 1e9 / mSampleRate);
+        }
+        const auto duration = endNanos - startNanos;
+
+        beginWrite();
+        increment(mCallbackCount);
+        increment(mDuration[bucketIndex(duration)]);
+        if (mPreviousStart != 0) {
+            increment(mInterval[bucketIndex(startNanos - mPreviousStart)]);
+        }
+        if (periodNanos > 0 && duration > periodNanos) {
+            increment(mLateCount);
+        }
+        if (sampleTime >= 0 && mExpectedSampleTime >= 0 && !isContinuous) {
+            increment(mDiscontinuityCount);
+        }
+        if (duration > mMaxDuration.load(std::memory_order_relaxed)) {
+            mMaxDuration.store(duration, std::memory_order_relaxed);
+        }
+        mLastPeriod.store(periodNanos, std::memory_order_relaxed);
+        endWrite();
+
+        mPreviousStart = startNanos;
+        mExpectedSampleTime = sampleTime >= 0 ? sampleTime + frameCount : -1;
+        mPreviousSampleTime = sampleTime;
+        mPreviousHostTime = hasTimeStamp ? hostTime : 0;
+    }
+
+    void recordRenderError(int32_t error)
+    {
+        beginWrite();
+        increment(mRenderErrorCount);
+        mLastRenderError.store(error, std::memory_order_relaxed);
+        endWrite();
+    }
+
+    // MARK: - Any thread
+
+    // Copies the statistics. Returns false, leaving a possibly inconsistent copy,
+    // if the render thread kept updating them through every attempt.
+    bool snapshot(Snapshot& snapshot) const
+    {
+        for (int attempt = 0; attempt < kSnapshotAttempts; ++attempt) {
+            const auto before = mSequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            snapshot.callbackCount = mCallbackCount.load(std::memory_order_relaxed);
+            snapshot.lateCount = mLateCount.load(std::memory_order_relaxed);
+            snapshot.discontinuityCount = mDiscontinuityCount.load(std::memory_order_relaxed);
+            snapshot.renderErrorCount = mRenderErrorCount.load(std::memory_order_relaxed);
+            snapshot.lastRenderError = mLastRenderError.load(std::memory_order_relaxed);
+            snapshot.maxDurationNanos = mMaxDuration.load(std::memory_order_relaxed);
+            snapshot.lastPeriodNanos = mLastPeriod.load(std::memory_order_relaxed);
+            for (uint32_t i = 0; i < kBucketCount; ++i) {
+                snapshot.duration[i] = mDuration[i].load(std::memory_order_relaxed);
+                snapshot.interval[i] = mInterval[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mSequence.load(std::memory_order_relaxed) == before) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint32_t bucketIndex(uint64_t value)
+    {
+        if (value < kSubBucketCount) {
+            return uint32_t(value);
+        }
+        const auto shift = uint32_t(63 - __builtin_clzll(value)) - kSubBucketBits;
+        const auto subBucket = uint32_t(value >> shift) & (kSubBucketCount - 1);
+        return std::min((shift + 1) * kSubBucketCount + subBucket, kBucketCount - 1);
+    }
+
+    static uint64_t bucketUpperBound(uint32_t index)
+    {
+        if (index < kSubBucketCount) {
+            return index;
+        }
+        const auto shift = index / kSubBucketCount - 1;
+        const auto subBucket = uint64_t(index % kSubBucketCount);
+        return ((kSubBucketCount + subBucket + 1) << shift) - 1;
+    }
+
+private:
+    static constexpr int kSnapshotAttempts = 8;
+
+    // A sequence lock: the count is odd while the render thread updates the
+    // statistics, so a reader knows to discard what it copied.
+    void beginWrite()
+    {
+        mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void endWrite()
+    {
+        mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Only the render thread writes, so a load and a store are enough.
+    static void increment(std::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    double mSampleRate{0};
+    double mNanosPerHostTick{1};
+    uint64_t mPreviousStart{0};
+    double mExpectedSampleTime{-1};
+    double mPreviousSampleTime{-1};
+    uint64_t mPreviousHostTime{0};
+
+    alignas(64) std::atomic<uint64_t> mSequence{0};
+    std::atomic<uint64_t> mCallbackCount{0};
+    std::atomic<uint64_t> mLateCount{0};
+    std::atomic<uint64_t> mDiscontinuityCount{0};
+    std::atomic<uint64_t> mRenderErrorCount{0};
+    std::atomic<int32_t> mLastRenderError{0};
+    std::atomic<uint64_t> mMaxDuration{0};
+    std::atomic<uint64_t> mLastPeriod{0};
+    std::array<std::atomic<uint64_t>, kBucketCount> mDuration{};
+    std::array<std::atomic<uint64_t>, kBucketCount> mInterval{};
+};
+
+#endif /* RenderTelemetry_h */
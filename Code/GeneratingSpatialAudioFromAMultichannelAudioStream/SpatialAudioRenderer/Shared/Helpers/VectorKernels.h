@@ -0,0 +1,461 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Portable vectorized audio kernels with AVX, SSE, and NEON paths.
+*/
+#ifndef VectorKernels_h
+#define VectorKernels_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// On x86, the AVX loops are compiled for AVX whatever the build targets, and run when the processor
+// supports AVX; builds that target AVX already (-mavx) skip the check. Other architectures choose their
+// instruction set at compile time. Each kernel finishes the frames that don't fill a vector with a scalar loop.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define VECTOR_KERNELS_AVX 1
+#define VECTOR_KERNELS_TARGET_AVX __attribute__((target("avx")))
+#define VECTOR_KERNELS_TARGET_F16C __attribute__((target("avx,f16c")))
+#else
+#define VECTOR_KERNELS_AVX 0
+#endif
+
+namespace VectorKernels {
+
+#if VECTOR_KERNELS_AVX
+namespace detail {
+
+// The processor check runs once, while the program's static data initializes, so the
+// render thread only reads a flag.
+inline bool processorSupports(bool (*check)())
+{
+    __builtin_cpu_init();
+    return check();
+}
+
+#if defined(__AVX__)
+inline bool hasAVX() { return true; }
+#else
+inline const bool kProcessorHasAVX = processorSupports([] { return bool(__builtin_cpu_supports("avx")); });
+inline bool hasAVX() { return kProcessorHasAVX; }
+#endif
+
+#if defined(__AVX__) && defined(__F16C__)
+inline bool hasF16C() { return true; }
+#else
+inline const bool kProcessorHasF16C = processorSupports([] { return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"); });
+inline bool hasF16C() { return kProcessorHasF16C; }
+#endif
+
+// The AVX loops. Each returns the number of frames it processed, a multiple of eight.
+
+VECTOR_KERNELS_TARGET_AVX
+inline size_t mixRampedAVX(float* destination, const float* source, size_t frameCount, float gain, float step)
+{
+    size_t i = 0;
+    __m256 g = _mm256_add_ps(_mm256_set1_ps(gain),
+                             _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+    const __m256 increment = _mm256_set1_ps(step * 8);
+    for (; i + 8 <= frameCount; i += 8) {
+        const __m256 d = _mm256_loadu_ps(destination + i);
+        const __m256 s = _mm256_loadu_ps(source + i);
+        _mm256_storeu_ps(destination + i, _mm256_add_ps(d, _mm256_mul_ps(s, g)));
+        g = _mm256_add_ps(g, increment);
+    }
+    return i;
+}
+
+VECTOR_KERNELS_TARGET_AVX
+inline size_t mixAVX(float* destination, const float* source, size_t frameCount, float gain)
+{
+    size_t i = 0;
+    const __m256 g = _mm256_set1_ps(gain);
+    for (; i + 8 <= frameCount; i += 8) {
+        const __m256 d = _mm256_loadu_ps(destination + i);
+        _mm256_storeu_ps(destination + i, _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(source + i), g)));
+    }
+    return i;
+}
+
+VECTOR_KERNELS_TARGET_AVX
+inline size_t scaleAVX(float* buffer, size_t frameCount, float gain)
+{
+    size_t i = 0;
+    const __m256 g = _mm256_set1_ps(gain);
+    for (; i + 8 <= frameCount; i += 8) {
+        _mm256_storeu_ps(buffer + i, _mm256_mul_ps(_mm256_loadu_ps(buffer + i), g));
+    }
+    return i;
+}
+
+VECTOR_KERNELS_TARGET_AVX
+inline size_t butterflyAVX(float* first, float* second, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 a = _mm256_loadu_ps(first + i);
+        const __m256 b = _mm256_loadu_ps(second + i);
+        _mm256_storeu_ps(first + i, _mm256_add_ps(a, b));
+        _mm256_storeu_ps(second + i, _mm256_sub_ps(a, b));
+    }
+    return i;
+}
+
+VECTOR_KERNELS_TARGET_AVX
+inline size_t interpolateAVX(float* destination, const float* first, const float* second, size_t count, float fraction)
+{
+    size_t i = 0;
+    const __m256 f = _mm256_set1_ps(fraction);
+    for (; i + 8 <= count; i += 8) {
+        const __m256 a = _mm256_loadu_ps(first + i);
+        const __m256 b = _mm256_loadu_ps(second + i);
+        _mm256_storeu_ps(destination + i, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), f)));
+    }
+    return i;
+}
+
+// Also returns the sum of the vector lanes in `sum`.
+VECTOR_KERNELS_TARGET_AVX
+inline size_t dotProductAVX(const float* first, const float* second, size_t count, float& sum)
+{
+    size_t i = 0;
+    __m256 accumulator = _mm256_setzero_ps();
+    for (; i + 8 <= count; i += 8) {
+        accumulator = _mm256_add_ps(accumulator, _mm256_mul_ps(_mm256_loadu_ps(first + i), _mm256_loadu_ps(second + i)));
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(accumulator), _mm256_extractf128_ps(accumulator, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    sum = _mm_cvtss_f32(half);
+    return i;
+}
+
+VECTOR_KERNELS_TARGET_AVX
+inline size_t complexMultiplyAccumulateAVX(float* accumulatorReal, float* accumulatorImaginary,
+                                           const float* firstReal, const float* firstImaginary,
+                                           const float* secondReal, const float* secondImaginary,
+                                           size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 ar = _mm256_loadu_ps(firstReal + i);
+        const __m256 ai = _mm256_loadu_ps(firstImaginary + i);
+        const __m256 br = _mm256_loadu_ps(secondReal + i);
+        const __m256 bi = _mm256_loadu_ps(secondImaginary + i);
+        const __m256 real = _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi));
+        const __m256 imaginary = _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br));
+        _mm256_storeu_ps(accumulatorReal + i, _mm256_add_ps(_mm256_loadu_ps(accumulatorReal + i), real));
+        _mm256_storeu_ps(accumulatorImaginary + i, _mm256_add_ps(_mm256_loadu_ps(accumulatorImaginary + i), imaginary));
+    }
+    return i;
+}
+
+VECTOR_KERNELS_TARGET_F16C
+inline size_t convertHalfToFloatF16C(float* destination, const uint16_t* source, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+        _mm256_storeu_ps(destination + i, _mm256_cvtph_ps(half));
+    }
+    return i;
+}
+
+} // namespace detail
+#endif
+
+// Accumulates `source` into `destination` with a gain that starts at `gain`
+// and changes by `step` every frame.
+inline void mixRamped(float* destination, const float* source, size_t frameCount, float gain, float step)
+{
+    size_t i = 0;
+#if VECTOR_KERNELS_AVX
+    if (detail::hasAVX()) {
+        i = detail::mixRampedAVX(destination, source, frameCount, gain, step);
+    }
+    else
+#endif
+    {
+#if defined(__SSE2__)
+        __m128 g = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0, 1, 2, 3)));
+        const __m128 increment = _mm_set1_ps(step * 4);
+        for (; i + 4 <= frameCount; i += 4) {
+            const __m128 d = _mm_loadu_ps(destination + i);
+            const __m128 s = _mm_loadu_ps(source + i);
+            _mm_storeu_ps(destination + i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+            g = _mm_add_ps(g, increment);
+        }
+#elif defined(__ARM_NEON)
+        const float ramp[4] = {0, 1, 2, 3};
+        float32x4_t g = vmlaq_n_f32(vdupq_n_f32(gain), vld1q_f32(ramp), step);
+        const float32x4_t increment = vdupq_n_f32(step * 4);
+        for (; i + 4 <= frameCount; i += 4) {
+            vst1q_f32(destination + i, vmlaq_f32(vld1q_f32(destination + i), vld1q_f32(source + i), g));
+            g = vaddq_f32(g, increment);
+        }
+#endif
+    }
+    for (; i < frameCount; ++i) {
+        destination[i] += source[i] * (gain + step * float(i));
+    }
+}
+
+// Accumulates `source` into `destination` with a constant gain.
+inline void mix(float* destination, const float* source, size_t frameCount, float gain)
+{
+    size_t i = 0;
+#if VECTOR_KERNELS_AVX
+    if (detail::hasAVX()) {
+        i = detail::mixAVX(destination, source, frameCount, gain);
+    }
+    else
+#endif
+    {
+#if defined(__SSE2__)
+        const __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= frameCount; i += 4) {
+            const __m128 d = _mm_loadu_ps(destination + i);
+            _mm_storeu_ps(destination + i, _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(source + i), g)));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= frameCount; i += 4) {
+            vst1q_f32(destination + i, vmlaq_n_f32(vld1q_f32(destination + i), vld1q_f32(source + i), gain));
+        }
+#endif
+    }
+    for (; i < frameCount; ++i) {
+        destination[i] += source[i] * gain;
+    }
+}
+
+// Multiplies `buffer` in place by a constant gain.
+inline void scale(float* buffer, size_t frameCount, float gain)
+{
+    size_t i = 0;
+#if VECTOR_KERNELS_AVX
+    if (detail::hasAVX()) {
+        i = detail::scaleAVX(buffer, frameCount, gain);
+    }
+    else
+#endif
+    {
+#if defined(__SSE2__)
+        const __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= frameCount; i += 4) {
+            _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), g));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= frameCount; i += 4) {
+            vst1q_f32(buffer + i, vmulq_n_f32(vld1q_f32(buffer + i), gain));
+        }
+#endif
+    }
+    for (; i < frameCount; ++i) {
+        buffer[i] *= gain;
+    }
+}
+
+// Replaces `first` with `first + second` and `second` with `first - second`, a stage of a Hadamard transform.
+inline void butterfly(float* first, float* second, size_t count)
+{
+    size_t i = 0;
+#if VECTOR_KERNELS_AVX
+    if (detail::hasAVX()) {
+        i = detail::butterflyAVX(first, second, count);
+    }
+    else
+#endif
+    {
+#if defined(__SSE2__)
+        for (; i + 4 <= count; i += 4) {
+            const __m128 a = _mm_loadu_ps(first + i);
+            const __m128 b = _mm_loadu_ps(second + i);
+            _mm_storeu_ps(first + i, _mm_add_ps(a, b));
+            _mm_storeu_ps(second + i, _mm_sub_ps(a, b));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= count; i += 4) {
+            const float32x4_t a = vld1q_f32(first + i);
+            const float32x4_t b = vld1q_f32(second + i);
+            vst1q_f32(first + i, vaddq_f32(a, b));
+            vst1q_f32(second + i, vsubq_f32(a, b));
+        }
+#endif
+    }
+    for (; i < count; ++i) {
+        const float a = first[i];
+        const float b = second[i];
+        first[i] = a + b;
+        second[i] = a - b;
+    }
+}
+
+// Writes `first + (second - first) * fraction` to `destination`.
+inline void interpolate(float* destination, const float* first, const float* second, size_t count, float fraction)
+{
+    size_t i = 0;
+#if VECTOR_KERNELS_AVX
+    if (detail::hasAVX()) {
+        i = detail::interpolateAVX(destination, first, second, count, fraction);
+    }
+    else
+#endif
+    {
+#if defined(__SSE2__)
+        const __m128 f = _mm_set1_ps(fraction);
+        for (; i + 4 <= count; i += 4) {
+            const __m128 a = _mm_loadu_ps(first + i);
+            const __m128 b = _mm_loadu_ps(second + i);
+            _mm_storeu_ps(destination + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f)));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= count; i += 4) {
+            const float32x4_t a = vld1q_f32(first + i);
+            vst1q_f32(destination + i, vmlaq_n_f32(a, vsubq_f32(vld1q_f32(second + i), a), fraction));
+        }
+#endif
+    }
+    for (; i < count; ++i) {
+        destination[i] = first[i] + (second[i] - first[i]) * fraction;
+    }
+}
+
+// Returns the sum of the products of `first` and `second`.
+inline float dotProduct(const float* first, const float* second, size_t count)
+{
+    size_t i = 0;
+    float sum = 0;
+#if VECTOR_KERNELS_AVX
+    if (detail::hasAVX()) {
+        i = detail::dotProductAVX(first, second, count, sum);
+    }
+    else
+#endif
+    {
+#if defined(__SSE2__)
+        __m128 accumulator = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4) {
+            accumulator = _mm_add_ps(accumulator, _mm_mul_ps(_mm_loadu_ps(first + i), _mm_loadu_ps(second + i)));
+        }
+        accumulator = _mm_add_ps(accumulator, _mm_movehl_ps(accumulator, accumulator));
+        accumulator = _mm_add_ss(accumulator, _mm_shuffle_ps(accumulator, accumulator, 1));
+        sum = _mm_cvtss_f32(accumulator);
+#elif defined(__ARM_NEON)
+        float32x4_t accumulator = vdupq_n_f32(0);
+        for (; i + 4 <= count; i += 4) {
+            accumulator = vmlaq_f32(accumulator, vld1q_f32(first + i), vld1q_f32(second + i));
+        }
+        const float32x2_t pair = vadd_f32(vget_low_f32(accumulator), vget_high_f32(accumulator));
+        sum = vget_lane_f32(vpadd_f32(pair, pair), 0);
+#endif
+    }
+    for (; i < count; ++i) {
+        sum += first[i] * second[i];
+    }
+    return sum;
+}
+
+// Accumulates the product of two split-complex arrays: `accumulator += first * second`.
+inline void complexMultiplyAccumulate(float* accumulatorReal, float* accumulatorImaginary,
+                                      const float* firstReal, const float* firstImaginary,
+                                      const float* secondReal, const float* secondImaginary,
+                                      size_t count)
+{
+    size_t i = 0;
+#if VECTOR_KERNELS_AVX
+    if (detail::hasAVX()) {
+        i = detail::complexMultiplyAccumulateAVX(accumulatorReal, accumulatorImaginary, firstReal, firstImaginary,
+                                                 secondReal, secondImaginary, count);
+    }
+    else
+#endif
+    {
+#if defined(__SSE2__)
+        for (; i + 4 <= count; i += 4) {
+            const __m128 ar = _mm_loadu_ps(firstReal + i);
+            const __m128 ai = _mm_loadu_ps(firstImaginary + i);
+            const __m128 br = _mm_loadu_ps(secondReal + i);
+            const __m128 bi = _mm_loadu_ps(secondImaginary + i);
+            const __m128 real = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+            const __m128 imaginary = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+            _mm_storeu_ps(accumulatorReal + i, _mm_add_ps(_mm_loadu_ps(accumulatorReal + i), real));
+            _mm_storeu_ps(accumulatorImaginary + i, _mm_add_ps(_mm_loadu_ps(accumulatorImaginary + i), imaginary));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= count; i += 4) {
+            const float32x4_t ar = vld1q_f32(firstReal + i);
+            const float32x4_t ai = vld1q_f32(firstImaginary + i);
+            const float32x4_t br = vld1q_f32(secondReal + i);
+            const float32x4_t bi = vld1q_f32(secondImaginary + i);
+            float32x4_t real = vmlaq_f32(vld1q_f32(accumulatorReal + i), ar, br);
+            float32x4_t imaginary = vmlaq_f32(vld1q_f32(accumulatorImaginary + i), ar, bi);
+            vst1q_f32(accumulatorReal + i, vmlsq_f32(real, ai, bi));
+            vst1q_f32(accumulatorImaginary + i, vmlaq_f32(imaginary, ai, br));
+        }
+#endif
+    }
+    for (; i < count; ++i) {
+        accumulatorReal[i] += firstReal[i] * secondReal[i] - firstImaginary[i] * secondImaginary[i];
+        accumulatorImaginary[i] += firstReal[i] * secondImaginary[i] + firstImaginary[i] * secondReal[i];
+    }
+}
+
+// Converts an IEEE half-precision value to single precision.
+inline float halfToFloat(uint16_t half)
+{
+    const uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent != 0) {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    else if (mantissa == 0) {
+        bits = sign;
+    }
+    else {
+        // Normalize a subnormal half, which is representable as a normal float.
+        exponent = 127 - 15 + 1;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Converts `count` half-precision values to single precision.
+inline void convertHalfToFloat(float* destination, const uint16_t* source, size_t count)
+{
+    size_t i = 0;
+#if VECTOR_KERNELS_AVX
+    if (detail::hasF16C()) {
+        i = detail::convertHalfToFloatF16C(destination, source, count);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(destination + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(source + i))));
+    }
+#endif
+    for (; i < count; ++i) {
+        destination[i] = halfToFloat(source[i]);
+    }
+}
+
+} // namespace VectorKernels
+
+#endif /* VectorKernels_h */
@@ -6,5 +6,6 @@ Imports target's public headers to expose to Swift.
 */
 #import "AudioEngine.h"
 #import "AudioFileReader.h"
+#import "OfflineRenderer.h"
 
 #import <AVFoundation/AVFoundation.h>
@@ -0,0 +1,184 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Tests of the aligned buffer list and its pool, and a benchmark of the heap allocations each one makes.
+*/
+#include "AllocatedAudioBufferList.h"
+#include "TestSupport.h"
+
+#include <atomic>
+#include <thread>
+
+// The build wraps `posix_memalign` and `free` so the tests can count the heap traffic the lists make.
+static std::atomic<uint64_t> gAlignedAllocations{0};
+static std::atomic<uint64_t> gFrees{0};
+
+extern "C" int __real_posix_memalign(void** memory, size_t alignment, size_t size);
+extern "C" void __real_free(void* memory);
+
+extern "C" int __wrap_posix_memalign(void** memory, size_t alignment, size_t size)
+{
+    gAlignedAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __real_posix_memalign(memory, alignment, size);
+}
+
+extern "C" void __wrap_free(void* memory)
+{
+    if (memory != nullptr) {
+        gFrees.fetch_add(1, std::memory_order_relaxed);
+    }
+    __real_free(memory);
+}
+
+static bool planesAreAligned(const AudioBufferList* bufferList)
+{
+    for (UInt32 c = 0; c < bufferList->mNumberBuffers; ++c) {
+        if (reinterpret_cast<uintptr_t>(bufferList->mBuffers[c].mData) % AllocatedAudioBufferList::kAlignment != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// One allocation holds the header and every plane, each plane aligned and past the 16-bit frame limit.
+static void testSingleAlignedAllocation()
+{
+    constexpr UInt32 kChannels = 12;
+    constexpr UInt32 kFrames = 100000;
+    const auto allocationsBefore = gAlignedAllocations.load();
+    {
+        AllocatedAudioBufferList list(kChannels, kFrames);
+        CHECK(gAlignedAllocations.load() - allocationsBefore == 1);
+        CHECK(list.getChannelCount() == kChannels);
+        CHECK(list.getFrameCapacity() == kFrames);
+        CHECK(planesAreAligned(list.get()));
+
+        // Writing every frame of every plane stays inside the allocation and doesn't overlap the next plane.
+        for (UInt32 c = 0; c < kChannels; ++c) {
+            CHECK(list.get()->mBuffers[c].mDataByteSize == kFrames * sizeof(float));
+            auto plane = static_cast<float *>(list.get()->mBuffers[c].mData);
+            std::fill(plane, plane + kFrames, float(c));
+        }
+        for (UInt32 c = 0; c < kChannels; ++c) {
+            auto plane = static_cast<const float *>(list.get()->mBuffers[c].mData);
+            CHECK(plane[0] == float(c) && plane[kFrames - 1] == float(c));
+        }
+
+        list.setFrameCount(480);
+        CHECK(list.get()->mBuffers[kChannels - 1].mDataByteSize == 480 * sizeof(float));
+
+        // Moving hands over the allocation; the moved-from list is empty.
+        AllocatedAudioBufferList moved(std::move(list));
+        CHECK(list.get() == nullptr && list.getChannelCount() == 0);
+        CHECK(moved.getChannelCount() == kChannels);
+    }
+    CHECK(AllocatedAudioBufferList().get() == nullptr);
+}
+
+static void testPoolAcquireAndRelease()
+{
+    AudioBufferListPool pool(4, 12, 1024);
+    CHECK(pool.getAvailableCount() == 4);
+
+    const auto allocationsBefore = gAlignedAllocations.load();
+    const auto freesBefore = gFrees.load();
+    {
+        AllocatedAudioBufferList lists[4];
+        for (auto& list : lists) {
+            list = pool.acquire(12, 1024);
+            CHECK(list.get() != nullptr && planesAreAligned(list.get()));
+        }
+        CHECK(pool.getAvailableCount() == 0);
+        // The pool is out of lists, and never makes one bigger than its slots.
+        CHECK(pool.acquire(2, 64).get() == nullptr);
+        lists[1].reset();
+        CHECK(pool.acquire(13, 64).get() == nullptr);
+        CHECK(pool.acquire(2, 1025).get() == nullptr);
+
+        // A smaller list fits in a slot, and its planes don't overlap its neighbors'.
+        auto small = pool.acquire(2, 64);
+        CHECK(small.get() != nullptr && small.getFrameCapacity() == 64);
+        const auto smallEnd = static_cast<uint8_t *>(small.get()->mBuffers[1].mData) + 64 * sizeof(float);
+        for (auto& list : lists) {
+            if (list.get() != nullptr) {
+                CHECK(list.get()->mBuffers[0].mData >= smallEnd || list.get()->mBuffers[11].mData < small.get()->mBuffers[0].mData);
+            }
+        }
+    }
+    CHECK(pool.getAvailableCount() == 4);
+    CHECK(gAlignedAllocations.load() == allocationsBefore);
+    CHECK(gFrees.load() == freesBefore);
+}
+
+// Threads that acquire and release concurrently never hold the same slot at once.
+static void testPoolConcurrency()
+{
+    constexpr UInt32 kSlots = 64;
+    AudioBufferListPool pool(kSlots, 2, 64);
+    std::atomic<uint32_t> owners[kSlots] = {};
+    std::atomic<bool> collided{false};
+    const int iterations = test::quickMode() ? 20000 : 1000000;
+
+    auto work = [&] {
+        for (int i = 0; i < iterations; ++i) {
+            auto list = pool.acquire(2, 64);
+            if (list.get() == nullptr) {
+                continue;
+            }
+            auto& owner = owners[*static_cast<uint32_t *>(list.get()->mBuffers[0].mData) % kSlots];
+            if (owner.fetch_add(1) != 0) {
+                collided = true;
+            }
+            owner.fetch_sub(1);
+        }
+    };
+    // Give each slot's first plane its own index, so a thread can tell which slot it holds.
+    {
+        AllocatedAudioBufferList lists[kSlots];
+        for (UInt32 s = 0; s < kSlots; ++s) {
+            lists[s] = pool.acquire(2, 64);
+            *static_cast<uint32_t *>(lists[s].get()->mBuffers[0].mData) = s;
+        }
+    }
+    std::thread threads[4] = {std::thread(work), std::thread(work), std::thread(work), std::thread(work)};
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(!collided);
+    CHECK(pool.getAvailableCount() == kSlots);
+}
+
+// Builds and tears down the lists a kernel needs (an output buffer and two fade buffers) many times,
+// from the heap and from a pool, and reports the heap allocations and time per construction.
+static void benchmark()
+{
+    const int iterations = test::quickMode() ? 1000 : 200000;
+    AudioBufferListPool pool(8, 12, 4096);
+
+    printf("%-6s %18s %16s\n", "source", "allocations/kernel", "ns/kernel");
+    for (bool pooled : {false, true}) {
+        const auto allocationsBefore = gAlignedAllocations.load();
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            AllocatedAudioBufferList output = pooled ? pool.acquire(2, 4096) : AllocatedAudioBufferList(2, 4096);
+            AllocatedAudioBufferList fadeOut = pooled ? pool.acquire(12, 4096) : AllocatedAudioBufferList(12, 4096);
+            AllocatedAudioBufferList fadeIn = pooled ? pool.acquire(12, 4096) : AllocatedAudioBufferList(12, 4096);
+            CHECK(output.get() != nullptr && fadeOut.get() != nullptr && fadeIn.get() != nullptr);
+        }
+        const auto seconds = test::secondsSince(start);
+        const double allocations = double(gAlignedAllocations.load() - allocationsBefore) / iterations;
+        printf("%-6s %18.1f %16.1f\n", pooled ? "pool" : "heap", allocations, seconds * 1e9 / iterations);
+        CHECK(allocations == (pooled ? 0.0 : 3.0));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    testSingleAlignedAllocation();
+    testPoolAcquireAndRelease();
+    testPoolConcurrency();
+    benchmark();
+    return test::finish("AllocatedAudioBufferListTests");
+}
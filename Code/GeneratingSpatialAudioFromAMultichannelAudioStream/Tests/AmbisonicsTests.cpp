@@ -0,0 +1,369 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of ambisonic encoding, rotation, and decoding, and benchmarks of each stage.
+*/
+#include "Ambisonics.hpp"
+#include "TestSupport.h"
+
+#include <functional>
+#include <random>
+
+using Ambisonics::kChannelCount;
+
+constexpr uint32_t kBlockFrames = 512;
+constexpr double kSampleRate = 48000;
+
+using Planes = std::vector<std::vector<float>>;
+
+static std::vector<float*> pointersTo(Planes& planes)
+{
+    std::vector<float*> pointers;
+    for (auto& plane : planes) {
+        pointers.push_back(plane.data());
+    }
+    return pointers;
+}
+
+static std::vector<const float*> constPointersTo(const Planes& planes)
+{
+    std::vector<const float*> pointers;
+    for (auto& plane : planes) {
+        pointers.push_back(plane.data());
+    }
+    return pointers;
+}
+
+static std::array<double, 3> unitVector(double azimuth, double elevation)
+{
+    const auto a = azimuth * M_PI / 180, e = elevation * M_PI / 180;
+    // x to the front, y to the left, z up; azimuth runs clockwise, toward the right.
+    return {std::cos(e) * std::cos(a), -std::cos(e) * std::sin(a), std::sin(e)};
+}
+
+// SN3D harmonics are orthogonal over the sphere, with a squared norm of 4π / (2l + 1).
+static void checkHarmonics()
+{
+    float c[kChannelCount];
+    Ambisonics::evaluate(37, 12, c);
+    CHECK_NEAR(c[0], 1.0, 1e-6);
+
+    // Integrate over an equal-area grid.
+    double gram[kChannelCount][kChannelCount] = {};
+    const int rings = 180, segments = 360;
+    for (int r = 0; r < rings; ++r) {
+        const double z = -1 + (r + 0.5) * 2.0 / rings;
+        const double elevation = std::asin(z) * 180 / M_PI;
+        for (int s = 0; s < segments; ++s) {
+            Ambisonics::evaluate(float((s + 0.5) * 360.0 / segments - 180), float(elevation), c);
+            for (uint32_t i = 0; i < kChannelCount; ++i) {
+                for (uint32_t j = 0; j < kChannelCount; ++j) {
+                    gram[i][j] += double(c[i]) * c[j] * 4 * M_PI / (rings * segments);
+                }
+            }
+        }
+    }
+    for (uint32_t i = 0; i < kChannelCount; ++i) {
+        const auto order = uint32_t(std::sqrt(double(i)));
+        for (uint32_t j = 0; j < kChannelCount; ++j) {
+            CHECK_NEAR(gram[i][j], i == j ? 4 * M_PI / (2 * order + 1) : 0.0, 2e-3);
+        }
+    }
+}
+
+// A source encodes to the harmonics at its direction, and a move ramps across one block.
+static void checkEncoder()
+{
+    AmbisonicEncoder encoder;
+    encoder.setup({{30, 20, false}, {0, 0, true}});
+    Planes sources(2, std::vector<float>(kBlockFrames, 1.0f));
+    Planes field(kChannelCount, std::vector<float>(kBlockFrames, 0.0f));
+    auto fieldPointers = pointersTo(field);
+    encoder.process(constPointersTo(sources).data(), 2, fieldPointers.data(), kBlockFrames);
+
+    float expected[kChannelCount];
+    Ambisonics::evaluate(30, 20, expected);
+    for (uint32_t c = 0; c < kChannelCount; ++c) {
+        CHECK_NEAR(field[c][kBlockFrames - 1], expected[c], 1e-5);
+    }
+
+    float target[kChannelCount];
+    Ambisonics::evaluate(-90, 0, target);
+    encoder.setSourcePosition(0, -90, 0);
+    for (auto& channel : field) {
+        std::fill(channel.begin(), channel.end(), 0.0f);
+    }
+    encoder.process(constPointersTo(sources).data(), 2, fieldPointers.data(), kBlockFrames);
+    for (uint32_t c = 0; c < kChannelCount; ++c) {
+        CHECK_NEAR(field[c][0], expected[c], 1e-5);
+        CHECK_NEAR(field[c][kBlockFrames / 2], 0.5 * (expected[c] + target[c]), 1e-2);
+        CHECK_NEAR(field[c][kBlockFrames - 1], target[c], 1e-2);
+    }
+}
+
+// Applies a rotation matrix's order blocks to one set of coefficients.
+static void rotate(const AmbisonicRotator::Matrix& matrix, const float* input, float* output)
+{
+    uint32_t offset = 0;
+    for (uint32_t l = 0; l <= Ambisonics::kOrder; ++l) {
+        const auto first = l * l, size = 2 * l + 1;
+        for (uint32_t row = 0; row < size; ++row) {
+            output[first + row] = 0;
+            for (uint32_t column = 0; column < size; ++column) {
+                output[first + row] += matrix[offset + row * size + column] * input[first + column];
+            }
+        }
+        offset += size * size;
+    }
+}
+
+// The field moves against the head: turning right moves a source to the left, and so on.
+static void checkRotation()
+{
+    struct Case { float yaw, pitch, roll, azimuth, elevation, rotatedAzimuth, rotatedElevation; };
+    const Case cases[] = {
+        {30, 0, 0, 0, 0, -30, 0},
+        {-45, 0, 0, 60, 30, 105, 30},
+        {0, 20, 0, 0, 0, 0, -20},
+        {0, 0, 25, 90, 0, 90, 25},
+        {90, 0, 0, 0, 45, -90, 45},
+    };
+    AmbisonicRotator rotator;
+    float input[kChannelCount], output[kChannelCount], expected[kChannelCount];
+    for (const auto& test : cases) {
+        AmbisonicRotator::Matrix matrix;
+        rotator.computeMatrix(test.yaw, test.pitch, test.roll, matrix);
+        Ambisonics::evaluate(test.azimuth, test.elevation, input);
+        rotate(matrix, input, output);
+        Ambisonics::evaluate(test.rotatedAzimuth, test.rotatedElevation, expected);
+        for (uint32_t c = 0; c < kChannelCount; ++c) {
+            CHECK_NEAR(output[c], expected[c], 1e-4);
+        }
+    }
+
+    // Every order block is orthonormal, so a rotation keeps each order's energy.
+    AmbisonicRotator::Matrix matrix;
+    rotator.computeMatrix(33, -17, 48, matrix);
+    uint32_t offset = 0;
+    for (uint32_t l = 0; l <= Ambisonics::kOrder; ++l) {
+        const auto size = 2 * l + 1;
+        for (uint32_t i = 0; i < size; ++i) {
+            for (uint32_t j = 0; j < size; ++j) {
+                double dot = 0;
+                for (uint32_t k = 0; k < size; ++k) {
+                    dot += double(matrix[offset + i * size + k]) * matrix[offset + j * size + k];
+                }
+                CHECK_NEAR(dot, i == j ? 1.0 : 0.0, 1e-4);
+            }
+        }
+        offset += size * size;
+    }
+}
+
+// A new orientation crossfades over one block, then holds.
+static void checkRotatorProcess()
+{
+    AmbisonicRotator rotator;
+    Planes input(kChannelCount, std::vector<float>(kBlockFrames)), output = input;
+    float coefficients[kChannelCount];
+    Ambisonics::evaluate(0, 0, coefficients);
+    for (uint32_t c = 0; c < kChannelCount; ++c) {
+        std::fill(input[c].begin(), input[c].end(), coefficients[c]);
+    }
+    auto outputPointers = pointersTo(output);
+    rotator.process(constPointersTo(input).data(), outputPointers.data(), kBlockFrames);
+    for (uint32_t c = 0; c < kChannelCount; ++c) {
+        CHECK_NEAR(output[c][kBlockFrames - 1], coefficients[c], 1e-4);
+    }
+
+    float rotated[kChannelCount];
+    Ambisonics::evaluate(-40, 0, rotated);
+    rotator.setOrientation(40, 0, 0);
+    rotator.process(constPointersTo(input).data(), outputPointers.data(), kBlockFrames);
+    for (uint32_t c = 0; c < kChannelCount; ++c) {
+        CHECK_NEAR(output[c][0], coefficients[c], 1e-4);
+        CHECK_NEAR(output[c][kBlockFrames - 1], rotated[c], 1e-2);
+    }
+    rotator.process(constPointersTo(input).data(), outputPointers.data(), kBlockFrames);
+    for (uint32_t c = 0; c < kChannelCount; ++c) {
+        CHECK_NEAR(output[c][0], rotated[c], 1e-4);
+    }
+}
+
+// Decoding a source to speakers puts its energy vector close to its direction,
+// and a binaural decode puts a source on the right louder in the right ear.
+static void checkDecoder()
+{
+    AmbisonicDecoder decoder;
+    decoder.setupSpeakers(SpeakerLayout::Atmos_7_1_4);
+    CHECK(decoder.getOutputChannelCount() == 12);
+    CHECK(decoder.getLatencyFrames() == 0);
+    const auto speakers = speakerPositions(SpeakerLayout::Atmos_7_1_4);
+    const auto& matrix = decoder.getMatrix();
+
+    double worstError = 0;
+    const std::array<float, 2> directions[] = {{0, 0}, {-30, 0}, {30, 0}, {90, 0}, {-135, 0}, {180, 0}, {45, 35}, {-120, 40}};
+    for (const auto& direction : directions) {
+        float c[kChannelCount];
+        Ambisonics::evaluate(direction[0], direction[1], c);
+        std::array<double, 3> energyVector{};
+        double energy = 0;
+        for (uint32_t s = 0; s < speakers.size(); ++s) {
+            double gain = 0;
+            for (uint32_t k = 0; k < kChannelCount; ++k) {
+                gain += matrix[s * kChannelCount + k] * c[k];
+            }
+            if (speakers[s].isLFE) {
+                CHECK_NEAR(gain, 0, 1e-6);
+                continue;
+            }
+            const auto u = unitVector(speakers[s].azimuth, speakers[s].elevation);
+            for (int i = 0; i < 3; ++i) {
+                energyVector[i] += gain * gain * u[i];
+            }
+            energy += gain * gain;
+        }
+        const auto u = unitVector(direction[0], direction[1]);
+        const auto length = std::sqrt(energyVector[0] * energyVector[0] + energyVector[1] * energyVector[1] + energyVector[2] * energyVector[2]);
+        const auto cosine = (energyVector[0] * u[0] + energyVector[1] * u[1] + energyVector[2] * u[2]) / length;
+        worstError = std::max(worstError, std::acos(std::min(1.0, cosine)) * 180 / M_PI);
+    }
+    printf("7.1.4 decode: worst energy-vector error %.1f degrees\n", worstError);
+    CHECK(worstError < 15);
+
+    AmbisonicDecoder binaural;
+    binaural.setupBinaural(HRIRSet::sphericalHead(kSampleRate), 128);
+    CHECK(binaural.getLatencyFrames() == 128);
+    AmbisonicEncoder encoder;
+    encoder.setup({{90, 0, false}});
+    Planes source(1, std::vector<float>(kBlockFrames));
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> sample(-0.5f, 0.5f);
+    Planes field(kChannelCount, std::vector<float>(kBlockFrames)), ears(2, std::vector<float>(kBlockFrames));
+    auto fieldPointers = pointersTo(field);
+    auto earPointers = pointersTo(ears);
+    double energy[2] = {};
+    for (int block = 0; block < 8; ++block) {
+        for (auto& value : source[0]) {
+            value = sample(random);
+        }
+        for (auto& channel : field) {
+            std::fill(channel.begin(), channel.end(), 0.0f);
+        }
+        encoder.process(constPointersTo(source).data(), 1, fieldPointers.data(), kBlockFrames);
+        binaural.process(constPointersTo(field).data(), earPointers.data(), 2, kBlockFrames);
+        for (int ear = 0; ear < 2; ++ear) {
+            for (auto value : ears[ear]) {
+                energy[ear] += double(value) * value;
+            }
+        }
+    }
+    const auto difference = 10 * std::log10(energy[1] / energy[0]);
+    printf("binaural decode: right ear %.1f dB above the left for a source at 90 degrees\n", difference);
+    CHECK(difference > 6);
+}
+
+// MARK: - Benchmarks
+
+static double timeBlocks(int blocks, const std::function<void(int)>& render)
+{
+    double best = 1e12;
+    for (int round = 0; round < 3; ++round) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int block = 0; block < blocks; ++block) {
+            render(block);
+        }
+        best = std::min(best, test::secondsSince(start) / blocks);
+    }
+    return best;
+}
+
+static void printResult(const char* stage, const char* detail, double seconds)
+{
+    printf("%-22s %-18s %10.2f %10.2f%%\n", stage, detail, seconds * 1e6, 100 * seconds * kSampleRate / kBlockFrames);
+}
+
+static void benchmark()
+{
+    const int blocks = test::quickMode() ? 20 : 5000;
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> sample(-0.5f, 0.5f);
+    Planes sources(64, std::vector<float>(kBlockFrames));
+    for (auto& source : sources) {
+        for (auto& value : source) {
+            value = sample(random);
+        }
+    }
+    const auto sourcePointers = constPointersTo(sources);
+    Planes field(kChannelCount, std::vector<float>(kBlockFrames)), rotated = field;
+    auto fieldPointers = pointersTo(field);
+    auto rotatedPointers = pointersTo(rotated);
+    const auto fieldInputs = constPointersTo(field);
+    const auto rotatedInputs = constPointersTo(rotated);
+    Planes outputs(12, std::vector<float>(kBlockFrames));
+    auto outputPointers = pointersTo(outputs);
+
+    printf("\n%u-frame blocks, 48 kHz, one core\n", kBlockFrames);
+    printf("%-22s %-18s %10s %11s\n", "stage", "", "µs/block", "core load");
+    for (uint32_t sourceCount : {12u, 32u, 64u}) {
+        for (bool moving : {false, true}) {
+            AmbisonicEncoder encoder;
+            std::vector<SpeakerPosition> positions;
+            for (uint32_t s = 0; s < sourceCount; ++s) {
+                positions.push_back({float(s * 37 % 360) - 180, float(s * 11 % 60), false});
+            }
+            encoder.setup(positions);
+            const auto seconds = timeBlocks(blocks, [&](int block) {
+                if (moving) {
+                    for (uint32_t s = 0; s < sourceCount; ++s) {
+                        encoder.setSourcePosition(s, std::fmod(float(block + s * 37), 360.0f) - 180, float(s * 11 % 60));
+                    }
+                }
+                encoder.process(sourcePointers.data(), sourceCount, fieldPointers.data(), kBlockFrames);
+            });
+            char detail[32];
+            snprintf(detail, sizeof(detail), "%u sources, %s", sourceCount, moving ? "moving" : "fixed");
+            printResult("encode", detail, seconds);
+        }
+    }
+
+    // The rotation's cost doesn't depend on how many sources the field holds.
+    for (bool turning : {false, true}) {
+        AmbisonicRotator rotator;
+        const auto seconds = timeBlocks(blocks, [&](int block) {
+            if (turning) {
+                rotator.setOrientation(float(block % 360), 10, 5);
+            }
+            rotator.process(fieldInputs.data(), rotatedPointers.data(), kBlockFrames);
+        });
+        printResult("rotate", turning ? "turning" : "still", seconds);
+    }
+
+    for (auto layout : {SpeakerLayout::Stereo, SpeakerLayout::Surround_5_1, SpeakerLayout::Atmos_7_1_4}) {
+        AmbisonicDecoder decoder;
+        decoder.setupSpeakers(layout);
+        const auto seconds = timeBlocks(blocks, [&](int) {
+            decoder.process(rotatedInputs.data(), outputPointers.data(), decoder.getOutputChannelCount(), kBlockFrames);
+        });
+        printResult("decode", layout == SpeakerLayout::Stereo ? "stereo" : layout == SpeakerLayout::Surround_5_1 ? "5.1" : "7.1.4", seconds);
+    }
+    AmbisonicDecoder binaural;
+    binaural.setupBinaural(HRIRSet::sphericalHead(kSampleRate), 128);
+    const auto seconds = timeBlocks(blocks, [&](int) {
+        binaural.process(rotatedInputs.data(), outputPointers.data(), 2, kBlockFrames);
+    });
+    printResult("decode", "binaural", seconds);
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    checkHarmonics();
+    checkEncoder();
+    checkRotation();
+    checkRotatorProcess();
+    checkDecoder();
+    benchmark();
+    return test::finish("AmbisonicsTests");
+}
@@ -0,0 +1,112 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+An accuracy check of the binaural convolver and a benchmark of its cost on a 12-channel bed.
+*/
+#include "BinauralConvolver.hpp"
+#include "TestSupport.h"
+
+#include <random>
+
+constexpr uint32_t kBedChannels = 12;
+constexpr double kSampleRate = 48000;
+
+using Planes = std::vector<std::vector<float>>;
+
+static Planes randomPlanes(uint32_t count, uint32_t length, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> sample(-0.5f, 0.5f);
+    Planes planes(count, std::vector<float>(length));
+    for (auto& plane : planes) {
+        for (auto& value : plane) {
+            value = sample(random);
+        }
+    }
+    return planes;
+}
+
+// The output matches a direct convolution of every input with its responses, `getLatencyFrames()` later.
+static void checkAgainstDirectConvolution()
+{
+    const uint32_t responseLength = 300, partitionFrames = 64, frameCount = 2000;
+    const auto left = randomPlanes(kBedChannels, responseLength, 1);
+    const auto right = randomPlanes(kBedChannels, responseLength, 2);
+    const auto input = randomPlanes(kBedChannels, frameCount, 3);
+
+    BinauralConvolver convolver;
+    convolver.setup(left, right, partitionFrames);
+    std::vector<float> leftOutput(frameCount), rightOutput(frameCount);
+    std::vector<const float*> inputs(kBedChannels);
+    // Render in uneven requests, which don't line up with the partitions.
+    std::mt19937 random(4);
+    std::uniform_int_distribution<uint32_t> requestSize(1, 3 * partitionFrames);
+    for (uint32_t offset = 0; offset < frameCount;) {
+        const auto frames = std::min(requestSize(random), frameCount - offset);
+        for (uint32_t c = 0; c < kBedChannels; ++c) {
+            inputs[c] = input[c].data() + offset;
+        }
+        convolver.process(inputs.data(), kBedChannels, leftOutput.data() + offset, rightOutput.data() + offset, frames);
+        offset += frames;
+    }
+
+    const auto latency = convolver.getLatencyFrames();
+    CHECK(latency == partitionFrames);
+    double largest = 0;
+    for (uint32_t i = latency; i < frameCount; ++i) {
+        double expectedLeft = 0, expectedRight = 0;
+        const auto n = i - latency;
+        for (uint32_t c = 0; c < kBedChannels; ++c) {
+            for (uint32_t k = 0; k <= std::min(n, responseLength - 1); ++k) {
+                expectedLeft += double(input[c][n - k]) * left[c][k];
+                expectedRight += double(input[c][n - k]) * right[c][k];
+            }
+        }
+        largest = std::max({largest, std::fabs(leftOutput[i] - expectedLeft), std::fabs(rightOutput[i] - expectedRight)});
+    }
+    printf("largest difference from direct convolution: %g\n", largest);
+    CHECK(largest < 1e-3);
+}
+
+// Renders a 12-channel bed to two ears and reports the cost per block, and the share
+// of one core that real-time rendering at 48 kHz takes.
+static void benchmark(uint32_t responseLength, uint32_t partitionFrames, uint32_t blockFrames)
+{
+    BinauralConvolver convolver;
+    convolver.setup(randomPlanes(kBedChannels, responseLength, 5), randomPlanes(kBedChannels, responseLength, 6), partitionFrames);
+    const auto input = randomPlanes(kBedChannels, blockFrames, 7);
+    std::vector<const float*> inputs;
+    for (auto& plane : input) {
+        inputs.push_back(plane.data());
+    }
+    std::vector<float> left(blockFrames), right(blockFrames);
+
+    const int blocks = test::quickMode() ? 20 : int(std::max<uint64_t>(200, 40000000ull * 128 / (uint64_t(responseLength) * blockFrames)));
+    double best = 1e12;
+    for (int round = 0; round < 3; ++round) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int block = 0; block < blocks; ++block) {
+            convolver.process(inputs.data(), kBedChannels, left.data(), right.data(), blockFrames);
+        }
+        best = std::min(best, test::secondsSince(start) / blocks);
+    }
+    const double blockSeconds = blockFrames / kSampleRate;
+    printf("%9u %10u %6u %10u %12.1f %10.2f%%\n", responseLength, partitionFrames, blockFrames, convolver.getPartitionCount(),
+           best * 1e6, 100 * best / blockSeconds);
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    checkAgainstDirectConvolution();
+
+    printf("\n%u-channel bed to two ears, 48 kHz, one core\n", kBedChannels);
+    printf("%9s %10s %6s %10s %12s %11s\n", "response", "partition", "block", "partitions", "µs/block", "core load");
+    for (uint32_t responseLength : {256u, 512u, 2048u}) {
+        for (uint32_t partitionFrames : {64u, 128u, 256u}) {
+            benchmark(responseLength, partitionFrames, 512);
+        }
+    }
+    return test::finish("BinauralConvolverBenchmark");
+}
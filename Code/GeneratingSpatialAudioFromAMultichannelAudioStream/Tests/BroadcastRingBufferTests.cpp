@@ -0,0 +1,134 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the broadcast ring buffer's reads, catch-up, and requests larger than its capacity.
+*/
+#include "BroadcastRingBuffer.h"
+#include "TestSupport.h"
+
+#include <cstdint>
+#include <vector>
+
+constexpr uint32_t kChannels = 2;
+constexpr size_t kCapacity = 256;
+
+// Frame `position` of channel `c` holds a value that identifies both, so a read shows where it came from.
+static float frameValue(uint64_t position, uint32_t c)
+{
+    return float(position + 1) + 0.5f * float(c);
+}
+
+class Channels
+{
+public:
+    explicit Channels(size_t frameCount)
+    : mPlanes(kChannels, std::vector<float>(frameCount, -1.0f))
+    {
+        for (auto& plane : mPlanes) {
+            mPointers.push_back(plane.data());
+        }
+    }
+
+    float* const* pointers() { return mPointers.data(); }
+    const std::vector<float>& operator[](uint32_t c) const { return mPlanes[c]; }
+
+private:
+    std::vector<std::vector<float>> mPlanes;
+    std::vector<float*> mPointers;
+};
+
+static void writeFrames(BroadcastRingBuffer& buffer, size_t frameCount)
+{
+    const auto start = buffer.writePosition();
+    Channels source(frameCount);
+    for (uint32_t c = 0; c < kChannels; ++c) {
+        for (size_t i = 0; i < frameCount; ++i) {
+            source.pointers()[c][i] = frameValue(start + i, c);
+        }
+    }
+    std::vector<const float*> pointers(source.pointers(), source.pointers() + kChannels);
+    buffer.write(pointers.data(), frameCount);
+}
+
+// A reader gets the frames in order, and silence where the writer hasn't caught up.
+static void checkReadAndUnderrun()
+{
+    BroadcastRingBuffer buffer(kChannels, kCapacity);
+    const auto reader = uint32_t(buffer.addReader());
+    writeFrames(buffer, 100);
+
+    Channels destination(128);
+    bool matches = true;
+    for (uint64_t start = 0; start < 128; start += 64) {
+        buffer.read(reader, destination.pointers(), 64);
+        for (uint32_t c = 0; c < kChannels; ++c) {
+            for (size_t i = 0; i < 64; ++i) {
+                matches = matches && destination[c][i] == (start + i < 100 ? frameValue(start + i, c) : 0.0f);
+            }
+        }
+    }
+    CHECK(matches);
+    CHECK(buffer.underrunFrames(reader) == 28);
+    CHECK(buffer.droppedFrames(reader) == 0);
+}
+
+// A reader that falls more than a capacity behind drops what the writer overwrote and resumes with the leader.
+static void checkCatchUp()
+{
+    BroadcastRingBuffer buffer(kChannels, kCapacity);
+    const auto leader = uint32_t(buffer.addReader());
+    const auto laggard = uint32_t(buffer.addReader());
+    Channels destination(64);
+    for (int i = 0; i < 8; ++i) {
+        writeFrames(buffer, 64);
+        buffer.read(leader, destination.pointers(), 64);
+    }
+
+    buffer.read(laggard, destination.pointers(), 64);
+    CHECK(buffer.droppedFrames(laggard) == 8 * 64);
+    CHECK(buffer.underrunFrames(laggard) == 64);
+    CHECK(buffer.droppedFrames(leader) == 0);
+}
+
+// A request larger than the capacity from a reader more than a capacity behind catches up like any other,
+// instead of wrapping the catch-up arithmetic and copying more than a capacity out of the planes.
+static void checkReadLargerThanCapacity()
+{
+    BroadcastRingBuffer buffer(kChannels, kCapacity);
+    const auto leader = uint32_t(buffer.addReader());
+    const auto laggard = uint32_t(buffer.addReader());
+    Channels leaderDestination(64);
+    for (int i = 0; i < 12; ++i) {
+        writeFrames(buffer, 64);
+        buffer.read(leader, leaderDestination.pointers(), 64);
+    }
+
+    const size_t frameCount = kCapacity * 2;
+    Channels destination(frameCount);
+    buffer.read(laggard, destination.pointers(), frameCount);
+    bool silent = true;
+    for (uint32_t c = 0; c < kChannels; ++c) {
+        for (size_t i = 0; i < frameCount; ++i) {
+            silent = silent && destination[c][i] == 0.0f;
+        }
+    }
+    CHECK(silent);
+    CHECK(buffer.droppedFrames(laggard) == 12 * 64);
+    CHECK(buffer.underrunFrames(laggard) == frameCount);
+
+    // The laggard is level with the leader again.
+    writeFrames(buffer, 16);
+    buffer.read(laggard, destination.pointers(), 16);
+    CHECK(destination[0][0] == frameValue(12 * 64, 0));
+    CHECK(buffer.droppedFrames(laggard) == 12 * 64);
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    checkReadAndUnderrun();
+    checkCatchUp();
+    checkReadLargerThanCapacity();
+    return test::finish("BroadcastRingBufferTests");
+}
@@ -0,0 +1,134 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the FDN reverb's decay and channel handling, and a benchmark of its cost per channel.
+*/
+#include "FDNReverb.hpp"
+#include "TestSupport.h"
+
+#include <random>
+
+constexpr double kSampleRate = 48000;
+constexpr uint32_t kBlockFrames = 512;
+
+using Planes = std::vector<std::vector<float>>;
+
+static std::vector<float*> pointersTo(Planes& planes)
+{
+    std::vector<float*> pointers;
+    for (auto& plane : planes) {
+        pointers.push_back(plane.data());
+    }
+    return pointers;
+}
+
+// An impulse's tail falls by 60 dB in about the decay time.
+static void checkDecayTime()
+{
+    FDNReverb reverb;
+    reverb.setup(16, kSampleRate, 2);
+    FDNReverb::Parameters parameters;
+    parameters.decayTime = 1.0f;
+    parameters.highFrequencyDecayRatio = 1.0f;
+    parameters.modulationDepth = 0;
+    parameters.dryLevel = 0;
+    reverb.setParameters(parameters);
+
+    const uint32_t totalFrames = uint32_t(1.5 * kSampleRate);
+    Planes output(2, std::vector<float>(totalFrames));
+    output[0][0] = 1.0f;
+    auto pointers = pointersTo(output);
+    for (uint32_t offset = 0; offset < totalFrames; offset += kBlockFrames) {
+        float* block[] = {pointers[0] + offset, pointers[1] + offset};
+        reverb.process(block, 2, std::min(kBlockFrames, totalFrames - offset));
+    }
+
+    // Compare the energy in 100 ms windows 0.2 s and 0.7 s in, well into the diffuse tail.
+    auto energy = [&](double start) {
+        double sum = 0;
+        for (auto i = uint32_t(start * kSampleRate); i < uint32_t((start + 0.1) * kSampleRate); ++i) {
+            sum += double(output[0][i]) * output[0][i] + double(output[1][i]) * output[1][i];
+        }
+        return sum;
+    };
+    const double decibelsPerSecond = 10 * std::log10(energy(0.2) / energy(0.7)) / 0.5;
+    const double decayTime = 60 / decibelsPerSecond;
+    printf("measured decay time %.2f s for 1.00 s\n", decayTime);
+    CHECK_NEAR(decayTime, 1.0, 0.2);
+}
+
+// Channels past the count the reverb was set up for pass through unchanged.
+static void checkChannelCount()
+{
+    FDNReverb reverb;
+    reverb.setup(8, kSampleRate, 2);
+    CHECK(reverb.getChannelCount() == 2);
+    Planes channels(4, std::vector<float>(kBlockFrames * 8, 0.0f));
+    for (auto& channel : channels) {
+        channel[0] = 1.0f;
+    }
+    auto pointers = pointersTo(channels);
+    reverb.process(pointers.data(), 4, kBlockFrames * 8);
+
+    double tail[4] = {};
+    for (uint32_t c = 0; c < 4; ++c) {
+        for (uint32_t i = 1; i < channels[c].size(); ++i) {
+            tail[c] += std::fabs(channels[c][i]);
+        }
+    }
+    CHECK(tail[0] > 0 && tail[1] > 0);
+    CHECK(tail[2] == 0 && tail[3] == 0);
+    CHECK(channels[2][0] == 1.0f && channels[3][0] == 1.0f);
+}
+
+// Reports the cost of one block, per channel, and the share of one core at 48 kHz.
+static void benchmark(uint32_t lineCount, uint32_t channelCount, const std::vector<float>& noise)
+{
+    FDNReverb reverb;
+    reverb.setup(lineCount, kSampleRate, channelCount);
+    Planes channels(channelCount, std::vector<float>(kBlockFrames));
+    auto pointers = pointersTo(channels);
+
+    const int blocks = test::quickMode() ? 20 : 20000;
+    double best = 1e12;
+    for (int round = 0; round < 3; ++round) {
+        double seconds = 0;
+        for (int block = 0; block < blocks; ++block) {
+            // Refill the input outside the timed part, so the tail doesn't grow without bound.
+            for (uint32_t c = 0; c < channelCount; ++c) {
+                memcpy(channels[c].data(), noise.data() + c, kBlockFrames * sizeof(float));
+            }
+            const auto start = std::chrono::steady_clock::now();
+            reverb.process(pointers.data(), channelCount, kBlockFrames);
+            seconds += test::secondsSince(start);
+        }
+        best = std::min(best, seconds / blocks);
+    }
+    const double blockSeconds = kBlockFrames / kSampleRate;
+    printf("%5u %8u %12.2f %14.2f %10.2f%%\n", lineCount, channelCount, best * 1e6,
+           best * 1e9 / (double(channelCount) * kBlockFrames), 100 * best / blockSeconds);
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    checkDecayTime();
+    checkChannelCount();
+
+    std::vector<float> noise(kBlockFrames + 16);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> sample(-0.5f, 0.5f);
+    for (auto& value : noise) {
+        value = sample(random);
+    }
+
+    printf("\n%u-frame blocks, 48 kHz, one core\n", kBlockFrames);
+    printf("%5s %8s %12s %14s %11s\n", "lines", "channels", "µs/block", "ns/ch×frame", "core load");
+    for (uint32_t lineCount : {8u, 16u}) {
+        for (uint32_t channelCount : {1u, 2u, 6u, 12u, 16u}) {
+            benchmark(lineCount, channelCount, noise);
+        }
+    }
+    return test::finish("FDNReverbBenchmark");
+}
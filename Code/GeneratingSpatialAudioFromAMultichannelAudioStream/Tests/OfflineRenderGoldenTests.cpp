@@ -0,0 +1,261 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Golden-file and alignment checks of the offline renderer's block loop, driving the portable renderers.
+*/
+#include "OfflineRenderLoop.h"
+#include "AllocatedAudioBufferList.h"
+#include "PolyphaseResampler.hpp"
+#include "BinauralConvolver.hpp"
+#include "SpatialPanner.hpp"
+#include "TestSupport.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+constexpr uint32_t kBedChannels = 12;
+constexpr double kInputRate = 44100;
+constexpr double kOutputRate = 48000;
+constexpr uint32_t kInputFrames = 4410;
+constexpr uint32_t kPartitionFrames = 128;
+constexpr ResamplerQuality kQuality = ResamplerQuality::High;
+
+// Whether to rewrite the golden files from this build's output instead of checking against them.
+static bool updateGolden = false;
+
+enum class Path
+{
+    // The headphone path: the bed convolved with the spherical head's responses.
+    Binaural,
+    // The speaker path: the CPU panner folding the bed down to stereo.
+    Speakers
+};
+
+using Bed = std::vector<std::vector<float>>;
+
+// Renders the way the offline renderer does, through the same block loop and input padding, with
+// the portable renderers in place of the kernel: convert the rate, render in blocks, feed silence
+// past the input's end, and drop the renderer's delay from the start.
+class OfflineRender
+{
+public:
+    OfflineRender(const Bed& input, Path path, uint32_t blockSize)
+    : mInput(input), mPath(path), mBlockSize(blockSize), mBed(kBedChannels, std::vector<float>(blockSize)),
+      mOutput(2, blockSize)
+    {
+        mResampler.setup(kBedChannels, kInputRate, kOutputRate, blockSize, kQuality);
+        for (auto& channel : mBed) {
+            mBedPointers.push_back(channel.data());
+        }
+        mSourceBufferListStorage.assign(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * kBedChannels, 0);
+        uint32_t latencyFrames = 0;
+        if (path == Path::Binaural) {
+            mConvolver.setup(speakerPositions(SpeakerLayout::Atmos_7_1_4), HRIRSet::sphericalHead(kOutputRate), kPartitionFrames);
+            latencyFrames = mConvolver.getLatencyFrames();
+        }
+        else {
+            mPanner.setup(SpeakerLayout::Stereo, blockSize);
+            mPanner.addBedBus(SpeakerLayout::Atmos_7_1_4, pullBed, this);
+        }
+        mTiming = OfflineRenderTiming::make(kInputFrames, kInputRate, kOutputRate, latencyFrames, PolyphaseResampler::tapCount(kQuality));
+    }
+
+    const OfflineRenderTiming& timing() const { return mTiming; }
+
+    // Returns the left and right outputs.
+    std::vector<std::vector<float>> run()
+    {
+        std::vector<std::vector<float>> output(2);
+        auto renderBlock = [this](AudioBufferList* bufferList, int64_t, uint32_t frames) {
+            render(bufferList, frames);
+            return true;
+        };
+        auto writeBlock = [&output](AudioBufferList* bufferList, uint32_t frames) {
+            for (uint32_t c = 0; c < 2; ++c) {
+                const auto channel = static_cast<const float *>(bufferList->mBuffers[c].mData);
+                output[c].insert(output[c].end(), channel, channel + frames);
+            }
+            return true;
+        };
+        CHECK(OfflineRenderLoop::run(mTiming, mBlockSize, mOutput.get(), renderBlock, writeBlock));
+        return output;
+    }
+
+private:
+    void render(AudioBufferList* bufferList, uint32_t frames)
+    {
+        float* outputs[] = {static_cast<float *>(bufferList->mBuffers[0].mData), static_cast<float *>(bufferList->mBuffers[1].mData)};
+        if (mPath == Path::Binaural) {
+            pullBed(this, 0, mBedPointers.data(), kBedChannels, frames);
+            std::vector<const float*> inputs(mBedPointers.begin(), mBedPointers.end());
+            mConvolver.process(inputs.data(), kBedChannels, outputs[0], outputs[1], frames);
+        }
+        else {
+            mPanner.process(outputs, 2, frames);
+        }
+    }
+
+    static void pullBed(void* context, uint32_t, float* const* channels, uint32_t, uint32_t frameCount)
+    {
+        auto render = static_cast<OfflineRender *>(context);
+        render->mResampler.process(channels, frameCount, pullInput, render);
+    }
+
+    // Hands the resampler's buffers to the offline renderer's input padding, as the kernel does.
+    static void pullInput(void* context, float* const* channels, uint32_t channelCount, uint32_t frameCount)
+    {
+        auto render = static_cast<OfflineRender *>(context);
+        auto sourceBufferList = reinterpret_cast<AudioBufferList *>(render->mSourceBufferListStorage.data());
+        sourceBufferList->mNumberBuffers = channelCount;
+        for (uint32_t c = 0; c < channelCount; ++c) {
+            sourceBufferList->mBuffers[c].mNumberChannels = 1;
+            sourceBufferList->mBuffers[c].mDataByteSize = frameCount * sizeof(float);
+            sourceBufferList->mBuffers[c].mData = channels[c];
+        }
+        OfflineRenderLoop::pullInput(sourceBufferList, frameCount,
+                                     [render](AudioBufferList* bufferList, size_t frameOffset, size_t count) -> size_t {
+            const auto available = std::min<size_t>(count, kInputFrames - render->mInputPosition);
+            for (uint32_t c = 0; c < bufferList->mNumberBuffers; ++c) {
+                std::copy_n(render->mInput[c].data() + render->mInputPosition, available,
+                            static_cast<float *>(bufferList->mBuffers[c].mData) + frameOffset);
+            }
+            render->mInputPosition += available;
+            return available;
+        });
+    }
+
+    const Bed mInput;
+    Path mPath;
+    uint32_t mBlockSize;
+    size_t mInputPosition{0};
+    PolyphaseResampler mResampler;
+    BinauralConvolver mConvolver;
+    SpatialPanner mPanner;
+    OfflineRenderTiming mTiming;
+    Bed mBed;
+    std::vector<float*> mBedPointers;
+    std::vector<uint8_t> mSourceBufferListStorage;
+    AllocatedAudioBufferList mOutput;
+};
+
+// A tone per channel, each at its own frequency, faded in to avoid a click.
+static Bed makeTones()
+{
+    Bed bed(kBedChannels, std::vector<float>(kInputFrames));
+    for (uint32_t c = 0; c < kBedChannels; ++c) {
+        for (uint32_t i = 0; i < kInputFrames; ++i) {
+            const double fade = std::min(1.0, i / 64.0);
+            bed[c][i] = float(0.2 * fade * std::sin(2 * M_PI * (220.0 + 110.0 * c) * i / kInputRate));
+        }
+    }
+    return bed;
+}
+
+static Bed makeImpulse(uint32_t channel, uint32_t frame)
+{
+    Bed bed(kBedChannels, std::vector<float>(kInputFrames));
+    bed[channel][frame] = 1.0f;
+    return bed;
+}
+
+static size_t peakIndex(const std::vector<float>& signal)
+{
+    size_t peak = 0;
+    for (size_t i = 1; i < signal.size(); ++i) {
+        if (std::fabs(signal[i]) > std::fabs(signal[peak])) {
+            peak = i;
+        }
+    }
+    return peak;
+}
+
+// The output has the input's length at the output rate plus the resampler's tail,
+// and doesn't depend on the block size.
+static void checkLengthAndBlocks(Path path)
+{
+    const auto input = makeTones();
+    OfflineRender large(input, path, 4096), small(input, path, 1000);
+    const auto expected = large.run();
+    const auto actual = small.run();
+    const auto outputFrames = int64_t(std::ceil(kInputFrames * kOutputRate / kInputRate)) + int64_t(std::ceil(32 * kOutputRate / kInputRate));
+    CHECK(large.timing().outputFrames == outputFrames);
+    for (int c = 0; c < 2; ++c) {
+        CHECK(int64_t(expected[c].size()) == outputFrames);
+        CHECK(actual[c].size() == expected[c].size());
+        float largest = 0;
+        for (size_t i = 0; i < std::min(actual[c].size(), expected[c].size()); ++i) {
+            largest = std::max(largest, std::fabs(actual[c][i] - expected[c][i]));
+        }
+        // Where the vector loops split the work moves with the block boundaries, which rounds differently.
+        CHECK(largest < 1e-5f);
+    }
+}
+
+// An impulse comes out where the input had it, shifted only by the head's own
+// propagation delay, not by the convolver's block.
+static void checkAlignment()
+{
+    const uint32_t inputFrame = 2205;
+    const auto outputFrame = size_t(std::lround(inputFrame * kOutputRate / kInputRate));
+    const auto input = makeImpulse(0, inputFrame);
+
+    OfflineRender speakers(input, Path::Speakers, 4096);
+    CHECK_NEAR(double(peakIndex(speakers.run()[0])), double(outputFrame), 1);
+
+    const auto position = speakerPositions(SpeakerLayout::Atmos_7_1_4)[0];
+    const auto hrirs = HRIRSet::sphericalHead(kOutputRate);
+    const auto responsePeak = peakIndex(hrirs.nearest(position.azimuth, position.elevation).left);
+    OfflineRender binaural(input, Path::Binaural, 4096);
+    CHECK_NEAR(double(peakIndex(binaural.run()[0])), double(outputFrame + responsePeak), 2);
+}
+
+// Interleaved 32-bit float stereo, in the machine's byte order, which is little endian on every target.
+static void checkGolden(Path path, const char* name)
+{
+    OfflineRender render(makeTones(), path, 4096);
+    const auto output = render.run();
+    std::vector<float> interleaved;
+    for (size_t i = 0; i < output[0].size(); ++i) {
+        interleaved.push_back(output[0][i]);
+        interleaved.push_back(output[1][i]);
+    }
+
+    const auto goldenPath = std::string(GOLDEN_DIR) + "/" + name;
+    if (updateGolden) {
+        std::ofstream file(goldenPath, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(interleaved.data()), std::streamsize(interleaved.size() * sizeof(float)));
+        printf("wrote %s\n", goldenPath.c_str());
+        CHECK(bool(file));
+        return;
+    }
+
+    std::ifstream file(goldenPath, std::ios::binary | std::ios::ate);
+    CHECK(bool(file));
+    std::vector<float> golden(size_t(std::max<std::streamoff>(file.tellg(), 0)) / sizeof(float));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(golden.data()), std::streamsize(golden.size() * sizeof(float)));
+    CHECK(golden.size() == interleaved.size());
+
+    // Leave room for differences in vector instructions and math libraries between machines.
+    float largest = 0;
+    for (size_t i = 0; i < std::min(golden.size(), interleaved.size()); ++i) {
+        largest = std::max(largest, std::fabs(golden[i] - interleaved[i]));
+    }
+    CHECK_NEAR(largest, 0, 1e-4);
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    for (int i = 1; i < argc; ++i) {
+        updateGolden = updateGolden || strcmp(argv[i], "--update-golden") == 0;
+    }
+    checkLengthAndBlocks(Path::Binaural);
+    checkLengthAndBlocks(Path::Speakers);
+    checkAlignment();
+    checkGolden(Path::Binaural, "OfflineBinaural.f32");
+    checkGolden(Path::Speakers, "OfflineSpeakers.f32");
+    return test::finish("OfflineRenderGoldenTests");
+}
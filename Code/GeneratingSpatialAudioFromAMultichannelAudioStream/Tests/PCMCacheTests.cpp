@@ -0,0 +1,127 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Tests that write, map, and read the decoded PCM cache, and hand playback from a stream to it.
+*/
+#include "PCMCache.hpp"
+#include "SyntheticSource.h"
+#include "TestSupport.h"
+
+#include <unistd.h>
+
+static std::string temporaryPath(const char* name)
+{
+    return std::string("/tmp/PCMCacheTests-") + std::to_string(getpid()) + "-" + name;
+}
+
+// A float32 cache holds the source exactly, in planes aligned for vector loads.
+static void testFloatRoundTrip()
+{
+    constexpr uint32_t kChannels = 12;
+    constexpr size_t kLength = 50000;
+    const auto path = temporaryPath("f32.pcm");
+    SyntheticSource source(kChannels, kLength);
+    CHECK(PCMCache::write(path, source, kLength, PCMSampleFormat::Float32));
+
+    const auto cache = PCMCache::open(path);
+    CHECK(cache != nullptr);
+    if (cache == nullptr) {
+        return;
+    }
+    CHECK(cache->channelCount() == kChannels);
+    CHECK(cache->frameCount() == kLength);
+    CHECK(cache->sampleRate() == 48000);
+    bool matches = true;
+    for (uint32_t c = 0; c < kChannels; ++c) {
+        const float* plane = cache->floatChannel(c);
+        CHECK(reinterpret_cast<uintptr_t>(plane) % PCMCache::kPlaneAlignment == 0);
+        for (size_t i = 0; i < kLength && matches; ++i) {
+            matches = plane[i] == SyntheticSource::expected(c, i);
+        }
+    }
+    CHECK(matches);
+
+    // Opening the same path again shares the mapping rather than mapping the file twice.
+    CHECK(PCMCache::open(path).get() == cache.get());
+    unlink(path.c_str());
+}
+
+// A float16 cache converts as it reads, to within half precision.
+static void testHalfRoundTrip()
+{
+    constexpr uint32_t kChannels = 2;
+    constexpr size_t kLength = 2000;
+    const auto path = temporaryPath("f16.pcm");
+    SyntheticSource source(kChannels, kLength);
+    CHECK(PCMCache::write(path, source, kLength, PCMSampleFormat::Float16));
+
+    const auto cache = PCMCache::open(path);
+    CHECK(cache != nullptr && cache->floatChannel(0) == nullptr);
+    if (cache == nullptr) {
+        return;
+    }
+    Planes planes(kChannels, 777);
+    CHECK(cache->read(planes.pointers.data(), kChannels, 1500, 777) == 500);
+    for (uint32_t c = 0; c < kChannels; ++c) {
+        for (size_t i = 0; i < 500; ++i) {
+            const auto expected = SyntheticSource::expected(c, 1500 + i);
+            CHECK_NEAR(planes.storage[c][i], expected, expected / 1024);
+        }
+    }
+    unlink(path.c_str());
+}
+
+// The reader streams until its cache is ready, counting the frames the decoder delivered, then
+// reads the cache from that position. The two together play the file without a gap or a repeat.
+static void testSwitchFromStreamToCache()
+{
+    constexpr uint32_t kChannels = 12;
+    constexpr size_t kLength = 20000;
+    constexpr size_t kBlock = 480;
+    const auto path = temporaryPath("switch.pcm");
+    SyntheticSource cacheSource(kChannels, kLength);
+    CHECK(PCMCache::write(path, cacheSource, kLength));
+    const auto cache = PCMCache::open(path);
+    if (cache == nullptr) {
+        CHECK(cache != nullptr);
+        return;
+    }
+
+    StreamingDecoder decoder(std::make_unique<SyntheticSource>(kChannels, kLength), 8192, 1024);
+    decoder.start();
+    Planes planes(kChannels, kBlock);
+    size_t position = 0;
+    size_t played = 0;
+    bool matches = true;
+    // Stream past the end of the file once, so the position has to wrap.
+    for (int block = 0; block < 50; ++block) {
+        while (decoder.bufferedFrames() < kBlock) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        position = (position + decoder.pull(planes.pointers.data(), kChannels, kBlock)) % kLength;
+        played += kBlock;
+    }
+    decoder.stop();
+    CHECK(played > kLength);
+
+    for (int block = 0; block < 10; ++block) {
+        const auto frames = cache->read(planes.pointers.data(), kChannels, position, kBlock);
+        for (size_t i = 0; i < frames && matches; ++i) {
+            matches = planes.storage[3][i] == SyntheticSource::expected(3, (played + i) % kLength);
+        }
+        position = (position + frames) % kLength;
+        played += frames;
+    }
+    CHECK(matches);
+    unlink(path.c_str());
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    testFloatRoundTrip();
+    testHalfRoundTrip();
+    testSwitchFromStreamToCache();
+    return test::finish("PCMCacheTests");
+}
@@ -0,0 +1,226 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+THD+N and block-size checks for the polyphase resampler, and a benchmark of its throughput.
+*/
+#include "PolyphaseResampler.hpp"
+#include "TestSupport.h"
+
+#include <random>
+
+constexpr uint32_t kChannelCount = 12;
+constexpr uint32_t kMaxOutputFrames = 512;
+
+// A sine on every channel, with a different phase per channel, continuous across pulls.
+struct SineSource
+{
+    double frequency;
+    double sampleRate;
+    uint64_t frame{0};
+    uint64_t pulledFrames{0};
+
+    static void pull(void* context, float* const* channels, uint32_t channelCount, uint32_t frameCount)
+    {
+        auto source = static_cast<SineSource *>(context);
+        for (uint32_t i = 0; i < frameCount; ++i) {
+            const double t = 2 * M_PI * source->frequency * double(source->frame + i) / source->sampleRate;
+            for (uint32_t c = 0; c < channelCount; ++c) {
+                channels[c][i] = float(0.5 * std::sin(t + 0.3 * c));
+            }
+        }
+        source->frame += frameCount;
+        source->pulledFrames += frameCount;
+    }
+};
+
+// Renders `totalFrames` frames in requests of random sizes up to `maxRequest`, like the mixer's input callback.
+static std::vector<std::vector<float>> render(PolyphaseResampler& resampler, SineSource& source,
+                                              uint32_t totalFrames, uint32_t maxRequest, uint32_t seed)
+{
+    std::vector<std::vector<float>> output(resampler.getChannelCount(), std::vector<float>(totalFrames));
+    std::vector<float*> pointers(resampler.getChannelCount());
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<uint32_t> requestSize(1, maxRequest);
+    for (uint32_t offset = 0; offset < totalFrames;) {
+        const auto frames = std::min(requestSize(random), totalFrames - offset);
+        for (uint32_t c = 0; c < pointers.size(); ++c) {
+            pointers[c] = output[c].data() + offset;
+        }
+        resampler.process(pointers.data(), frames, SineSource::pull, &source);
+        offset += frames;
+    }
+    return output;
+}
+
+// Fits a sine, a cosine, and DC at `frequency` by least squares and returns the
+// power of what's left relative to the fitted sine, in decibels.
+static double thdPlusNoise(const float* signal, size_t count, double frequency)
+{
+    double m[3][3] = {}, v[3] = {};
+    for (size_t i = 0; i < count; ++i) {
+        const double basis[3] = {std::sin(2 * M_PI * frequency * i), std::cos(2 * M_PI * frequency * i), 1.0};
+        for (int r = 0; r < 3; ++r) {
+            v[r] += basis[r] * signal[i];
+            for (int c = 0; c < 3; ++c) {
+                m[r][c] += basis[r] * basis[c];
+            }
+        }
+    }
+    // Solve the 3×3 normal equations by Cramer's rule.
+    auto determinant = [](double a[3][3]) {
+        return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+             - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+             + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    };
+    const double d = determinant(m);
+    double coefficients[3];
+    for (int k = 0; k < 3; ++k) {
+        double replaced[3][3];
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                replaced[r][c] = (c == k) ? v[r] : m[r][c];
+            }
+        }
+        coefficients[k] = determinant(replaced) / d;
+    }
+
+    double residual = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const double fit = coefficients[0] * std::sin(2 * M_PI * frequency * i)
+                         + coefficients[1] * std::cos(2 * M_PI * frequency * i) + coefficients[2];
+        residual += (signal[i] - fit) * (signal[i] - fit);
+    }
+    const double signalPower = 0.5 * (coefficients[0] * coefficients[0] + coefficients[1] * coefficients[1]) * count;
+    return 10 * std::log10(residual / signalPower);
+}
+
+struct Case
+{
+    double inputRate;
+    double outputRate;
+    double frequency;
+    ResamplerQuality quality;
+    double limit;
+};
+
+static const char* qualityName(ResamplerQuality quality)
+{
+    switch (quality) {
+        case ResamplerQuality::Low: return "low";
+        case ResamplerQuality::Medium: return "medium";
+        case ResamplerQuality::High: return "high";
+    }
+    return "";
+}
+
+static void checkAccuracy()
+{
+    // The limits leave about 5 dB of margin above what each tier measures.
+    const Case cases[] = {
+        {44100, 48000, 1000, ResamplerQuality::Low, -70},
+        {44100, 48000, 1000, ResamplerQuality::Medium, -85},
+        {44100, 48000, 1000, ResamplerQuality::High, -105},
+        {48000, 44100, 1000, ResamplerQuality::Medium, -85},
+        {48000, 44100, 1000, ResamplerQuality::High, -110},
+        {44100, 48000, 10000, ResamplerQuality::Medium, -80},
+        {44100, 48000, 16000, ResamplerQuality::High, -100},
+        {96000, 48000, 10000, ResamplerQuality::High, -120},
+    };
+    printf("%8s %8s %8s %8s %10s\n", "input", "output", "tone", "quality", "THD+N (dB)");
+    for (const auto& test : cases) {
+        PolyphaseResampler resampler;
+        resampler.setup(kChannelCount, test.inputRate, test.outputRate, kMaxOutputFrames, test.quality);
+        SineSource source{test.frequency, test.inputRate};
+        const uint32_t settleFrames = 4 * resampler.getTapCount();
+        const auto output = render(resampler, source, settleFrames + 32768, kMaxOutputFrames, 3);
+
+        double worst = -300;
+        for (uint32_t c = 0; c < kChannelCount; ++c) {
+            worst = std::max(worst, thdPlusNoise(output[c].data() + settleFrames, 32768, test.frequency / test.outputRate));
+        }
+        printf("%8.0f %8.0f %8.0f %8s %10.1f\n", test.inputRate, test.outputRate, test.frequency, qualityName(test.quality), worst);
+        CHECK(worst < test.limit);
+    }
+}
+
+// The output doesn't depend on how the caller splits its requests.
+static void checkVariableRequests()
+{
+    PolyphaseResampler fixed, variable;
+    fixed.setup(kChannelCount, 44100, 48000, kMaxOutputFrames);
+    variable.setup(kChannelCount, 44100, 48000, kMaxOutputFrames);
+    SineSource fixedSource{440, 44100}, variableSource{440, 44100};
+    const auto expected = render(fixed, fixedSource, 20000, 1, 0);
+    // Requests larger than `kMaxOutputFrames` exercise the resampler's own slicing.
+    const auto actual = render(variable, variableSource, 20000, 3 * kMaxOutputFrames, 5);
+    for (uint32_t c = 0; c < kChannelCount; ++c) {
+        for (uint32_t i = 0; i < expected[c].size(); ++i) {
+            CHECK_NEAR(actual[c][i], expected[c][i], 1e-6);
+        }
+    }
+
+    // The resampler pulls input at the conversion ratio, plus the filter's lookahead.
+    const double expectedInput = 20000 * 44100.0 / 48000 + fixed.getLookaheadFrames();
+    CHECK_NEAR(double(variableSource.pulledFrames), expectedInput, 2);
+    CHECK_NEAR(double(fixedSource.pulledFrames), expectedInput, 2);
+}
+
+struct TableSource
+{
+    std::vector<float> table = std::vector<float>(4096 + 1024);
+    uint32_t position{0};
+
+    TableSource()
+    {
+        std::mt19937 random(9);
+        std::uniform_real_distribution<float> sample(-0.5f, 0.5f);
+        for (auto& value : table) {
+            value = sample(random);
+        }
+    }
+
+    static void pull(void* context, float* const* channels, uint32_t channelCount, uint32_t frameCount)
+    {
+        auto source = static_cast<TableSource *>(context);
+        for (uint32_t c = 0; c < channelCount; ++c) {
+            memcpy(channels[c], source->table.data() + (source->position + c) % 1024, frameCount * sizeof(float));
+        }
+        source->position = (source->position + frameCount) % 4096;
+    }
+};
+
+static void benchmark()
+{
+    printf("\n%u channels, %u-frame requests, 44.1 kHz to 48 kHz\n", kChannelCount, kMaxOutputFrames);
+    printf("%8s %5s %16s %14s\n", "quality", "taps", "Mframes/s/core", "×real time");
+    for (auto quality : {ResamplerQuality::Low, ResamplerQuality::Medium, ResamplerQuality::High}) {
+        PolyphaseResampler resampler;
+        resampler.setup(kChannelCount, 44100, 48000, kMaxOutputFrames, quality);
+        // Copy the input from a table, so the benchmark times the resampler rather than `sin`.
+        TableSource source;
+        std::vector<std::vector<float>> output(kChannelCount, std::vector<float>(kMaxOutputFrames));
+        std::vector<float*> pointers;
+        for (auto& channel : output) {
+            pointers.push_back(channel.data());
+        }
+        const int blocks = test::quickMode() ? 20 : 4000;
+        const auto start = std::chrono::steady_clock::now();
+        for (int block = 0; block < blocks; ++block) {
+            resampler.process(pointers.data(), kMaxOutputFrames, TableSource::pull, &source);
+        }
+        const auto seconds = test::secondsSince(start);
+        const double frames = double(blocks) * kMaxOutputFrames;
+        printf("%8s %5u %16.2f %14.1f\n", qualityName(quality), resampler.getTapCount(),
+               frames / seconds / 1e6, frames / seconds / 48000);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    checkAccuracy();
+    checkVariableRequests();
+    benchmark();
+    return test::finish("PolyphaseResamplerTests");
+}
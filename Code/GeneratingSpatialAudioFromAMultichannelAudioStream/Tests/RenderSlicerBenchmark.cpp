@@ -0,0 +1,120 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A benchmark of the render callback's cost with and without the copy through the scratch buffer.
+*/
+#include "RenderSlicer.h"
+#include "SpatialPanner.hpp"
+#include "TestSupport.h"
+
+#include <cstdlib>
+
+constexpr UInt32 kBedChannels = 12;
+constexpr UInt32 kOutputChannels = 2;
+constexpr UInt32 kMaxFrames = 4096;
+
+// Host buffers: one plane per output channel, either aligned so the renderer can write in place,
+// or four bytes off alignment so the slicer has to render into its scratch buffer and copy.
+struct HostBuffers {
+    HostBuffers(UInt32 frameCount, bool aligned)
+    : storage(kOutputChannels, std::vector<float>(frameCount + 64)),
+      listStorage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * kOutputChannels)
+    {
+        list()->mNumberBuffers = kOutputChannels;
+        for (UInt32 c = 0; c < kOutputChannels; ++c) {
+            auto address = reinterpret_cast<uintptr_t>(storage[c].data());
+            address = (address + 63) / 64 * 64 + (aligned ? 0 : sizeof(float));
+            list()->mBuffers[c] = AudioBuffer{1, UInt32(frameCount * sizeof(float)), reinterpret_cast<float *>(address)};
+        }
+    }
+    AudioBufferList* list() { return reinterpret_cast<AudioBufferList *>(listStorage.data()); }
+    std::vector<std::vector<float>> storage;
+    std::vector<uint8_t> listStorage;
+};
+
+static void pullBed(void*, uint32_t, float* const* channels, uint32_t channelCount, uint32_t frameCount)
+{
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        for (uint32_t i = 0; i < frameCount; ++i) {
+            channels[c][i] = 0.01f * float((i + c) % 97);
+        }
+    }
+}
+
+struct Result {
+    double nanoseconds;
+    uint32_t inPlaceCount;
+};
+
+// With no panner, the renderer writes a ramp, which leaves the copy as most of the callback's cost.
+static Result measure(SpatialPanner* panner, RenderSlicer& slicer, HostBuffers& host, UInt32 frameCount, int iterations)
+{
+    float* outputs[kOutputChannels];
+    uint32_t inPlaceCount = 0;
+    auto renderSlice = [&](AudioBufferList* bufferList, const AudioTimeStamp*, UInt32 frames) {
+        inPlaceCount += (bufferList == host.list());
+        for (UInt32 c = 0; c < kOutputChannels; ++c) {
+            outputs[c] = static_cast<float *>(bufferList->mBuffers[c].mData);
+        }
+        if (panner != nullptr) {
+            panner->process(outputs, kOutputChannels, frames);
+        }
+        else {
+            for (UInt32 c = 0; c < kOutputChannels; ++c) {
+                for (UInt32 i = 0; i < frames; ++i) {
+                    outputs[c][i] = float(i) * 0.001f;
+                }
+            }
+        }
+        return OSStatus(noErr);
+    };
+
+    for (int i = 0; i < 8; ++i) {
+        slicer.render(nullptr, frameCount, host.list(), renderSlice);
+    }
+    inPlaceCount = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        slicer.render(nullptr, frameCount, host.list(), renderSlice);
+    }
+    return Result{test::secondsSince(start) * 1e9 / iterations, inPlaceCount};
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+
+    SpatialPanner panner;
+    panner.setup(SpeakerLayout::Stereo, kMaxFrames);
+    panner.addBedBus(SpeakerLayout::Atmos_7_1_4, pullBed, nullptr);
+    RenderSlicer slicer(AllocatedAudioBufferList(kOutputChannels, kMaxFrames));
+
+    for (SpatialPanner* renderer : {&panner, static_cast<SpatialPanner *>(nullptr)}) {
+        printf("\n%s\n", (renderer != nullptr) ? "7.1.4 bed panned to stereo" : "ramp");
+        printf("%6s %14s %14s %10s\n", "frames", "in place (ns)", "copied (ns)", "saving");
+        for (UInt32 frameCount : {64u, 128u, 512u, 4096u}) {
+            const int iterations = test::quickMode() ? 200 : int(4000000 / frameCount);
+            HostBuffers aligned(frameCount, true);
+            HostBuffers misaligned(frameCount, false);
+            // Alternate the two paths and keep each one's best round, so neither pays for warming the caches.
+            Result inPlace{1e12, 0}, copied{1e12, 0};
+            for (int round = 0; round < 5; ++round) {
+                const auto inPlaceRound = measure(renderer, slicer, aligned, frameCount, iterations);
+                const auto copiedRound = measure(renderer, slicer, misaligned, frameCount, iterations);
+                inPlace = (inPlaceRound.nanoseconds < inPlace.nanoseconds) ? inPlaceRound : inPlace;
+                copied = (copiedRound.nanoseconds < copied.nanoseconds) ? copiedRound : copied;
+            }
+            CHECK(inPlace.inPlaceCount == uint32_t(iterations));
+            CHECK(copied.inPlaceCount == 0);
+            printf("%6u %14.0f %14.0f %9.1f%%\n", frameCount, inPlace.nanoseconds, copied.nanoseconds,
+                   100.0 * (copied.nanoseconds - inPlace.nanoseconds) / copied.nanoseconds);
+
+            // Both paths produce the same audio.
+            for (UInt32 c = 0; c < kOutputChannels; ++c) {
+                CHECK(memcmp(aligned.list()->mBuffers[c].mData, misaligned.list()->mBuffers[c].mData, frameCount * sizeof(float)) == 0);
+            }
+        }
+    }
+    return test::finish("RenderSlicerBenchmark");
+}
@@ -0,0 +1,185 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the render slicer's in-place and sliced paths, as the kernel uses them for large requests.
+*/
+#include "RenderSlicer.h"
+#include "TestSupport.h"
+
+constexpr UInt32 kRendererChannels = 2;
+constexpr UInt32 kMaxSliceFrames = 256;
+
+// A host's output list with its own storage, a plane per channel.
+struct HostBuffers {
+    HostBuffers(UInt32 channelCount, UInt32 frameCount, float fill = 0.0f)
+    : storage(channelCount, std::vector<float>(frameCount + 16, fill)),
+      listStorage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channelCount)
+    {
+        list()->mNumberBuffers = channelCount;
+        for (UInt32 c = 0; c < channelCount; ++c) {
+            // Aligned to 64 bytes within the plane, so the in-place checks depend only on the channel count.
+            auto address = (reinterpret_cast<uintptr_t>(storage[c].data()) + 63) / 64 * 64;
+            list()->mBuffers[c] = AudioBuffer{1, UInt32(frameCount * sizeof(float)), reinterpret_cast<float *>(address)};
+        }
+    }
+    AudioBufferList* list() { return reinterpret_cast<AudioBufferList *>(listStorage.data()); }
+    float* channel(UInt32 c) { return static_cast<float *>(list()->mBuffers[c].mData); }
+    std::vector<std::vector<float>> storage;
+    std::vector<uint8_t> listStorage;
+};
+
+// Writes a running frame count to every channel, offset by the channel, and records each call.
+struct RampRenderer {
+    struct Call {
+        bool inPlace;
+        bool hasTimeStamp;
+        Float64 sampleTime;
+        UInt32 frameCount;
+    };
+
+    AudioBufferList* host{nullptr};
+    UInt32 frame{0};
+    std::vector<Call> calls;
+    size_t failAtCall{SIZE_MAX};
+
+    OSStatus operator()(AudioBufferList* bufferList, const AudioTimeStamp* timeStamp, UInt32 frameCount)
+    {
+        calls.push_back({bufferList == host, timeStamp != nullptr, timeStamp ? timeStamp->mSampleTime : -1, frameCount});
+        if (calls.size() - 1 == failAtCall) {
+            return kAudio_ParamError;
+        }
+        for (UInt32 c = 0; c < bufferList->mNumberBuffers; ++c) {
+            auto data = static_cast<float *>(bufferList->mBuffers[c].mData);
+            for (UInt32 i = 0; i < frameCount; ++i) {
+                data[i] = float(frame + i) + 0.25f * c;
+            }
+        }
+        frame += frameCount;
+        return noErr;
+    }
+};
+
+static RenderSlicer makeSlicer()
+{
+    return RenderSlicer(AllocatedAudioBufferList(kRendererChannels, kMaxSliceFrames));
+}
+
+// A request that fits and matches the renderer's output renders once, straight into the host's buffers.
+static void checkInPlace()
+{
+    auto slicer = makeSlicer();
+    HostBuffers host(kRendererChannels, kMaxSliceFrames);
+    RampRenderer renderer;
+    renderer.host = host.list();
+    AudioTimeStamp timeStamp{};
+    timeStamp.mSampleTime = 1000;
+    timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+
+    CHECK(slicer.render(&timeStamp, 200, host.list(), renderer) == noErr);
+    CHECK(renderer.calls.size() == 1);
+    CHECK(renderer.calls[0].inPlace);
+    CHECK(renderer.calls[0].sampleTime == 1000);
+    CHECK(host.list()->mBuffers[0].mDataByteSize == 200 * sizeof(float));
+    CHECK_NEAR(host.channel(1)[199], 199.25, 0);
+}
+
+// A request larger than the slice size renders in consecutive slices that join without a gap,
+// each stamped with its own sample time, and the channels the renderer doesn't make stay silent.
+static void checkSlicing(UInt32 hostChannels, UInt32 frameCount)
+{
+    auto slicer = makeSlicer();
+    // Fill the host's buffers with garbage, which every frame of the render has to replace.
+    HostBuffers host(hostChannels, frameCount, 7.0f);
+    RampRenderer renderer;
+    renderer.host = host.list();
+    AudioTimeStamp timeStamp{};
+    timeStamp.mSampleTime = 48000;
+    timeStamp.mHostTime = 123456789;
+    timeStamp.mFlags = kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid;
+
+    CHECK(slicer.render(&timeStamp, frameCount, host.list(), renderer) == noErr);
+
+    const auto sliceCount = (frameCount + kMaxSliceFrames - 1) / kMaxSliceFrames;
+    CHECK(renderer.calls.size() == sliceCount);
+    UInt32 rendered = 0;
+    for (const auto& call : renderer.calls) {
+        CHECK(!call.inPlace);
+        CHECK(call.hasTimeStamp);
+        CHECK(call.sampleTime == 48000 + rendered);
+        CHECK(call.frameCount == std::min(kMaxSliceFrames, frameCount - rendered));
+        rendered += call.frameCount;
+    }
+    CHECK(rendered == frameCount);
+    // The host's own time stamp is left as it was.
+    CHECK(timeStamp.mSampleTime == 48000);
+
+    for (UInt32 c = 0; c < hostChannels; ++c) {
+        for (UInt32 i = 0; i < frameCount; ++i) {
+            const float expected = (c < kRendererChannels) ? float(i) + 0.25f * c : 0.0f;
+            if (host.channel(c)[i] != expected) {
+                CHECK(host.channel(c)[i] == expected);
+                break;
+            }
+        }
+        // Nothing past the request changes.
+        CHECK(host.channel(c)[frameCount] == 7.0f);
+    }
+}
+
+// Without a time stamp, every slice gets none either.
+static void checkMissingTimeStamp()
+{
+    auto slicer = makeSlicer();
+    HostBuffers host(kRendererChannels, 3 * kMaxSliceFrames);
+    RampRenderer renderer;
+    // Off alignment, so even a request that fits goes through the scratch buffer.
+    host.list()->mBuffers[1].mData = host.channel(1) + 1;
+    CHECK(slicer.render(nullptr, 3 * kMaxSliceFrames, host.list(), renderer) == noErr);
+    CHECK(renderer.calls.size() == 3);
+    for (const auto& call : renderer.calls) {
+        CHECK(!call.hasTimeStamp);
+    }
+    CHECK(host.channel(1)[3 * kMaxSliceFrames - 1] == float(3 * kMaxSliceFrames - 1) + 0.25f);
+}
+
+// A failed slice stops the render and returns its error.
+static void checkError()
+{
+    auto slicer = makeSlicer();
+    HostBuffers host(kRendererChannels, 4 * kMaxSliceFrames);
+    RampRenderer renderer;
+    renderer.failAtCall = 1;
+    CHECK(slicer.render(nullptr, 4 * kMaxSliceFrames, host.list(), renderer) == kAudio_ParamError);
+    CHECK(renderer.calls.size() == 2);
+}
+
+// A host buffer shorter than the request takes only what fits.
+static void checkShortBuffer()
+{
+    auto slicer = makeSlicer();
+    HostBuffers host(3, 600, 7.0f);
+    host.list()->mBuffers[1].mDataByteSize = 300 * sizeof(float);
+    RampRenderer renderer;
+    CHECK(slicer.render(nullptr, 600, host.list(), renderer) == noErr);
+    CHECK(host.channel(0)[599] == 599.0f);
+    CHECK(host.channel(1)[299] == 299.25f);
+    CHECK(host.channel(1)[300] == 7.0f);
+    CHECK(host.channel(2)[599] == 0.0f);
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    checkInPlace();
+    // The renderer's own channel count, with and without a partial last slice.
+    checkSlicing(kRendererChannels, 4 * kMaxSliceFrames);
+    checkSlicing(kRendererChannels, 1000);
+    // More host channels than the renderer makes, which can't render in place at any size.
+    checkSlicing(6, 100);
+    checkSlicing(6, 4096);
+    checkMissingTimeStamp();
+    checkError();
+    checkShortBuffer();
+    return test::finish("RenderSlicerTests");
+}
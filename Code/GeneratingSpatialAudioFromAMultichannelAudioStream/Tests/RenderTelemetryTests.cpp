@@ -0,0 +1,177 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the render telemetry's period, lateness, and snapshots, and a measurement of its overhead.
+*/
+#include "RenderTelemetry.h"
+#include "TestSupport.h"
+
+#include <thread>
+
+constexpr double kSampleRate = 48000;
+constexpr uint32_t kSliceFrames = 128;
+
+// Host times in 24 MHz ticks, as on Apple silicon.
+constexpr double kNanosPerHostTick = 125.0 / 3.0;
+
+static uint64_t hostTicks(double nanos)
+{
+    return uint64_t(nanos / kNanosPerHostTick + 0.5);
+}
+
+static RenderTelemetry::Snapshot snapshotOf(const RenderTelemetry& telemetry)
+{
+    RenderTelemetry::Snapshot snapshot;
+    CHECK(telemetry.snapshot(snapshot));
+    return snapshot;
+}
+
+// The period follows the device's actual rate, which the time stamps reveal, rather than the nominal one.
+static void checkPeriodFromTimeStamps()
+{
+    RenderTelemetry telemetry;
+    telemetry.setSampleRate(kSampleRate);
+    telemetry.setNanosPerHostTick(kNanosPerHostTick);
+
+    // A device that runs 1% slow, so each slice takes 1% longer than its nominal 2.667 ms.
+    const double nominalNanos = kSliceFrames * 1e9 / kSampleRate;
+    const double actualNanos = nominalNanos * 1.01;
+    const uint64_t start = 1000000000;
+
+    telemetry.recordCallback(start, start + 1000, 0, hostTicks(start), kSliceFrames);
+    // The first callback has nothing to compare against, so it uses the nominal rate.
+    CHECK_NEAR(snapshotOf(telemetry).lastPeriodNanos, nominalNanos, 1);
+
+    for (uint32_t i = 1; i < 10; ++i) {
+        const auto callbackStart = start + uint64_t(i * actualNanos);
+        // Each callback takes longer than the nominal period but not the actual one.
+        const auto duration = uint64_t(nominalNanos * 1.005);
+        telemetry.recordCallback(callbackStart, callbackStart + duration, i * kSliceFrames,
+                                 hostTicks(start + i * actualNanos), kSliceFrames);
+        CHECK_NEAR(snapshotOf(telemetry).lastPeriodNanos, actualNanos, 50);
+    }
+    auto snapshot = snapshotOf(telemetry);
+    CHECK(snapshot.callbackCount == 10);
+    CHECK(snapshot.lateCount == 0);
+    CHECK(snapshot.discontinuityCount == 0);
+
+    // A callback for twice the frames covers twice the time.
+    const auto callbackStart = start + uint64_t(10 * actualNanos);
+    telemetry.recordCallback(callbackStart, callbackStart + 1000, 10 * kSliceFrames,
+                             hostTicks(start + 10 * actualNanos), 2 * kSliceFrames);
+    CHECK_NEAR(snapshotOf(telemetry).lastPeriodNanos, 2 * actualNanos, 100);
+
+    // A callback longer than the actual period is late.
+    const auto lateStart = start + uint64_t(12 * actualNanos);
+    telemetry.recordCallback(lateStart, lateStart + uint64_t(actualNanos * 1.1), 12 * kSliceFrames,
+                             hostTicks(start + 12 * actualNanos), kSliceFrames);
+    CHECK(snapshotOf(telemetry).lateCount == 1);
+}
+
+// A skipped cycle counts as a discontinuity, and the period falls back to the nominal rate
+// instead of spreading the gap over one buffer.
+static void checkDiscontinuity()
+{
+    RenderTelemetry telemetry;
+    telemetry.setSampleRate(kSampleRate);
+    telemetry.setNanosPerHostTick(1);
+    const double periodNanos = kSliceFrames * 1e9 / kSampleRate;
+
+    telemetry.recordCallback(1000, 2000, 0, 1000, kSliceFrames);
+    telemetry.recordCallback(1000 + uint64_t(3 * periodNanos), 2000 + uint64_t(3 * periodNanos),
+                             3 * kSliceFrames, 1000 + uint64_t(3 * periodNanos), kSliceFrames);
+    auto snapshot = snapshotOf(telemetry);
+    CHECK(snapshot.discontinuityCount == 1);
+    CHECK_NEAR(snapshot.lastPeriodNanos, periodNanos, 1);
+
+    // Without host times, the period comes from the nominal rate.
+    telemetry.recordCallback(1000 + uint64_t(4 * periodNanos), 2000 + uint64_t(4 * periodNanos),
+                             4 * kSliceFrames, 0, kSliceFrames);
+    snapshot = snapshotOf(telemetry);
+    CHECK(snapshot.discontinuityCount == 1);
+    CHECK_NEAR(snapshot.lastPeriodNanos, periodNanos, 1);
+}
+
+static void checkBuckets()
+{
+    for (uint64_t value : {0ull, 1ull, 7ull, 8ull, 9ull, 100ull, 2666666ull, 123456789ull, 1ull << 40}) {
+        const auto upper = RenderTelemetry::bucketUpperBound(RenderTelemetry::bucketIndex(value));
+        CHECK(upper >= value);
+        CHECK(double(upper - value) <= 0.125 * double(value) + 1);
+    }
+
+    RenderTelemetry::Histogram histogram{};
+    for (uint64_t value = 1; value <= 100; ++value) {
+        ++histogram[RenderTelemetry::bucketIndex(value * 1000)];
+    }
+    CHECK_NEAR(RenderTelemetry::Snapshot::percentile(histogram, 0.5), 50000, 50000 * 0.125);
+    CHECK_NEAR(RenderTelemetry::Snapshot::percentile(histogram, 0.99), 99000, 99000 * 0.125);
+}
+
+// A reader on another thread never sees a half-written update.
+static void checkConcurrentSnapshots()
+{
+    RenderTelemetry telemetry;
+    telemetry.setSampleRate(kSampleRate);
+    const uint32_t callbackCount = test::quickMode() ? 200000 : 5000000;
+    std::atomic<bool> done{false};
+    uint64_t consistent = 0, inconsistent = 0;
+
+    std::thread reader([&] {
+        RenderTelemetry::Snapshot snapshot;
+        while (!done.load(std::memory_order_acquire)) {
+            if (!telemetry.snapshot(snapshot)) {
+                continue;
+            }
+            uint64_t total = 0;
+            for (auto count : snapshot.duration) {
+                total += count;
+            }
+            (total == snapshot.callbackCount ? consistent : inconsistent) += 1;
+        }
+    });
+    for (uint32_t i = 0; i < callbackCount; ++i) {
+        telemetry.recordCallback(1000 + i * 3000ull, 2000 + i * 3000ull + i % 500, double(i) * kSliceFrames,
+                                 1000 + i * 3000ull, kSliceFrames);
+    }
+    done.store(true, std::memory_order_release);
+    reader.join();
+
+    printf("snapshots: %llu consistent, %llu inconsistent\n", (unsigned long long)consistent, (unsigned long long)inconsistent);
+    CHECK(inconsistent == 0);
+    CHECK(snapshotOf(telemetry).callbackCount == callbackCount);
+}
+
+// Times what the kernel adds to each callback, both clock reads included, against a 128-frame period.
+static void measureOverhead()
+{
+    RenderTelemetry telemetry;
+    telemetry.setSampleRate(kSampleRate);
+    const int callbacks = test::quickMode() ? 100000 : 10000000;
+    double best = 1e12;
+    for (int round = 0; round < 5; ++round) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < callbacks; ++i) {
+            const auto callbackStart = RenderTelemetry::now();
+            telemetry.recordCallback(callbackStart, RenderTelemetry::now(), double(i) * kSliceFrames,
+                                     callbackStart, kSliceFrames);
+        }
+        best = std::min(best, test::secondsSince(start) * 1e9 / callbacks);
+    }
+    const double periodNanos = kSliceFrames * 1e9 / kSampleRate;
+    printf("overhead: %.1f ns per callback, %.4f%% of a %u-frame period at %.0f kHz\n",
+           best, 100 * best / periodNanos, kSliceFrames, kSampleRate / 1000);
+    CHECK(best < 0.01 * periodNanos);
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    checkPeriodFromTimeStamps();
+    checkDiscontinuity();
+    checkBuckets();
+    checkConcurrentSnapshots();
+    measureOverhead();
+    return test::finish("RenderTelemetryTests");
+}
@@ -0,0 +1,67 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+The Core Audio types that the portable headers use, for building the tests where AudioToolbox isn't available.
+*/
+#ifndef Shims_AudioToolbox_h
+#define Shims_AudioToolbox_h
+
+#include <cstdint>
+
+#define __nullable
+#define _Nullable
+#define _Nonnull
+
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef int64_t SInt64;
+typedef double Float64;
+typedef int32_t OSStatus;
+
+enum : OSStatus {
+    noErr = 0,
+    kAudio_ParamError = -50
+};
+
+struct AudioBuffer {
+    UInt32 mNumberChannels;
+    UInt32 mDataByteSize;
+    void* mData;
+};
+
+struct AudioBufferList {
+    UInt32 mNumberBuffers;
+    AudioBuffer mBuffers[1];
+};
+
+struct SMPTETime {
+    int16_t mSubframes;
+    int16_t mSubframeDivisor;
+    UInt32 mCounter;
+    UInt32 mType;
+    UInt32 mFlags;
+    int16_t mHours;
+    int16_t mMinutes;
+    int16_t mSeconds;
+    int16_t mFrames;
+};
+
+enum : UInt32 {
+    kAudioTimeStampSampleTimeValid = 1u << 0,
+    kAudioTimeStampHostTimeValid = 1u << 1,
+    kAudioTimeStampRateScalarValid = 1u << 2
+};
+
+struct AudioTimeStamp {
+    Float64 mSampleTime;
+    UInt64 mHostTime;
+    Float64 mRateScalar;
+    UInt64 mWordClockTime;
+    SMPTETime mSMPTETime;
+    UInt32 mFlags;
+    UInt32 mReserved;
+};
+
+#endif /* Shims_AudioToolbox_h */
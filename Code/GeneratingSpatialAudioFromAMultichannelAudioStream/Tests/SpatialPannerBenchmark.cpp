@@ -0,0 +1,214 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Checks of the CPU panner's gains and smoothing, and a benchmark of its throughput per core.
+*/
+#include "SpatialPanner.hpp"
+#include "VectorKernels.h"
+#include "TestSupport.h"
+
+#include <random>
+
+constexpr uint32_t kBlockFrames = 512;
+
+// Fills every channel with a constant: 1 + the channel index, or 1 for an object.
+static void pullConstant(void*, uint32_t, float* const* channels, uint32_t channelCount, uint32_t frameCount)
+{
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        std::fill(channels[c], channels[c] + frameCount, float(c + 1));
+    }
+}
+
+static void pullNoise(void* context, uint32_t, float* const* channels, uint32_t channelCount, uint32_t frameCount)
+{
+    const auto noise = static_cast<const std::vector<float> *>(context);
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        memcpy(channels[c], noise->data() + c, frameCount * sizeof(float));
+    }
+}
+
+static void checkVectorKernels()
+{
+    // Every frame count exercises a different split between the vector loop and the scalar tail.
+    std::vector<float> source(67), destination(67), expected(67);
+    for (size_t i = 0; i < source.size(); ++i) {
+        source[i] = 0.25f * float(i % 7) - 0.5f;
+    }
+    for (size_t frameCount = 0; frameCount <= source.size(); ++frameCount) {
+        std::fill(destination.begin(), destination.end(), 1.0f);
+        std::fill(expected.begin(), expected.end(), 1.0f);
+        VectorKernels::mixRamped(destination.data(), source.data(), frameCount, 0.5f, 0.01f);
+        for (size_t i = 0; i < frameCount; ++i) {
+            expected[i] += source[i] * (0.5f + 0.01f * float(i));
+        }
+        for (size_t i = 0; i < destination.size(); ++i) {
+            CHECK_NEAR(destination[i], expected[i], 1e-5);
+        }
+
+        float sum = 0;
+        for (size_t i = 0; i < frameCount; ++i) {
+            sum += source[i] * expected[i];
+        }
+        CHECK_NEAR(VectorKernels::dotProduct(source.data(), expected.data(), frameCount), sum, 1e-4);
+    }
+}
+
+static void checkLayouts()
+{
+    CHECK(speakerLayoutForChannelCount(0) == SpeakerLayout::Stereo);
+    CHECK(speakerLayoutForChannelCount(2) == SpeakerLayout::Stereo);
+    CHECK(speakerLayoutForChannelCount(6) == SpeakerLayout::Surround_5_1);
+    CHECK(speakerLayoutForChannelCount(8) == SpeakerLayout::Surround_5_1);
+    CHECK(speakerLayoutForChannelCount(12) == SpeakerLayout::Atmos_7_1_4);
+    CHECK(speakerLayoutForChannelCount(16) == SpeakerLayout::Atmos_7_1_4);
+}
+
+static void checkPowerNormalization()
+{
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> azimuth(-180, 180), elevation(0, 60);
+    for (auto layout : {SpeakerLayout::Stereo, SpeakerLayout::Surround_5_1, SpeakerLayout::Atmos_7_1_4}) {
+        SpatialPanner panner;
+        panner.setup(layout, kBlockFrames);
+        std::vector<float> gains(panner.getOutputChannelCount());
+        for (int i = 0; i < 200; ++i) {
+            panner.computeGains(azimuth(random), elevation(random), gains.data());
+            float power = 0;
+            for (auto gain : gains) {
+                CHECK(gain >= -1e-6f);
+                power += gain * gain;
+            }
+            CHECK_NEAR(power, 1.0, 1e-3);
+        }
+    }
+}
+
+// A bed on a matching layout plays each channel from its own speaker.
+static void checkMatchingBed()
+{
+    for (auto layout : {SpeakerLayout::Surround_5_1, SpeakerLayout::Atmos_7_1_4}) {
+        SpatialPanner panner;
+        panner.setup(layout, kBlockFrames);
+        panner.addBedBus(layout, pullConstant, nullptr);
+        std::vector<std::vector<float>> outputs(panner.getOutputChannelCount(), std::vector<float>(kBlockFrames));
+        std::vector<float*> pointers;
+        for (auto& output : outputs) {
+            pointers.push_back(output.data());
+        }
+        panner.process(pointers.data(), uint32_t(pointers.size()), kBlockFrames);
+        for (uint32_t o = 0; o < outputs.size(); ++o) {
+            CHECK_NEAR(outputs[o][kBlockFrames - 1], o + 1, 1e-3);
+        }
+    }
+}
+
+// Moving an object ramps its gains across the next block instead of jumping.
+static void checkSmoothing()
+{
+    SpatialPanner panner;
+    panner.setup(SpeakerLayout::Stereo, kBlockFrames);
+    const auto bus = panner.addObjectBus(pullConstant, nullptr);
+    panner.setObjectPosition(bus, -30, 0);
+    std::vector<float> left(kBlockFrames), right(kBlockFrames);
+    float* outputs[] = {left.data(), right.data()};
+
+    // Settle on the left speaker, then move to the right one.
+    panner.process(outputs, 2, kBlockFrames);
+    panner.process(outputs, 2, kBlockFrames);
+    CHECK_NEAR(left[kBlockFrames - 1], 1.0, 1e-4);
+    CHECK_NEAR(right[kBlockFrames - 1], 0.0, 1e-4);
+
+    panner.setObjectPosition(bus, 30, 0);
+    panner.process(outputs, 2, kBlockFrames);
+    const float largestStep = 1.0f / kBlockFrames * 1.01f;
+    for (uint32_t i = 1; i < kBlockFrames; ++i) {
+        CHECK(left[i] <= left[i - 1] && left[i - 1] - left[i] <= largestStep);
+        CHECK(right[i] >= right[i - 1] && right[i] - right[i - 1] <= largestStep);
+    }
+    panner.process(outputs, 2, kBlockFrames);
+    CHECK_NEAR(left[0], 0.0, 1e-4);
+    CHECK_NEAR(right[0], 1.0, 1e-4);
+}
+
+static const char* layoutName(SpeakerLayout layout)
+{
+    switch (layout) {
+        case SpeakerLayout::Stereo: return "stereo";
+        case SpeakerLayout::Surround_5_1: return "5.1";
+        case SpeakerLayout::Atmos_7_1_4: return "7.1.4";
+    }
+    return "";
+}
+
+// Renders a 7.1.4 bed and `objectCount` objects, and reports input channels × frames per second
+// on the one core the panner runs on.
+static void benchmark(SpeakerLayout layout, uint32_t objectCount, bool moving, const std::vector<float>& noise)
+{
+    SpatialPanner panner;
+    panner.setup(layout, kBlockFrames);
+    panner.addBedBus(SpeakerLayout::Atmos_7_1_4, pullNoise, const_cast<std::vector<float> *>(&noise));
+    for (uint32_t i = 0; i < objectCount; ++i) {
+        const auto bus = panner.addObjectBus(pullNoise, const_cast<std::vector<float> *>(&noise));
+        panner.setObjectPosition(bus, float(i * 37 % 360) - 180, float(i * 11 % 60));
+    }
+    std::vector<std::vector<float>> outputs(panner.getOutputChannelCount(), std::vector<float>(kBlockFrames));
+    std::vector<float*> pointers;
+    for (auto& output : outputs) {
+        pointers.push_back(output.data());
+    }
+
+    const auto inputChannels = 12 + objectCount;
+    const int blocks = test::quickMode() ? 20 : int(400000000 / (inputChannels * kBlockFrames * pointers.size()));
+    float angle = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int block = 0; block < blocks; ++block) {
+        if (moving) {
+            angle += 1.0f;
+            for (uint32_t i = 0; i < objectCount; ++i) {
+                panner.setObjectPosition(1 + i, std::fmod(angle + float(i * 37), 360.0f) - 180, float(i * 11 % 60));
+            }
+        }
+        panner.process(pointers.data(), uint32_t(pointers.size()), kBlockFrames);
+    }
+    const auto seconds = test::secondsSince(start);
+    const double channelFrames = double(inputChannels) * kBlockFrames * blocks;
+    printf("%-7s %7u %8s %14.1f %12.1f\n", layoutName(layout), objectCount, moving ? "moving" : "static",
+           channelFrames / seconds / 1e6, double(kBlockFrames) * blocks / seconds / 48000);
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+
+    checkVectorKernels();
+    checkLayouts();
+    checkPowerNormalization();
+    checkMatchingBed();
+    checkSmoothing();
+
+    std::vector<float> noise(kBlockFrames + 64);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> sample(-1, 1);
+    for (auto& value : noise) {
+        value = sample(random);
+    }
+
+    printf("%d-frame blocks, 7.1.4 bed plus objects, one core%s\n", kBlockFrames,
+#if VECTOR_KERNELS_AVX
+           VectorKernels::detail::hasAVX() ? ", AVX" : ", SSE"
+#else
+           ""
+#endif
+           );
+    printf("%-7s %7s %8s %14s %12s\n", "output", "objects", "motion", "Mch×frames/s", "×48k real time");
+    for (auto layout : {SpeakerLayout::Stereo, SpeakerLayout::Surround_5_1, SpeakerLayout::Atmos_7_1_4}) {
+        for (uint32_t objectCount : {0u, 16u, 64u}) {
+            benchmark(layout, objectCount, false, noise);
+            if (objectCount > 0) {
+                benchmark(layout, objectCount, true, noise);
+            }
+        }
+    }
+    return test::finish("SpatialPannerBenchmark");
+}
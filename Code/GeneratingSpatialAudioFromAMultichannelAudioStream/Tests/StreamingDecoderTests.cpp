@@ -0,0 +1,105 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Tests that drive the streaming decoder with a synthetic source.
+*/
+#include "StreamingDecoder.hpp"
+#include "SyntheticSource.h"
+#include "TestSupport.h"
+
+#include <thread>
+
+// The decoder plays the source in order, looping at its end, as long as the consumer doesn't outrun it.
+static void testPlaysInOrderAcrossLoops()
+{
+    constexpr uint32_t kChannels = 12;
+    constexpr size_t kLength = 30000;
+    constexpr size_t kBlock = 256;
+    StreamingDecoder decoder(std::make_unique<SyntheticSource>(kChannels, kLength), 8192, 1024);
+    decoder.start();
+
+    Planes planes(kChannels, kBlock);
+    size_t frame = 0;
+    bool matches = true;
+    while (frame < 3 * kLength) {
+        while (decoder.bufferedFrames() < kBlock) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        matches = matches && decoder.pull(planes.pointers.data(), kChannels, kBlock) == kBlock;
+        for (uint32_t c = 0; c < kChannels && matches; ++c) {
+            for (size_t i = 0; i < kBlock; ++i) {
+                if (planes.storage[c][i] != SyntheticSource::expected(c, (frame + i) % kLength)) {
+                    printf("frame %zu channel %u: %g\n", frame + i, c, planes.storage[c][i]);
+                    matches = false;
+                    break;
+                }
+            }
+        }
+        frame += kBlock;
+    }
+    CHECK(matches);
+    CHECK(decoder.underrunCount() == 0);
+}
+
+// Memory stays at the ring, whatever the source's length, and the first cycle has audio right away.
+static void testBoundedMemoryAndFastStart()
+{
+    constexpr uint32_t kChannels = 12;
+    // An hour at 48 kHz, which the source generates as it goes.
+    constexpr size_t kLength = size_t(48000) * 3600;
+    const size_t bufferFrames = 2 * 48000;
+    StreamingDecoder decoder(std::make_unique<SyntheticSource>(kChannels, kLength), bufferFrames, 4096);
+
+    const auto start = std::chrono::steady_clock::now();
+    decoder.start();
+    const auto startSeconds = test::secondsSince(start);
+    CHECK(startSeconds < 0.05);
+    CHECK(decoder.bufferedFrames() >= 4096);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(decoder.bufferedFrames() <= 131072);
+    CHECK(decoder.bufferedFrames() >= bufferFrames);
+}
+
+// A source slower than real time runs the ring dry; the decoder pads with silence and counts each underrun.
+static void testCountsUnderruns()
+{
+    constexpr uint32_t kChannels = 2;
+    constexpr size_t kBlock = 512;
+    StreamingDecoder decoder(std::make_unique<SyntheticSource>(kChannels, 1000000, std::chrono::milliseconds(20)), 2048, 256);
+    decoder.start();
+
+    Planes planes(kChannels, kBlock);
+    // The primed chunk comes first, then silence.
+    CHECK(decoder.pull(planes.pointers.data(), kChannels, kBlock) == 256);
+    CHECK(decoder.underrunCount() == 1);
+    CHECK(planes.storage[1][0] == SyntheticSource::expected(1, 0));
+    CHECK(planes.storage[0][kBlock - 1] == 0.0f);
+    decoder.stop();
+}
+
+// Pulling a channel count the source doesn't have plays silence instead of leaving the buffers as they were.
+static void testSilenceOnChannelMismatch()
+{
+    StreamingDecoder decoder(std::make_unique<SyntheticSource>(12, 10000), 4096, 1024);
+    decoder.start();
+
+    Planes planes(2, 128);
+    for (auto& plane : planes.storage) {
+        std::fill(plane.begin(), plane.end(), 1.0f);
+    }
+    CHECK(decoder.pull(planes.pointers.data(), 2, 128) == 0);
+    CHECK(std::all_of(planes.storage[0].begin(), planes.storage[0].end(), [](float x) { return x == 0.0f; }));
+    CHECK(std::all_of(planes.storage[1].begin(), planes.storage[1].end(), [](float x) { return x == 0.0f; }));
+}
+
+int main(int argc, char** argv)
+{
+    test::parseArguments(argc, argv);
+    testPlaysInOrderAcrossLoops();
+    testBoundedMemoryAndFastStart();
+    testCountsUnderruns();
+    testSilenceOnChannelMismatch();
+    return test::finish("StreamingDecoderTests");
+}
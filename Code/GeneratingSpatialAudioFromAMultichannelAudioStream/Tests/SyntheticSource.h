@@ -0,0 +1,68 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+A synthetic streaming source and deinterleaved buffers for the decoder and cache tests.
+*/
+#ifndef SyntheticSource_h
+#define SyntheticSource_h
+
+#include "StreamingDecoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Channel `c` of frame `f` holds f + c / 16, which a float holds exactly for the lengths here.
+class SyntheticSource : public StreamingSource
+{
+public:
+    SyntheticSource(uint32_t channelCount, size_t length, std::chrono::microseconds readDelay = {})
+    : mChannelCount(channelCount), mLength(length), mReadDelay(readDelay) {}
+
+    uint32_t channelCount() const override { return mChannelCount; }
+    double sampleRate() const override { return 48000; }
+
+    size_t read(float* const* channels, size_t frameCount) override
+    {
+        if (mReadDelay.count() > 0) {
+            std::this_thread::sleep_for(mReadDelay);
+        }
+        const auto frames = std::min(frameCount, mLength - mPosition);
+        for (uint32_t c = 0; c < mChannelCount; ++c) {
+            for (size_t i = 0; i < frames; ++i) {
+                channels[c][i] = expected(c, mPosition + i);
+            }
+        }
+        mPosition += frames;
+        return frames;
+    }
+
+    bool rewind() override
+    {
+        mPosition = 0;
+        return true;
+    }
+
+    static float expected(uint32_t channel, size_t frame) { return float(frame) + float(channel) / 16; }
+
+private:
+    uint32_t mChannelCount;
+    size_t mLength;
+    size_t mPosition{0};
+    std::chrono::microseconds mReadDelay;
+};
+
+struct Planes {
+    Planes(uint32_t channelCount, size_t frameCount) : storage(channelCount, std::vector<float>(frameCount))
+    {
+        for (auto& plane : storage) {
+            pointers.push_back(plane.data());
+        }
+    }
+    std::vector<std::vector<float>> storage;
+    std::vector<float*> pointers;
+};
+
+#endif /* SyntheticSource_h */
@@ -0,0 +1,77 @@
+/*
+See the LICENSE.txt file for this sample’s licensing information.
+
+Abstract:
+Minimal check macros and timing helpers for the portable core tests.
+*/
+#ifndef TestSupport_h
+#define TestSupport_h
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace test {
+
+inline int& failureCount()
+{
+    static int count = 0;
+    return count;
+}
+
+// Runs the benchmarks in a test for only a moment, as ctest does, unless the test runs with `--full`.
+inline bool& quickMode()
+{
+    static bool quick = true;
+    return quick;
+}
+
+inline void parseArguments(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--full") == 0) {
+            quickMode() = false;
+        }
+    }
+}
+
+inline int finish(const char* name)
+{
+    if (failureCount() == 0) {
+        printf("%s: all checks passed\n", name);
+        return EXIT_SUCCESS;
+    }
+    printf("%s: %d checks failed\n", name, failureCount());
+    return EXIT_FAILURE;
+}
+
+inline double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace test
+
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);          \
+            ++test::failureCount();                                                       \
+        }                                                                                 \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance)                                                       \
+    do {                                                                                  \
+        const double checkA = double(a), checkB = double(b);                              \
+        if (!(std::fabs(checkA - checkB) <= double(tolerance))) {                         \
+            printf("%s:%d: check failed: %s = %g, %s = %g, tolerance %g\n", __FILE__,     \
+                   __LINE__, #a, checkA, #b, checkB, double(tolerance));                  \
+            ++test::failureCount();                                                       \
+        }                                                                                 \
+    } while (0)
+
+#endif /* TestSupport_h */